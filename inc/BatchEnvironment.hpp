@@ -0,0 +1,200 @@
+#pragma once
+#include "Environment.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace robo {
+
+// Lockstep access to a group of robots of one Environment for learning
+// workloads: step() applies the actions of all robots, advances the
+// physics and writes the observations into flat float arrays owned by the
+// caller, robot after robot with the strides below. Nothing is allocated
+// per step. Several worlds are several Environments with one
+// BatchEnvironment each.
+//
+//     action  : vx, vy, omega (robot frame), pick, drop (> 0.5 triggers)
+//     sensors : distance sensor values, Robot::num_rays
+//     pose    : x, y, orientation, vx, vy, omega (world frame)
+//     guest   : carrying, target dx, dy, guest visible, closest dx, dy
+//               (offsets in the robot frame)
+//     reward  : score gained during the step
+//     alive   : 0 once the robot is gone
+//
+// The environment should not run its own sim loop meanwhile, step() is
+// the clock.
+class BatchEnvironment {
+public:
+	constexpr static std::size_t action_size = 5;
+	constexpr static std::size_t sensor_size = Robot::num_rays;
+	constexpr static std::size_t pose_size   = 6;
+	constexpr static std::size_t guest_size  = 6;
+
+	// caller owned outputs, size() * stride floats each, nullptr skips
+	struct Observations {
+		float* sensors = nullptr;
+		float* poses   = nullptr;
+		float* guests  = nullptr;
+		float* rewards = nullptr;
+		float* alive   = nullptr;
+	};
+
+private:
+	Environment&             environment;
+	std::vector<RobotId>     ids;
+	std::vector<std::size_t> hint;   // last index of the robot in robots
+	std::vector<int>         last_score;
+
+	// caller holds the mutex
+	auto robot(std::size_t i)
+		-> Robot*
+	{
+		Robots& robots = environment.robots;
+		Robot*  r      = hint[i] < robots.size() && robots[hint[i]].id == ids[i]
+			? &robots[hint[i]]
+			: robots.find(ids[i])
+		;
+		if(r) {
+			hint[i] = static_cast<std::size_t>(r - robots.data());
+		}
+		return r && !r->killed ? r : nullptr;
+	}
+
+	static auto clamp(float v, double max)
+		-> double
+	{
+		return std::isfinite(v) ? std::clamp(static_cast<double>(v), -max, max) : 0.0;
+	}
+
+	void apply(Robot& r, float const* a) {
+		r.reference = LocalVelocityReference{
+			  {clamp(a[0], config::Robot::velocity_max_x), clamp(a[1], config::Robot::velocity_max_y)}
+			, clamp(a[2], config::Robot::angular_velocity_max)
+		};
+		if(a[3] > 0.5f) {
+			environment.try_pick(r);
+		}
+		if(a[4] > 0.5f) {
+			environment.try_drop(r);
+		}
+	}
+
+	void observe(std::size_t i, Robot const* r, Observations const& out) {
+		float* sensors = out.sensors ? out.sensors + i * sensor_size : nullptr;
+		float* pose    = out.poses   ? out.poses   + i * pose_size   : nullptr;
+		float* guest   = out.guests  ? out.guests  + i * guest_size  : nullptr;
+		if(out.alive) {
+			out.alive[i] = r ? 1.0f : 0.0f;
+		}
+		if(!r) {
+			if(sensors) std::fill_n(sensors, sensor_size, 0.0f);
+			if(pose)    std::fill_n(pose,    pose_size,   0.0f);
+			if(guest)   std::fill_n(guest,   guest_size,  0.0f);
+			if(out.rewards) out.rewards[i] = 0.0f;
+			return;
+		}
+		auto const& k = r->kinematics;
+		if(sensors) {
+			std::copy(r->ray_distances.begin(), r->ray_distances.end(), sensors);
+		}
+		if(pose) {
+			pose[0] = k.position[0];
+			pose[1] = k.position[1];
+			pose[2] = k.orientation;
+			pose[3] = k.velocity[0];
+			pose[4] = k.velocity[1];
+			pose[5] = k.angular_velocity;
+		}
+		if(guest) {
+			auto local = [&](Vertex<double,2> const& p) {
+				return rotate(p - k.position, -k.orientation);
+			};
+			auto const& guests = environment.taxi_guests.guests;
+			std::fill_n(guest, guest_size, 0.0f);
+			if(r->taxi_guest) {
+				Vertex<double,2> d = local(guests[*r->taxi_guest].target_position);
+				guest[0] = 1.0f;
+				guest[1] = d[0];
+				guest[2] = d[1];
+			}
+			double const d2_max = config::TaxiGuest::max_visibility_distance * config::TaxiGuest::max_visibility_distance;
+			double best = d2_max;
+			for(auto const& g : guests) {
+				if(g.bound_to_robot || g.done) {
+					continue;
+				}
+				Vertex<double,2> d = g.position - k.position;
+				if(d*d < best) {
+					best = d*d;
+					Vertex<double,2> l = local(g.position);
+					guest[3] = 1.0f;
+					guest[4] = l[0];
+					guest[5] = l[1];
+				}
+			}
+		}
+		if(out.rewards) {
+			out.rewards[i] = static_cast<float>(r->score - last_score[i]);
+		}
+		last_score[i] = r->score;
+	}
+
+public:
+	// registers n robots named prefix0, prefix1, ...
+	BatchEnvironment(Environment& environment, std::size_t n, std::string const& prefix = "batch")
+		: environment{environment}
+	{
+		ids.reserve(n);
+		for(std::size_t i = 0; i < n; ++i) {
+			auto r = environment.handle(RegisterRobotCommand::Request{prefix + std::to_string(i)});
+			if(r.result) {
+				ids.push_back(r.result->registration);
+			}
+		}
+		hint.assign(ids.size(), 0);
+		last_score.assign(ids.size(), 0);
+	}
+	BatchEnvironment(BatchEnvironment const&) = delete;
+	BatchEnvironment& operator=(BatchEnvironment const&) = delete;
+	~BatchEnvironment() {
+		for(RobotId id : ids) {
+			environment.handle(DeregisterRobotCommand::Request{id});
+		}
+	}
+
+	std::size_t size() const {
+		return ids.size();
+	}
+	RobotId id(std::size_t i) const {
+		return ids[i];
+	}
+
+	// current observations without stepping, rewards since the last call
+	void observe(Observations const& out) {
+		std::lock_guard<Environment::mutex_t> lock{environment.mutex};
+		environment.refresh_rays_unlocked();
+		for(std::size_t i = 0; i < ids.size(); ++i) {
+			observe(i, robot(i), out);
+		}
+	}
+
+	// actions: size() * action_size floats, then ticks physics steps
+	void step(float const* actions, std::size_t ticks, Observations const& out) {
+		{
+			std::lock_guard<Environment::mutex_t> lock{environment.mutex};
+			for(std::size_t i = 0; i < ids.size(); ++i) {
+				if(Robot* r = robot(i)) {
+					apply(*r, actions + i * action_size);
+				}
+			}
+		}
+		for(std::size_t t = 0; t < ticks; ++t) {
+			environment.update(false);
+		}
+		observe(out);
+	}
+};
+
+} /** namespace robo */
@@ -0,0 +1,475 @@
+#pragma once
+#include "Environment.hpp"
+#include "EnvironmentCheckpoint.hpp"
+#include "config/Journal.hpp"
+#include "serializer/DefaultPodBackend.hpp"
+#include "serializer/PrefixSerializer.hpp"
+#include "serializer/SerializationBuffers.hpp"
+#include "socket/PosixError.hpp"
+#include "util/MappedFile.hpp"
+#include "util/SynchronizedQueue.hpp"
+#include "util/name_this_thread.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace robo {
+
+// Journal file: a JournalFileHeader, then records appended as they come,
+// each a JournalRecordHeader followed by size bytes of payload:
+//     COMMAND    : PrefixSerializer encoding of the CommandSet::Request,
+//                  tick and sequence as noted by Environment::note_command
+//     CHECKPOINT : CheckpointHeader and payload as in a checkpoint file,
+//                  sequence is the last request it contains
+// Commands may be stored slightly out of sequence, readers sort them. A
+// record cut short by a crash ends the journal.
+struct JournalFileHeader {
+	constexpr static uint32_t magic_value = 0x4c4a4252;   // "RBJL"
+	constexpr static uint32_t version     = 1;
+
+	uint32_t magic;
+	uint32_t file_version;
+	uint64_t reserved;
+};
+static_assert(std::is_trivially_copyable_v<JournalFileHeader>);
+static_assert(sizeof(JournalFileHeader) == 16);
+
+struct JournalRecordHeader {
+	enum Type : uint32_t {
+		  COMMAND    = 1
+		, CHECKPOINT = 2
+	};
+	uint32_t type;
+	uint32_t size;
+	uint64_t tick;
+	uint64_t sequence;
+};
+static_assert(std::is_trivially_copyable_v<JournalRecordHeader>);
+static_assert(sizeof(JournalRecordHeader) == 24);
+
+// Appends every request served by environment to path, plus a checkpoint
+// at start and every checkpoint_interval simulated seconds. Requests are
+// copied into a queue on the serving thread, encoding and write() happen
+// on the journal thread, which also takes the periodic snapshots. Past
+// config::Journal::max_queued records are dropped; drops and a failed
+// write show in environment.journal_stats, as gaps in a replay would.
+// Create it before the servers start, destroy it after they stopped.
+class CommandJournal {
+private:
+	using Serializer = PrefixSerializer<DefaultPodBackend>;
+	using Request    = Environment::CommandSet::Request;
+
+	// a request, a snapshot or neither: take a checkpoint now
+	struct Entry {
+		uint64_t                                     tick;
+		uint64_t                                     sequence;
+		std::optional<Request>                       request;
+		std::shared_ptr<Environment::Snapshot const> snapshot;
+	};
+
+	Environment&           environment;
+	int                    fd;
+	double                 checkpoint_interval;
+	double                 next_checkpoint;
+	SynchronizedQueue<Entry> entries;
+	Environment::JournalStats& stats;
+	std::atomic<uint64_t>  _checkpoints{0};
+	std::atomic<uint64_t>  _bytes{0};
+	std::thread            thread;
+
+	void push(Entry entry) {
+		if(stats.is_failed.load(std::memory_order_relaxed)) {
+			return;
+		}
+		if(!entries.try_push(std::move(entry), config::Journal::max_queued)) {
+			stats.dropped.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	void write_all(void const* data, std::size_t size) {
+		auto const* p = static_cast<char const*>(data);
+		while(size != 0) {
+			ssize_t n = ::write(fd, p, size);
+			if(n < 0 && errno == EINTR) {
+				continue;
+			}
+			if(n < 0) {
+				throw PosixError("CommandJournal::write", errno);
+			}
+			p    += n;
+			size -= static_cast<std::size_t>(n);
+		}
+	}
+
+	void run() {
+		name_this_thread("journal");
+		DynamicSerializationBuffer<> payload;
+		std::vector<std::byte>       record;
+		while(auto entry = entries.pop()) {
+			if(stats.is_failed) {
+				continue;
+			}
+			if(!entry->request && !entry->snapshot) {
+				entry->snapshot = environment.snapshot();
+				entry->tick     = entry->snapshot->physics_tick;
+				entry->sequence = entry->snapshot->command_sequence;
+			}
+			try {
+				JournalRecordHeader header{0, 0, entry->tick, entry->sequence};
+				CheckpointHeader    checkpoint_header;
+				if(entry->request) {
+					payload.reset();
+					if(!Serializer::serialize(payload, *entry->request)) {
+						throw std::runtime_error("CommandJournal: serialization failed");
+					}
+					header.type = JournalRecordHeader::COMMAND;
+					header.size = static_cast<uint32_t>(payload.count());
+				} else {
+					checkpoint_header = encode_checkpoint(EnvironmentCheckpoint::from(*entry->snapshot), payload);
+					header.type = JournalRecordHeader::CHECKPOINT;
+					header.size = static_cast<uint32_t>(sizeof(checkpoint_header) + payload.count());
+				}
+				// one write() per record, a crash cuts at most the last one
+				record.resize(sizeof(header) + header.size);
+				std::byte* p = record.data();
+				std::memcpy(p, &header, sizeof(header));
+				p += sizeof(header);
+				if(!entry->request) {
+					std::memcpy(p, &checkpoint_header, sizeof(checkpoint_header));
+					p += sizeof(checkpoint_header);
+				}
+				std::memcpy(p, payload.data(), payload.count());
+				write_all(record.data(), record.size());
+				_bytes += record.size();
+				++(entry->request ? stats.commands : _checkpoints);
+			} catch(std::exception const& e) {
+				std::cerr << "journal disabled: " << e.what() << '\n';
+				stats.is_failed = true;
+			}
+		}
+	}
+
+
+public:
+	CommandJournal(std::string const& path, Environment& environment, double checkpoint_interval)
+		: environment{environment}
+		, fd{::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644)}
+		, checkpoint_interval{checkpoint_interval}
+		, next_checkpoint{environment.get_time() + checkpoint_interval}
+		, stats{environment.journal_stats}
+	{
+		if(fd < 0) {
+			throw PosixError("CommandJournal::open " + path, errno);
+		}
+		JournalFileHeader header{JournalFileHeader::magic_value, JournalFileHeader::version, 0};
+		try {
+			write_all(&header, sizeof(header));
+		} catch(...) {
+			::close(fd);
+			throw;
+		}
+		_bytes += sizeof(header);
+		stats.is_enabled = true;
+		push(Entry{});
+		thread = std::thread{[this]{ run(); }};
+		environment.journal_sink = [this](Request const& request, uint64_t tick, uint64_t sequence) {
+			push(Entry{tick, sequence, request, nullptr});
+		};
+	}
+	CommandJournal(CommandJournal const&) = delete;
+	CommandJournal& operator=(CommandJournal const&) = delete;
+	// writes what is queued, then closes the file
+	~CommandJournal() {
+		environment.journal_sink = nullptr;
+		entries.stop();
+		thread.join();
+		::fsync(fd);
+		::close(fd);
+	}
+
+	// called by the sim loop after every physics step, the snapshot is
+	// taken by the journal thread
+	void checkpoint_if_due() {
+		if(environment.get_time() >= next_checkpoint) {
+			push(Entry{});
+			next_checkpoint += checkpoint_interval;
+		}
+	}
+
+	uint64_t commands() const {
+		return stats.commands;
+	}
+	uint64_t dropped() const {
+		return stats.dropped;
+	}
+	bool is_failed() const {
+		return stats.is_failed;
+	}
+	uint64_t checkpoints() const {
+		return _checkpoints;
+	}
+	uint64_t bytes() const {
+		return _bytes;
+	}
+};
+
+// Mapped journal, records indexed by kind: commands by sequence,
+// checkpoints by tick.
+class JournalReader {
+public:
+	struct Record {
+		JournalRecordHeader        header;
+		std::span<std::byte const> payload;
+	};
+
+private:
+	MappedFile          file;
+	std::vector<Record> _commands;
+	std::vector<Record> _checkpoints;
+	bool                _is_truncated = false;
+
+public:
+	explicit JournalReader(std::string const& path)
+		: file{path}
+	{
+		auto bytes = file.bytes();
+		JournalFileHeader file_header;
+		if(bytes.size() < sizeof(file_header)) {
+			throw std::runtime_error(path + ": not a journal");
+		}
+		std::memcpy(&file_header, bytes.data(), sizeof(file_header));
+		if(file_header.magic != JournalFileHeader::magic_value) {
+			throw std::runtime_error(path + ": not a journal");
+		}
+		if(file_header.file_version != JournalFileHeader::version) {
+			throw std::runtime_error(
+				  path + ": journal version " + std::to_string(file_header.file_version)
+				+ ", expected " + std::to_string(JournalFileHeader::version)
+			);
+		}
+		std::size_t offset = sizeof(file_header);
+		while(offset < bytes.size()) {
+			Record r;
+			if(bytes.size() - offset < sizeof(r.header)) {
+				_is_truncated = true;
+				break;
+			}
+			std::memcpy(&r.header, bytes.data() + offset, sizeof(r.header));
+			offset += sizeof(r.header);
+			if(bytes.size() - offset < r.header.size) {
+				_is_truncated = true;
+				break;
+			}
+			r.payload = bytes.subspan(offset, r.header.size);
+			offset += r.header.size;
+			if(r.header.type == JournalRecordHeader::COMMAND) {
+				if(r.header.sequence != 0) {
+					_commands.push_back(r);
+				}
+			} else if(r.header.type == JournalRecordHeader::CHECKPOINT) {
+				_checkpoints.push_back(r);
+			}
+		}
+		auto by_sequence = [](Record const& a, Record const& b) {
+			return a.header.sequence < b.header.sequence;
+		};
+		std::stable_sort(_commands.begin(), _commands.end(), by_sequence);
+		std::stable_sort(_checkpoints.begin(), _checkpoints.end(), by_sequence);
+		if(_checkpoints.empty()) {
+			throw std::runtime_error(path + ": journal without checkpoint");
+		}
+	}
+
+	std::vector<Record> const& commands() const {
+		return _commands;
+	}
+	std::vector<Record> const& checkpoints() const {
+		return _checkpoints;
+	}
+	bool is_truncated() const {
+		return _is_truncated;
+	}
+	// last tick the journal knows of
+	uint64_t last_tick() const {
+		uint64_t tick = _checkpoints.back().header.tick;
+		if(!_commands.empty()) {
+			tick = std::max(tick, _commands.back().header.tick);
+		}
+		return tick;
+	}
+};
+
+// Feeds a journal back into an environment in lock step: the requests of
+// a tick in their original order, then one physics step, no sockets and no
+// sleeps. The environment must have the time steps of the recorded run and
+// no sim loop, servers or plugins of its own. Read-only queries are
+// skipped, QueryVisionCommand only restarts the vision timer of its robot.
+// Runs mixing in unjournaled changes (GUI edits, plugin robots) do not
+// replay exactly.
+class JournalReplay {
+public:
+	struct Stats {
+		uint64_t commands    = 0;
+		uint64_t ticks       = 0;
+		uint64_t verified    = 0;   // checkpoints compared
+		uint64_t mismatches  = 0;   // checkpoints that differed
+	};
+
+private:
+	using Serializer = PrefixSerializer<DefaultPodBackend>;
+	using Request    = Environment::CommandSet::Request;
+	using Record     = JournalReader::Record;
+
+	JournalReader reader;
+	std::size_t   cursor = 0;   // next command
+
+	void apply(Environment& environment, Record const& record) {
+		std::span<std::byte const> payload = record.payload;
+		detail::FixedDeserializationBufferBase<0, std::span<std::byte const>, std::size_t> buffer{payload};
+		buffer.reset(payload.size());
+		Request request;
+		if(!Serializer::deserialize(buffer, request)) {
+			throw std::runtime_error("journal: corrupt command " + std::to_string(record.header.sequence));
+		}
+		{
+			std::lock_guard<Environment::mutex_t> lock{environment.mutex};
+			environment.command_sequence = record.header.sequence - 1;
+		}
+		std::visit(
+			[&](auto const& r) {
+				using T = std::decay_t<decltype(r)>;
+				if constexpr(std::is_same_v<T, QueryVisionCommand::Request>) {
+					std::lock_guard<Environment::mutex_t> lock{environment.mutex};
+					environment.note_command();
+					if(Robot* robot = environment.robots.find(r.id)) {
+						robot->time_since_last_vision = 0.0;
+					}
+				} else if constexpr(
+					   std::is_same_v<T, QuerySegmentTraversableCommand::Request>
+					|| std::is_same_v<T, SimulateAheadCommand::Request>
+				) {
+					std::lock_guard<Environment::mutex_t> lock{environment.mutex};
+					environment.note_command();
+				} else {
+					environment.handle(r);
+				}
+			}
+			, request.request
+		);
+	}
+
+	// applies the commands up to max_sequence and steps until tick
+	void advance(Environment& environment, uint64_t tick, uint64_t max_sequence, Stats& stats) {
+		auto const& commands = reader.commands();
+		for(;;) {
+			uint64_t now = environment.get_physics_tick();
+			while(
+				   cursor < commands.size()
+				&& commands[cursor].header.tick     <= now
+				&& commands[cursor].header.sequence <= max_sequence
+			) {
+				apply(environment, commands[cursor++]);
+				++stats.commands;
+			}
+			if(now >= tick) {
+				break;
+			}
+			environment.update(false);
+			++stats.ticks;
+		}
+	}
+
+	auto checkpoint_before(uint64_t tick) const
+		-> Record const&
+	{
+		auto const& checkpoints = reader.checkpoints();
+		Record const* best = &checkpoints.front();
+		for(Record const& c : checkpoints) {
+			if(c.header.tick <= tick) {
+				best = &c;
+			}
+		}
+		return *best;
+	}
+
+	static bool matches(Environment& environment, Record const& checkpoint) {
+		std::shared_ptr<Environment::Snapshot const> snapshot;
+		{
+			std::lock_guard<Environment::mutex_t> lock{environment.mutex};
+			environment.snapshot_cache.reset();
+			snapshot = environment.snapshot_unlocked();
+		}
+		DynamicSerializationBuffer<> payload;
+		CheckpointHeader header = encode_checkpoint(EnvironmentCheckpoint::from(*snapshot), payload);
+		auto recorded = checkpoint.payload;
+		return recorded.size() == sizeof(header) + payload.count()
+			&& std::memcmp(recorded.data(), &header, sizeof(header)) == 0
+			&& std::memcmp(recorded.data() + sizeof(header), payload.data(), payload.count()) == 0
+		;
+	}
+
+public:
+	explicit JournalReplay(std::string const& path)
+		: reader{path}
+	{}
+
+	JournalReader const& journal() const {
+		return reader;
+	}
+
+	// Restores the last checkpoint at or before tick and replays from
+	// there to the end of tick, i.e. including its requests.
+	auto seek(Environment& environment, uint64_t tick)
+		-> Stats
+	{
+		Record const& checkpoint = checkpoint_before(tick);
+		restore(environment, decode_checkpoint(checkpoint.payload, "journal checkpoint"));
+		{
+			std::lock_guard<Environment::mutex_t> lock{environment.mutex};
+			environment.command_sequence = checkpoint.header.sequence;
+		}
+		auto const& commands = reader.commands();
+		cursor = static_cast<std::size_t>(std::upper_bound(
+			  commands.begin()
+			, commands.end()
+			, checkpoint.header.sequence
+			, [](uint64_t sequence, Record const& r) { return sequence < r.header.sequence; }
+		) - commands.begin());
+		Stats stats;
+		advance(environment, tick, std::numeric_limits<uint64_t>::max(), stats);
+		return stats;
+	}
+
+	// Replays from the first checkpoint to the end of tick. With verify the
+	// world is compared with every later checkpoint on the way, bit by bit.
+	auto run(Environment& environment, uint64_t tick, bool verify)
+		-> Stats
+	{
+		Stats stats = seek(environment, 0);
+		auto const& checkpoints = reader.checkpoints();
+		for(std::size_t i = 1; verify && i < checkpoints.size() && checkpoints[i].header.tick <= tick; ++i) {
+			advance(environment, checkpoints[i].header.tick, checkpoints[i].header.sequence, stats);
+			++stats.verified;
+			if(!matches(environment, checkpoints[i])) {
+				++stats.mismatches;
+				std::cerr << "replay: world differs from checkpoint at tick " << checkpoints[i].header.tick << '\n';
+			}
+		}
+		advance(environment, tick, std::numeric_limits<uint64_t>::max(), stats);
+		return stats;
+	}
+};
+
+} /** namespace robo */
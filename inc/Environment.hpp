@@ -3,21 +3,33 @@
 #include "environment/Obstacles.hpp"
 #include "environment/Robots.hpp"
 #include "client_server/make_command_set.hpp"
+#include "client_server/ServerStats.hpp"
 #include "environment_models/RobotMovementModelAcceleration.hpp"
 #include "environment_models/RobotStateIntegration.hpp"
 #include "robo_commands.hpp"
+#include "TickMonitor.hpp"
 #include "config/TaxiGuest.hpp"
+#include "config/Trajectory.hpp"
+#include "config/Rollout.hpp"
+#include "util/TracedMutex.hpp"
+#include "util/TripleBuffer.hpp"
+#include "util/WorkerPool.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <chrono>
+#include <cmath>
+#include <functional>
 #include <iostream>
 #include <limits>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <optional>
 #include <random>
 #include <thread>
+#include <utility>
 
 #define VCHECK(v)                    \
 	do {                             \
@@ -35,31 +47,102 @@ struct Environment {
 	using robot_state_integration = RobotStateIntegration<kinematic_model>;
 	using DebugLines              = std::vector<DebugLine>;
 
-	struct GuiData {
+	// The world as drawn by the GUI, see publish_render_snapshot_unlocked().
+	// The versions tell what the copies of the rarely changing parts are of.
+	struct RenderSnapshot {
 		Robots                  robots;
-		DebugLines              debug_lines;
 		ObstacleSet::exchange_t obstacles;
-		int                     speed_scale;
-		bool                    is_paused;
 		TaxiGuests              taxi_guests;
+		int                     speed_scale = 0;
+		bool                    is_paused   = false;
+		uint64_t                physics_tick        = 0;
+		uint64_t                obstacles_version   = 0;
+		uint64_t                debug_lines_version = 0;
+		uint64_t                roster_version      = 0;
+	};
+	// with the debug lines of the robots the GUI shows them of
+	struct GuiData : RenderSnapshot {
+		DebugLines debug_lines;
+	};
+
+	// Copy of everything the physics step touches, see snapshot(). The
+	// obstacles are shared by all snapshots taken while they don't change,
+	// their robot cylinders are those of the first one; physics_step()
+	// rebuilds them anyway. Robots come without their debug lines.
+	struct Snapshot {
+		Robots                           robots;
+		std::shared_ptr<Obstacles const> obstacles;
+		TaxiGuests                       taxi_guests;
+		std::mt19937 gen;
+		double       time;
+		double       delta_t;   // scaled simulation step
+		double       delta_t_simulation;
+		double       delta_t_vision;
+		int          speed_scale;
+		uint64_t     vision_tick;
+		uint64_t     physics_tick;
+		double       time_since_vision_tick;
+		RobotId      current_id;
+		uint32_t     current_trajectory_id;
+		uint64_t     command_sequence;
 	};
 
+	// Called with every request served after it was handled, tick and
+	// sequence as noted by the handler, see CommandJournal. sequence is 0
+	// for requests rejected before touching the world.
+	using JournalSink = std::function<void(CommandSet::Request const&, uint64_t tick, uint64_t sequence)>;
+
 	double                     delta_t_simulation;
 	double                     delta_t_vision;
 	int                        speed_scale;
 	double                     time = 0.0;
-	std::mutex                 mutex;
+	uint64_t                   vision_tick = 0;
+	uint64_t                   physics_tick = 0;
+	double                     time_since_vision_tick = 0.0;
+	using mutex_t = TracedMutex;
+	mutex_t                    mutex{"environment"};
 	bool                       is_running = true;
 	bool                       is_paused  = false;
 	RobotId                    current_id;
+	uint32_t                   current_trajectory_id = 0;
 	Robots                     robots;
-	std::vector<RobotView>     robot_views_buffer;
-	std::vector<double>        distance_sensor_values_buffer;
-	std::vector<Vision::Guest> visible_guests_buffer;
 	std::mt19937               gen{};
 	Obstacles                  obstacles;
 	TaxiGuests                 taxi_guests;
 	bool                       auto_kill_dead_robots = false;
+	std::shared_ptr<Snapshot const> snapshot_cache;
+	uint64_t                   snapshot_tick = 0;
+	std::unique_ptr<WorkerPool> rollout_pool;
+
+	// World counts for QueryServerStatsCommand, written by update(). The
+	// timing of the sim loop is in tick_monitor.
+	struct LoopStats {
+		std::atomic<uint32_t> robots{0};
+		std::atomic<uint32_t> guests{0};
+		std::atomic<uint32_t> obstacles{0};
+	};
+	LoopStats                  loop_stats;
+	// Written by an attached CommandJournal, for QueryServerStatsCommand.
+	struct JournalStats {
+		std::atomic<bool>     is_enabled{false};
+		std::atomic<bool>     is_failed{false};   // a write failed, nothing was journaled since
+		std::atomic<uint64_t> commands{0};
+		std::atomic<uint64_t> dropped{0};         // records lost to a full queue
+	};
+	JournalStats               journal_stats;
+	TickMonitor                tick_monitor;
+	bool                       rays_stale = false;   // some robot has rays_stale
+	// published by update() while a view is open, see RenderSnapshot
+	TripleBuffer<RenderSnapshot> render_snapshots;
+	std::atomic<bool>          is_rendered{false};
+	uint64_t                   debug_lines_version = 0;   // changes with any robot's lines
+	uint64_t                   roster_version      = 0;   // changes when robots come or go, ids are reused
+	uint64_t                   command_sequence = 0;
+	JournalSink                journal_sink;   // set before serving
+
+	// tick and order of the last request handled by this thread
+	inline static thread_local uint64_t handled_tick     = 0;
+	inline static thread_local uint64_t handled_sequence = 0;
 
 	Environment(double delta_t_vision, double delta_t_simulation, int speed_scale)
 		: delta_t_simulation{delta_t_simulation}
@@ -74,165 +157,249 @@ struct Environment {
 	}
 
 	void move_obstacle(std::size_t id, Vertex<double, 2> new_position) {
-		std::lock_guard<std::mutex> lock{mutex};
+		std::lock_guard<mutex_t> lock{mutex};
 		obstacles.move(id, new_position);
 		taxi_guests.validate(gen, obstacles);
 	}
 	auto closest_obstacle(Vertex<double, 3> const& position)
 		-> std::optional<std::size_t>
 	{
-		std::lock_guard<std::mutex> lock{mutex};
+		std::lock_guard<mutex_t> lock{mutex};
 		return obstacles.closest(position);
 	}
 	void clear_obstacles() {
-		std::lock_guard<std::mutex> lock{mutex};
+		std::lock_guard<mutex_t> lock{mutex};
 		obstacles.clear();
 	}
 	void clear_guests() {
-		std::lock_guard<std::mutex> lock{mutex};
+		std::lock_guard<mutex_t> lock{mutex};
 		for(auto& robot : robots) {
 			robot.taxi_guest = {};
 		}
 		taxi_guests.clear();
 	}
 	void populate_guests(std::size_t N) {
-		std::lock_guard<std::mutex> lock{mutex};
+		std::lock_guard<mutex_t> lock{mutex};
 		for(std::size_t i = 0; i < N; ++i) {
 			taxi_guests.guests.push_back(taxi_guests.create_random_state(gen, obstacles));
 		}
 	}
 	void populate_obstacles(std::size_t N) {
-		std::lock_guard<std::mutex> lock{mutex};
+		std::lock_guard<mutex_t> lock{mutex};
+		refresh_rays_unlocked();
 		obstacles.add_random_N(gen, N);
 		taxi_guests.validate(gen, obstacles);
 	}
 	auto create_random_obstacle(ObstacleSet::class_id_t class_id)
 		-> bool
 	{
-		std::lock_guard<std::mutex> lock{mutex};
+		std::lock_guard<mutex_t> lock{mutex};
+		refresh_rays_unlocked();
 		bool r = obstacles.add_random(gen, class_id);
 		taxi_guests.validate(gen, obstacles);
 		return r;
 	}
 
 	void move_robot(robo::RobotId const& id, Vertex<double, 2> new_position) {
-		std::lock_guard<std::mutex> lock{mutex};
-		Robot*                      robot = robots.find(id);
+		std::lock_guard<mutex_t> lock{mutex};
+		Robot*                   robot = robots.find(id);
 		if(robot) {
 			robot->kinematics.position = new_position;
 		}
 	}
 
-	template<typename debug_line_selector>
-		requires std::is_invocable_r_v<bool, debug_line_selector, RobotId>
-	auto get_gui_data(debug_line_selector selector)
-		-> GuiData
-	{
-		std::lock_guard<std::mutex> lock{mutex};
-		auto convert_debug_lines = [&]() {
-			DebugLines result;
-			result.reserve(robots.size());
-			for(auto const& robot : robots) {
-				if(selector(robot.id)) {
-					auto const& src = robot.debug_lines;
-					result.insert(result.end(), src.begin(), src.end());
-				}
+	// Copies the world into the free render snapshot buffer and hands it
+	// to the GUI. The buffers keep their storage, so in place assignment
+	// doesn't allocate once they have grown; obstacles and debug lines are
+	// only copied after they changed. Lines are shed under load, but not
+	// after robots came or went: the buffer's would belong to others. The
+	// caller holds the mutex.
+	void publish_render_snapshot_unlocked() {
+		RenderSnapshot& s          = render_snapshots.back();
+		bool            with_lines = s.roster_version != roster_version || (
+			   s.debug_lines_version != debug_lines_version
+			&& !tick_monitor.shed_debug_lines()
+		);
+		s.robots.resize(robots.size());
+		for(std::size_t i = 0; i < robots.size(); ++i) {
+			Robot&       dst = s.robots[i];
+			Robot const& src = robots[i];
+			if(with_lines) {
+				dst.debug_lines = src.debug_lines;
 			}
-			return result;
-		};
-		return {
-			robots, convert_debug_lines(), obstacles.fix.obstacles, speed_scale, is_paused, taxi_guests
-		};
+			dst.id                     = src.id;
+			dst.name                   = src.name;
+			dst.kinematics             = src.kinematics;
+			dst.reference              = src.reference;
+			dst.is_paused              = src.is_paused;
+			dst.time_since_last_vision = src.time_since_last_vision;
+			dst.ray_distances          = src.ray_distances;
+			dst.taxi_guest             = src.taxi_guest;
+			dst.score                  = src.score;
+			dst.killed                 = src.killed;
+		}
+		if(with_lines) {
+			s.debug_lines_version = debug_lines_version;
+			s.roster_version      = roster_version;
+		}
+		if(s.obstacles_version != obstacles.fix.version) {
+			s.obstacles         = obstacles.fix.obstacles;
+			s.obstacles_version = obstacles.fix.version;
+		}
+		s.taxi_guests.guests = taxi_guests.guests;
+		s.taxi_guests.time   = taxi_guests.time;
+		s.speed_scale        = speed_scale;
+		s.is_paused          = is_paused;
+		s.physics_tick       = physics_tick;
+		render_snapshots.publish();
+	}
+	void publish_render_snapshot() {
+		std::lock_guard<mutex_t> lock{mutex};
+		publish_render_snapshot_unlocked();
+	}
+	// GUI: the latest world published, false if there is none since the last call
+	bool take_render_snapshot(RenderSnapshot& snapshot) {
+		return render_snapshots.take(snapshot);
 	}
 
 	auto closest_robot(Vertex<double, 3> const& position)
 		-> std::optional<std::pair<double, robo::RobotId>>
 	{
-		std::lock_guard<std::mutex> lock(mutex);
+		std::lock_guard<mutex_t> lock(mutex);
 		return robots.closest(position);
 	}
 
 	void reset() {
-		std::lock_guard<std::mutex> lock{mutex};
+		std::lock_guard<mutex_t> lock{mutex};
 		current_id = RobotId{};
 		robots.clear();
+		rays_stale = false;
+		++roster_version;
+	}
+
+	// Snapshot of the whole world, once per vision tick: empty, if there was
+	// no new tick since last_tick. Used by the multicast broadcaster.
+	auto world_state(uint64_t& last_tick)
+		-> std::optional<WorldState>
+	{
+		std::lock_guard<mutex_t> lock{mutex};
+		if(vision_tick == last_tick) {
+			return {};
+		}
+		last_tick = vision_tick;
+		WorldState result{vision_tick, time, {}, {}, {}};
+		result.robots.reserve(robots.size());
+		for(auto const& r : robots) {
+			result.robots.push_back(r.view());
+		}
+		result.guests.reserve(taxi_guests.guests.size());
+		for(auto const& g : taxi_guests.guests) {
+			if(!g.done) {
+				result.guests.push_back({g.position, g.target_position, g.score_on_arrival, g.bound_to_robot});
+			}
+		}
+		ObstacleSet const& fix = obstacles.fix;
+		result.obstacles.reserve(fix.obstacles.size());
+		for(auto const& [class_id, T] : fix.obstacles) {
+			result.obstacles.push_back({
+				  class_id->raw.bounding_box_size
+				, T.position()
+				, T.rotation().yaw()
+				, fix.is_cylinder_class(class_id)
+			});
+		}
+		return result;
 	}
 
 	void kill() {
-		std::lock_guard<std::mutex> lock{mutex};
+		std::lock_guard<mutex_t> lock{mutex};
 		is_running = false;
 	}
 
 	void toggle_pause() {
-		std::lock_guard<std::mutex> lock{mutex};
+		std::lock_guard<mutex_t> lock{mutex};
 		is_paused = !is_paused;
 	}
 	void set_pause(bool is_paused) {
-		std::lock_guard<std::mutex> lock{mutex};
+		std::lock_guard<mutex_t> lock{mutex};
 		this->is_paused = is_paused;
 	}
+	auto get_time()
+		-> double
+	{
+		std::lock_guard<mutex_t> lock{mutex};
+		return time;
+	}
+	auto get_physics_tick()
+		-> uint64_t
+	{
+		std::lock_guard<mutex_t> lock{mutex};
+		return physics_tick;
+	}
 	auto get_fps_vision()
 		-> double
 	{
-		std::lock_guard<std::mutex> lock{mutex};
+		std::lock_guard<mutex_t> lock{mutex};
 		return 1.0 / delta_t_vision;
 	}
 	auto get_fps_simulation()
 		-> double
 	{
-		std::lock_guard<std::mutex> lock{mutex};
+		std::lock_guard<mutex_t> lock{mutex};
 		return 1.0 / delta_t_simulation;
 	}
 	void set_fps_vision(double fps) {
-		std::lock_guard<std::mutex> lock{mutex};
+		std::lock_guard<mutex_t> lock{mutex};
 		delta_t_vision = 1.0 / fps;
 	}
 	void set_fps_simulation(double fps) {
-		std::lock_guard<std::mutex> lock{mutex};
+		std::lock_guard<mutex_t> lock{mutex};
 		delta_t_simulation = 1.0 / fps;
 	}
 	
 	void erase_dead_robots() {
-		robots.erase(
-			std::remove_if(
-				  robots.begin()
-				, robots.end()
-				, [&](Robot const& robot) {
-					return robot.killed;
-				}
-			)
+		refresh_rays_unlocked();
+		auto dead = std::remove_if(
+			  robots.begin()
 			, robots.end()
+			, [&](Robot const& robot) {
+				return robot.killed;
+			}
 		);
+		if(dead != robots.end()) {
+			robots.erase(dead, robots.end());
+			++roster_version;
+		}
 	}
 	void set_autokill_dead_robots(bool is_autokill_dead_robots) {
-		std::lock_guard<std::mutex> lock{mutex};
+		std::lock_guard<mutex_t> lock{mutex};
 		this->auto_kill_dead_robots = is_autokill_dead_robots;
 		if(this->auto_kill_dead_robots) {
 			erase_dead_robots();
 		}
 	}
 	bool get_autokill_dead_robots() {
-		std::lock_guard<std::mutex> lock{mutex};
+		std::lock_guard<mutex_t> lock{mutex};
 		return auto_kill_dead_robots;
 	}
 	void set_speed_scale(int speed_scale) {
-		std::lock_guard<std::mutex> lock{mutex};
+		std::lock_guard<mutex_t> lock{mutex};
 		this->speed_scale = std::clamp(speed_scale, -4, 8);
 	}
 	void add_speed_scale(int delta) {
-		std::lock_guard<std::mutex> lock{mutex};
+		std::lock_guard<mutex_t> lock{mutex};
 		speed_scale = std::clamp(speed_scale + delta, -4, 8);
 	}
 	void set_robot_pause(robo::RobotId const& id, bool is_pause) {
-		std::lock_guard<std::mutex> lock{mutex};
-		Robot*                      robot = robots.find(id);
+		std::lock_guard<mutex_t> lock{mutex};
+		Robot*                   robot = robots.find(id);
 		if(robot) {
 			robot->is_paused = is_pause;
 		}
 	}
 	void toggle_robot_pause(robo::RobotId const& id) {
-		std::lock_guard<std::mutex> lock{mutex};
-		Robot*                      robot = robots.find(id);
+		std::lock_guard<mutex_t> lock{mutex};
+		Robot*                   robot = robots.find(id);
 		if(robot) {
 			robot->is_paused = !robot->is_paused;
 		}
@@ -243,9 +410,69 @@ struct Environment {
 	}
 
 	void update(bool override_pause) {
-		std::lock_guard<std::mutex> lock{mutex};
+		std::lock_guard<mutex_t> lock{mutex};
 		double dt = scaled_delta_t(delta_t_simulation);
 		time += dt;
+		time_since_vision_tick += dt;
+		double vision_dt = scaled_delta_t(delta_t_vision);
+		if(time_since_vision_tick >= vision_dt) {
+			++vision_tick;
+			time_since_vision_tick = std::fmod(time_since_vision_tick, vision_dt);
+		}
+		++physics_tick;
+		rays_stale = tick_monitor.defer_rays();
+		physics_step(robots, obstacles, taxi_guests, gen, dt, is_paused, !rays_stale, [](std::size_t) {});
+		uint32_t guests = 0;
+		for(auto const& g : taxi_guests.guests) {
+			guests += !g.done;
+		}
+		loop_stats.robots.store(static_cast<uint32_t>(robots.size()), std::memory_order_relaxed);
+		loop_stats.guests.store(guests, std::memory_order_relaxed);
+		loop_stats.obstacles.store(static_cast<uint32_t>(obstacles.fix.obstacles.size()), std::memory_order_relaxed);
+		// at most one copy per GUI frame: the next once the GUI took this one
+		if(
+			   is_rendered.load(std::memory_order_relaxed)
+			&& render_snapshots.is_taken()
+			&& !tick_monitor.skip_gui_snapshot()
+		) {
+			publish_render_snapshot_unlocked();
+		}
+	}
+
+	// Casts the distance sensors the last physics step deferred, as it
+	// would have: they only depend on the poses the step started from,
+	// which stay until the next one. Anything changing the robots or
+	// obstacles in between refreshes first. The caller holds the mutex.
+	void refresh_rays_unlocked(Robot& robot) {
+		if(robot.rays_stale) {
+			obstacles.update_robot_rays(robot, static_cast<std::size_t>(&robot - robots.data()));
+			robot.rays_stale = false;
+		}
+	}
+	void refresh_rays_unlocked() {
+		if(rays_stale) {
+			for(auto& robot : robots) {
+				refresh_rays_unlocked(robot);
+			}
+			rays_stale = false;
+		}
+	}
+
+	// One step of the world made of these parts, shared by update() and the
+	// rollouts on snapshots. on_collision(i) is called for every robot that
+	// had to be pushed out of an obstacle or another robot. Without
+	// update_rays the robots are left with rays_stale.
+	template<typename F>
+	static void physics_step(
+		  Robots&       robots
+		, Obstacles&    obstacles
+		, TaxiGuests&   taxi_guests
+		, std::mt19937& gen
+		, double        dt
+		, bool          is_paused
+		, bool          update_rays
+		, F&&           on_collision
+	) {
 		obstacles.update(robots);
 		taxi_guests.update(dt, robots);
 		for(std::size_t i = 0, last = robots.size(); i != last; ++i) {
@@ -253,24 +480,159 @@ struct Environment {
 			Robot::Kinematics old_kin = robot.kinematics;
 			if(!is_paused && !robot.is_paused) {
 				robot_state_integration::step(robot, dt);
-				obstacles.fix_robot_position(gen, robot, i, old_kin);
+				if(obstacles.fix_robot_position(gen, robot, i, old_kin)) {
+					on_collision(i);
+				}
+			}
+			if(update_rays) {
+				obstacles.update_robot_rays(robot, i);
 			}
-			obstacles.update_robot_rays(robot, i);
+			robot.rays_stale = !update_rays;
 			robot.time_since_last_vision += dt;
 		}
 	}
 
+	// The world as of the last physics step, taken at most once per step and
+	// shared by everyone asking meanwhile. The caller holds the mutex.
+	auto snapshot_unlocked()
+		-> std::shared_ptr<Snapshot const>
+	{
+		if(!snapshot_cache || snapshot_tick != physics_tick) {
+			refresh_rays_unlocked();
+			std::shared_ptr<Obstacles const> shared_obstacles;
+			if(snapshot_cache && snapshot_cache->obstacles->fix.version == obstacles.fix.version) {
+				shared_obstacles = snapshot_cache->obstacles;
+			} else {
+				shared_obstacles = std::make_shared<Obstacles const>(obstacles);
+			}
+			// the debug lines step aside while the robots are copied
+			std::vector<DebugLines> lines(robots.size());
+			for(std::size_t i = 0; i < robots.size(); ++i) {
+				lines[i].swap(robots[i].debug_lines);
+			}
+			Robots robots_copy = robots;
+			for(std::size_t i = 0; i < robots.size(); ++i) {
+				lines[i].swap(robots[i].debug_lines);
+			}
+			auto s = std::make_shared<Snapshot>(Snapshot{
+				  std::move(robots_copy)
+				, std::move(shared_obstacles)
+				, taxi_guests
+				, gen
+				, time
+				, scaled_delta_t(delta_t_simulation)
+				, delta_t_simulation
+				, delta_t_vision
+				, speed_scale
+				, vision_tick
+				, physics_tick
+				, time_since_vision_tick
+				, current_id
+				, current_trajectory_id
+				, command_sequence
+			});
+			snapshot_cache = std::move(s);
+			snapshot_tick  = physics_tick;
+		}
+		return snapshot_cache;
+	}
+	auto snapshot()
+		-> std::shared_ptr<Snapshot const>
+	{
+		std::lock_guard<mutex_t> lock{mutex};
+		return snapshot_unlocked();
+	}
+
+	// Plays one candidate command sequence of robot id on a private copy of
+	// snapshot: every segment is a local velocity reference held for its
+	// duration, the last one until the end. The other robots keep their
+	// references.
+	static auto rollout(
+		  Snapshot const& snapshot
+		, RobotId         id
+		, Rollout const&  candidate
+		, double          duration
+		, double          sample_interval
+	)
+		-> RolloutResult
+	{
+		Robots       robots      = snapshot.robots;
+		Obstacles    obstacles   = *snapshot.obstacles;
+		TaxiGuests   taxi_guests = snapshot.taxi_guests;
+		std::mt19937 gen         = snapshot.gen;
+		double       dt          = snapshot.delta_t;
+		std::size_t  index       = *robots.index(id);
+
+		RolloutResult result;
+		result.trajectory.reserve(static_cast<std::size_t>(duration / sample_interval) + 2);
+		auto sample = [&](double t) {
+			auto const& k = robots[index].kinematics;
+			result.trajectory.push_back({t, k.position, k.velocity, k.orientation, k.angular_velocity});
+		};
+		auto apply = [&](RolloutSegment const& segment) {
+			robots[index].reference = LocalVelocityReference{segment.velocity, segment.angular_velocity};
+		};
+
+		std::size_t segment     = 0;
+		double      segment_end = candidate.segments[0].duration;
+		double      next_sample = sample_interval;
+		bool        in_contact  = false;
+		apply(candidate.segments[0]);
+		sample(0.0);
+		for(double t = 0.0; t + 0.5 * dt < duration;) {
+			while(segment + 1 < candidate.segments.size() && t + 0.5 * dt >= segment_end) {
+				++segment;
+				segment_end += candidate.segments[segment].duration;
+				apply(candidate.segments[segment]);
+			}
+			bool collided = false;
+			physics_step(robots, obstacles, taxi_guests, gen, dt, false, false, [&](std::size_t i) {
+				collided = collided || i == index;
+			});
+			t += dt;
+			if(collided && !in_contact) {
+				result.collisions.push_back({t, robots[index].kinematics.position});
+			}
+			in_contact = collided;
+			if(t + 0.5 * dt >= next_sample || t + 0.5 * dt >= duration) {
+				sample(t);
+				while(next_sample <= t + 0.5 * dt) {
+					next_sample += sample_interval;
+				}
+			}
+		}
+		return result;
+	}
+
+	// Orders the request being handled among all others, the caller holds
+	// the mutex. Replaying the requests in this order between the same
+	// physics steps reproduces the run.
+	void note_command() {
+		handled_tick     = physics_tick;
+		handled_sequence = ++command_sequence;
+	}
+
+	// called by the servers after handle(request), see has_journal
+	void journal(CommandSet::Request const& request) {
+		uint64_t sequence = std::exchange(handled_sequence, 0);
+		if(journal_sink) {
+			journal_sink(request, sequence != 0 ? handled_tick : 0, sequence);
+		}
+	}
+
 	auto handle(RegisterRobotCommand::Request const& request)
 		-> RegisterRobotCommand::Response
 	{
 		using Response = RegisterRobotCommand::Response;
-		std::lock_guard<std::mutex> lock{mutex};
+		std::lock_guard<mutex_t> lock{mutex};
+		note_command();
 		if(is_running) {
 			if(robots.empty()) {
 				current_id       = RobotId{};
 			}
 			current_id                            = current_id.next();
 			robots.emplace_back();
+			++roster_version;
 			Robot& robot    = robots.back();
 			robot.id        = current_id;
 			robot.name      = request.name;
@@ -320,8 +682,9 @@ struct Environment {
 	{
 		using Response = DeregisterRobotCommand::Response;
 		using Result   = Response::Result;
-		std::lock_guard<std::mutex> lock{mutex};
-		Robot*                      robot = robots.find(request.id);
+		std::lock_guard<mutex_t> lock{mutex};
+		Robot*                   robot = robots.find(request.id);
+		note_command();
 		if(!robot) {
 			return {Result::UNKNOWN_ROBOT};
 		}
@@ -338,8 +701,9 @@ struct Environment {
 	{
 		using Response = LocalVelocityCommand::Response;
 		using Result   = Response::Result;
-		std::lock_guard<std::mutex> lock{mutex};
-		Robot*                      robot = robots.find(request.id);
+		std::lock_guard<mutex_t> lock{mutex};
+		Robot*                   robot = robots.find(request.id);
+		note_command();
 		if(!robot) {
 			return Response{Result::UNKNOWN_ROBOT};
 		}
@@ -363,8 +727,9 @@ struct Environment {
 	{
 		using Response = LocalVelocityFixedFrameCommand::Response;
 		using Result   = Response::Result;
-		std::lock_guard<std::mutex> lock{mutex};
-		Robot*                      robot = robots.find(request.id);
+		std::lock_guard<mutex_t> lock{mutex};
+		Robot*                   robot = robots.find(request.id);
+		note_command();
 		if(!robot) {
 			return Response{Result::UNKNOWN_ROBOT};
 		}
@@ -406,26 +771,145 @@ struct Environment {
 		return Result::TRAVERSABLE;
 	}
 
+	auto handle(FollowTrajectoryCommand::Request const& request)
+		-> FollowTrajectoryCommand::Response
+	{
+		using Response = FollowTrajectoryCommand::Response;
+		using Result   = Response::Result;
+		std::lock_guard<mutex_t> lock{mutex};
+		Robot*                   robot = robots.find(request.id);
+		note_command();
+		if(!robot) {
+			return Response{Result::UNKNOWN_ROBOT, 0};
+		}
+		auto is_finite = [](TrajectoryWaypoint const& w) {
+			return w.position.is_finite() && std::isfinite(w.orientation);
+		};
+		if(    request.waypoints.empty()
+			|| request.waypoints.size() > config::Trajectory::max_waypoints
+			|| !std::all_of(request.waypoints.begin(), request.waypoints.end(), is_finite)
+			|| !std::isfinite(request.velocity_max)
+			|| !std::isfinite(request.angular_velocity_max)
+			|| request.velocity_max         <= 0.0
+			|| request.angular_velocity_max <= 0.0
+		) {
+			return Response{Result::INVALID_TRAJECTORY, 0};
+		}
+		++current_trajectory_id;
+		robot->reference = TrajectoryReference{
+			  current_trajectory_id
+			, request.waypoints
+			, request.velocity_max
+			, request.angular_velocity_max
+		};
+		return Response{Result::SUCCESS, current_trajectory_id};
+	}
+
+	// Runs the rollouts on a snapshot, in parallel on the rollout workers,
+	// the live world goes on meanwhile.
+	auto handle(SimulateAheadCommand::Request const& request)
+		-> SimulateAheadCommand::Response
+	{
+		using Response = SimulateAheadCommand::Response;
+		using Result   = Response::Result;
+		double const v_max_x = 1.05 * config::Robot::velocity_max_x;
+		double const v_max_y = 1.05 * config::Robot::velocity_max_y;
+		double const w_max   = 1.05 * config::Robot::angular_velocity_max;
+		auto is_valid = [&](RolloutSegment const& s) {
+			return s.velocity.is_finite()
+				&& std::isfinite(s.angular_velocity)
+				&& std::isfinite(s.duration)
+				&& s.duration > 0.0
+				&& std::abs(s.velocity[0]      ) <= v_max_x
+				&& std::abs(s.velocity[1]      ) <= v_max_y
+				&& std::abs(s.angular_velocity) <= w_max
+			;
+		};
+		auto is_valid_rollout = [&](Rollout const& r) {
+			return !r.segments.empty()
+				&& r.segments.size() <= config::Rollout::max_segments
+				&& std::all_of(r.segments.begin(), r.segments.end(), is_valid)
+			;
+		};
+		if(    request.rollouts.empty()
+			|| request.rollouts.size() > config::Rollout::max_rollouts
+			|| !std::isfinite(request.duration)
+			|| !std::isfinite(request.sample_interval)
+			|| request.duration <= 0.0
+			|| request.duration > config::Rollout::max_duration
+			|| request.sample_interval < config::Rollout::min_sample_interval
+			|| !std::all_of(request.rollouts.begin(), request.rollouts.end(), is_valid_rollout)
+		) {
+			return Response{Result::INVALID_REQUEST, {}};
+		}
+		std::shared_ptr<Snapshot const> snapshot;
+		WorkerPool*                     pool;
+		{
+			std::lock_guard<mutex_t> lock{mutex};
+			Robot*                   robot = robots.find(request.id);
+			note_command();
+			if(!robot) {
+				return Response{Result::UNKNOWN_ROBOT, {}};
+			}
+			snapshot = snapshot_unlocked();
+			if(!snapshot->robots.index(request.id)) {
+				// registered after the cached snapshot was taken
+				snapshot_cache.reset();
+				snapshot = snapshot_unlocked();
+			}
+			if(!rollout_pool) {
+				rollout_pool = std::make_unique<WorkerPool>(config::Rollout::threads);
+			}
+			pool = rollout_pool.get();
+		}
+		Response response{Result::SUCCESS, std::vector<RolloutResult>(request.rollouts.size())};
+		pool->parallel_for(request.rollouts.size(), [&](std::size_t i) {
+			response.rollouts[i] = rollout(
+				  *snapshot
+				, request.id
+				, request.rollouts[i]
+				, request.duration
+				, request.sample_interval
+			);
+		});
+		return response;
+	}
+
 	auto handle(QuerySegmentTraversableCommand::Request const& request)
 		-> QuerySegmentTraversableCommand::Response
 	{
 		using Response = QuerySegmentTraversableCommand::Response;
 		using Result   = Response::Result;
-		std::lock_guard<std::mutex> lock{mutex};
-		auto                        robot = robots.find(request.id);
+		std::lock_guard<mutex_t> lock{mutex};
+		auto                     robot = robots.find(request.id);
+		note_command();
 		if(!robot) {
 			return Response{Result::UNKNOWN_ROBOT};
 		}
 		return Response{collides(*robot, request.start, request.end)};
 	}
 
+	// seconds until handle(request) answers without sleeping,
+	// event driven servers defer the call instead of blocking
+	auto ready_in(QueryVisionCommand::Request const& request)
+		-> double
+	{
+		std::lock_guard<mutex_t> lock{mutex};
+		Robot*                   robot = robots.find(request.id);
+		if(!robot) {
+			return 0.0;
+		}
+		double vision_dt = scaled_delta_t(delta_t_vision);
+		return std::max(0.0, vision_dt - robot->time_since_last_vision);
+	}
+
 	auto handle(QueryVisionCommand::Request const& request)
 		-> QueryVisionCommand::Response
 	{
 		using Response = QueryVisionCommand::Response;
 		using Result   = Response::Result;
-		std::unique_lock<std::mutex> lock{mutex};
-		Robot*                       robot = robots.find(request.id);
+		std::unique_lock<mutex_t> lock{mutex};
+		Robot*                    robot = robots.find(request.id);
 		if(!robot) {
 			return Response{Result::UNKNOWN_ROBOT};
 		}
@@ -437,8 +921,17 @@ struct Environment {
 			std::this_thread::sleep_for(std::chrono::duration<double>{time_to_wait});
 			lock.lock();
 		}
+		note_command();
 		time_since_last_vision = 0.0;
+		Vision vision;
+		fill_vision(*robot, vision);
+		return Response{Result::SUCCESS, std::move(vision)};
+	}
 
+	// What robot sees right now, written into vision to reuse its storage.
+	// The caller holds the mutex.
+	void fill_vision(Robot& robot, Vision& vision) {
+		refresh_rays_unlocked(robot);
 		auto guest = [&](std::size_t idx)
 			-> Vision::Guest
 		{
@@ -448,79 +941,67 @@ struct Environment {
 			};
 		};
 
-		auto generate_taxi_guest_views = [&]()
-			-> std::vector<Vision::Guest> const&
-		{
-			std::vector<std::size_t> visible_guests_idx = taxi_guests.guests_in_range(
-				robot->kinematics.position, config::TaxiGuest::max_visibility_distance
-			);
-			visible_guests_buffer.clear();
-			visible_guests_buffer.reserve(visible_guests_idx.size());
-			for(std::size_t idx : visible_guests_idx) {
-				visible_guests_buffer.push_back(guest(idx));
-			}
-			return visible_guests_buffer;
-		};
+		vision.available_guests.clear();
+		for(std::size_t idx : taxi_guests.guests_in_range(
+			robot.kinematics.position, config::TaxiGuest::max_visibility_distance
+		)) {
+			vision.available_guests.push_back(guest(idx));
+		}
 
-		auto generate_robot_views = [&]()
-			-> std::vector<RobotView> const&
-		{
-			robot_views_buffer.clear();
-			robot_views_buffer.reserve(robots.size());
-			for(auto const& r : robots) {
-				Vertex<double,2> d = robot->kinematics.position - r.kinematics.position;
-				double const d2_max = config::Robot::max_visibility_distance * config::Robot::max_visibility_distance;
-				if(d*d <= d2_max) {
-					robot_views_buffer.push_back(r.view());
-				}
+		double const d2_max = config::Robot::max_visibility_distance * config::Robot::max_visibility_distance;
+		vision.robots.clear();
+		for(auto const& r : robots) {
+			Vertex<double,2> d = robot.kinematics.position - r.kinematics.position;
+			if(d*d <= d2_max) {
+				vision.robots.push_back(r.view());
 			}
-			return robot_views_buffer;
-		};
-		auto generate_distance_sensor_values = [&]()
-			-> std::vector<double> const&
-		{
-			distance_sensor_values_buffer.clear();
-			distance_sensor_values_buffer.reserve(Robot::num_rays);
-			std::copy(
-				  robot->ray_distances.begin()
-				, robot->ray_distances.end()
-				, std::back_inserter(distance_sensor_values_buffer)
-			);
-			return distance_sensor_values_buffer;
-		};
+		}
 
-		return Response{
-			  Result::SUCCESS
-			, Vision{
-				  generate_robot_views()
-				, generate_taxi_guest_views()
-				, generate_distance_sensor_values()
-				, robot->taxi_guest ? guest(*robot->taxi_guest) : std::optional<Vision::Guest>{}
-			  }
-		};
+		vision.distance_sensor_values.assign(robot.ray_distances.begin(), robot.ray_distances.end());
+		vision.guest = robot.taxi_guest ? guest(*robot.taxi_guest) : std::optional<Vision::Guest>{};
+		vision.trajectory.reset();
+		if(auto const* t = std::get_if<TrajectoryReference>(&robot.reference)) {
+			vision.trajectory = t->progress();
+		}
 	}
 
-	auto handle(PickTaxiGuestCommand::Request const& request)
+	// Visions of several robots under one lock, without the rate limit of
+	// QueryVisionCommand. Used by in-process controllers. Returns false for
+	// robots that are gone.
+	void fill_visions(
+		  std::vector<RobotId> const& ids
+		, std::vector<Vision>&        visions
+		, std::vector<bool>&          found
+	) {
+		std::lock_guard<mutex_t> lock{mutex};
+		visions.resize(ids.size());
+		found.assign(ids.size(), false);
+		for(std::size_t i = 0; i < ids.size(); ++i) {
+			Robot*       robot = robots.find(ids[i]);
+			if(robot && !robot->killed) {
+				fill_vision(*robot, visions[i]);
+				found[i] = true;
+			}
+		}
+	}
+
+	// pick and drop rules, the caller holds the mutex
+	auto try_pick(Robot& robot)
 		-> PickTaxiGuestCommand::Response
 	{
 		using Response = PickTaxiGuestCommand::Response;
 		using Result   = Response::Result;
-		std::lock_guard<std::mutex> lock{mutex};
-		Robot*                      robot = robots.find(request.id);
-		if(!robot) {
-			return Response{Result::UNKNOWN_ROBOT};
-		}
-		auto const& v = robot->kinematics.velocity;
+		auto const& v = robot.kinematics.velocity;
 		if(v*v > config::TaxiGuest::max_pick_velocity*config::TaxiGuest::max_pick_velocity) {
 			return Response{
 				Result::TOO_FAST_TO_PICK
 			};
 		}
-		bool has_picked = taxi_guests.pick(*robot, config::TaxiGuest::max_pick_distance);
+		bool has_picked = taxi_guests.pick(robot, config::TaxiGuest::max_pick_distance);
 		std::optional<Vision::Guest> picked_guest;
 		Result r = Result::NO_GUEST_IN_RANGE;
 		if(has_picked) {
-			auto& g = taxi_guests.guests[*robot->taxi_guest];
+			auto& g = taxi_guests.guests[*robot.taxi_guest];
 			picked_guest = Vision::Guest{
 				g.position, g.target_position
 			};
@@ -528,43 +1009,149 @@ struct Environment {
 		}
 		return Response{r, picked_guest};
 	}
-
-	auto handle(DropTaxiGuestCommand::Request const& request)
+	auto try_drop(Robot& robot)
 		-> DropTaxiGuestCommand::Response
 	{
 		using Response = DropTaxiGuestCommand::Response;
 		using Result   = Response::Result;
-		std::lock_guard<std::mutex> lock{mutex};
-		Robot*                      robot = robots.find(request.id);
-		if(!robot) {
-			return Response{Result::UNKNOWN_ROBOT};
-		}
-		if(!robot->taxi_guest) {
+		if(!robot.taxi_guest) {
 			return Response{Result::NO_GUEST_TO_DROP, 0};
 		}
-		auto const& v = robot->kinematics.velocity;
+		auto const& v = robot.kinematics.velocity;
 		if(v*v > config::TaxiGuest::max_drop_velocity*config::TaxiGuest::max_drop_velocity) {
 			return Response{
 				Result::TOO_FAST_TO_DROP
 			};
 		}
-		int drop_score = taxi_guests.drop(gen, obstacles, *robot, config::TaxiGuest::max_drop_distance);
+		int drop_score = taxi_guests.drop(gen, obstacles, robot, config::TaxiGuest::max_drop_distance);
 		return Response{Result::SUCCESS, drop_score};
 	}
 
+	auto handle(PickTaxiGuestCommand::Request const& request)
+		-> PickTaxiGuestCommand::Response
+	{
+		using Response = PickTaxiGuestCommand::Response;
+		using Result   = Response::Result;
+		std::lock_guard<mutex_t> lock{mutex};
+		Robot*                   robot = robots.find(request.id);
+		note_command();
+		if(!robot) {
+			return Response{Result::UNKNOWN_ROBOT};
+		}
+		return try_pick(*robot);
+	}
+
+	auto handle(DropTaxiGuestCommand::Request const& request)
+		-> DropTaxiGuestCommand::Response
+	{
+		using Response = DropTaxiGuestCommand::Response;
+		using Result   = Response::Result;
+		std::lock_guard<mutex_t> lock{mutex};
+		Robot*                   robot = robots.find(request.id);
+		note_command();
+		if(!robot) {
+			return Response{Result::UNKNOWN_ROBOT};
+		}
+		return try_drop(*robot);
+	}
+
 	auto handle(SetDebugLinesCommand::Request const& request)
 		-> SetDebugLinesCommand::Response
 	{
 		using Response = SetDebugLinesCommand::Response;
 		using Result   = Response::Result;
-		std::lock_guard<std::mutex> lock{mutex};
-		Robot*                      robot = robots.find(request.id);
+		std::lock_guard<mutex_t> lock{mutex};
+		Robot*                   robot = robots.find(request.id);
+		note_command();
 		if(!robot) {
 			return Response{Result::UNKNOWN_ROBOT};
 		}
 		robot->debug_lines = request.lines;
+		++debug_lines_version;
 		return Response{Result::SUCCESS};
 	}
+
+	// Does not take the mutex and is not journaled. Every field comes from
+	// an atomic written concurrently by the servers and the sim loop (the
+	// ServerStats sample is taken under its own lock): loop_stats,
+	// journal_stats, the TracedMutex and TickMonitor counters and the
+	// TimeHistogram buckets. They are read relaxed, so a response may mix
+	// neighbouring ticks, but no field is torn.
+	auto handle(QueryServerStatsCommand::Request const& request)
+		-> QueryServerStatsCommand::Response
+	{
+		auto latency = [](std::string name, TimeSummary const& s) {
+			return LatencyStatistics{
+				  std::move(name)
+				, s.count
+				, s.total()
+				, s.mean()
+				, s.percentile(0.5)
+				, s.percentile(0.9)
+				, s.percentile(0.99)
+				, s.maximum()
+			};
+		};
+		auto histogram = [&](std::string name, TimeHistogram const& h) {
+			TimeSummary s;
+			s.merge(h);
+			return latency(std::move(name), s);
+		};
+		ServerStatsSample server = ServerStats::global().sample(request.with_connections);
+		QueryServerStatsCommand::Response response;
+		response.uptime               = server.uptime;
+		response.interval             = server.interval;
+		response.connections_accepted = server.accepted;
+		response.connections_open     = server.open;
+		response.requests             = server.requests;
+		response.bytes_in             = server.bytes_in;
+		response.bytes_out            = server.bytes_out;
+		response.requests_per_second  = server.requests_per_second;
+		response.bytes_in_per_second  = server.bytes_in_per_second;
+		response.bytes_out_per_second = server.bytes_out_per_second;
+		for(ConnectionSample& c : server.connections) {
+			response.connections.push_back({
+				  c.id
+				, std::move(c.endpoint)
+				, c.age
+				, c.requests
+				, c.bytes_in
+				, c.bytes_out
+				, c.requests_per_second
+				, c.bytes_in_per_second
+				, c.bytes_out_per_second
+			});
+		}
+		for(TimeSummary const& h : server.handlers) {
+			response.handlers.push_back(latency(h.name, h));
+		}
+		TracedMutex::Counters const& m = mutex.counters();
+		response.mutex_locks     = m.locks.load(std::memory_order_relaxed);
+		response.mutex_contended = m.contended.load(std::memory_order_relaxed);
+		response.mutex_wait      = histogram("environment.wait", m.waits);
+		TickMonitor::Counters const& t = tick_monitor.counters();
+		response.tick                  = histogram("tick", tick_monitor.work);
+		response.tick_overruns         = t.overruns.load(std::memory_order_relaxed);
+		response.robots                = loop_stats.robots.load(std::memory_order_relaxed);
+		response.guests                = loop_stats.guests.load(std::memory_order_relaxed);
+		response.obstacles             = loop_stats.obstacles.load(std::memory_order_relaxed);
+		response.tick_period           = histogram("tick.period", tick_monitor.periods);
+		response.tick_update           = histogram("tick.update", tick_monitor.updates);
+		response.tick_lateness         = histogram("tick.lateness", tick_monitor.lateness);
+		response.ticks                 = t.ticks.load(std::memory_order_relaxed);
+		response.ticks_missed          = t.missed.load(std::memory_order_relaxed);
+		response.overloaded            = tick_monitor.is_overloaded();
+		response.overloads             = t.overloads.load(std::memory_order_relaxed);
+		response.overloaded_ticks      = t.overloaded_ticks.load(std::memory_order_relaxed);
+		response.gui_snapshots_skipped = t.gui_snapshots_skipped.load(std::memory_order_relaxed);
+		response.rays_deferred         = t.rays_deferred.load(std::memory_order_relaxed);
+		response.debug_lines_shed      = t.debug_lines_shed.load(std::memory_order_relaxed);
+		response.journal_enabled       = journal_stats.is_enabled.load(std::memory_order_relaxed);
+		response.journal_failed        = journal_stats.is_failed.load(std::memory_order_relaxed);
+		response.journal_commands      = journal_stats.commands.load(std::memory_order_relaxed);
+		response.journal_dropped       = journal_stats.dropped.load(std::memory_order_relaxed);
+		return response;
+	}
 };
 
 }   // namespace robo
@@ -0,0 +1,348 @@
+#pragma once
+#include "Environment.hpp"
+#include "serializer/DefaultPodBackend.hpp"
+#include "serializer/PrefixSerializer.hpp"
+#include "serializer/SerializationBuffers.hpp"
+#include "socket/PosixError.hpp"
+#include "util/MappedFile.hpp"
+#include "util/SynchronizedQueue.hpp"
+#include "util/name_this_thread.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace robo {
+
+// Checkpoint file: a CheckpointHeader followed by the PrefixSerializer
+// encoding of an EnvironmentCheckpoint. The obstacle classes are stored by
+// their shape and looked up again on restore, everything else is stored as
+// is. Files of another version are refused.
+struct CheckpointHeader {
+	constexpr static uint32_t magic_value = 0x4b434252;   // "RBCK"
+
+	uint32_t magic;
+	uint32_t version;
+	uint64_t payload_size;
+	uint64_t physics_tick;
+	double   time;
+};
+static_assert(std::is_trivially_copyable_v<CheckpointHeader>);
+static_assert(sizeof(CheckpointHeader) == 32);
+
+struct ObstacleRecord {
+	bool              is_cylinder;
+	Vertex<double, 3> shape;   // box: size, cylinder: radius, height
+	Transform         transform;
+
+	template<typename Serializer, typename Buffer>
+	static auto serialize(Buffer& buffer, ObstacleRecord const& o)
+		-> bool
+	{
+		return Serializer::serialize(buffer, o.is_cylinder, o.shape, o.transform);
+	}
+	template<typename Serializer, typename Buffer>
+	static auto deserialize(Buffer& buffer, ObstacleRecord& o)
+		-> bool
+	{
+		return Serializer::deserialize(buffer, o.is_cylinder, o.shape, o.transform);
+	}
+};
+
+struct EnvironmentCheckpoint {
+	using Serializer = PrefixSerializer<DefaultPodBackend>;
+	constexpr static uint32_t version = 1;
+
+	double                              time                   = 0.0;
+	double                              delta_t_simulation     = 0.0;
+	double                              delta_t_vision         = 0.0;
+	int                                 speed_scale            = 0;
+	uint64_t                            vision_tick            = 0;
+	uint64_t                            physics_tick           = 0;
+	double                              time_since_vision_tick = 0.0;
+	RobotId                             current_id;
+	uint32_t                            current_trajectory_id  = 0;
+	std::string                         rng;   // std::mt19937 stream format
+	std::vector<Robot>                  robots;
+	std::vector<ObstacleRecord>         obstacles;
+	std::vector<TaxiGuests::GuestState> guests;
+	double                              guest_time             = 0.0;
+
+	template<typename S, typename Buffer>
+	static auto serialize(Buffer& buffer, EnvironmentCheckpoint const& c)
+		-> bool
+	{
+		return S::serialize(
+			  buffer
+			, c.time, c.delta_t_simulation, c.delta_t_vision, c.speed_scale
+			, c.vision_tick, c.physics_tick, c.time_since_vision_tick
+			, c.current_id, c.current_trajectory_id, c.rng
+			, c.robots, c.obstacles, c.guests, c.guest_time
+		);
+	}
+	template<typename S, typename Buffer>
+	static auto deserialize(Buffer& buffer, EnvironmentCheckpoint& c)
+		-> bool
+	{
+		return S::deserialize(
+			  buffer
+			, c.time, c.delta_t_simulation, c.delta_t_vision, c.speed_scale
+			, c.vision_tick, c.physics_tick, c.time_since_vision_tick
+			, c.current_id, c.current_trajectory_id, c.rng
+			, c.robots, c.obstacles, c.guests, c.guest_time
+		);
+	}
+
+	static auto from(Environment::Snapshot const& s)
+		-> EnvironmentCheckpoint
+	{
+		EnvironmentCheckpoint c;
+		c.time                   = s.time;
+		c.delta_t_simulation     = s.delta_t_simulation;
+		c.delta_t_vision         = s.delta_t_vision;
+		c.speed_scale            = s.speed_scale;
+		c.vision_tick            = s.vision_tick;
+		c.physics_tick           = s.physics_tick;
+		c.time_since_vision_tick = s.time_since_vision_tick;
+		c.current_id             = s.current_id;
+		c.current_trajectory_id  = s.current_trajectory_id;
+		std::ostringstream rng;
+		rng << s.gen;
+		c.rng = rng.str();
+		c.robots.assign(s.robots.begin(), s.robots.end());
+
+		ObstacleSet const& fix = s.obstacles->fix;
+		auto shape = [&](ObstacleSet::class_id_t class_id)
+			-> std::pair<bool, Vertex<double, 3>>
+		{
+			for(auto const& [key, id] : fix.know_cylinders) {
+				if(id == class_id) {
+					return {true, {key[0], key[1], 0.0}};
+				}
+			}
+			for(auto const& [key, id] : fix.know_boxes) {
+				if(id == class_id) {
+					return {false, key};
+				}
+			}
+			throw std::logic_error("checkpoint: obstacle of unknown class");
+		};
+		c.obstacles.reserve(fix.obstacles.size());
+		for(auto const& [class_id, T] : fix.obstacles) {
+			auto [is_cylinder, size] = shape(class_id);
+			c.obstacles.push_back({is_cylinder, size, T});
+		}
+		c.guests     = s.taxi_guests.guests;
+		c.guest_time = s.taxi_guests.time;
+		return c;
+	}
+};
+
+// Serializes checkpoint into payload, returns the header that goes in
+// front of it.
+inline auto encode_checkpoint(EnvironmentCheckpoint const& checkpoint, DynamicSerializationBuffer<>& payload)
+	-> CheckpointHeader
+{
+	payload.reset();
+	if(!EnvironmentCheckpoint::Serializer::serialize(payload, checkpoint)) {
+		throw std::runtime_error("checkpoint: serialization failed");
+	}
+	return CheckpointHeader{
+		  CheckpointHeader::magic_value
+		, EnvironmentCheckpoint::version
+		, payload.count()
+		, checkpoint.physics_tick
+		, checkpoint.time
+	};
+}
+
+// Header and payload as written by write_checkpoint, name is for the errors.
+// Deserializes straight out of bytes without copying them first; robots,
+// guests and obstacles are still rebuilt field by field, since their
+// strings, variants and vectors can't be mapped in place.
+inline auto decode_checkpoint(std::span<std::byte const> bytes, std::string const& name)
+	-> EnvironmentCheckpoint
+{
+	CheckpointHeader header;
+	if(bytes.size() < sizeof(header)) {
+		throw std::runtime_error(name + ": not a checkpoint");
+	}
+	std::memcpy(&header, bytes.data(), sizeof(header));
+	if(header.magic != CheckpointHeader::magic_value) {
+		throw std::runtime_error(name + ": not a checkpoint");
+	}
+	if(header.version != EnvironmentCheckpoint::version) {
+		throw std::runtime_error(
+			  name + ": checkpoint version " + std::to_string(header.version)
+			+ ", expected " + std::to_string(EnvironmentCheckpoint::version)
+		);
+	}
+	if(bytes.size() - sizeof(header) < header.payload_size) {
+		throw std::runtime_error(name + ": truncated checkpoint");
+	}
+	std::span<std::byte const> payload = bytes.subspan(sizeof(header), header.payload_size);
+	detail::FixedDeserializationBufferBase<0, std::span<std::byte const>, std::size_t> buffer{payload};
+	buffer.reset(payload.size());
+	EnvironmentCheckpoint checkpoint;
+	if(!EnvironmentCheckpoint::Serializer::deserialize(buffer, checkpoint)) {
+		throw std::runtime_error(name + ": corrupt checkpoint");
+	}
+	return checkpoint;
+}
+
+// Writes header and payload to path.tmp and renames it to path, so path
+// always holds a complete checkpoint. Returns the file size.
+inline auto write_checkpoint(std::string const& path, EnvironmentCheckpoint const& checkpoint)
+	-> std::size_t
+{
+	DynamicSerializationBuffer<> buffer;
+	CheckpointHeader header = encode_checkpoint(checkpoint, buffer);
+	std::string tmp = path + ".tmp";
+	int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if(fd < 0) {
+		throw PosixError("write_checkpoint::open " + tmp, errno);
+	}
+	auto write_all = [&](void const* data, std::size_t size) {
+		auto const* p = static_cast<char const*>(data);
+		while(size != 0) {
+			ssize_t n = ::write(fd, p, size);
+			if(n < 0 && errno == EINTR) {
+				continue;
+			}
+			if(n < 0) {
+				int e = errno;
+				::close(fd);
+				throw PosixError("write_checkpoint::write " + tmp, e);
+			}
+			p    += n;
+			size -= static_cast<std::size_t>(n);
+		}
+	};
+	write_all(&header, sizeof(header));
+	write_all(buffer.data(), buffer.count());
+	if(::fsync(fd) != 0) {
+		int e = errno;
+		::close(fd);
+		throw PosixError("write_checkpoint::fsync " + tmp, e);
+	}
+	::close(fd);
+	if(::rename(tmp.c_str(), path.c_str()) != 0) {
+		throw PosixError("write_checkpoint::rename " + path, errno);
+	}
+	return sizeof(header) + buffer.count();
+}
+
+inline auto read_checkpoint(std::string const& path)
+	-> EnvironmentCheckpoint
+{
+	MappedFile file(path);
+	return decode_checkpoint(file.bytes(), path);
+}
+
+// Replaces the whole state of environment, obstacle classes are looked up
+// by shape. Connected clients keep their ids if their robots were saved.
+inline void restore(Environment& environment, EnvironmentCheckpoint const& c) {
+	std::lock_guard<Environment::mutex_t> lock{environment.mutex};
+	environment.time                   = c.time;
+	environment.delta_t_simulation     = c.delta_t_simulation;
+	environment.delta_t_vision         = c.delta_t_vision;
+	environment.speed_scale            = c.speed_scale;
+	environment.vision_tick            = c.vision_tick;
+	environment.physics_tick           = c.physics_tick;
+	environment.time_since_vision_tick = c.time_since_vision_tick;
+	environment.current_id             = c.current_id;
+	environment.current_trajectory_id  = c.current_trajectory_id;
+	std::istringstream rng(c.rng);
+	rng >> environment.gen;
+	environment.robots.assign(c.robots.begin(), c.robots.end());
+
+	ObstacleSet& fix = environment.obstacles.fix;
+	fix.clear_obstacles();
+	for(ObstacleRecord const& o : c.obstacles) {
+		ObstacleSet::class_id_t class_id = o.is_cylinder
+			? fix.add_cylinder_class(o.shape[0], o.shape[1])
+			: fix.add_box_class(o.shape[0], o.shape[1], o.shape[2])
+		;
+		fix.add_obstacle(class_id, o.transform);
+	}
+	environment.taxi_guests.guests = c.guests;
+	environment.taxi_guests.time   = c.guest_time;
+	environment.obstacles.update(environment.robots);
+	environment.snapshot_cache.reset();
+	++environment.debug_lines_version;
+	++environment.roster_version;
+}
+
+// Serializes and writes snapshots on its own thread, the caller only pays
+// for Environment::snapshot(). At most one snapshot waits while another
+// is written: a newer one replaces it, as both are meant for the latest
+// state of the same file.
+class CheckpointWriter {
+private:
+	struct Job {
+		std::string                                  path;
+		std::shared_ptr<Environment::Snapshot const> snapshot;
+	};
+	SynchronizedQueue<Job> jobs;
+	std::atomic<uint64_t>  _written{0};
+	std::atomic<uint64_t>  _failed{0};
+	std::atomic<uint64_t>  _replaced{0};
+	std::thread            thread;
+
+	void run() {
+		name_this_thread("checkpoint");
+		while(auto job = jobs.pop()) {
+			try {
+				auto start = std::chrono::steady_clock::now();
+				std::size_t size = write_checkpoint(job->path, EnvironmentCheckpoint::from(*job->snapshot));
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				std::cerr
+					<< "checkpoint " << job->path
+					<< ": tick "     << job->snapshot->physics_tick
+					<< ", "          << size << " bytes in " << seconds * 1e3 << " ms\n"
+				;
+				++_written;
+			} catch(std::exception const& e) {
+				std::cerr << "checkpoint " << job->path << " failed: " << e.what() << '\n';
+				++_failed;
+			}
+		}
+	}
+
+public:
+	CheckpointWriter()
+		: thread{[this]{ run(); }}
+	{}
+	CheckpointWriter(CheckpointWriter const&) = delete;
+	CheckpointWriter& operator=(CheckpointWriter const&) = delete;
+	// writes what is queued, then stops
+	~CheckpointWriter() {
+		jobs.stop();
+		thread.join();
+	}
+
+	void write(std::string const& path, Environment& environment) {
+		_replaced += jobs.push_latest(Job{path, environment.snapshot()}, 1);
+	}
+	uint64_t written() const {
+		return _written;
+	}
+	uint64_t failed() const {
+		return _failed;
+	}
+	// snapshots dropped for a newer one before they were written
+	uint64_t replaced() const {
+		return _replaced;
+	}
+};
+
+} /** namespace robo */
@@ -44,24 +44,24 @@ struct EnvironmentView
 	{}
 
 	void render(bool show_camera_foot) {
-		time_this("render", [&]() {
-			time_this("render::copy_state", [&]() { this->update(robots_view.debug_lines_selector()); });
+		time_this<"render">([&]() {
+			time_this<"render::copy_state">([&]() { this->update(robots_view.debug_lines_selector()); });
 			this->window.draw([&]() {
-				time_this("render::setup_camera", [&]() {
+				time_this<"render::setup_camera">([&]() {
 					camera.setup(this->sim_state.robots);
 					camera.update_transform();
 				});
-				time_this("render::setup_light"                   , [&]() { this->setup_light();          });
-				time_this("render::show_plane"                    , [&]() { pitch_view.show();            });
-				time_this("render::show_coordinate_system"        , [&]() { coordinate_system_view.show();});
-				time_this("render::show_camera_base_position_view", [&]() { camera_base_position_view.show(show_camera_foot);});
-				time_this("render::show_taxi_guests"              , [&]() { taxi_guest_view.show();       });
-				time_this("render::show_robots"                   , [&]() { robots_view.show();           });
-				time_this("render::show_obstacles"                , [&]() { obstacles_view.show();        });
-				time_this("render::show_sky"                      , [&]() { sky_view.show();              });
-				time_this("render::show_robots_overlays"          , [&]() { robots_view.show_overlays();  });
+				time_this<"render::setup_light">                   ([&]() { this->setup_light();                              });
+				time_this<"render::show_plane">                    ([&]() { pitch_view.show();                                });
+				time_this<"render::show_coordinate_system">        ([&]() { coordinate_system_view.show();                    });
+				time_this<"render::show_camera_base_position_view">([&]() { camera_base_position_view.show(show_camera_foot); });
+				time_this<"render::show_taxi_guests">              ([&]() { taxi_guest_view.show();                           });
+				time_this<"render::show_robots">                   ([&]() { robots_view.show();                               });
+				time_this<"render::show_obstacles">                ([&]() { obstacles_view.show();                            });
+				time_this<"render::show_sky">                      ([&]() { sky_view.show();                                  });
+				time_this<"render::show_robots_overlays">          ([&]() { robots_view.show_overlays();                      });
 				if(gui) {
-					time_this("render::gui", [&]() { gui->show(); });
+					time_this<"render::gui">([&]() { gui->show(); });
 				}
 			});
 		});
@@ -2,6 +2,7 @@
 #include "math/Vertex.hpp"
 #include "math/r3/Triangle.hpp"
 #include "robo_commands.hpp"
+#include "environment_models/TrajectoryReference.hpp"
 #include "config/Body.hpp"
 
 namespace robo {
@@ -9,6 +10,7 @@ struct Robot {
 	using velocity_command_t = std::variant<
 		  LocalVelocityReference
 		, LocalVelocityFixedFrameReference
+		, TrajectoryReference
 	>;
 
 	constexpr static std::size_t                   num_rays = 16;
@@ -38,6 +40,19 @@ struct Robot {
 		double           angular_velocity;
 		Vertex<double,4> wheel_turn_angle;  // integral of wheel omegas
 
+		template<typename Serializer, typename Buffer>
+		static auto serialize(Buffer& buffer, Kinematics const& k)
+			-> bool
+		{
+			return Serializer::serialize(buffer, k.position, k.velocity, k.orientation, k.angular_velocity, k.wheel_turn_angle);
+		}
+		template<typename Serializer, typename Buffer>
+		static auto deserialize(Buffer& buffer, Kinematics& k)
+			-> bool
+		{
+			return Serializer::deserialize(buffer, k.position, k.velocity, k.orientation, k.angular_velocity, k.wheel_turn_angle);
+		}
+
 		template<typename OS>
 		friend
 		auto operator<<(OS& os, Kinematics const& kinematics)
@@ -63,6 +78,28 @@ struct Robot {
 	std::optional<std::size_t>   taxi_guest;
 	int                          score;
 	bool                         killed = false;
+	bool                         rays_stale = false;   // not cast this step yet, not serialized
+
+	template<typename Serializer, typename Buffer>
+	static auto serialize(Buffer& buffer, Robot const& r)
+		-> bool
+	{
+		return Serializer::serialize(
+			  buffer
+			, r.id, r.name, r.kinematics, r.reference, r.debug_lines, r.is_paused
+			, r.time_since_last_vision, r.ray_distances, r.taxi_guest, r.score, r.killed
+		);
+	}
+	template<typename Serializer, typename Buffer>
+	static auto deserialize(Buffer& buffer, Robot& r)
+		-> bool
+	{
+		return Serializer::deserialize(
+			  buffer
+			, r.id, r.name, r.kinematics, r.reference, r.debug_lines, r.is_paused
+			, r.time_since_last_vision, r.ray_distances, r.taxi_guest, r.score, r.killed
+		);
+	}
 
 	template<typename OS>
 	friend
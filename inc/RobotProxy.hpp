@@ -45,6 +45,7 @@ struct RobotProxy {
 	RobotProxy(RobotProxy const&) = delete;
 	RobotProxy& operator=(RobotProxy const&) = delete;
 
+	// host: hostname, or a url selecting another transport, see Endpoint
 	RobotProxy(std::string const& host, int port, std::string const& name)
 		: client{host, port}
 		, registration_response{
@@ -80,6 +81,40 @@ struct RobotProxy {
 			std::exit(1);
 		}
 	}
+	// returns the trajectory id reported in Vision::trajectory
+	auto follow_trajectory(
+		  std::vector<TrajectoryWaypoint> const& waypoints
+		, double                                 velocity_max
+		, double                                 angular_velocity_max
+	)
+		-> uint32_t
+	{
+		FollowTrajectoryCommand::Request request{id(), waypoints, velocity_max, angular_velocity_max};
+		auto response = client.fatal_call<FollowTrajectoryCommand>(request);
+		if(response.result != FollowTrajectoryCommand::Response::Result::SUCCESS) {
+			std::cerr << request << '\n';
+			std::cerr << response << '\n';
+			std::exit(1);
+		}
+		return response.trajectory_id;
+	}
+	// predicted motion for each candidate command sequence, see SimulateAheadCommand
+	auto simulate_ahead(
+		  std::vector<Rollout> const& rollouts
+		, double                      duration
+		, double                      sample_interval
+	)
+		-> std::vector<RolloutResult>
+	{
+		SimulateAheadCommand::Request request{id(), rollouts, duration, sample_interval};
+		auto response = client.fatal_call<SimulateAheadCommand>(request);
+		if(response.result != SimulateAheadCommand::Response::Result::SUCCESS) {
+			std::cerr << request << '\n';
+			std::cerr << response << '\n';
+			std::exit(1);
+		}
+		return std::move(response.rollouts);
+	}
 	void set_debug_lines(std::vector<DebugLine> const& debug_lines) {
 		auto response = client.fatal_call<SetDebugLinesCommand>(
 			SetDebugLinesCommand::Request{id(), debug_lines}
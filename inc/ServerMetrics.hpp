@@ -0,0 +1,127 @@
+#pragma once
+#include "robo_commands.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+namespace robo {
+
+// QueryServerStatsCommand::Response in the Prometheus text exposition
+// format. Only totals are exported, rates are left to the scraper.
+inline std::string prometheus_metrics(QueryServerStatsCommand::Response const& s) {
+	std::string out;
+	auto line = [&](char const* format, auto... values) {
+		char buffer[512];
+		int  n = std::snprintf(buffer, sizeof(buffer), format, values...);
+		out.append(buffer, static_cast<std::size_t>(n < 0 ? 0 : std::min<int>(n, sizeof(buffer) - 1)));
+	};
+	auto header = [&](char const* name, char const* type, char const* help) {
+		line("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+	};
+	// label values are endpoints and command names, escape anyway
+	auto label = [](std::string const& value) {
+		std::string result;
+		for(char c : value) {
+			if(c == '\\' || c == '"') {
+				result += '\\';
+			}
+			result += c == '\n' ? ' ' : c;
+		}
+		return result;
+	};
+	auto summary = [&](char const* name, std::string const& labels, LatencyStatistics const& l) {
+		std::string prefix = labels.empty() ? "" : labels + ",";
+		line("%s{%squantile=\"0.5\"} %.9g\n",  name, prefix.c_str(), l.p50);
+		line("%s{%squantile=\"0.9\"} %.9g\n",  name, prefix.c_str(), l.p90);
+		line("%s{%squantile=\"0.99\"} %.9g\n", name, prefix.c_str(), l.p99);
+		std::string braced = labels.empty() ? "" : "{" + labels + "}";
+		line("%s_sum%s %.9g\n",  name, braced.c_str(), l.total);
+		line("%s_count%s %llu\n", name, braced.c_str(), static_cast<unsigned long long>(l.count));
+	};
+	using ull = unsigned long long;
+
+	header("robo_uptime_seconds", "gauge", "Seconds since the server statistics started.");
+	line("robo_uptime_seconds %.3f\n", s.uptime);
+	header("robo_connections_accepted_total", "counter", "Connections accepted.");
+	line("robo_connections_accepted_total %llu\n", static_cast<ull>(s.connections_accepted));
+	header("robo_connections_open", "gauge", "Connections open.");
+	line("robo_connections_open %llu\n", static_cast<ull>(s.connections_open));
+	header("robo_requests_total", "counter", "Requests received on all connections.");
+	line("robo_requests_total %llu\n", static_cast<ull>(s.requests));
+	header("robo_received_bytes_total", "counter", "Bytes received on all connections.");
+	line("robo_received_bytes_total %llu\n", static_cast<ull>(s.bytes_in));
+	header("robo_sent_bytes_total", "counter", "Bytes sent on all connections.");
+	line("robo_sent_bytes_total %llu\n", static_cast<ull>(s.bytes_out));
+
+	if(!s.connections.empty()) {
+		header("robo_connection_requests_total", "counter", "Requests received per open connection.");
+		for(auto const& c : s.connections) {
+			line("robo_connection_requests_total{connection=\"%llu\",endpoint=\"%s\"} %llu\n", static_cast<ull>(c.id), label(c.endpoint).c_str(), static_cast<ull>(c.requests));
+		}
+		header("robo_connection_received_bytes_total", "counter", "Bytes received per open connection.");
+		for(auto const& c : s.connections) {
+			line("robo_connection_received_bytes_total{connection=\"%llu\",endpoint=\"%s\"} %llu\n", static_cast<ull>(c.id), label(c.endpoint).c_str(), static_cast<ull>(c.bytes_in));
+		}
+		header("robo_connection_sent_bytes_total", "counter", "Bytes sent per open connection.");
+		for(auto const& c : s.connections) {
+			line("robo_connection_sent_bytes_total{connection=\"%llu\",endpoint=\"%s\"} %llu\n", static_cast<ull>(c.id), label(c.endpoint).c_str(), static_cast<ull>(c.bytes_out));
+		}
+	}
+
+	if(!s.handlers.empty()) {
+		header("robo_handler_seconds", "summary", "Time to handle a request, per command.");
+		for(auto const& h : s.handlers) {
+			summary("robo_handler_seconds", "command=\"" + label(h.name) + "\"", h);
+		}
+	}
+
+	header("robo_environment_mutex_locks_total", "counter", "Locks of the environment mutex.");
+	line("robo_environment_mutex_locks_total %llu\n", static_cast<ull>(s.mutex_locks));
+	header("robo_environment_mutex_contended_total", "counter", "Locks of the environment mutex that had to wait.");
+	line("robo_environment_mutex_contended_total %llu\n", static_cast<ull>(s.mutex_contended));
+	header("robo_environment_mutex_wait_seconds", "summary", "Wait of the contended environment mutex locks.");
+	summary("robo_environment_mutex_wait_seconds", "", s.mutex_wait);
+
+	header("robo_tick_seconds", "summary", "Duration of a simulation loop iteration.");
+	summary("robo_tick_seconds", "", s.tick);
+	header("robo_tick_overruns_total", "counter", "Simulation loop iterations longer than their period.");
+	line("robo_tick_overruns_total %llu\n", static_cast<ull>(s.tick_overruns));
+	header("robo_tick_period_seconds", "summary", "Time from the start of one simulation tick to the next.");
+	summary("robo_tick_period_seconds", "", s.tick_period);
+	header("robo_tick_update_seconds", "summary", "Duration of the physics step of a simulation tick.");
+	summary("robo_tick_update_seconds", "", s.tick_update);
+	header("robo_tick_lateness_seconds", "summary", "Start of a simulation tick after it was due.");
+	summary("robo_tick_lateness_seconds", "", s.tick_lateness);
+	header("robo_ticks_total", "counter", "Simulation ticks.");
+	line("robo_ticks_total %llu\n", static_cast<ull>(s.ticks));
+	header("robo_ticks_missed_total", "counter", "Simulation ticks dropped after falling behind.");
+	line("robo_ticks_missed_total %llu\n", static_cast<ull>(s.ticks_missed));
+	header("robo_overloaded", "gauge", "Whether the simulation loop sheds load.");
+	line("robo_overloaded %d\n", s.overloaded ? 1 : 0);
+	header("robo_overloads_total", "counter", "Times the simulation loop started shedding load.");
+	line("robo_overloads_total %llu\n", static_cast<ull>(s.overloads));
+	header("robo_overloaded_ticks_total", "counter", "Simulation ticks while shedding load.");
+	line("robo_overloaded_ticks_total %llu\n", static_cast<ull>(s.overloaded_ticks));
+	header("robo_shed_total", "counter", "Work left out while overloaded, per load.");
+	line("robo_shed_total{load=\"gui_snapshot\"} %llu\n", static_cast<ull>(s.gui_snapshots_skipped));
+	line("robo_shed_total{load=\"rays\"} %llu\n", static_cast<ull>(s.rays_deferred));
+	line("robo_shed_total{load=\"debug_lines\"} %llu\n", static_cast<ull>(s.debug_lines_shed));
+	if(s.journal_enabled) {
+		header("robo_journal_failed", "gauge", "Whether a write failed and the journal stopped.");
+		line("robo_journal_failed %d\n", s.journal_failed ? 1 : 0);
+		header("robo_journal_commands_total", "counter", "Requests written to the journal.");
+		line("robo_journal_commands_total %llu\n", static_cast<ull>(s.journal_commands));
+		header("robo_journal_dropped_total", "counter", "Journal records dropped on a full queue.");
+		line("robo_journal_dropped_total %llu\n", static_cast<ull>(s.journal_dropped));
+	}
+
+	header("robo_robots", "gauge", "Robots registered.");
+	line("robo_robots %u\n", static_cast<unsigned>(s.robots));
+	header("robo_guests", "gauge", "Taxi guests waiting or on board.");
+	line("robo_guests %u\n", static_cast<unsigned>(s.guests));
+	header("robo_obstacles", "gauge", "Static obstacles.");
+	line("robo_obstacles %u\n", static_cast<unsigned>(s.obstacles));
+	return out;
+}
+
+} /** namespace robo */
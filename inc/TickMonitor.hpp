@@ -0,0 +1,189 @@
+#pragma once
+#include "config/Overload.hpp"
+#include "util/time_this.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace robo {
+
+// Tick budget of the sim loop. Ticks are due on a fixed grid of periods,
+// begin() and end() bracket the work of one; the monitor records the
+// actual period, the update duration, the whole work and how late each
+// tick started, and returns when the next one is due. A tick more than a
+// whole period behind its slot is counted as missed and the grid restarts
+// from now: simulated time then runs slower than wall time, which is what
+// the missed count tells.
+//
+// While the loop can't keep its rate, the monitor is overloaded and the
+// loads of its policy are shed, until it has kept up for a while again.
+// The histograms are written by the sim loop only, the rest is readable
+// from anywhere.
+class TickMonitor {
+public:
+	using clock_t = std::chrono::steady_clock;
+
+	// loads shed while overloaded, none by default
+	struct Policy {
+		bool gui_snapshots = false;   // the world is published to the GUI every gui_snapshot_every ticks
+		bool rays          = false;   // distance sensors are cast when read, not every tick
+		bool debug_lines   = false;   // the GUI keeps showing the debug lines it has
+
+		// comma separated "gui", "rays", "debug_lines", "all" or "none"
+		static auto parse(std::string_view list)
+			-> Policy
+		{
+			Policy p;
+			while(!list.empty()) {
+				std::size_t      comma = list.find(',');
+				std::string_view name  = list.substr(0, comma);
+				if(name == "all") {
+					p = Policy{true, true, true};
+				}
+				p.gui_snapshots |= name == "gui";
+				p.rays          |= name == "rays";
+				p.debug_lines   |= name == "debug_lines";
+				list.remove_prefix(comma == std::string_view::npos ? list.size() : comma + 1);
+			}
+			return p;
+		}
+	};
+
+	struct Counters {
+		std::atomic<uint64_t> ticks{0};
+		std::atomic<uint64_t> overruns{0};             // work longer than the period
+		std::atomic<uint64_t> missed{0};               // slots skipped after falling behind
+		std::atomic<uint64_t> overloads{0};            // times shedding started
+		std::atomic<uint64_t> overloaded_ticks{0};
+		std::atomic<uint64_t> gui_snapshots_skipped{0};
+		std::atomic<uint64_t> rays_deferred{0};        // ticks that didn't cast the rays
+		std::atomic<uint64_t> debug_lines_shed{0};     // GUI snapshots without new debug lines
+	};
+
+	TimeHistogram periods;    // start to start, ns
+	TimeHistogram updates;    // Environment::update
+	TimeHistogram work;       // begin() to end()
+	TimeHistogram lateness;   // start after the slot
+
+private:
+	Policy                   policy;
+	Counters                 _counters;
+	std::atomic<bool>        overloaded{false};
+	clock_t::time_point      slot;
+	clock_t::time_point      last_start;
+	clock_t::time_point      start;
+	bool                     is_started = false;
+	uint32_t                 busy_in_a_row = 0;
+	uint32_t                 idle_in_a_row = 0;
+	uint32_t                 gui_tick      = 0;
+
+	static uint64_t ns(clock_t::duration d) {
+		return static_cast<uint64_t>(std::max<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count(), 0));
+	}
+	static void bump(std::atomic<uint64_t>& a, uint64_t n = 1) {
+		a.fetch_add(n, std::memory_order_relaxed);
+	}
+
+	void judge(bool busy, bool idle) {
+		bool is_overloaded = overloaded.load(std::memory_order_relaxed);
+		busy_in_a_row = busy ? busy_in_a_row + 1 : 0;
+		idle_in_a_row = idle ? idle_in_a_row + 1 : 0;
+		if(!is_overloaded && busy_in_a_row >= config::Overload::enter_ticks) {
+			overloaded.store(true, std::memory_order_relaxed);
+			bump(_counters.overloads);
+			idle_in_a_row = 0;
+		} else if(is_overloaded && idle_in_a_row >= config::Overload::leave_ticks) {
+			overloaded.store(false, std::memory_order_relaxed);
+			busy_in_a_row = 0;
+		}
+		if(overloaded.load(std::memory_order_relaxed)) {
+			bump(_counters.overloaded_ticks);
+		}
+	}
+
+public:
+	Counters const& counters() const {
+		return _counters;
+	}
+	bool is_overloaded() const {
+		return overloaded.load(std::memory_order_relaxed);
+	}
+	void set_policy(Policy p) {
+		policy = p;
+	}
+
+	// sim loop: a tick starts
+	void begin() {
+		start = clock_t::now();
+		if(!is_started) {
+			slot       = start;
+			last_start = start;
+			is_started = true;
+		}
+		periods.add(ns(start - last_start));
+		lateness.add(ns(start - slot));
+		last_start = start;
+	}
+	// sim loop: environment.update of this tick took d
+	void updated(clock_t::duration d) {
+		updates.add(ns(d));
+	}
+	// sim loop: the work of the tick is done, returns when the next is due
+	auto end(clock_t::duration period)
+		-> clock_t::time_point
+	{
+		auto now  = clock_t::now();
+		auto busy = now - start;
+		work.add(ns(busy));
+		bump(_counters.ticks);
+		if(busy > period) {
+			bump(_counters.overruns);
+		}
+		slot += period;
+		uint64_t missed = 0;
+		if(now > slot + period) {
+			missed = static_cast<uint64_t>((now - slot) / period);
+			slot   = now;
+			bump(_counters.missed, missed);
+		}
+		judge(
+			  missed != 0 || busy > period * config::Overload::busy_load
+			, busy < period * config::Overload::leave_load
+		);
+		return slot;
+	}
+
+	// Environment::update: whether to skip casting the rays this tick
+	bool defer_rays() {
+		if(policy.rays && is_overloaded()) {
+			bump(_counters.rays_deferred);
+			return true;
+		}
+		return false;
+	}
+	// Environment::update: whether to leave the GUI with the last snapshot
+	bool skip_gui_snapshot() {
+		if(!policy.gui_snapshots || !is_overloaded()) {
+			gui_tick = 0;
+			return false;
+		}
+		if(gui_tick++ % config::Overload::gui_snapshot_every == 0) {
+			return false;
+		}
+		bump(_counters.gui_snapshots_skipped);
+		return true;
+	}
+	// GUI snapshot of the world: whether to keep the debug lines it has
+	bool shed_debug_lines() {
+		if(policy.debug_lines && is_overloaded()) {
+			bump(_counters.debug_lines_shed);
+			return true;
+		}
+		return false;
+	}
+};
+
+}   // namespace robo
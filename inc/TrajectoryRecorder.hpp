@@ -0,0 +1,552 @@
+#pragma once
+#include "Environment.hpp"
+#include "config/Recorder.hpp"
+#include "socket/PosixError.hpp"
+#include "util/MappedFile.hpp"
+#include "util/name_this_thread.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace robo {
+
+// Recording file: a RecordingHeader, then one frame per recorded tick, a
+// FrameHeader followed by one column per quantity holding the values of
+// all robots of that tick, each column padded to 8 bytes:
+//     integer columns (int32) : id, reference, score, guest
+//     value columns (float or double) : x, y, orientation, vx, vy,
+//         angular_velocity, ref_x, ref_y, ref_angular, ray 0 ... num_rays - 1
+// reference is 0 for local velocity, 1 for fixed frame velocity (ref_* are
+// the commanded velocities) and 2 for trajectories (ref_* is the pose of the
+// next waypoint). guest is -1 or the index of the carried guest. Readers
+// stop at the first frame without magic, the unused tail of a crashed
+// recording is zero.
+struct RecordingHeader {
+	constexpr static uint32_t magic_value = 0x52544252;   // "RBTR"
+	constexpr static uint32_t version     = 1;
+
+	uint32_t magic;
+	uint32_t file_version;
+	uint32_t value_size;   // 4: float, 8: double
+	uint32_t num_rays;
+	uint64_t reserved;
+};
+static_assert(std::is_trivially_copyable_v<RecordingHeader>);
+static_assert(sizeof(RecordingHeader) == 24);
+
+struct FrameHeader {
+	constexpr static uint32_t magic_value = 0x52464252;   // "RBFR"
+
+	uint32_t magic;
+	uint32_t robots;
+	uint64_t tick;
+	double   time;
+	uint64_t size;   // bytes of columns behind the header
+};
+static_assert(std::is_trivially_copyable_v<FrameHeader>);
+static_assert(sizeof(FrameHeader) == 32);
+
+namespace recording {
+
+enum Column : std::size_t {
+	  id
+	, reference
+	, score
+	, guest
+	, x
+	, y
+	, orientation
+	, vx
+	, vy
+	, angular_velocity
+	, ref_x
+	, ref_y
+	, ref_angular
+	, ray0
+};
+constexpr std::size_t integer_columns = 4;
+
+inline std::size_t num_columns(std::size_t num_rays) {
+	return ray0 + num_rays;
+}
+inline bool is_integer(std::size_t column) {
+	return column < integer_columns;
+}
+inline std::string column_name(std::size_t column) {
+	constexpr static char const* names[] = {
+		  "id", "reference", "score", "guest", "x", "y", "orientation"
+		, "vx", "vy", "angular_velocity", "ref_x", "ref_y", "ref_angular"
+	};
+	return column < ray0 ? names[column] : "ray" + std::to_string(column - ray0);
+}
+// byte offset of column in a frame of n robots
+inline std::size_t column_offset(std::size_t column, std::size_t n, std::size_t value_size) {
+	auto padded = [](std::size_t bytes) {
+		return (bytes + 7) & ~std::size_t{7};
+	};
+	std::size_t integers = padded(sizeof(int32_t) * n);
+	std::size_t values   = padded(value_size * n);
+	return is_integer(column)
+		? column * integers
+		: integer_columns * integers + (column - integer_columns) * values
+	;
+}
+inline std::size_t frame_size(std::size_t n, std::size_t value_size, std::size_t num_rays) {
+	return column_offset(num_columns(num_rays), n, value_size);
+}
+
+} /** namespace recording */
+
+// Records every robot of every every-th tick into a columnar file. The sim
+// thread packs the frame into a preallocated slot of a single producer,
+// single consumer ring and moves on, the writer thread copies it into the
+// mapped file. Neither side locks or waits for the other, a full ring drops
+// the frame. The ring is kept small so the slots stay in cache. A frame
+// that doesn't fit its slot is dropped and the writer grows the slots as it
+// passes them, so the sim thread never allocates.
+class TrajectoryRecorder {
+private:
+	struct Slot {
+		FrameHeader            header;
+		std::vector<std::byte> columns;
+		bool                   is_short = false;   // passed on only to be grown
+	};
+
+	std::vector<Slot>                slots;
+	alignas(64) std::atomic<uint64_t> head{0};   // next slot to fill, sim thread
+	alignas(64) std::atomic<uint64_t> tail{0};   // next slot to write, writer
+	std::atomic<bool>                stopping{false};
+	std::atomic<uint64_t>            _frames{0};
+	std::atomic<uint64_t>            _dropped{0};
+	std::atomic<bool>                _failed{false};
+	std::atomic<std::size_t>         _bytes{0};
+	std::atomic<std::size_t>         slot_size{0};   // raised by the sim thread, the writer grows to it
+	std::size_t                      value_size;
+	uint64_t                         every;
+	int                              fd;
+	std::byte*                       map      = nullptr;
+	std::size_t                      capacity = 0;
+	std::size_t                      used     = 0;
+	std::thread                      thread;
+
+	template<typename T>
+	static void pack(Slot& slot, Robots const& robots) {
+		std::size_t n = slot.header.robots;
+		std::byte*  c = slot.columns.data();
+		auto integers = [&](std::size_t column) {
+			return reinterpret_cast<int32_t*>(c + recording::column_offset(column, n, sizeof(T)));
+		};
+		auto values = [&](std::size_t column) {
+			return reinterpret_cast<T*>(c + recording::column_offset(column, n, sizeof(T)));
+		};
+		int32_t* id               = integers(recording::id);
+		int32_t* reference        = integers(recording::reference);
+		int32_t* score            = integers(recording::score);
+		int32_t* guest            = integers(recording::guest);
+		T*       x                = values(recording::x);
+		T*       y                = values(recording::y);
+		T*       orientation      = values(recording::orientation);
+		T*       vx               = values(recording::vx);
+		T*       vy               = values(recording::vy);
+		T*       angular_velocity = values(recording::angular_velocity);
+		T*       ref_x            = values(recording::ref_x);
+		T*       ref_y            = values(recording::ref_y);
+		T*       ref_angular      = values(recording::ref_angular);
+		T*       rays             = values(recording::ray0);
+		std::size_t const ray_stride = recording::column_offset(recording::ray0 + 1, n, sizeof(T))
+			- recording::column_offset(recording::ray0, n, sizeof(T));
+		std::size_t i = 0;
+		for(Robot const& robot : robots) {
+			if(robot.killed) {
+				continue;
+			}
+			auto const& k = robot.kinematics;
+			id[i]               = static_cast<int32_t>(robot.id.value);
+			score[i]            = robot.score;
+			guest[i]            = robot.taxi_guest ? static_cast<int32_t>(*robot.taxi_guest) : -1;
+			x[i]                = static_cast<T>(k.position[0]);
+			y[i]                = static_cast<T>(k.position[1]);
+			orientation[i]      = static_cast<T>(k.orientation);
+			vx[i]               = static_cast<T>(k.velocity[0]);
+			vy[i]               = static_cast<T>(k.velocity[1]);
+			angular_velocity[i] = static_cast<T>(k.angular_velocity);
+			if(auto const* r = std::get_if<LocalVelocityReference>(&robot.reference)) {
+				reference[i]   = 0;
+				ref_x[i]       = static_cast<T>(r->velocity[0]);
+				ref_y[i]       = static_cast<T>(r->velocity[1]);
+				ref_angular[i] = static_cast<T>(r->angular_velocity);
+			} else if(auto const* r = std::get_if<LocalVelocityFixedFrameReference>(&robot.reference)) {
+				reference[i]   = 1;
+				ref_x[i]       = static_cast<T>(r->velocity[0]);
+				ref_y[i]       = static_cast<T>(r->velocity[1]);
+				ref_angular[i] = static_cast<T>(r->angular_velocity);
+			} else {
+				auto const& t = std::get<TrajectoryReference>(robot.reference);
+				auto const& w = t.waypoints[std::min(t.next, t.waypoints.size() - 1)];
+				reference[i]   = 2;
+				ref_x[i]       = static_cast<T>(w.position[0]);
+				ref_y[i]       = static_cast<T>(w.position[1]);
+				ref_angular[i] = static_cast<T>(w.orientation);
+			}
+			T* ray = rays + i;
+			for(double d : robot.ray_distances) {
+				*ray = static_cast<T>(d);
+				ray  = reinterpret_cast<T*>(reinterpret_cast<std::byte*>(ray) + ray_stride);
+			}
+			++i;
+		}
+	}
+
+	void append(void const* data, std::size_t size) {
+		if(used + size > capacity) {
+			std::size_t new_capacity = std::max(capacity + config::Recorder::grow_bytes, used + size);
+			if(::ftruncate(fd, static_cast<off_t>(new_capacity)) != 0) {
+				throw PosixError("TrajectoryRecorder::ftruncate", errno);
+			}
+			void* p = map
+				? ::mremap(map, capacity, new_capacity, MREMAP_MAYMOVE)
+				: ::mmap(nullptr, new_capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+			;
+			if(p == MAP_FAILED) {
+				throw PosixError("TrajectoryRecorder::mmap", errno);
+			}
+			map      = static_cast<std::byte*>(p);
+			capacity = new_capacity;
+		}
+		std::memcpy(map + used, data, size);
+		used += size;
+	}
+
+	void write(Slot const& slot) {
+		if(_failed) {
+			return;
+		}
+		try {
+			append(&slot.header, sizeof(slot.header));
+			append(slot.columns.data(), slot.header.size);
+			_bytes.store(used, std::memory_order_relaxed);
+			++_frames;
+		} catch(std::exception const& e) {
+			std::cerr << "recording stopped: " << e.what() << '\n';
+			_failed = true;
+		}
+	}
+
+	// polls instead of being woken, so the sim thread makes no system call
+	void run() {
+		name_this_thread("recorder");
+		for(;;) {
+			bool     stop = stopping.load(std::memory_order_acquire);
+			uint64_t t    = tail.load(std::memory_order_relaxed);
+			uint64_t h    = head.load(std::memory_order_acquire);
+			for(; t != h; ++t) {
+				Slot& slot = slots[t % slots.size()];
+				if(!slot.is_short) {
+					write(slot);
+				}
+				if(std::size_t size = slot_size.load(std::memory_order_relaxed); slot.columns.size() < size) {
+					slot.columns.resize(size);
+				}
+				tail.store(t + 1, std::memory_order_release);
+			}
+			if(stop) {
+				break;
+			}
+			std::this_thread::sleep_for(config::Recorder::poll_interval);
+		}
+	}
+
+public:
+	// value_size 4 records floats, 8 doubles
+	TrajectoryRecorder(std::string const& path, std::size_t value_size, uint64_t every = 1)
+		: slots(config::Recorder::slots)
+		, value_size{value_size}
+		, every{std::max<uint64_t>(every, 1)}
+		, fd{::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)}
+	{
+		if(value_size != sizeof(float) && value_size != sizeof(double)) {
+			throw std::invalid_argument("TrajectoryRecorder: value size must be 4 or 8");
+		}
+		if(fd < 0) {
+			throw PosixError("TrajectoryRecorder::open " + path, errno);
+		}
+		slot_size = recording::frame_size(config::Recorder::initial_robots, value_size, Robot::num_rays);
+		for(Slot& slot : slots) {
+			// touched now rather than on the first pass of the sim thread
+			slot.columns.resize(slot_size);
+		}
+		RecordingHeader header{
+			  RecordingHeader::magic_value
+			, RecordingHeader::version
+			, static_cast<uint32_t>(value_size)
+			, static_cast<uint32_t>(Robot::num_rays)
+			, 0
+		};
+		try {
+			append(&header, sizeof(header));
+		} catch(...) {
+			::close(fd);
+			throw;
+		}
+		thread = std::thread{[this]{ run(); }};
+	}
+	TrajectoryRecorder(TrajectoryRecorder const&) = delete;
+	TrajectoryRecorder& operator=(TrajectoryRecorder const&) = delete;
+	// writes what is queued, then cuts the file to its content
+	~TrajectoryRecorder() {
+		stopping.store(true, std::memory_order_release);
+		thread.join();
+		if(map) {
+			::munmap(map, capacity);
+		}
+		if(::ftruncate(fd, static_cast<off_t>(used)) != 0) {
+			std::cerr << PosixError("TrajectoryRecorder::ftruncate", errno).what() << '\n';
+		}
+		::close(fd);
+	}
+
+	// Called by the sim thread after a physics step, records it if the tick
+	// is due. Only the environment mutex is taken.
+	void record(Environment& environment) {
+		uint64_t h = head.load(std::memory_order_relaxed);
+		Slot&    slot = slots[h % slots.size()];
+		{
+			std::lock_guard<Environment::mutex_t> lock{environment.mutex};
+			if(environment.physics_tick % every != 0) {
+				return;
+			}
+			if(h - tail.load(std::memory_order_acquire) == slots.size()) {
+				++_dropped;
+				return;
+			}
+			environment.refresh_rays_unlocked();
+			Robots const& robots = environment.robots;
+			std::size_t   n      = static_cast<std::size_t>(std::count_if(
+				  robots.begin()
+				, robots.end()
+				, [](Robot const& r) { return !r.killed; }
+			));
+			std::size_t size = recording::frame_size(n, value_size, Robot::num_rays);
+			slot.is_short    = slot.columns.size() < size;
+			if(slot.is_short) {
+				// with room to spare, so a few more robots don't drop frames again
+				std::size_t grown = recording::frame_size(n + n / 2, value_size, Robot::num_rays);
+				if(slot_size.load(std::memory_order_relaxed) < grown) {
+					slot_size.store(grown, std::memory_order_relaxed);
+				}
+				++_dropped;
+				head.store(h + 1, std::memory_order_release);
+				return;
+			}
+			slot.header = FrameHeader{
+				  FrameHeader::magic_value
+				, static_cast<uint32_t>(n)
+				, environment.physics_tick
+				, environment.time
+				, size
+			};
+			if(value_size == sizeof(float)) {
+				pack<float>(slot, robots);
+			} else {
+				pack<double>(slot, robots);
+			}
+		}
+		head.store(h + 1, std::memory_order_release);
+	}
+
+	uint64_t frames() const {
+		return _frames;
+	}
+	uint64_t dropped() const {
+		return _dropped;
+	}
+	std::size_t bytes() const {
+		return _bytes;
+	}
+};
+
+// Random access to the frames of a recording, mapped read only.
+class TrajectoryReader {
+public:
+	class Frame {
+	private:
+		FrameHeader      header;
+		std::byte const* columns;
+		std::size_t      value_size;
+
+	public:
+		Frame(FrameHeader const& header, std::byte const* columns, std::size_t value_size)
+			: header{header}
+			, columns{columns}
+			, value_size{value_size}
+		{}
+
+		uint64_t tick() const {
+			return header.tick;
+		}
+		double time() const {
+			return header.time;
+		}
+		// robots in this frame
+		std::size_t size() const {
+			return header.robots;
+		}
+		// int32_t for integer columns, float or double as recorded for the rest
+		template<typename T>
+		auto column(std::size_t c) const
+			-> std::span<T const>
+		{
+			bool fits = recording::is_integer(c)
+				? std::is_same_v<T, int32_t>
+				: std::is_floating_point_v<T> && sizeof(T) == value_size
+			;
+			if(!fits) {
+				throw std::logic_error("TrajectoryReader: wrong type for column " + recording::column_name(c));
+			}
+			return {
+				  reinterpret_cast<T const*>(columns + recording::column_offset(c, size(), value_size))
+				, size()
+			};
+		}
+		auto value(std::size_t c, std::size_t i) const
+			-> double
+		{
+			std::byte const* p = columns + recording::column_offset(c, size(), value_size);
+			if(recording::is_integer(c)) {
+				return reinterpret_cast<int32_t const*>(p)[i];
+			}
+			return value_size == sizeof(float)
+				? reinterpret_cast<float  const*>(p)[i]
+				: reinterpret_cast<double const*>(p)[i]
+			;
+		}
+		RobotId id(std::size_t i) const {
+			return {static_cast<uint32_t>(column<int32_t>(recording::id)[i])};
+		}
+	};
+
+	class iterator {
+	private:
+		TrajectoryReader const* reader;
+		std::size_t             i;
+	public:
+		iterator(TrajectoryReader const* reader, std::size_t i)
+			: reader{reader}
+			, i{i}
+		{}
+		Frame operator*() const {
+			return (*reader)[i];
+		}
+		iterator& operator++() {
+			++i;
+			return *this;
+		}
+		bool operator==(iterator const& other) const {
+			return i == other.i;
+		}
+	};
+
+private:
+	MappedFile               file;
+	RecordingHeader          header;
+	std::vector<std::size_t> offsets;   // of the frame headers
+
+public:
+	explicit TrajectoryReader(std::string const& path)
+		: file{path}
+	{
+		auto bytes = file.bytes();
+		if(bytes.size() < sizeof(header)) {
+			throw std::runtime_error(path + ": not a recording");
+		}
+		std::memcpy(&header, bytes.data(), sizeof(header));
+		if(header.magic != RecordingHeader::magic_value) {
+			throw std::runtime_error(path + ": not a recording");
+		}
+		if(header.file_version != RecordingHeader::version) {
+			throw std::runtime_error(
+				  path + ": recording version " + std::to_string(header.file_version)
+				+ ", expected " + std::to_string(RecordingHeader::version)
+			);
+		}
+		if(header.value_size != sizeof(float) && header.value_size != sizeof(double)) {
+			throw std::runtime_error(path + ": bad value size");
+		}
+		std::size_t offset = sizeof(header);
+		while(bytes.size() - offset >= sizeof(FrameHeader)) {
+			FrameHeader frame;
+			std::memcpy(&frame, bytes.data() + offset, sizeof(frame));
+			if(    frame.magic != FrameHeader::magic_value
+				|| frame.size  != recording::frame_size(frame.robots, header.value_size, header.num_rays)
+				|| bytes.size() - offset - sizeof(frame) < frame.size
+			) {
+				break;
+			}
+			offsets.push_back(offset);
+			offset += sizeof(frame) + frame.size;
+		}
+	}
+
+	std::size_t value_size() const {
+		return header.value_size;
+	}
+	std::size_t num_rays() const {
+		return header.num_rays;
+	}
+	std::size_t num_columns() const {
+		return recording::num_columns(header.num_rays);
+	}
+	std::size_t size() const {
+		return offsets.size();
+	}
+	Frame operator[](std::size_t i) const {
+		std::byte const* p = file.bytes().data() + offsets[i];
+		FrameHeader frame;
+		std::memcpy(&frame, p, sizeof(frame));
+		return {frame, p + sizeof(frame), header.value_size};
+	}
+	iterator begin() const {
+		return {this, 0};
+	}
+	iterator end() const {
+		return {this, size()};
+	}
+	// index of the first frame at or after tick, size() if none
+	std::size_t lower_bound(uint64_t tick) const {
+		std::size_t lo = 0;
+		std::size_t hi = size();
+		while(lo < hi) {
+			std::size_t mid = lo + (hi - lo) / 2;
+			if((*this)[mid].tick() < tick) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		return lo;
+	}
+	auto find(uint64_t tick) const
+		-> std::optional<Frame>
+	{
+		std::size_t i = lower_bound(tick);
+		if(i == size()) {
+			return std::nullopt;
+		}
+		return (*this)[i];
+	}
+};
+
+} /** namespace robo */
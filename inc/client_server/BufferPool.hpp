@@ -0,0 +1,271 @@
+#pragma once
+#include "serializer/SerializationBuffers.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Thrown when a frame or a buffer exceeds the limits of the pool.
+// Servers drop the offending connection.
+struct BufferLimitError : std::runtime_error {
+	using std::runtime_error::runtime_error;
+};
+
+struct BufferPoolStats {
+	std::size_t bytes_in_use      = 0;   // handed out to connections
+	std::size_t bytes_pooled      = 0;   // free, kept for reuse
+	std::size_t peak_bytes_in_use = 0;
+	uint64_t    allocations       = 0;   // served by the system allocator
+	uint64_t    reuses            = 0;   // served from a free list
+	uint64_t    releases          = 0;   // given back to the system
+	uint64_t    denied            = 0;   // over the global budget
+
+	friend std::ostream& operator<<(std::ostream& os, BufferPoolStats const& s) {
+		return os
+			<< "buffers in use "  << s.bytes_in_use
+			<< " (peak "          << s.peak_bytes_in_use
+			<< "), pooled "       << s.bytes_pooled
+			<< ", allocations "   << s.allocations
+			<< ", reuses "        << s.reuses
+			<< ", releases "      << s.releases
+			<< ", denied "        << s.denied
+		;
+	}
+};
+
+// Power of two size classes shared by all connections of a process.
+// Buffers grow by moving to the next class, released blocks go to the
+// free list of their class as long as the pool holds less than
+// max_pooled_bytes, otherwise back to the system.
+class BufferPool {
+public:
+	struct Limits {
+		std::size_t max_frame_size    = std::size_t{16}   << 20;
+		std::size_t connection_budget = std::size_t{64}   << 20;
+		std::size_t global_budget     = std::size_t{1024} << 20;
+		std::size_t max_pooled_bytes  = std::size_t{64}   << 20;
+		// idle buffers above this size are handed back after a spike
+		std::size_t shrink_size       = std::size_t{256}  << 10;
+	};
+
+	static constexpr std::size_t min_class_bits = 12;   // 4 KiB
+	static constexpr std::size_t n_classes      = 40;
+
+private:
+	mutable std::mutex                                 mutex;
+	Limits                                             _limits;
+	std::array<std::vector<std::byte*>, n_classes>     free_lists;
+	BufferPoolStats                                    _stats;
+
+	static std::size_t size_class(std::size_t size) {
+		std::size_t bits = std::bit_width(std::max(size, std::size_t{1} << min_class_bits) - 1);
+		return bits - min_class_bits;
+	}
+
+public:
+	BufferPool() = default;
+	BufferPool(BufferPool const&) = delete;
+	BufferPool& operator=(BufferPool const&) = delete;
+	~BufferPool() {
+		trim();
+	}
+
+	// the pool used by FramedStream and the Pooled*Buffer types
+	static BufferPool& global() {
+		static BufferPool pool;
+		return pool;
+	}
+
+	void set_limits(Limits const& limits) {
+		std::lock_guard<std::mutex> lock{mutex};
+		_limits = limits;
+	}
+	Limits limits() const {
+		std::lock_guard<std::mutex> lock{mutex};
+		return _limits;
+	}
+	BufferPoolStats stats() const {
+		std::lock_guard<std::mutex> lock{mutex};
+		return _stats;
+	}
+
+	static std::size_t class_size(std::size_t size) {
+		return std::size_t{1} << (size_class(size) + min_class_bits);
+	}
+
+	// a block of class_size(size) bytes, nullptr if over the global budget
+	std::byte* acquire(std::size_t size) {
+		std::size_t c        = size_class(size);
+		std::size_t capacity = std::size_t{1} << (c + min_class_bits);
+		std::lock_guard<std::mutex> lock{mutex};
+		if(c >= n_classes || _stats.bytes_in_use + capacity > _limits.global_budget) {
+			++_stats.denied;
+			return nullptr;
+		}
+		std::byte* block;
+		if(free_lists[c].empty()) {
+			block = new std::byte[capacity];
+			++_stats.allocations;
+		} else {
+			block = free_lists[c].back();
+			free_lists[c].pop_back();
+			_stats.bytes_pooled -= capacity;
+			++_stats.reuses;
+		}
+		_stats.bytes_in_use     += capacity;
+		_stats.peak_bytes_in_use = std::max(_stats.peak_bytes_in_use, _stats.bytes_in_use);
+		return block;
+	}
+
+	void release(std::byte* block, std::size_t capacity) {
+		if(!block) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock{mutex};
+		_stats.bytes_in_use -= capacity;
+		if(_stats.bytes_pooled + capacity > _limits.max_pooled_bytes) {
+			delete[] block;
+			++_stats.releases;
+			return;
+		}
+		free_lists[size_class(capacity)].push_back(block);
+		_stats.bytes_pooled += capacity;
+	}
+
+	// hands every pooled block back to the system
+	void trim() {
+		std::lock_guard<std::mutex> lock{mutex};
+		for(auto& list : free_lists) {
+			for(std::byte* block : list) {
+				delete[] block;
+				++_stats.releases;
+			}
+			list.clear();
+		}
+		_stats.bytes_pooled = 0;
+	}
+};
+
+// Memory of one connection, checked against Limits::connection_budget.
+struct BufferAccount {
+	BufferPool& pool  = BufferPool::global();
+	std::size_t bytes = 0;
+	std::size_t peak  = 0;
+};
+
+// Byte storage with the interface of std::vector<std::byte> used by the
+// serialization buffers, backed by a BufferPool block.
+class PooledBytes {
+private:
+	BufferAccount* _account  = nullptr;
+	std::byte*     _data     = nullptr;
+	std::size_t    _size     = 0;
+	std::size_t    _capacity = 0;
+
+	BufferPool& pool() const {
+		return _account ? _account->pool : BufferPool::global();
+	}
+
+	void reallocate(std::size_t capacity) {
+		BufferPool& p = pool();
+		std::byte* block = nullptr;
+		if(capacity != 0) {
+			capacity = BufferPool::class_size(capacity);
+			if(_account && _account->bytes - _capacity + capacity > p.limits().connection_budget) {
+				throw BufferLimitError("buffer of " + std::to_string(capacity) + " bytes exceeds the connection budget");
+			}
+			block = p.acquire(capacity);
+			if(!block) {
+				throw BufferLimitError("buffer of " + std::to_string(capacity) + " bytes exceeds the global budget");
+			}
+			if(_size != 0) {
+				std::memcpy(block, _data, std::min(_size, capacity));
+			}
+		}
+		p.release(_data, _capacity);
+		if(_account) {
+			_account->bytes = _account->bytes - _capacity + capacity;
+			_account->peak  = std::max(_account->peak, _account->bytes);
+		}
+		_data     = block;
+		_capacity = capacity;
+		_size     = std::min(_size, capacity);
+	}
+
+public:
+	PooledBytes() = default;
+	PooledBytes(PooledBytes const&) = delete;
+	PooledBytes& operator=(PooledBytes const&) = delete;
+	PooledBytes(PooledBytes&& other) noexcept
+		: _account{other._account}
+		, _data{std::exchange(other._data, nullptr)}
+		, _size{std::exchange(other._size, 0)}
+		, _capacity{std::exchange(other._capacity, 0)}
+	{}
+	~PooledBytes() {
+		reallocate(0);
+	}
+
+	// charge this buffer to account, before the first allocation
+	void bind(BufferAccount& account) {
+		_account = &account;
+	}
+
+	void resize(std::size_t size) {
+		if(size > _capacity) {
+			reallocate(size);
+		}
+		_size = size;
+	}
+	void clear() {
+		_size = 0;
+	}
+	// the shrink policy: back to the pool if idle and above shrink_size
+	void shrink() {
+		if(_size == 0 && _capacity > pool().limits().shrink_size) {
+			reallocate(0);
+		}
+	}
+
+	std::byte*       data()           { return _data; }
+	std::byte const* data()     const { return _data; }
+	std::byte*       begin()          { return _data; }
+	std::byte const* begin()    const { return _data; }
+	std::byte*       end()            { return _data + _size; }
+	std::byte const* end()      const { return _data + _size; }
+	std::size_t      size()     const { return _size; }
+	std::size_t      capacity() const { return _capacity; }
+};
+
+template<detail::Integer integer_t = std::size_t>
+struct PooledSerializationBuffer
+	: detail::DynamicSerializationBufferBase<PooledBytes, integer_t>
+{
+	using buffer_t = PooledBytes;
+	buffer_t buffer;
+
+	PooledSerializationBuffer()
+		: detail::DynamicSerializationBufferBase<buffer_t, integer_t>{buffer}
+	{}
+};
+
+template<detail::Integer integer_t = std::size_t>
+struct PooledDeserializationBuffer
+	: detail::DynamicDeserializationBufferBase<PooledBytes, integer_t>
+{
+	using buffer_t = PooledBytes;
+	buffer_t buffer;
+
+	PooledDeserializationBuffer()
+		: detail::DynamicDeserializationBufferBase<buffer_t, integer_t>{buffer}
+	{}
+};
@@ -0,0 +1,283 @@
+#pragma once
+#include "BufferPool.hpp"
+#include "util/time_this.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <stdexcept>
+#include <vector>
+
+// Thrown for a frame that cannot be valid, a length prefix shorter than the
+// prefix itself or a message that does not deserialize. The stream is out of
+// sync from there on, servers drop the connection.
+struct ProtocolError : std::runtime_error {
+	using std::runtime_error::runtime_error;
+};
+
+// Counters of one connection, to check how many syscalls a message costs.
+struct FramedStreamStats {
+	uint64_t wait_calls   = 0;   // can_read()/select
+	uint64_t recv_calls   = 0;
+	uint64_t send_calls   = 0;
+	uint64_t frames_in    = 0;
+	uint64_t frames_out   = 0;
+	uint64_t bytes_in     = 0;
+	uint64_t bytes_out    = 0;
+	uint64_t buffer_bytes      = 0;   // pooled buffer memory of the connection
+	uint64_t buffer_bytes_peak = 0;
+
+	uint64_t syscalls() const {
+		return wait_calls + recv_calls + send_calls;
+	}
+	double syscalls_per_message() const {
+		uint64_t messages = frames_in + frames_out;
+		return messages ? static_cast<double>(syscalls()) / messages : 0.0;
+	}
+
+	friend std::ostream& operator<<(std::ostream& os, FramedStreamStats const& s) {
+		return os
+			<< "frames in/out "    << s.frames_in  << '/' << s.frames_out
+			<< ", bytes in/out "   << s.bytes_in   << '/' << s.bytes_out
+			<< ", wait/recv/send " << s.wait_calls << '/' << s.recv_calls << '/' << s.send_calls
+			<< ", syscalls/message " << s.syscalls_per_message()
+			<< ", buffers "        << s.buffer_bytes << " (peak " << s.buffer_bytes_peak << ')'
+		;
+	}
+};
+
+// Buffered, length prefixed framing on top of a stream socket.
+// Frames are a uint64 size including the prefix, then the message. The
+// socket calls of fill() and flush() are timed as "receive" and "send".
+//
+// Reading: fill() pulls whatever is available with a single recv into the
+// input buffer, next() then hands out every complete frame in it.
+// Writing: queue() serializes into one output buffer, flush() sends all
+// queued frames with a single send.
+//
+// Memory: the input buffer, and SBuffer/DBuffer if they are the Pooled*
+// types, come from BufferPool::global() and are charged to the connection.
+// A length prefix above max_frame_size or a buffer over budget throws
+// BufferLimitError, buffers left above shrink_size by a large frame go back
+// to the pool once they are idle. A malformed frame throws ProtocolError.
+template<typename Serializer, typename SBuffer, typename DBuffer>
+class FramedStream {
+private:
+	static constexpr std::size_t header_size      = sizeof(uint64_t);
+	static constexpr std::size_t initial_capacity = std::size_t{1} << 16;
+
+	std::unique_ptr<BufferAccount> account = std::make_unique<BufferAccount>();
+	std::size_t                    max_frame_size;
+	std::size_t                    shrink_size;
+	PooledBytes                    input;
+	std::size_t                    input_begin = 0;
+	std::size_t                    input_end   = 0;
+	SBuffer                        sbuffer;
+	DBuffer                        dbuffer;
+	FramedStreamStats              _stats;
+
+	template<typename Buffer>
+	void bind(Buffer& buffer) {
+		if constexpr(requires { buffer.buffer.bind(*account); }) {
+			buffer.buffer.bind(*account);
+		}
+	}
+
+	template<typename Buffer>
+	void shrink_idle(Buffer& buffer) {
+		if constexpr(requires { buffer.buffer.shrink(); }) {
+			if(buffer.buffer.capacity() > shrink_size) {
+				buffer.buffer.clear();
+				buffer.buffer.shrink();
+			}
+		}
+	}
+
+	// size of the frame at the front of the input, if its prefix is complete
+	std::optional<uint64_t> front_frame_size() {
+		if(input_end - input_begin < header_size) {
+			return {};
+		}
+		dbuffer.reset(header_size);
+		std::memcpy(dbuffer.data(), input.data() + input_begin, header_size);
+		uint64_t size;
+		if(!Serializer::deserialize(dbuffer, size) || size < header_size) {
+			throw ProtocolError("malformed frame length prefix");
+		}
+		if(size > max_frame_size) {
+			throw BufferLimitError("frame of " + std::to_string(size) + " bytes exceeds max_frame_size");
+		}
+		return size;
+	}
+
+	// make room for at least one more complete frame
+	void prepare_input() {
+		std::size_t needed = front_frame_size().value_or(header_size);
+		if(input_begin == input_end) {
+			input_begin = 0;
+			input_end   = 0;
+		} else if(input.size() - input_begin < needed || input_end == input.size()) {
+			std::memmove(input.data(), input.data() + input_begin, input_end - input_begin);
+			input_end  -= input_begin;
+			input_begin = 0;
+		}
+		if(input.size() < needed || input_end == input.size()) {
+			input.resize(std::max(needed, 2 * input.size()));
+		}
+	}
+
+public:
+	FramedStream()
+		: max_frame_size{BufferPool::global().limits().max_frame_size}
+		, shrink_size{BufferPool::global().limits().shrink_size}
+	{
+		input.bind(*account);
+		bind(sbuffer);
+		bind(dbuffer);
+		input.resize(initial_capacity);
+	}
+
+	FramedStreamStats stats() const {
+		FramedStreamStats s    = _stats;
+		s.buffer_bytes      = account->bytes;
+		s.buffer_bytes_peak = account->peak;
+		return s;
+	}
+
+	template<typename Socket>
+	bool can_read(Socket const& socket, long timeout_secs, int timeout_usecs) {
+		if(has_frame()) {
+			return true;
+		}
+		++_stats.wait_calls;
+		return socket.can_read(timeout_secs, timeout_usecs);
+	}
+
+	bool has_frame() {
+		auto size = front_frame_size();
+		return size && input_end - input_begin >= *size;
+	}
+
+	// one recv, returns false if the peer closed the connection
+	template<typename Socket>
+	bool fill(Socket const& socket) {
+		prepare_input();
+		++_stats.recv_calls;
+		uint64_t r = time_this<"receive">([&]() {
+			return socket.recv(input.data() + input_end, input.size() - input_end);
+		});
+		if(r == 0) {
+			return false;
+		}
+		input_end       += r;
+		_stats.bytes_in += r;
+		return true;
+	}
+
+	// feed bytes that were received elsewhere, e.g. by an io_uring completion
+	void append(void const* data, std::size_t size) {
+		if(input.size() - input_end < size && input_begin != 0) {
+			std::memmove(input.data(), input.data() + input_begin, input_end - input_begin);
+			input_end  -= input_begin;
+			input_begin = 0;
+		}
+		if(input.size() - input_end < size) {
+			input.resize(std::max(input_end + size, 2 * input.size()));
+		}
+		std::memcpy(input.data() + input_end, data, size);
+		input_end       += size;
+		_stats.bytes_in += size;
+	}
+
+	// next complete frame from the input buffer, without touching the socket
+	template<typename Message>
+	std::optional<Message> next() {
+		auto size = front_frame_size();
+		if(!size || input_end - input_begin < *size) {
+			return {};
+		}
+		dbuffer.reset(*size);
+		std::memcpy(dbuffer.data(), input.data() + input_begin, *size);
+		input_begin += *size;
+		++_stats.frames_in;
+		if(input_begin == input_end && input.size() > shrink_size) {
+			input_begin = 0;
+			input_end   = 0;
+			input.clear();
+			input.shrink();
+			input.resize(initial_capacity);
+		}
+		uint64_t s;
+		Message message;
+		bool ok = Serializer::deserialize(dbuffer, s, message);
+		shrink_idle(dbuffer);
+		if(!ok) {
+			throw ProtocolError("frame of " + std::to_string(*size) + " bytes does not deserialize");
+		}
+		return message;
+	}
+
+	// blocks until a complete frame arrived or the connection is closed
+	template<typename Message, typename Socket>
+	std::optional<Message> receive(Socket const& socket) {
+		while(!has_frame()) {
+			if(!fill(socket)) {
+				return {};
+			}
+		}
+		return next<Message>();
+	}
+
+	template<typename Message>
+	bool queue(Message const& message) {
+		if(pending() == 0) {
+			sbuffer.reset();
+		}
+		auto start = sbuffer.count();
+		uint64_t size = 0;
+		if(!Serializer::serialize(sbuffer, size, message)) {
+			sbuffer.count() = start;
+			return false;
+		}
+		size = sbuffer.count() - start;
+		sbuffer.count() = start;
+		if(!Serializer::serialize(sbuffer, size)) {
+			sbuffer.count() = start;
+			return false;
+		}
+		sbuffer.count() = start + size;
+		++_stats.frames_out;
+		return true;
+	}
+
+	std::size_t pending() const {
+		return sbuffer.count();
+	}
+
+	// queued frames, for callers doing the send themselves
+	std::byte const* output() const {
+		return sbuffer.data();
+	}
+	void clear_output() {
+		_stats.bytes_out += sbuffer.count();
+		sbuffer.reset();
+		shrink_idle(sbuffer);
+	}
+
+	// sends all queued frames at once
+	template<typename Socket>
+	void flush(Socket const& socket) {
+		if(pending() == 0) {
+			return;
+		}
+		++_stats.send_calls;
+		time_this<"send">([&]() {socket.send(sbuffer.data(), sbuffer.count());});
+		_stats.bytes_out += sbuffer.count();
+		sbuffer.reset();
+		shrink_idle(sbuffer);
+	}
+};
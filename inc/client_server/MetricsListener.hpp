@@ -0,0 +1,107 @@
+#pragma once
+#include "socket/PosixError.hpp"
+#include "socket/TCP_Socket.hpp"
+#include "util/name_this_thread.hpp"
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+// Minimal HTTP endpoint for Prometheus scrapes on a loopback TCP port:
+// whatever a connection asks for, it gets the text of render() once and
+// is closed. One connection at a time, render() runs on the listener
+// thread; a connection gets timeout for its request and the response
+// together, so a slow or idle client can't hold up the next scrape.
+class MetricsListener {
+private:
+	using clock_t = std::chrono::steady_clock;
+	constexpr static std::chrono::milliseconds timeout{250};
+
+	std::function<std::string()> render;
+	TCP_ServerSocket             socket;
+	std::atomic<bool>            is_running{true};
+	std::thread                  thread;
+
+	// what is left of the connection's time, as for select and SO_SNDTIMEO
+	static std::optional<timeval> remaining(clock_t::time_point deadline) {
+		auto us = std::chrono::duration_cast<std::chrono::microseconds>(deadline - clock_t::now()).count();
+		if(us <= 0) {
+			return {};
+		}
+		return timeval{static_cast<time_t>(us / 1000000), static_cast<suseconds_t>(us % 1000000)};
+	}
+
+	void serve(TCP_Socket& client) {
+		auto deadline = clock_t::now() + timeout;
+		// the request, up to the empty line, only so the client sees it read
+		std::string request;
+		char        buffer[1024];
+		while(request.find("\r\n\r\n") == std::string::npos && request.size() < 8192) {
+			auto left = remaining(deadline);
+			if(!left || !client.can_read(left->tv_sec, static_cast<int>(left->tv_usec))) {
+				return;
+			}
+			uint64_t n = client.recv(buffer, sizeof(buffer));
+			if(n == 0) {
+				return;
+			}
+			request.append(buffer, n);
+		}
+		std::string body = render();
+		std::string response =
+			  "HTTP/1.0 200 OK\r\n"
+			  "Content-Type: text/plain; version=0.0.4\r\n"
+			  "Content-Length: " + std::to_string(body.size()) + "\r\n"
+			  "Connection: close\r\n"
+			  "\r\n"
+			+ body
+		;
+		// a client that doesn't read makes send fail with EAGAIN
+		auto left = remaining(deadline).value_or(timeval{0, 1000});
+		errno = 0;
+		if(::setsockopt(client.native_handle(), SOL_SOCKET, SO_SNDTIMEO, &left, sizeof(left)) != 0) {
+			throw PosixError("metrics: setsockopt SO_SNDTIMEO", errno);
+		}
+		client.send(response.data(), response.size());
+	}
+
+	void run() {
+		name_this_thread("metrics");
+		while(is_running) {
+			try {
+				if(!socket.can_read(0, 100000)) {
+					continue;
+				}
+				TCP_Socket client;
+				socket.accept(client);
+				serve(client);
+			} catch(PosixError const& e) {
+				std::cerr << "metrics: " << e.what() << '\n';
+			}
+		}
+	}
+
+public:
+	// throws PosixError, if port can't be bound
+	MetricsListener(int port, std::function<std::string()> render)
+		: render(std::move(render))
+		, socket(port, true, 16, true)
+	{
+		thread = std::thread(&MetricsListener::run, this);
+	}
+	MetricsListener(MetricsListener const&) = delete;
+	MetricsListener& operator=(MetricsListener const&) = delete;
+	~MetricsListener() {
+		is_running = false;
+		if(thread.joinable()) {
+			thread.join();
+		}
+	}
+};
@@ -0,0 +1,232 @@
+#pragma once
+#include "client_server/FramedStream.hpp"
+#include "util/time_this.hpp"
+#include "util/Tracer.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Counters of one connection, written by the thread serving it, read by
+// whoever samples ServerStats.
+struct ConnectionCounters {
+	using clock_t = std::chrono::steady_clock;
+	uint64_t              id;
+	std::string           endpoint;
+	clock_t::time_point   connected = clock_t::now();
+	std::atomic<uint64_t> requests{0};
+	std::atomic<uint64_t> bytes_in{0};
+	std::atomic<uint64_t> bytes_out{0};
+
+	// totals of the connection so far
+	void update(FramedStreamStats const& s) {
+		requests.store(s.frames_in,  std::memory_order_relaxed);
+		bytes_in.store(s.bytes_in,   std::memory_order_relaxed);
+		bytes_out.store(s.bytes_out, std::memory_order_relaxed);
+	}
+};
+
+struct ConnectionSample {
+	uint64_t    id;
+	std::string endpoint;
+	double      age;   // seconds
+	uint64_t    requests;
+	uint64_t    bytes_in;
+	uint64_t    bytes_out;
+	double      requests_per_second;
+	double      bytes_in_per_second;
+	double      bytes_out_per_second;
+};
+
+struct ServerStatsSample {
+	double                        uptime   = 0.0;
+	double                        interval = 0.0;   // the rates are over the last interval seconds
+	uint64_t                      accepted = 0;
+	uint64_t                      open     = 0;
+	uint64_t                      requests  = 0;   // of open and closed connections
+	uint64_t                      bytes_in  = 0;
+	uint64_t                      bytes_out = 0;
+	double                        requests_per_second  = 0.0;
+	double                        bytes_in_per_second  = 0.0;
+	double                        bytes_out_per_second = 0.0;
+	std::vector<ConnectionSample> connections;
+	std::vector<TimeSummary>      handlers;   // named after their request
+};
+
+// Request and byte counts of all connections of the servers of a process
+// and the latency of their handlers per request type. The serving threads
+// only write their own counters (and TimeStats histograms), sample() reads
+// them as they are. Rates are taken against the previous sample that is at
+// least min_interval old, so frequent callers still see a stable window.
+class ServerStats {
+public:
+	using clock_t = std::chrono::steady_clock;
+	static constexpr std::chrono::seconds min_interval{1};
+
+private:
+	struct Totals {
+		uint64_t requests  = 0;
+		uint64_t bytes_in  = 0;
+		uint64_t bytes_out = 0;
+
+		Totals& operator+=(Totals const& o) {
+			requests  += o.requests;
+			bytes_in  += o.bytes_in;
+			bytes_out += o.bytes_out;
+			return *this;
+		}
+	};
+
+	static Totals totals(ConnectionCounters const& c) {
+		return {
+			  c.requests.load(std::memory_order_relaxed)
+			, c.bytes_in.load(std::memory_order_relaxed)
+			, c.bytes_out.load(std::memory_order_relaxed)
+		};
+	}
+
+	mutable std::mutex                               mutex;   // connect, disconnect, sample
+	clock_t::time_point const                        started = clock_t::now();
+	std::vector<std::shared_ptr<ConnectionCounters>> open;
+	Totals                                           closed;
+	uint64_t                                         accepted = 0;
+	std::vector<std::string>                         handler_names;
+	clock_t::time_point                              last_time = started;
+	Totals                                           last_totals;
+	std::map<uint64_t, Totals>                       last_connections;
+
+	std::size_t add_handler(std::string const& name) {
+		std::string zone = "handle::" + name;
+		std::size_t id   = TimeStats::get().add_zone(zone.c_str());
+		std::lock_guard<std::mutex> lock(mutex);
+		handler_names.push_back(std::move(zone));
+		return id;
+	}
+
+public:
+	static ServerStats& global() {
+		static ServerStats stats;
+		return stats;
+	}
+
+	// robo::XyzCommand::Request -> XyzCommand
+	template<typename Request>
+	static std::string const& command_name_of() {
+		static std::string const name = []() {
+			std::string_view s = type_name_of<Request>();
+			constexpr std::string_view suffix = "::Request";
+			if(s.size() > suffix.size() && s.substr(s.size() - suffix.size()) == suffix) {
+				s.remove_suffix(suffix.size());
+			}
+			if(auto colon = s.rfind("::"); colon != std::string_view::npos) {
+				s.remove_prefix(colon + 2);
+			}
+			return std::string(s);
+		}();
+		return name;
+	}
+
+	// Runs op, the handler of a Request, adds its duration to the latency
+	// of the command and traces it under the command's name.
+	template<typename Request, typename OP>
+	static auto time_handler(OP op)
+		-> decltype(op())
+	{
+		static std::size_t const zone  = global().add_handler(command_name_of<Request>());
+		static uint32_t const    trace = Tracer::get().add_name(command_name_of<Request>());
+		TraceScope               trace_scope{trace};
+		struct Stop {
+			std::size_t         zone;
+			clock_t::time_point begin = clock_t::now();
+			~Stop() {
+				auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_t::now() - begin).count();
+				TimeStats::get().add(zone, static_cast<uint64_t>(std::max<decltype(ns)>(ns, 0)));
+			}
+		} stop{zone};
+		return op();
+	}
+
+	auto connect(std::string endpoint)
+		-> std::shared_ptr<ConnectionCounters>
+	{
+		auto c = std::make_shared<ConnectionCounters>();
+		c->endpoint = std::move(endpoint);
+		std::lock_guard<std::mutex> lock(mutex);
+		c->id = ++accepted;
+		open.push_back(c);
+		return c;
+	}
+	// after the last update() of c
+	void disconnect(std::shared_ptr<ConnectionCounters> const& c) {
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = std::find(open.begin(), open.end(), c);
+		if(it == open.end()) {
+			return;
+		}
+		closed += totals(*c);
+		last_connections.erase(c->id);
+		open.erase(it);
+	}
+
+	ServerStatsSample sample(bool with_connections = true) {
+		std::vector<TimeSummary> zones = TimeStats::get().summaries();
+		std::lock_guard<std::mutex> lock(mutex);
+		auto   now      = clock_t::now();
+		double interval = std::chrono::duration<double>(now - last_time).count();
+		auto   per_second = [&](uint64_t now_total, uint64_t last_total) {
+			return interval > 0.0 ? static_cast<double>(now_total - std::min(now_total, last_total)) / interval : 0.0;
+		};
+		bool   is_due = now - last_time >= min_interval;
+		ServerStatsSample s;
+		s.uptime   = std::chrono::duration<double>(now - started).count();
+		s.interval = interval;
+		s.accepted = accepted;
+		s.open     = open.size();
+		Totals all = closed;
+		for(auto const& c : open) {
+			Totals t = totals(*c);
+			all += t;
+			if(with_connections) {
+				Totals const& last = last_connections[c->id];
+				s.connections.push_back({
+					  c->id
+					, c->endpoint
+					, std::chrono::duration<double>(now - c->connected).count()
+					, t.requests
+					, t.bytes_in
+					, t.bytes_out
+					, per_second(t.requests,  last.requests)
+					, per_second(t.bytes_in,  last.bytes_in)
+					, per_second(t.bytes_out, last.bytes_out)
+				});
+			}
+			if(is_due) {
+				last_connections[c->id] = t;
+			}
+		}
+		s.requests             = all.requests;
+		s.bytes_in             = all.bytes_in;
+		s.bytes_out            = all.bytes_out;
+		s.requests_per_second  = per_second(all.requests,  last_totals.requests);
+		s.bytes_in_per_second  = per_second(all.bytes_in,  last_totals.bytes_in);
+		s.bytes_out_per_second = per_second(all.bytes_out, last_totals.bytes_out);
+		if(is_due) {
+			last_time   = now;
+			last_totals = all;
+		}
+		for(TimeSummary& z : zones) {
+			if(std::find(handler_names.begin(), handler_names.end(), z.name) != handler_names.end()) {
+				z.name.erase(0, std::string_view("handle::").size());
+				s.handlers.push_back(std::move(z));
+			}
+		}
+		return s;
+	}
+};
@@ -0,0 +1,566 @@
+#pragma once
+#include "client_server/FramedStream.hpp"
+#include "client_server/ServerStats.hpp"
+#include "socket/AnySocket.hpp"
+#include "socket/IoUring.hpp"
+#include "socket/PosixError.hpp"
+#include "util/name_this_thread.hpp"
+#include "util/Tracer.hpp"
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <concepts>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Servable::ready_in(request) tells how long handle(request) would block.
+template<typename Servable, typename Request>
+concept has_ready_in = requires(Servable& servable, Request const& request) {
+	{ servable.ready_in(request) } -> std::convertible_to<double>;
+};
+
+// Servable::journal(request) is called after handle(request), same thread.
+template<typename Servable, typename Request>
+concept has_journal = requires(Servable& servable, Request const& request) {
+	servable.journal(request);
+};
+
+// Single threaded, completion based server engine on io_uring.
+// Accept and recv are multishot, received data lands in a provided buffer
+// ring registered with the kernel. All requests of a completion batch are
+// handled, the responses of one connection go out in one send; the final
+// send of a closing connection is linked to its close.
+// Requests whose handle() would block (see has_ready_in) are parked on an
+// io_uring timeout instead of stalling the loop.
+// On shutdown every op still in flight is cancelled and its completion
+// reaped before connection memory, fds and buffers are released.
+template<typename Servable, typename Serializer, typename SBuffer, typename DBuffer>
+struct UringServer {
+	using command_set_t = typename Servable::CommandSet;
+	using request_t     = typename command_set_t::Request;
+	using response_t    = typename command_set_t::Response;
+	using stream_t      = FramedStream<Serializer, SBuffer, DBuffer>;
+
+	static constexpr unsigned ring_entries = 4096;
+	static constexpr unsigned buffer_count = 1024;
+	static constexpr unsigned buffer_size  = 16384;
+	static constexpr uint16_t buffer_group = 0;
+
+	enum Op : uint8_t {
+		  ACCEPT
+		, RECV
+		, SEND
+		, CLOSE
+		, TIMEOUT
+		, WAKE
+		, CANCEL
+	};
+
+	struct Connection {
+		int                                 fd;
+		uint32_t                            generation;
+		stream_t                            stream;
+		std::vector<std::byte>              sending;
+		std::size_t                         sent           = 0;
+		bool                                is_receiving   = false;
+		bool                                is_sending     = false;
+		bool                                is_waiting     = false;
+		bool                                is_closing     = false;
+		bool                                is_close_armed = false;
+		bool                                is_dropped     = false;   // over a buffer limit
+		std::optional<request_t>            deferred;
+		__kernel_timespec                   timeout{};
+		std::shared_ptr<ConnectionCounters> counters;
+	};
+
+	Servable&                                     servable;
+	bool const                                    verbose;
+	IoUring                                       ring;
+	std::vector<std::unique_ptr<AnyServerSocket>> listeners;
+	std::vector<int>                              listener_fds;
+	std::vector<std::string>                      listener_names;
+	std::vector<std::unique_ptr<Connection>>      connections;
+	std::vector<uint32_t>                         free_slots;
+	uint32_t                                      next_generation = 0;
+	int                                           wake_fd         = -1;
+	uint64_t                                      wake_value      = 0;
+	uint64_t                                      messages        = 0;
+	uint64_t                                      in_flight       = 0;   // ops without their final completion
+	std::atomic<bool>                             _is_running{true};
+	std::thread                                   thread;
+
+	// throws PosixError, if io_uring or one of the ops is not available
+	UringServer(Servable& servable, std::vector<Endpoint> const& endpoints, bool verbose = false)
+		: servable(servable)
+		, verbose(verbose)
+		, ring(ring_entries)
+	{
+		if(!ring.supports({
+			  IORING_OP_ACCEPT
+			, IORING_OP_RECV
+			, IORING_OP_SEND
+			, IORING_OP_CLOSE
+			, IORING_OP_TIMEOUT
+			, IORING_OP_READ
+			, IORING_OP_ASYNC_CANCEL
+		})) {
+			throw PosixError("io_uring lacks required ops", ENOTSUP);
+		}
+		ring.register_buffer_ring(buffer_group, buffer_count, buffer_size);
+		probe_multishot_recv();
+		for(Endpoint const& endpoint : endpoints) {
+			listeners.push_back(std::make_unique<AnyServerSocket>(endpoint));
+			std::optional<int> fd = listeners.back()->native_handle();
+			if(!fd) {
+				throw PosixError("io_uring can't serve " + endpoint.to_string(), ENOTSUP);
+			}
+			listener_fds.push_back(*fd);
+			listener_names.push_back(endpoint.to_string());
+		}
+		errno = 0;
+		wake_fd = ::eventfd(0, EFD_CLOEXEC);
+		if(wake_fd == -1) {
+			throw PosixError("Can't create eventfd", errno);
+		}
+		thread = std::thread(&UringServer::run, this);
+	}
+	UringServer(UringServer const&) = delete;
+	UringServer& operator=(UringServer const&) = delete;
+
+	// Multishot recv came with Linux 6.0, the buffer ring and multishot
+	// accept with 5.19. Kernels in between fail every recv with EINVAL,
+	// so one is tried on a socketpair before serving.
+	void probe_multishot_recv() {
+		int fds[2];
+		errno = 0;
+		if(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1) {
+			throw PosixError("Can't create socketpair", errno);
+		}
+		char byte = 0;
+		[[maybe_unused]] auto w = ::write(fds[1], &byte, sizeof(byte));
+		io_uring_sqe* s = ring.get_sqe();
+		s->opcode    = IORING_OP_RECV;
+		s->fd        = fds[0];
+		s->ioprio    = IORING_RECV_MULTISHOT;
+		s->flags     = IOSQE_BUFFER_SELECT;
+		s->buf_group = buffer_group;
+		bool is_supported = false;
+		bool is_done      = false;
+		while(!is_done) {
+			ring.commit_buffers();
+			ring.submit(1);
+			ring.for_each_cqe([&](io_uring_cqe const& cqe) {
+				if(cqe.flags & IORING_CQE_F_BUFFER) {
+					ring.recycle_buffer(static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+				}
+				is_supported = is_supported || cqe.res > 0;
+				if(cqe.flags & IORING_CQE_F_MORE) {
+					// still armed, the end of the stream completes it
+					::shutdown(fds[1], SHUT_WR);
+				} else {
+					is_done = true;
+				}
+			});
+		}
+		ring.commit_buffers();
+		::close(fds[0]);
+		::close(fds[1]);
+		if(!is_supported) {
+			throw PosixError("io_uring lacks multishot recv", ENOTSUP);
+		}
+	}
+	~UringServer() {
+		_is_running = false;
+		uint64_t one = 1;
+		[[maybe_unused]] auto r = ::write(wake_fd, &one, sizeof(one));
+		if(thread.joinable()) {
+			thread.join();
+		}
+		for(auto& c : connections) {
+			if(!c) {
+				continue;
+			}
+			if(!c->is_close_armed) {
+				::close(c->fd);
+			}
+			ServerStats::global().disconnect(c->counters);
+		}
+		::close(wake_fd);
+	}
+
+	static uint64_t user_data(Op op, uint32_t slot, uint32_t generation) {
+		return (uint64_t{op} << 56) | (uint64_t{generation} << 24) | slot;
+	}
+
+	io_uring_sqe* sqe(Op op, uint32_t slot, uint32_t generation) {
+		io_uring_sqe* s = ring.get_sqe();
+		while(!s) {
+			ring.submit();
+			s = ring.get_sqe();
+		}
+		s->user_data = user_data(op, slot, generation);
+		++in_flight;
+		return s;
+	}
+
+	void arm_accept(uint32_t listener) {
+		io_uring_sqe* s = sqe(ACCEPT, listener, 0);
+		s->opcode       = IORING_OP_ACCEPT;
+		s->fd           = listener_fds[listener];
+		s->ioprio       = IORING_ACCEPT_MULTISHOT;
+		s->accept_flags = SOCK_CLOEXEC;
+	}
+
+	void arm_wake() {
+		io_uring_sqe* s = sqe(WAKE, 0, 0);
+		s->opcode = IORING_OP_READ;
+		s->fd     = wake_fd;
+		s->addr   = reinterpret_cast<uint64_t>(&wake_value);
+		s->len    = sizeof(wake_value);
+		s->off    = static_cast<uint64_t>(-1);
+	}
+
+	void arm_recv(uint32_t slot, Connection& c) {
+		io_uring_sqe* s = sqe(RECV, slot, c.generation);
+		s->opcode    = IORING_OP_RECV;
+		s->fd        = c.fd;
+		s->ioprio    = IORING_RECV_MULTISHOT;
+		s->flags     = IOSQE_BUFFER_SELECT;
+		s->buf_group = buffer_group;
+		c.is_receiving = true;
+	}
+
+	void arm_timeout(uint32_t slot, Connection& c, double seconds) {
+		double integral;
+		c.timeout.tv_nsec = static_cast<long long>(std::modf(seconds, &integral) * 1e9);
+		c.timeout.tv_sec  = static_cast<long long>(integral);
+		io_uring_sqe* s = sqe(TIMEOUT, slot, c.generation);
+		s->opcode = IORING_OP_TIMEOUT;
+		s->addr   = reinterpret_cast<uint64_t>(&c.timeout);
+		s->len    = 1;
+		c.is_waiting = true;
+	}
+
+	void arm_close(uint32_t slot, Connection& c) {
+		io_uring_sqe* s = sqe(CLOSE, slot, c.generation);
+		s->opcode = IORING_OP_CLOSE;
+		s->fd     = c.fd;
+		c.is_close_armed = true;
+	}
+
+	bool is_finished(Connection const& c) const {
+		return c.is_closing && !c.is_receiving && !c.is_waiting;
+	}
+
+	void start_send(uint32_t slot, Connection& c) {
+		if(c.is_sending || c.is_close_armed || c.stream.pending() == 0) {
+			return;
+		}
+		c.sending.assign(c.stream.output(), c.stream.output() + c.stream.pending());
+		c.stream.clear_output();
+		c.sent = 0;
+		submit_send(slot, c);
+	}
+
+	void submit_send(uint32_t slot, Connection& c) {
+		io_uring_sqe* s = sqe(SEND, slot, c.generation);
+		s->opcode    = IORING_OP_SEND;
+		s->fd        = c.fd;
+		s->addr      = reinterpret_cast<uint64_t>(c.sending.data() + c.sent);
+		s->len       = static_cast<uint32_t>(c.sending.size() - c.sent);
+		s->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+		c.is_sending = true;
+		if(is_finished(c)) {
+			// last words: close right after the send, in the same submission
+			s->flags |= IOSQE_IO_LINK;
+			arm_close(slot, c);
+		}
+	}
+
+	void maybe_close(uint32_t slot, Connection& c) {
+		if(is_finished(c) && !c.is_sending && !c.is_close_armed) {
+			arm_close(slot, c);
+		}
+	}
+
+	double ready_in(request_t const& request) {
+		return std::visit(
+			[&](auto const& r) -> double {
+				if constexpr(has_ready_in<Servable, std::decay_t<decltype(r)>>) {
+					return servable.ready_in(r);
+				} else {
+					return 0.0;
+				}
+			}
+			, request.request
+		);
+	}
+
+	// stop reading, the pending recv completes with 0 and the close follows
+	void drop(Connection& c, std::runtime_error const& e) {
+		std::cerr << "UringServer: dropping connection: " << e.what() << '\n';
+		c.is_dropped = true;
+		c.is_closing = true;
+		c.deferred.reset();
+		::shutdown(c.fd, SHUT_RDWR);
+	}
+
+	void dispatch(uint32_t slot, Connection& c) {
+		try {
+			handle_requests(slot, c);
+		} catch(BufferLimitError const& e) {
+			drop(c, e);
+		} catch(ProtocolError const& e) {
+			drop(c, e);
+		}
+		start_send(slot, c);
+		c.counters->update(c.stream.stats());
+	}
+
+	void handle_requests(uint32_t slot, Connection& c) {
+		while(!c.is_waiting && !c.is_dropped) {
+			std::optional<request_t> request;
+			bool was_deferred = false;
+			if(c.deferred) {
+				request.swap(c.deferred);
+				was_deferred = true;
+			} else if(c.stream.has_frame()) {
+				request = c.stream.template next<request_t>();
+				if(!request) {
+					break;
+				}
+			} else {
+				break;
+			}
+			// deferred once only, handle() covers whatever is left
+			if(!was_deferred) {
+				if(double wait = ready_in(*request); wait > 0.0) {
+					c.deferred = std::move(request);
+					arm_timeout(slot, c, wait);
+					break;
+				}
+			}
+			response_t response = std::visit(
+				[&](auto const& r)
+					-> response_t
+				{
+					using T = std::decay_t<decltype(r)>;
+					return ServerStats::time_handler<T>([&]() {
+						return response_t{ servable.handle(r) };
+					});
+				}
+				, request->request
+			);
+			if constexpr(has_journal<Servable, request_t>) {
+				servable.journal(*request);
+			}
+			c.stream.queue(response);
+			++messages;
+		}
+	}
+
+	Connection* find(uint32_t slot, uint32_t generation) {
+		if(slot >= connections.size() || !connections[slot] || connections[slot]->generation != generation) {
+			return nullptr;
+		}
+		return connections[slot].get();
+	}
+
+	void on_accept(io_uring_cqe const& cqe, uint32_t listener) {
+		if(!(cqe.flags & IORING_CQE_F_MORE) && _is_running) {
+			arm_accept(listener);
+		}
+		if(cqe.res < 0) {
+			if(verbose) {
+				std::cerr << "UringServer: accept: " << std::strerror(-cqe.res) << '\n';
+			}
+			return;
+		}
+		uint32_t slot;
+		if(free_slots.empty()) {
+			slot = static_cast<uint32_t>(connections.size());
+			connections.emplace_back();
+		} else {
+			slot = free_slots.back();
+			free_slots.pop_back();
+		}
+		connections[slot] = std::make_unique<Connection>();
+		Connection& c = *connections[slot];
+		c.fd         = cqe.res;
+		c.generation = ++next_generation;
+		c.counters   = ServerStats::global().connect(listener_names[listener]);
+		arm_recv(slot, c);
+		if(verbose) {
+			std::cerr << "Client connected...\n";
+		}
+	}
+
+	void on_recv(io_uring_cqe const& cqe, uint32_t slot, Connection& c) {
+		if(cqe.flags & IORING_CQE_F_BUFFER) {
+			uint16_t id = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+			if(cqe.res > 0 && !c.is_dropped) {
+				try {
+					c.stream.append(ring.buffer(id), static_cast<std::size_t>(cqe.res));
+				} catch(BufferLimitError const& e) {
+					drop(c, e);
+				}
+			}
+			ring.recycle_buffer(id);
+		}
+		if(!(cqe.flags & IORING_CQE_F_MORE)) {
+			c.is_receiving = false;
+			if(cqe.res == -ENOBUFS) {
+				arm_recv(slot, c);
+			} else if(cqe.res <= 0) {
+				c.is_closing = true;
+			} else {
+				arm_recv(slot, c);
+			}
+		}
+		dispatch(slot, c);
+		maybe_close(slot, c);
+	}
+
+	void on_send(io_uring_cqe const& cqe, uint32_t slot, Connection& c) {
+		c.is_sending = false;
+		if(cqe.res < 0) {
+			c.is_closing = true;
+			c.stream.clear_output();
+		} else {
+			c.sent += static_cast<std::size_t>(cqe.res);
+			if(c.sent < c.sending.size() && !c.is_close_armed) {
+				submit_send(slot, c);
+				return;
+			}
+			start_send(slot, c);
+		}
+		maybe_close(slot, c);
+	}
+
+	void on_close(io_uring_cqe const& cqe, uint32_t slot, Connection& c) {
+		// a broken link chain cancels the close
+		if(cqe.res == -ECANCELED) {
+			::close(c.fd);
+		}
+		if(verbose) {
+			std::cerr << "UringServer: connection closed, " << c.stream.stats() << '\n';
+		}
+		c.counters->update(c.stream.stats());
+		ServerStats::global().disconnect(c.counters);
+		connections[slot].reset();
+		free_slots.push_back(slot);
+	}
+
+	void on_cqe(io_uring_cqe const& cqe) {
+		Op       op         = static_cast<Op>(cqe.user_data >> 56);
+		uint32_t generation = static_cast<uint32_t>(cqe.user_data >> 24);
+		uint32_t slot       = static_cast<uint32_t>(cqe.user_data & 0xffffff);
+		if(!(cqe.flags & IORING_CQE_F_MORE)) {
+			--in_flight;
+		}
+		if(!_is_running) {
+			// draining: only closes still need their bookkeeping
+			if(op == CLOSE) {
+				if(Connection* c = find(slot, generation)) {
+					on_close(cqe, slot, *c);
+				}
+			}
+			return;
+		}
+		if(op == WAKE) {
+			if(_is_running) {
+				arm_wake();
+			}
+			return;
+		}
+		if(op == ACCEPT) {
+			on_accept(cqe, slot);
+			return;
+		}
+		Connection* c = find(slot, generation);
+		if(!c) {
+			// completion of a connection that is gone, just hand the buffer back
+			if(cqe.flags & IORING_CQE_F_BUFFER) {
+				ring.recycle_buffer(static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+			}
+			return;
+		}
+		switch(op) {
+			case RECV:
+				on_recv(cqe, slot, *c);
+				break;
+			case SEND:
+				on_send(cqe, slot, *c);
+				break;
+			case TIMEOUT:
+				c->is_waiting = false;
+				dispatch(slot, *c);
+				maybe_close(slot, *c);
+				break;
+			case CLOSE:
+				on_close(cqe, slot, *c);
+				break;
+			default:
+				break;
+		}
+	}
+
+	// Pending recvs write into the provided buffers, sends read from
+	// Connection::sending and timeouts from Connection::timeout. Cancel all
+	// of them and wait for their completions, so nothing is freed under the
+	// kernel's hands.
+	void drain() {
+		_is_running = false;
+		io_uring_sqe* s = sqe(CANCEL, 0, 0);
+		s->opcode       = IORING_OP_ASYNC_CANCEL;
+		s->cancel_flags = IORING_ASYNC_CANCEL_ANY | IORING_ASYNC_CANCEL_ALL;
+		while(in_flight > 0) {
+			ring.submit(1);
+			ring.for_each_cqe([&](io_uring_cqe const& cqe) {
+				on_cqe(cqe);
+			});
+		}
+	}
+
+	void run() {
+		name_this_thread("UringServer");
+		if(verbose) {
+			std::cerr << "UringServer started...\n";
+		}
+		for(uint32_t i = 0; i < listener_fds.size(); ++i) {
+			arm_accept(i);
+		}
+		arm_wake();
+		try {
+			while(_is_running) {
+				ring.commit_buffers();
+				ring.submit(1);
+				ring.for_each_cqe([&](io_uring_cqe const& cqe) {
+					on_cqe(cqe);
+				});
+			}
+		} catch(PosixError const& e) {
+			std::cerr << e.what() << '\n';
+		}
+		try {
+			drain();
+		} catch(PosixError const& e) {
+			std::cerr << e.what() << '\n';
+		}
+		if(verbose) {
+			std::cerr
+				<< "UringServer done: " << messages << " messages, "
+				<< ring.enter_calls() << " io_uring_enter calls\n"
+			;
+		}
+	}
+};
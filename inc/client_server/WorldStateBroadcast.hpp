@@ -0,0 +1,295 @@
+#pragma once
+#include "client_server/BufferPool.hpp"
+#include "socket/UDP_Socket.hpp"
+#include "socket/Address.hpp"
+#include "util/SynchronizedQueue.hpp"
+#include "util/name_this_thread.hpp"
+#include "util/time_this.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Connectionless world state stream for spectators: the simulator sends one
+// serialized snapshot per vision tick to a multicast group, any number of
+// observers join the group and reassemble it. Nothing of this touches the
+// command server.
+//
+// A snapshot larger than one datagram is split into fragments, every
+// datagram starts with a WorldStateFragmentHeader. Fragments of one frame
+// share the sequence number, a frame is complete once all fragment_count
+// fragments arrived. Lost fragments are not repeated, the receiver drops
+// the incomplete frame as soon as the next one starts. A sequence far behind
+// the current one means the sender restarted, the receiver follows it.
+struct WorldStateFragmentHeader {
+	constexpr static uint32_t    magic_value   = 0x524f4257;   // "WBOR"
+	// stays below the usual ethernet MTU, no ip fragmentation
+	constexpr static std::size_t datagram_size = 1400;
+
+	uint32_t magic;
+	uint32_t sequence;
+	uint16_t fragment_index;
+	uint16_t fragment_count;
+	uint32_t frame_size;
+};
+static_assert(std::is_trivially_copyable_v<WorldStateFragmentHeader>);
+static_assert(sizeof(WorldStateFragmentHeader) == 16);
+
+struct WorldStateStreamStats {
+	uint64_t datagrams       = 0;
+	uint64_t bytes           = 0;
+	uint64_t frames          = 0;
+	uint64_t frames_dropped  = 0;   // receiver: incomplete or broken frames, bad headers
+	uint64_t frames_too_big  = 0;   // sender: more than 65535 fragments
+
+	friend std::ostream& operator<<(std::ostream& os, WorldStateStreamStats const& s) {
+		return os
+			<< "frames "            << s.frames
+			<< ", dropped "         << s.frames_dropped
+			<< ", datagrams "       << s.datagrams
+			<< ", bytes "           << s.bytes
+		;
+	}
+};
+
+template<typename Serializer, typename SBuffer>
+class WorldStateBroadcaster {
+private:
+	constexpr static std::size_t payload_size = WorldStateFragmentHeader::datagram_size - sizeof(WorldStateFragmentHeader);
+
+	UDP_Socket             socket;
+	Address                group;
+	SBuffer                sbuffer;
+	std::vector<std::byte> datagram;
+	uint32_t               sequence = 0;
+	WorldStateStreamStats  _stats;
+
+public:
+	WorldStateBroadcaster(std::string const& group, int port, int ttl)
+		: group{group, port}
+		, datagram(WorldStateFragmentHeader::datagram_size)
+	{
+		socket.set_multicast_ttl(ttl);
+		socket.enable_multicast_loop(true);
+	}
+
+	WorldStateStreamStats const& stats() const {
+		return _stats;
+	}
+
+	// serializes the snapshot and sends all its fragments,
+	// returns false if it could not be serialized or is too big
+	template<typename State>
+	bool publish(State const& state) {
+		sbuffer.reset();
+		if(!Serializer::serialize(sbuffer, state)) {
+			return false;
+		}
+		std::size_t size  = sbuffer.count();
+		std::size_t count = std::max<std::size_t>(1, (size + payload_size - 1) / payload_size);
+		if(count > UINT16_MAX) {
+			++_stats.frames_too_big;
+			return false;
+		}
+		WorldStateFragmentHeader header{
+			  WorldStateFragmentHeader::magic_value
+			, sequence++
+			, 0
+			, static_cast<uint16_t>(count)
+			, static_cast<uint32_t>(size)
+		};
+		auto const* data = reinterpret_cast<std::byte const*>(sbuffer.data());
+		for(std::size_t i = 0; i < count; ++i) {
+			std::size_t offset = i * payload_size;
+			std::size_t n      = std::min(payload_size, size - offset);
+			header.fragment_index = static_cast<uint16_t>(i);
+			std::memcpy(datagram.data(), &header, sizeof(header));
+			std::memcpy(datagram.data() + sizeof(header), data + offset, n);
+			socket.sendto(group, datagram.data(), sizeof(header) + n);
+			++_stats.datagrams;
+			_stats.bytes += sizeof(header) + n;
+		}
+		++_stats.frames;
+		return true;
+	}
+};
+
+// Keeps serializing and sending off the sim loop: it hands snapshots over,
+// a thread of the publisher broadcasts them. A snapshot still waiting when
+// the next one arrives is replaced by it. After a send failed the
+// publisher stops and takes no more snapshots.
+template<typename Serializer, typename SBuffer, typename State>
+class WorldStatePublisher {
+private:
+	WorldStateBroadcaster<Serializer, SBuffer>       broadcaster;
+	SynchronizedQueue<std::unique_ptr<State const>>  states;
+	std::atomic<bool>                                _is_failed{false};
+	std::atomic<uint64_t>                            _replaced{0};
+	std::thread                                      thread;
+
+	void run() {
+		name_this_thread("broadcast");
+		while(auto state = states.pop()) {
+			try {
+				time_this<"broadcast">([&]() {broadcaster.publish(**state);});
+			} catch(PosixError const& e) {
+				std::cerr << "world state broadcast disabled: " << e.what() << std::endl;
+				_is_failed = true;
+				states.stop();
+			}
+		}
+	}
+
+public:
+	WorldStatePublisher(std::string const& group, int port, int ttl)
+		: broadcaster{group, port, ttl}
+		, thread{[this]{ run(); }}
+	{}
+	WorldStatePublisher(WorldStatePublisher const&) = delete;
+	WorldStatePublisher& operator=(WorldStatePublisher const&) = delete;
+	// sends what is queued, then stops
+	~WorldStatePublisher() {
+		states.stop();
+		thread.join();
+	}
+
+	// false once broadcasting failed
+	bool publish(std::unique_ptr<State const> state) {
+		if(_is_failed) {
+			return false;
+		}
+		_replaced += states.push_latest(std::move(state), 1);
+		return true;
+	}
+	// snapshots replaced before they were sent
+	uint64_t replaced() const {
+		return _replaced;
+	}
+};
+
+// Observer side: joins the group and hands out complete snapshots.
+// Several receivers on one host may listen to the same group and port.
+template<typename Serializer, typename DBuffer>
+class WorldStateReceiver {
+private:
+	using clock_t = std::chrono::steady_clock;
+	constexpr static std::size_t payload_size = WorldStateFragmentHeader::datagram_size - sizeof(WorldStateFragmentHeader);
+	// frames a fragment may lag behind before it counts as a restarted sender
+	constexpr static int32_t     resync_window = 1024;
+
+	UDP_Socket             socket;
+	DBuffer                dbuffer;
+	std::vector<std::byte> datagram;
+	std::vector<std::byte> frame;
+	std::vector<bool>      received;
+	std::size_t            missing  = 0;
+	std::optional<uint32_t> sequence;
+	WorldStateStreamStats  _stats;
+
+	// the sizes come from the network, checked before anything is allocated
+	static bool is_plausible(WorldStateFragmentHeader const& header) {
+		std::size_t count = header.fragment_count;
+		std::size_t size  = header.frame_size;
+		return size <= BufferPool::global().limits().max_frame_size
+			&& size <= count * payload_size
+			&& (count == 1 || size > (count - 1) * payload_size)
+		;
+	}
+
+	void start_frame(WorldStateFragmentHeader const& header) {
+		if(sequence && missing != 0) {
+			++_stats.frames_dropped;
+		}
+		sequence = header.sequence;
+		frame.resize(header.frame_size);
+		received.assign(header.fragment_count, false);
+		missing = header.fragment_count;
+	}
+
+	// true, if the datagram completed the current frame
+	bool add(std::size_t size) {
+		if(size < sizeof(WorldStateFragmentHeader)) {
+			return false;
+		}
+		WorldStateFragmentHeader header;
+		std::memcpy(&header, datagram.data(), sizeof(header));
+		if(header.magic != WorldStateFragmentHeader::magic_value || header.fragment_index >= header.fragment_count) {
+			return false;
+		}
+		int32_t ahead = sequence ? static_cast<int32_t>(header.sequence - *sequence) : 1;
+		if(ahead > 0 || ahead <= -resync_window) {
+			if(!is_plausible(header)) {
+				++_stats.frames_dropped;
+				return false;
+			}
+			start_frame(header);
+		} else if(header.sequence != *sequence) {
+			// late fragment of a frame already given up
+			return false;
+		}
+		if(header.frame_size != frame.size() || header.fragment_count != received.size()) {
+			return false;
+		}
+		std::size_t offset = std::size_t{header.fragment_index} * payload_size;
+		std::size_t n      = size - sizeof(header);
+		if(received[header.fragment_index] || offset + n > frame.size()) {
+			return false;
+		}
+		std::memcpy(frame.data() + offset, datagram.data() + sizeof(header), n);
+		received[header.fragment_index] = true;
+		return --missing == 0;
+	}
+
+public:
+	WorldStateReceiver(std::string const& group, int port)
+		: datagram(WorldStateFragmentHeader::datagram_size)
+	{
+		socket.enable_reuse_address(true);
+		socket.bind(port);
+		socket.join_multicast_group(group);
+	}
+
+	WorldStateStreamStats const& stats() const {
+		return _stats;
+	}
+
+	// waits up to timeout_seconds for the next complete snapshot
+	template<typename State>
+	std::optional<State> receive(double timeout_seconds) {
+		auto deadline = clock_t::now() + std::chrono::duration_cast<clock_t::duration>(
+			std::chrono::duration<double>(timeout_seconds)
+		);
+		while(true) {
+			auto left = std::chrono::duration_cast<std::chrono::microseconds>(deadline - clock_t::now()).count();
+			if(left <= 0 || !socket.can_read(left / 1000000, static_cast<int>(left % 1000000))) {
+				return {};
+			}
+			Address src;
+			uint64_t size = socket.recvfrom(src, datagram.data(), datagram.size());
+			++_stats.datagrams;
+			_stats.bytes += size;
+			if(!add(size)) {
+				continue;
+			}
+			dbuffer.reset(frame.size());
+			std::memcpy(dbuffer.data(), frame.data(), frame.size());
+			State state;
+			if(!Serializer::deserialize(dbuffer, state)) {
+				++_stats.frames_dropped;
+				continue;
+			}
+			++_stats.frames;
+			return state;
+		}
+	}
+};
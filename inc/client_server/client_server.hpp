@@ -1,7 +1,9 @@
 #pragma once
 #include "util/name_this_thread.hpp"
-#include "util/time_this.hpp"
-#include "socket/TCP_Socket.hpp"
+#include "socket/AnySocket.hpp"
+#include "FramedStream.hpp"
+#include "ServerStats.hpp"
+#include "UringServer.hpp"
 #include "make_command_set.hpp"
 #include <algorithm>
 #include <iostream>
@@ -11,115 +13,20 @@
 #include <string_view>
 #include <vector>
 #include <optional>
+#include <memory>
 #include <cstdlib>
 
-struct Bench {
-	using clock_t = std::chrono::steady_clock;
-	std::string_view name;
-	clock_t::time_point start;
-	uint64_t bytes;
-	uint64_t packets;
-	std::mutex mutex;
-	
-	Bench(std::string_view name)
-		: name(name)
-		, start(clock_t::now())
-		, bytes(0)
-		, packets(0)
-	{}
-	
-	void add(uint64_t bytes) {
-		std::lock_guard<std::mutex> lock(mutex);
-		this->bytes += bytes;
-		++packets;
-	}
-	
-	~Bench() {
-		auto print = [&](double value, std::string_view what) {
-			char si_prefix[] = {' ', 'k', 'M', 'G', 'T'};
-			std::cerr << "Bench: " << name << ": ";
-			std::size_t p = 0;
-			while(p < std::size(si_prefix) && value > 1024)  {
-				++p;
-				value /= 1024;
-			}
-			std::cerr << value << ' ' << si_prefix[p] << what << '\n';
-		};
-		
-		std::chrono::duration<double> d(clock_t::now() - start);
-		double bytes_per_second   = bytes / d.count();
-		double bytes_per_packet   = (double)bytes / (double)packets;
-		double packets_per_second = packets / d.count();
-		print(bytes_per_second,  "Bytes/s");
-		print(bytes_per_packet,  "Bytes/Packet");
-		print(packets_per_second,"Packets/s");
-	}
-};
-
-static constexpr bool do_socket_bench = true;
-
-template<typename Serializer, typename SBuffer, typename Socket, typename Message>
-bool send(Socket& socket, SBuffer& buffer, Message const& message) {
-	return time_this("send", [&]() {
-		//std::cout << "SEND\n";
-		buffer.reset();
-		uint64_t size = 0;
-		if(!Serializer::serialize(buffer, size, message)) {
-			return false;
-		}
-		size = buffer.count();
-		buffer.count() = 0;
-		if(!Serializer::serialize(buffer, size)) {
-			return false;
-		}
-		buffer.count() = size;
-		socket.send(buffer.data(), buffer.count());
-		if constexpr(do_socket_bench) {
-			static Bench bench("send");
-			bench.add(size);
-		}
-		return true;
-	});
-}
-
-template<typename Serializer, typename Message, typename DBuffer, typename Socket>
-std::optional<Message> receive(Socket& socket, DBuffer& buffer) {
-	return time_this("receive", [&]() -> std::optional<Message> {
-		//std::cout << "RECEIVE\n";
-		buffer.reset(sizeof(uint64_t));
-		if(socket.peek(buffer.data(), sizeof(uint64_t)) != sizeof(uint64_t)) {
-			return {};
-		}
-		uint64_t size;
-		if(!Serializer::deserialize(buffer, size)) {
-			return {};
-		}
-		buffer.reset(size);
-		if(socket.recv_exact(buffer.data(), size) != size) {
-			return {};
-		}
-		if constexpr(do_socket_bench) {
-			static Bench bench("recv");
-			bench.add(size);
-		}
-		Message message;
-		if(Serializer::deserialize(buffer, size, message)) {
-			return message;
-		}
-		return {};
-	});
-}
-
 template<typename Servable, typename Serializer, typename SBuffer, typename DBuffer>
 struct Servlet {
 	using command_set_t = typename Servable::CommandSet;
-	Servable&   servable;
-	TCP_Socket  socket;
-	std::mutex  mutex;
-	bool        _is_done;
-	bool        _is_running;
-	bool const  verbose;
-	std::thread thread;
+	Servable&                           servable;
+	AnySocket                           socket;
+	std::shared_ptr<ConnectionCounters> counters;
+	std::mutex                          mutex;
+	bool                                _is_done;
+	bool                                _is_running;
+	bool const                          verbose;
+	std::thread                         thread;
 	
 	Servlet(Servlet const&) = delete;
 	Servlet& operator=(Servlet const&) = delete;
@@ -163,73 +70,127 @@ struct Servlet {
 		if(verbose) {
 			std::cerr << "Servlet started...\n";
 		}
-		SBuffer sbuffer;
-		DBuffer dbuffer;
+		FramedStream<Serializer, SBuffer, DBuffer> stream;
 		while(is_running()) {
 			try {
 				{
 					long timeout_secs = 0;
 					int timeout_usecs = 100000;
-					if(!socket.can_read(timeout_secs, timeout_usecs)) {
+					if(!stream.can_read(socket, timeout_secs, timeout_usecs)) {
 						continue;
 					}
 				}
-				using request_t = typename command_set_t::Request;
-				std::optional<request_t> request = receive<Serializer, request_t>(
-					socket, dbuffer
-				);
-				if(!request) {
+				if(!stream.fill(socket)) {
 					if(verbose) {
 						std::cerr << "Servlet: No requests available\n";
 					}
 					break;
 				}
+				// answer every request of this read, then send all responses at once
+				using request_t  = typename command_set_t::Request;
 				using response_t = typename command_set_t::Response;
-				response_t response = std::visit(
-					[&](auto const& r) 
-						-> response_t
-					{
-						return response_t{ servable.handle(r) };
+				while(stream.has_frame()) {
+					std::optional<request_t> request = stream.template next<request_t>();
+					if(!request) {
+						break;
 					}
-					, request->request
-				);
-				if(!send<Serializer>(socket, sbuffer, response)) {
-					continue;
+					response_t response = std::visit(
+						[&](auto const& r) 
+							-> response_t
+						{
+							using T = std::decay_t<decltype(r)>;
+							return ServerStats::time_handler<T>([&]() {
+								return response_t{ servable.handle(r) };
+							});
+						}
+						, request->request
+					);
+					if constexpr(has_journal<Servable, request_t>) {
+						servable.journal(*request);
+					}
+					stream.queue(response);
 				}
+				stream.flush(socket);
+				counters->update(stream.stats());
 			} catch(PosixError const& e) {
 				std::cerr << e.what() << '\n';
 				break;
+			} catch(BufferLimitError const& e) {
+				std::cerr << "Servlet: dropping connection: " << e.what() << '\n';
+				break;
+			} catch(ProtocolError const& e) {
+				std::cerr << "Servlet: dropping connection: " << e.what() << '\n';
+				break;
 			}
 		}
+		counters->update(stream.stats());
+		ServerStats::global().disconnect(counters);
 		if(verbose) {
-			std::cerr << "Servlet done...\n";
+			std::cerr << "Servlet done: " << stream.stats() << '\n';
 		}
 		std::lock_guard<std::mutex> lock(mutex);
 		_is_done = true;
 	}
 };
 
+enum class ServerEngine {
+	  THREADS   // one Servlet thread per connection
+	, URING     // UringServer for socket endpoints, falls back to THREADS
+};
+
 template<typename Servable, typename Serializer, typename SBuffer, typename DBuffer>
 struct Server {
 	using command_set_t = typename Servable::CommandSet;
 	using servlet_t     = Servlet<Servable, Serializer, SBuffer, DBuffer>;
+	using uring_t       = UringServer<Servable, Serializer, SBuffer, DBuffer>;
 	Servable&                               servable;
 	std::mutex                              mutex;
 	bool                                    _is_running;
 	bool const                              verbose;
 	std::vector<std::unique_ptr<servlet_t>> servlets;
-	std::thread                             thread;
+	std::vector<std::thread>                threads;
+	std::unique_ptr<uring_t>                uring;
 	
 	Server(Servable& servable, int port, bool verbose = false)
+		: Server(servable, std::vector<Endpoint>{Endpoint{Endpoint::Transport::TCP, "", port, ""}}, verbose)
+	{}
+	// one accepting thread per endpoint, all sharing the same servable
+	Server(
+		  Servable&                    servable
+		, std::vector<Endpoint> const& endpoints
+		, bool                         verbose = false
+		, ServerEngine                 engine  = ServerEngine::THREADS
+	)
 		: servable(servable)
 		, _is_running(true)
 		, verbose(verbose)
-		, thread(&Server::run, this, port)
-	{}
+	{
+		std::vector<Endpoint> thread_endpoints = endpoints;
+		if(engine == ServerEngine::URING) {
+			std::vector<Endpoint> uring_endpoints;
+			thread_endpoints.clear();
+			for(Endpoint const& endpoint : endpoints) {
+				(endpoint.transport == Endpoint::Transport::SHM ? thread_endpoints : uring_endpoints)
+					.push_back(endpoint);
+			}
+			try {
+				uring = std::make_unique<uring_t>(servable, uring_endpoints, verbose);
+			} catch(PosixError const& e) {
+				std::cerr << "io_uring engine not available, using threads: " << e.what() << '\n';
+				thread_endpoints = endpoints;
+			}
+		}
+		for(Endpoint const& endpoint : thread_endpoints) {
+			threads.emplace_back(&Server::run, this, endpoint);
+		}
+	}
 	~Server() {
 		set_stop();
-		if(thread.joinable()) {
-			thread.join();
+		uring.reset();
+		for(auto& thread : threads) {
+			if(thread.joinable()) {
+				thread.join();
+			}
 		}
 	}
 	void set_stop() {
@@ -243,12 +204,18 @@ struct Server {
 		std::lock_guard<std::mutex> lock(mutex);
 		return _is_running;
 	}
-	void run(int port) {
+	void run(Endpoint endpoint) {
 		name_this_thread("Server");
 		if(verbose) {
-			std::cerr << "Server started...\n";
+			std::cerr << "Server started on " << endpoint.to_string() << "...\n";
+		}
+		std::optional<AnyServerSocket> socket;
+		try {
+			socket.emplace(endpoint);
+		} catch (PosixError const& e) {
+			std::cerr << endpoint.to_string() << ": " << e.what() << '\n';
+			return;
 		}
-		TCP_ServerSocket socket(port, true);
 		while(is_running()) {
 			{
 				std::lock_guard<std::mutex> lock(mutex);
@@ -266,20 +233,26 @@ struct Server {
 			try {
 				long timeout_secs = 0;
 				int timeout_usecs = 100000;
-				if(!socket.can_read(timeout_secs, timeout_usecs)) {
+				if(!socket->can_read(timeout_secs, timeout_usecs)) {
 					continue;
 				}
-				{
-					std::lock_guard<std::mutex> lock(mutex);
-					servlets.push_back(
-						std::make_unique<servlet_t>(servable, verbose)
-					);
-				}
-				socket.accept(servlets.back()->socket);
+				auto servlet = std::make_unique<servlet_t>(servable, verbose);
+				socket->accept(servlet->socket);
+				servlet->counters = ServerStats::global().connect(endpoint.to_string());
 				if(verbose) {
-					std::cerr << "Client connected...\n";
+					std::cerr << "Client connected";
+					if(auto credentials = servlet->socket.peer_credentials()) {
+						std::cerr
+							<< " (pid "  << credentials->pid
+							<< ", uid " << credentials->uid
+							<< ')'
+						;
+					}
+					std::cerr << "...\n";
 				}
-				servlets.back()->start();
+				servlet->start();
+				std::lock_guard<std::mutex> lock(mutex);
+				servlets.push_back(std::move(servlet));
 			} catch (PosixError const& e) {
 				std::cerr << e.what() << '\n';
 			}
@@ -290,18 +263,17 @@ struct Server {
 	}
 };
 
-
 template<typename CommandSet, typename Serializer, typename SBuffer, typename DBuffer>
 struct Client {
-	TCP_ClientSocket socket;
-	SBuffer sbuffer;
-	DBuffer dbuffer;
+	AnyClientSocket socket;
+	FramedStream<Serializer, SBuffer, DBuffer> stream;
 	
 	Client(Client const&) = delete;
 	Client& operator=(Client const&) = delete;
 	Client(Client&&) = default;
 	Client& operator=(Client&&) = default;
 	
+	// host: hostname or url, see Endpoint
 	Client(const std::string& host, int port)
 		: socket(host, port)
 	{}
@@ -325,24 +297,33 @@ struct Client {
 		std::exit(1);
 	}
 	
+	FramedStreamStats stats() const {
+		return stream.stats();
+	}
+	
 	std::optional<typename CommandSet::Response> _call(typename CommandSet::Request const& request) {
 		try {
-			if(!send<Serializer>(socket, sbuffer, request)) {
+			if(!stream.queue(request)) {
 				return {};
 			}
+			stream.flush(socket);
 			{
 				long timeout_secs = 10;
 				int timeout_usecs = 0;
-				if(!socket.can_read(timeout_secs, timeout_usecs)) {
+				if(!stream.can_read(socket, timeout_secs, timeout_usecs)) {
 					return {};
 				}
 			}
-			return receive<Serializer, typename CommandSet::Response>(
-				socket, dbuffer
-			);
+			return stream.template receive<typename CommandSet::Response>(socket);
 		} catch(PosixError const& e) {
 			std::cerr << e.what() << '\n';
 			return {};
+		} catch(BufferLimitError const& e) {
+			std::cerr << e.what() << '\n';
+			return {};
+		} catch(ProtocolError const& e) {
+			std::cerr << e.what() << '\n';
+			return {};
 		}
 	}
 };
@@ -0,0 +1,14 @@
+#pragma once
+#include <cstddef>
+
+namespace robo {
+namespace config {
+
+// command journal, enabled with --journal
+struct Journal {
+	// records waiting for the journal thread, more are dropped and counted
+	constexpr static std::size_t max_queued = std::size_t{1} << 16;
+};
+
+} /** namespace config */
+} /** namespace robo */
@@ -0,0 +1,21 @@
+#pragma once
+#include <cstdint>
+
+namespace robo {
+namespace config {
+
+// sim loop overload detection and shedding, see TickMonitor and --shed
+struct Overload {
+	// a tick is busy when its work takes more than this part of its period
+	constexpr static double   busy_load          = 0.9;
+	// busy or missed ticks in a row before shedding starts
+	constexpr static uint32_t enter_ticks        = 8;
+	// shedding stops after this many ticks in a row below leave_load
+	constexpr static double   leave_load         = 0.6;
+	constexpr static uint32_t leave_ticks        = 200;
+	// while shedding the world is published to the GUI once in this many ticks
+	constexpr static uint32_t gui_snapshot_every = 4;
+};
+
+} /** namespace config */
+} /** namespace robo */
@@ -0,0 +1,22 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+
+namespace robo {
+namespace config {
+
+// trajectory recording, enabled with --record
+struct Recorder {
+	// frames between sim thread and writer, a full ring drops frames
+	constexpr static std::size_t slots          = 16;
+	// writer wake up period, slots frames must fit in
+	constexpr static std::chrono::milliseconds poll_interval{2};
+	// robots a frame has room for at first, past that frames are dropped
+	// until the writer has grown the slots
+	constexpr static std::size_t initial_robots = 64;
+	// the output file grows by this much at a time
+	constexpr static std::size_t grow_bytes     = std::size_t{64} << 20;
+};
+
+} /** namespace config */
+} /** namespace robo */
@@ -0,0 +1,18 @@
+#pragma once
+#include <cstddef>
+
+namespace robo {
+namespace config {
+
+// limits of SimulateAheadCommand
+struct Rollout {
+	constexpr static std::size_t max_rollouts        = 32;
+	constexpr static std::size_t max_segments        = 256;
+	constexpr static double      max_duration        = 10.0;
+	constexpr static double      min_sample_interval = 1e-3;
+	// workers besides the requesting thread, shared by all requests
+	constexpr static std::size_t threads             = 3;
+};
+
+} /** namespace config */
+} /** namespace robo */
@@ -4,8 +4,16 @@ namespace robo {
 namespace config {
 	
 struct Simulator {
-	constexpr static int         default_port = 31114;
-	constexpr static char const* name         = "RoboPlayground";
+	constexpr static int         default_port      = 31114;
+	// shared memory transport, clients connect via "shm://robo_sim"
+	constexpr static char const* default_shm_name  = "robo_sim";
+	// unix domain socket, clients connect via "unix://@robo_sim"
+	constexpr static char const* default_unix_path = "@robo_sim";
+	// world state broadcast for spectators, enabled with --multicast
+	constexpr static char const* multicast_group   = "239.255.31.114";
+	constexpr static int         multicast_port    = 31115;
+	constexpr static int         multicast_ttl     = 1;
+	constexpr static char const* name              = "RoboPlayground";
 };
 
 } /** namespace config */
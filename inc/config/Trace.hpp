@@ -0,0 +1,16 @@
+#pragma once
+#include <cstddef>
+
+namespace robo {
+namespace config {
+
+// event tracing, enabled with --trace
+struct Trace {
+	// ring of the most recent events per thread, 24 bytes each
+	constexpr static std::size_t events_per_thread = std::size_t{1} << 15;
+	// rings of ended threads kept for the next dump, oldest go first
+	constexpr static std::size_t retired_threads   = 32;
+};
+
+} /** namespace config */
+} /** namespace robo */
@@ -0,0 +1,22 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+
+namespace robo {
+namespace config {
+
+struct Trajectory {
+	constexpr static std::size_t max_waypoints         = 4096;
+	// intermediate waypoints count as passed within this distance
+	constexpr static double      switch_distance       = 0.10;
+	constexpr static double      position_tolerance    = 0.01;
+	constexpr static double      orientation_tolerance = 1.0 * M_PI / 180.0;
+	// below these, the braking velocity falls off linearly instead of with sqrt
+	constexpr static double      slow_down_distance    = 0.25;
+	constexpr static double      slow_down_angle       = 25.0 * M_PI / 180.0;
+	// margin to the acceleration limits, so braking is not cut short
+	constexpr static double      braking_scale         = 0.9;
+};
+
+} /** namespace config */
+} /** namespace robo */
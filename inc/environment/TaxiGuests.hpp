@@ -15,6 +15,23 @@ struct TaxiGuests {
 		double                 phi_z = 0.0;
 		double                 height = 0.0;
 		std::optional<RobotId> bound_to_robot{};
+
+		template<typename Serializer, typename Buffer>
+		static auto serialize(Buffer& buffer, GuestState const& g)
+			-> bool
+		{
+			return Serializer::serialize(
+				buffer, g.position, g.rotation, g.target_position, g.score_on_arrival, g.done, g.phi_z, g.height, g.bound_to_robot
+			);
+		}
+		template<typename Serializer, typename Buffer>
+		static auto deserialize(Buffer& buffer, GuestState& g)
+			-> bool
+		{
+			return Serializer::deserialize(
+				buffer, g.position, g.rotation, g.target_position, g.score_on_arrival, g.done, g.phi_z, g.height, g.bound_to_robot
+			);
+		}
 	};
 	std::vector<GuestState> guests;
 	double                  time;
@@ -153,12 +153,15 @@ struct ObstacleSet {
 	constexpr static std::size_t                      grow_sectors     = 2;
 	constexpr static std::size_t                      cylinder_sectors = 12;
 	double                                            grow_radius;
-	std::vector<std::unique_ptr<ObstacleClass const>> geometries;
+	// immutable, copies of the set share the geometry
+	std::vector<std::shared_ptr<ObstacleClass const>> geometries;
 	std::map<Vertex<double,3>, class_id_t>            know_boxes;
 	std::map<Vertex<double,2>, class_id_t>            know_cylinders;
 	std::vector<class_id_t>                           class_lookup;
 	exchange_t                                        obstacles_inv;
 	exchange_t                                        obstacles;
+	// changes with every obstacle added, moved or cleared
+	uint64_t                                          version = 0;
 
 	template<typename Accessor>
 	struct View {
@@ -283,7 +286,7 @@ struct ObstacleSet {
 		auto it = know_boxes.find(key);
 		if(it == know_boxes.end()) {
 			geometries.push_back(
-				std::make_unique<ObstacleClass>(
+				std::make_shared<ObstacleClass>(
 					  make_simple_cube<      true, false>(length_x, length_y, length_z)
 					, make_simple_grown_cube<true, false>(length_x, length_y, length_z, grow_radius, grow_stacks, grow_sectors)
 				)
@@ -301,7 +304,7 @@ struct ObstacleSet {
 		key_t key{radius, height};
 		auto it = know_cylinders.find(key);
 		if(it == know_cylinders.end()) {
-			geometries.push_back(std::make_unique<ObstacleClass>(
+			geometries.push_back(std::make_shared<ObstacleClass>(
 				  make_simple_cylinder<      true, false>(radius, -height / 2.0, height / 2.0             , cylinder_sectors, true, true)
 				, make_simple_grown_cylinder<true, false>(radius, -height / 2.0, height / 2.0, grow_radius, cylinder_sectors, grow_stacks)
 			));
@@ -312,6 +315,17 @@ struct ObstacleSet {
 		return it->second;
 	}
 
+	auto is_cylinder_class(class_id_t class_id) const
+		-> bool
+	{
+		for(auto const& p : know_cylinders) {
+			if(p.second == class_id) {
+				return true;
+			}
+		}
+		return false;
+	}
+
 	auto add_obstacle(class_id_t class_id, Transform const& T = {})
 		-> object_id_t
 	{
@@ -319,12 +333,14 @@ struct ObstacleSet {
 		obstacles.emplace_back(    class_id, T         );
 		obstacles_inv.emplace_back(class_id, T.invert());
 		class_lookup.push_back(    class_id);
+		++version;
 		return object_id;
 	}
 	void clear_obstacles() {
 		obstacles.clear();
 		obstacles_inv.clear();
 		class_lookup.clear();
+		++version;
 	}
 	auto transform(object_id_t object_id) const
 		-> Transform const&
@@ -334,5 +350,6 @@ struct ObstacleSet {
 	void set_transform(object_id_t object_id, Transform const& T) {
 		obstacles[    object_id].second = T;
 		obstacles_inv[object_id].second = T.invert();
+		++version;
 	}
 };
@@ -46,6 +46,13 @@ struct RobotStateIntegration {
 			result.global              = rotate(result.local, robot.kinematics.orientation);
 			result.angular_velocity    = reference.angular_velocity;
 		}
+		if(std::holds_alternative<TrajectoryReference>(robot.reference)) {
+			result = std::get<TrajectoryReference>(robot.reference).control(
+				  robot.kinematics.position
+				, robot.kinematics.orientation
+				, dt
+			);
+		}
 		return result;
 	}
 
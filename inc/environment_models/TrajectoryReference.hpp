@@ -0,0 +1,177 @@
+#pragma once
+#include "environment_models/RobotVelocity.hpp"
+#include "math/angle_util.hpp"
+#include "config/Robot.hpp"
+#include "config/Trajectory.hpp"
+#include "robo_commands.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace robo {
+
+// Server side trajectory tracking, see FollowTrajectoryCommand.
+// Called by RobotStateIntegration every physics step: steers towards the
+// current waypoint with the velocity the robot can still brake from
+// within the remaining path length. The acceleration model shapes the
+// corners, the robot only stops at the last waypoint.
+struct TrajectoryReference {
+	uint32_t                        id                   = 0;
+	std::vector<TrajectoryWaypoint> waypoints;
+	double                          velocity_max         = 0.0;
+	double                          angular_velocity_max = 0.0;
+	std::vector<double>             remaining_after;   // path length behind waypoint i
+	std::size_t                     next               = 0;
+	double                          remaining_distance = 0.0;
+	double                          elapsed_time       = 0.0;
+	bool                            done               = false;
+
+	TrajectoryReference() = default;
+	TrajectoryReference(
+		  uint32_t                        id
+		, std::vector<TrajectoryWaypoint> waypoints
+		, double                          velocity_max
+		, double                          angular_velocity_max
+	)
+		: id{id}
+		, waypoints{std::move(waypoints)}
+		, velocity_max{velocity_max}
+		, angular_velocity_max{std::min(angular_velocity_max, config::Robot::angular_velocity_max)}
+		, remaining_after(this->waypoints.size(), 0.0)
+	{
+		for(std::size_t i = this->waypoints.size() - 1; i-- > 0;) {
+			Vertex<double,2> d = this->waypoints[i + 1].position - this->waypoints[i].position;
+			remaining_after[i] = remaining_after[i + 1] + d.length();
+		}
+		remaining_distance = remaining_after.front();
+	}
+
+	static auto braking_velocity(double thresh, double acceleration_max, double distance)
+		-> double
+	{
+		auto v = [&](double s) {
+			return config::Trajectory::braking_scale * std::sqrt(2.0 * acceleration_max * s);
+		};
+		if(distance < thresh) {
+			return distance * v(thresh) / thresh;
+		}
+		return v(distance);
+	}
+
+	auto control(Vertex<double,2> const& position, double orientation, double dt)
+		-> RobotVelocity
+	{
+		RobotVelocity result;
+		if(done) {
+			return result;
+		}
+		elapsed_time += dt;
+		std::size_t last = waypoints.size() - 1;
+		// passed: close enough, or beyond it seen along the segment leading there
+		auto passed = [&](std::size_t i) {
+			Vertex<double,2> from_waypoint = position - waypoints[i].position;
+			if(from_waypoint.length() < config::Trajectory::switch_distance) {
+				return true;
+			}
+			return i > 0 && from_waypoint * (waypoints[i].position - waypoints[i - 1].position) > 0.0;
+		};
+		while(next < last && passed(next)) {
+			++next;
+		}
+		TrajectoryWaypoint const& target = waypoints[next];
+		Vertex<double,2> error     = target.position - position;
+		double           d         = error.length();
+		double           phi_error = sm::normalize_angle_relative(target.orientation - orientation);
+		remaining_distance = d + remaining_after[next];
+		if(    next == last
+			&& d                   < config::Trajectory::position_tolerance
+			&& std::abs(phi_error) < config::Trajectory::orientation_tolerance
+		) {
+			done               = true;
+			remaining_distance = 0.0;
+			return result;
+		}
+
+		double v = std::min(
+			  velocity_max
+			, braking_velocity(
+				  config::Trajectory::slow_down_distance
+				, std::min(config::Robot::acceleration_max_x, config::Robot::acceleration_max_y)
+				, remaining_distance
+			)
+		);
+		double omega = std::min(
+			  angular_velocity_max
+			, braking_velocity(
+				  config::Trajectory::slow_down_angle
+				, config::Robot::acceleration_max_angular
+				, std::abs(phi_error)
+			)
+		);
+		result.local = d > 1e-9
+			? rotate(error * (v / d), -orientation)
+			: Vertex<double,2>{0.0, 0.0}
+		;
+		double scale = 1.0;
+		if(std::abs(result.local[0]) > config::Robot::velocity_max_x) {
+			scale = std::min(scale, config::Robot::velocity_max_x / std::abs(result.local[0]));
+		}
+		if(std::abs(result.local[1]) > config::Robot::velocity_max_y) {
+			scale = std::min(scale, config::Robot::velocity_max_y / std::abs(result.local[1]));
+		}
+		result.local           *= scale;
+		result.global           = rotate(result.local, orientation);
+		result.angular_velocity = phi_error < 0.0 ? -omega : omega;
+		return result;
+	}
+
+	auto progress() const
+		-> TrajectoryProgress
+	{
+		return {
+			  id
+			, static_cast<uint32_t>(next)
+			, static_cast<uint32_t>(waypoints.size())
+			, remaining_distance
+			, elapsed_time
+			, done
+		};
+	}
+
+	template<typename Serializer, typename Buffer>
+	static auto serialize(Buffer& buffer, TrajectoryReference const& r)
+		-> bool
+	{
+		return Serializer::serialize(
+			  buffer
+			, r.id, r.waypoints, r.velocity_max, r.angular_velocity_max
+			, r.remaining_after, r.next, r.remaining_distance, r.elapsed_time, r.done
+		);
+	}
+	template<typename Serializer, typename Buffer>
+	static auto deserialize(Buffer& buffer, TrajectoryReference& r)
+		-> bool
+	{
+		return Serializer::deserialize(
+			  buffer
+			, r.id, r.waypoints, r.velocity_max, r.angular_velocity_max
+			, r.remaining_after, r.next, r.remaining_distance, r.elapsed_time, r.done
+		);
+	}
+
+	template<typename OS>
+	friend
+	auto operator<<(OS& os, TrajectoryReference const& reference)
+		-> OS&
+	{
+		os  << "[trajectory: "  << reference.id
+			<< ", waypoint: "   << reference.next << '/' << reference.waypoints.size()
+			<< ", remaining: "  << reference.remaining_distance
+			<< ", done: "       << reference.done
+			<< ']'
+		;
+		return os;
+	}
+};
+
+} /** namespace robo */
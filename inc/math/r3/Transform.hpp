@@ -58,6 +58,26 @@ struct Transform {
 		return D * v + T;
 	}
 
+	// rotation matrix rows and translation, see PrefixSerializer
+	template<typename Serializer, typename Buffer>
+	static auto serialize(Buffer& buffer, Transform const& t)
+		-> bool
+	{
+		return Serializer::serialize(buffer, t.D.D[0], t.D.D[1], t.D.D[2], t.T);
+	}
+	template<typename Serializer, typename Buffer>
+	static auto deserialize(Buffer& buffer, Transform& t)
+		-> bool
+	{
+		Vertex<double, 3> r0, r1, r2;
+		V                 T;
+		if(!Serializer::deserialize(buffer, r0, r1, r2, T)) {
+			return false;
+		}
+		t = Transform{Rotation{Rotation::M{r0, r1, r2}}, T};
+		return true;
+	}
+
 	constexpr auto invert() const noexcept
 		-> Transform
 	{
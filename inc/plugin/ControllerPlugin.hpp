@@ -0,0 +1,65 @@
+#pragma once
+#include "robo_commands.hpp"
+#include <cstdint>
+
+// In-process robot controllers: a shared library exporting the entry points
+// below is loaded by the simulator (--plugin=path.so[:count[:args]]) and
+// called directly with the Vision of its robot, no sockets and no
+// serialization in between. A plugin defines one class derived from
+// robo::plugin::Controller and exports it with
+//
+//     ROBO_CONTROLLER_PLUGIN("name", MyController)
+//
+// The simulator creates one instance per robot. control() of different
+// instances may run concurrently on the worker threads of the simulator,
+// one instance is never called concurrently.
+namespace robo::plugin {
+
+// bumped on every change of the types below, the simulator refuses
+// plugins built against another version
+constexpr static uint32_t abi_version = 1;
+
+struct Context {
+	RobotId                id;
+	RobotDescriptor const& descriptor;
+	double                 time;   // simulation time
+};
+
+struct Decision {
+	Vertex<double, 2> velocity{0.0, 0.0};   // robot frame, or fixed frame
+	double            angular_velocity = 0.0;
+	bool              fixed_frame      = false;
+	bool              pick             = false;
+	bool              drop             = false;
+};
+
+class Controller {
+public:
+	virtual ~Controller() = default;
+	virtual auto control(Vision const& vision, Context const& context)
+		-> Decision = 0;
+};
+
+using abi_version_fn = uint32_t    (*)();
+using name_fn        = char const* (*)();
+using create_fn      = Controller* (*)(RobotDescriptor const*, char const*);
+using destroy_fn     = void        (*)(Controller*);
+
+} /** namespace robo::plugin */
+
+#define ROBO_CONTROLLER_PLUGIN(NAME, TYPE)                                        \
+	extern "C" uint32_t robo_controller_abi_version() {                          \
+		return robo::plugin::abi_version;                                        \
+	}                                                                            \
+	extern "C" char const* robo_controller_name() {                              \
+		return NAME;                                                             \
+	}                                                                            \
+	extern "C" robo::plugin::Controller* robo_create_controller(                 \
+		  robo::RobotDescriptor const* descriptor                                \
+		, char const*                  args                                      \
+	) {                                                                          \
+		return new TYPE(*descriptor, args);                                      \
+	}                                                                            \
+	extern "C" void robo_destroy_controller(robo::plugin::Controller* c) {       \
+		delete c;                                                                \
+	}
@@ -0,0 +1,182 @@
+#pragma once
+#include "plugin/ControllerPlugin.hpp"
+#include "util/WorkerPool.hpp"
+#include "Environment.hpp"
+#include <dlfcn.h>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace robo::plugin {
+
+// One loaded controller library, see ControllerPlugin.hpp.
+class PluginLibrary {
+private:
+	void*       handle = nullptr;
+	std::string _name;
+	create_fn   _create  = nullptr;
+	destroy_fn  _destroy = nullptr;
+
+	template<typename F>
+	F symbol(std::string const& path, char const* name) {
+		dlerror();
+		void* s = dlsym(handle, name);
+		if(!s) {
+			char const* e = dlerror();
+			throw std::runtime_error(path + ": " + (e ? e : name));
+		}
+		return reinterpret_cast<F>(s);
+	}
+
+public:
+	explicit PluginLibrary(std::string const& path) {
+		handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+		if(!handle) {
+			char const* e = dlerror();
+			throw std::runtime_error(e ? e : path + ": dlopen failed");
+		}
+		try {
+			uint32_t version = symbol<abi_version_fn>(path, "robo_controller_abi_version")();
+			if(version != abi_version) {
+				throw std::runtime_error(
+					  path + ": plugin abi version " + std::to_string(version)
+					+ ", simulator expects " + std::to_string(abi_version)
+				);
+			}
+			_name    = symbol<name_fn>(path, "robo_controller_name")();
+			_create  = symbol<create_fn>(path, "robo_create_controller");
+			_destroy = symbol<destroy_fn>(path, "robo_destroy_controller");
+		} catch(...) {
+			dlclose(handle);
+			throw;
+		}
+	}
+	PluginLibrary(PluginLibrary const&) = delete;
+	PluginLibrary& operator=(PluginLibrary const&) = delete;
+	~PluginLibrary() {
+		dlclose(handle);
+	}
+
+	std::string const& name() const {
+		return _name;
+	}
+
+	auto create(RobotDescriptor const& descriptor, std::string const& args)
+		-> std::unique_ptr<Controller, destroy_fn>
+	{
+		return {_create(&descriptor, args.c_str()), _destroy};
+	}
+};
+
+// Runs the controllers of all plugin robots against the Environment of this
+// process. Every step reads all visions under one lock, runs the controllers
+// without holding it, on the calling thread or on the worker pool, and
+// hands the decisions to the usual command handlers.
+class PluginHost {
+private:
+	struct Bot {
+		RobotId                                 id;
+		RobotDescriptor                         descriptor;
+		std::unique_ptr<Controller, destroy_fn> controller;
+		bool                                    failed = false;
+	};
+
+	Environment&                                environment;
+	std::vector<std::unique_ptr<PluginLibrary>> libraries;   // outlive the bots
+	std::vector<Bot>                            bots;
+	std::vector<RobotId>                        ids;
+	std::vector<Vision>                         visions;
+	std::vector<bool>                           found;
+	std::vector<Decision>                       decisions;
+	WorkerPool                                  pool;
+	double                                      period;
+	double                                      next_time = 0.0;
+	uint64_t                                    _steps    = 0;
+
+	void apply(Bot& bot, Decision const& d) {
+		if(d.fixed_frame) {
+			environment.handle(LocalVelocityFixedFrameCommand::Request{bot.id, d.velocity, d.angular_velocity});
+		} else {
+			environment.handle(LocalVelocityCommand::Request{bot.id, d.velocity, d.angular_velocity});
+		}
+		if(d.pick) {
+			environment.handle(PickTaxiGuestCommand::Request{bot.id});
+		}
+		if(d.drop) {
+			environment.handle(DropTaxiGuestCommand::Request{bot.id});
+		}
+	}
+
+public:
+	// rate in simulated Hz, n_threads workers besides the calling thread
+	PluginHost(Environment& environment, double rate, std::size_t n_threads)
+		: environment{environment}
+		, pool{n_threads}
+		, period{1.0 / rate}
+	{}
+	~PluginHost() {
+		for(Bot const& bot : bots) {
+			environment.handle(DeregisterRobotCommand::Request{bot.id});
+		}
+	}
+
+	// loads path and registers count robots driven by it,
+	// throws std::runtime_error if the library is no controller plugin
+	void add(std::string const& path, std::size_t count, std::string const& args) {
+		auto& library = *libraries.emplace_back(std::make_unique<PluginLibrary>(path));
+		for(std::size_t i = 0; i < count; ++i) {
+			auto r = environment.handle(RegisterRobotCommand::Request{library.name() + std::to_string(i)});
+			if(!r.result) {
+				throw std::runtime_error(path + ": could not register robot");
+			}
+			auto controller = library.create(r.result->descriptor, args);
+			bots.push_back({r.result->registration, r.result->descriptor, std::move(controller)});
+			ids.push_back(r.result->registration);
+		}
+	}
+
+	std::size_t size() const {
+		return bots.size();
+	}
+	uint64_t steps() const {
+		return _steps;
+	}
+
+	// runs one step if the period passed since the last one
+	bool step_if_due(double time) {
+		if(bots.empty() || time < next_time) {
+			return false;
+		}
+		next_time = std::max(next_time + period, time);
+		step(time);
+		return true;
+	}
+
+	void step(double time) {
+		environment.fill_visions(ids, visions, found);
+		decisions.assign(bots.size(), Decision{});
+		pool.parallel_for(bots.size(), [&](std::size_t i) {
+			Bot& bot = bots[i];
+			if(!found[i] || bot.failed) {
+				return;
+			}
+			try {
+				decisions[i] = bot.controller->control(visions[i], Context{bot.id, bot.descriptor, time});
+			} catch(std::exception const& e) {
+				std::cerr << "plugin robot " << bot.id << " stopped: " << e.what() << '\n';
+				bot.failed = true;
+			}
+		});
+		for(std::size_t i = 0; i < bots.size(); ++i) {
+			if(found[i]) {
+				apply(bots[i], decisions[i]);
+			}
+		}
+		++_steps;
+	}
+};
+
+} /** namespace robo::plugin */
@@ -40,11 +40,19 @@ struct GL_Window {
 		
 		/** BEGIN from https://github.com/ocornut/imgui/blob/master/examples/example_sdl_opengl2/main.cpp */
 		SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
-		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 2);
-		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 2);
 		/** END from https://github.com/ocornut/imgui/blob/master/examples/example_sdl_opengl2/main.cpp */
 		
+		// 3.3 compatibility for instanced drawing next to the fixed function
+		// pipeline, 2.2 as before where there is none
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_COMPATIBILITY);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
 		gl_context = SDL_GL_CreateContext(window);
+		if(!gl_context) {
+			SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 2);
+			SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 2);
+			gl_context = SDL_GL_CreateContext(window);
+		}
 		if(!gl_context) {
 			printf( "OpenGL context could not be created! SDL Error: %s\n", SDL_GetError() );
 			std::exit(1);
@@ -0,0 +1,189 @@
+#pragma once
+#include <GL/glew.h>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include "math/r3/Transform.hpp"
+#include "simple_gl/GL_Window.hpp"
+#include "simple_gl/Mesh.hpp"
+#include "simple_gl/ShaderProgram.hpp"
+
+// Per instance data of InstanceRenderer: the model transform as the three
+// rows of its affine matrix and the material color.
+struct Instance {
+	std::array<Vertex<float,4>, 3> rows;
+	Vertex<float,4>                color;
+
+	static Instance make(Transform const& T, Vertex<float,4> const& color) {
+		auto const& D = T.rotation_matrix();
+		auto row = [&](std::size_t i) {
+			return Vertex<float,4>{
+				  static_cast<float>(D[i][0])
+				, static_cast<float>(D[i][1])
+				, static_cast<float>(D[i][2])
+				, static_cast<float>(T.T[i])
+			};
+		};
+		return {{row(0), row(1), row(2)}, color};
+	}
+	// translate(x, y, z) * rotate_z(phi), without the matrix products
+	static Instance make(double x, double y, double z, double phi, Vertex<float,4> const& color) {
+		float c = static_cast<float>(std::cos(phi));
+		float s = static_cast<float>(std::sin(phi));
+		return {
+			{
+				  Vertex<float,4>{c,    -s,    0.0f, static_cast<float>(x)}
+				, Vertex<float,4>{s,     c,    0.0f, static_cast<float>(y)}
+				, Vertex<float,4>{0.0f,  0.0f, 1.0f, static_cast<float>(z)}
+			}
+			, color
+		};
+	}
+};
+
+// Draws a mesh once per Instance with one call, GL 3.3 instanced arrays
+// in a compatibility context. The shader does what the fixed function
+// pipeline does for the views: the material color, lit by GL_LIGHT0 and
+// the light model ambient unless simplified, times texture unit 0 if
+// textured. The instances are streamed into an orphaned buffer per draw.
+struct InstanceRenderer {
+	// clear of the aliased conventional attributes that meshes use
+	constexpr static unsigned int location_row0  = 10;
+	constexpr static unsigned int location_color = 13;
+
+	GL_Window const* parent;
+	ShaderProgram    program;
+	unsigned int     buffer   = 0;
+	std::size_t      capacity = 0;   // in instances
+	int              uniform_lighting;
+	int              uniform_textured;
+	int              uniform_texture;
+
+	InstanceRenderer(InstanceRenderer const&) = delete;
+	InstanceRenderer& operator=(InstanceRenderer const&) = delete;
+
+	static bool is_supported() {
+		return GLEW_VERSION_3_3;
+	}
+
+	InstanceRenderer(GL_Window const* parent)
+		: parent(parent)
+		, program(
+			  parent
+			, {glsl::version, glsl::light0, vertex_source}
+			, {glsl::version, fragment_source}
+			, {
+				  {location_row0 + 0, "instance_row0"}
+				, {location_row0 + 1, "instance_row1"}
+				, {location_row0 + 2, "instance_row2"}
+				, {location_color,    "instance_color"}
+			}
+		)
+	{
+		parent->do_operation([&]() {
+			glGenBuffers(1, &buffer);
+			uniform_lighting = program.uniform("lighting");
+			uniform_textured = program.uniform("textured");
+			uniform_texture  = program.uniform("color_texture");
+		});
+	}
+	~InstanceRenderer() {
+		if(buffer) {
+			parent->do_operation([&]() {
+				glDeleteBuffers(1, &buffer);
+			});
+		}
+	}
+
+	bool is_valid() const {
+		return program.is_valid() && buffer != 0;
+	}
+
+	template<typename V>
+	void draw(
+		  Mesh<V> const&               mesh
+		, std::vector<Instance> const& instances
+		, bool                         textured
+		, bool                         lighting
+	) {
+		if(instances.empty() || !is_valid()) {
+			return;
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		if(instances.size() > capacity) {
+			capacity = instances.size() + instances.size() / 2;
+		}
+		glBufferData(GL_ARRAY_BUFFER, sizeof(Instance) * capacity, nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Instance) * instances.size(), instances.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		program.use();
+		glUniform1i(uniform_lighting, lighting ? 1 : 0);
+		glUniform1i(uniform_textured, textured ? 1 : 0);
+		glUniform1i(uniform_texture,  0);
+		{
+			auto lock = mesh.lock();
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+			auto attribute = [](unsigned int location, std::size_t offset) {
+				glEnableVertexAttribArray(location);
+				glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), reinterpret_cast<void*>(offset));
+				glVertexAttribDivisor(location, 1);
+			};
+			for(unsigned int i = 0; i < 3; ++i) {
+				attribute(location_row0 + i, i * sizeof(Vertex<float,4>));
+			}
+			attribute(location_color, offsetof(Instance, color));
+			lock.draw_instanced(static_cast<GLsizei>(instances.size()));
+			for(unsigned int location = location_row0; location <= location_color; ++location) {
+				glVertexAttribDivisor(location, 0);
+				glDisableVertexAttribArray(location);
+			}
+		}
+		ShaderProgram::use_none();
+	}
+
+private:
+	constexpr static char const* vertex_source = R"(
+		attribute vec4 instance_row0;
+		attribute vec4 instance_row1;
+		attribute vec4 instance_row2;
+		attribute vec4 instance_color;
+		uniform bool   lighting;
+		varying vec4   color;
+
+		void main() {
+			vec4 world = vec4(
+				  dot(instance_row0, gl_Vertex)
+				, dot(instance_row1, gl_Vertex)
+				, dot(instance_row2, gl_Vertex)
+				, 1.0
+			);
+			vec4 eye       = gl_ModelViewMatrix * world;
+			gl_Position    = gl_ProjectionMatrix * eye;
+			gl_TexCoord[0] = gl_MultiTexCoord0;
+			if(lighting) {
+				vec3 n = vec3(
+					  dot(instance_row0.xyz, gl_Normal)
+					, dot(instance_row1.xyz, gl_Normal)
+					, dot(instance_row2.xyz, gl_Normal)
+				);
+				color = light0(gl_NormalMatrix * n, eye, instance_color);
+			} else {
+				color = instance_color;
+			}
+		}
+	)";
+	constexpr static char const* fragment_source = R"(
+		uniform bool      textured;
+		uniform sampler2D color_texture;
+		varying vec4      color;
+
+		void main() {
+			gl_FragColor = textured
+				? color * texture2D(color_texture, gl_TexCoord[0].st)
+				: color
+			;
+		}
+	)";
+};
@@ -293,6 +293,25 @@ struct Mesh {
 		);
 	}
 
+	// overwrites vertices from first on, the buffer keeps its size
+	void load_vertices(std::size_t first, Vertex const* vertices, std::size_t count) {
+		if(!has_buffers() || !count) {
+			return;
+		}
+		parent->do_operation(
+			[&]() {
+				glBindBuffer(GL_ARRAY_BUFFER, vertex_VBO_id);
+				glBufferSubData(
+					  GL_ARRAY_BUFFER
+					, sizeof(Vertex) * first
+					, sizeof(Vertex) * count
+					, vertices
+				);
+				glBindBuffer(GL_ARRAY_BUFFER, 0);
+			}
+		);
+	}
+
 	struct Lock {
 		Mesh const* parent;
 		
@@ -370,6 +389,22 @@ struct Mesh {
 				glDrawElements(GL_TRIANGLES, parent->indices_size, parent->type, nullptr);
 			}
 		}
+		// count indices from first on
+		void draw_range(std::size_t first, std::size_t count) const {
+			if(parent && parent->has_buffers() && count) {
+				std::size_t index_size = parent->type == GL_UNSIGNED_SHORT
+					? sizeof(unsigned short)
+					: sizeof(unsigned int)
+				;
+				glDrawElements(GL_TRIANGLES, count, parent->type, reinterpret_cast<void*>(first * index_size));
+			}
+		}
+		// GL 3.3, the per instance attributes are set up by the caller
+		void draw_instanced(GLsizei count) const {
+			if(parent && parent->has_buffers()) {
+				glDrawElementsInstanced(GL_TRIANGLES, parent->indices_size, parent->type, nullptr, count);
+			}
+		}
 	};
 	Lock lock() const {
 		return Lock(this);
@@ -26,37 +26,15 @@ struct MeshData {
 	auto mesh(GL_Window* parent) const
 		-> gl_mesh_t
 	{
-		using target_t = typename vertex_t::template as_type<float>;
-		using Mesh = Mesh<target_t>;
-
-		auto convert_vertices = [&]() {
-			std::vector<target_t> target_vertices;
-			target_vertices.reserve(vertices.size());
-			for(auto const& v : vertices) {
-				target_vertices.push_back(v.template as<float>());
-			}
-			return target_vertices;
-		};
-		auto may_convert_vertices = [&]()
-			-> decltype(auto)
-		{
-			if constexpr(std::is_same_v<vertex_t, target_t>) {
-				return static_cast<std::vector<vertex_t> const&>(vertices);
-			} else {
-				return convert_vertices();
-			}
-		};
-		auto convert_indices = [&]() {
-			std::vector<unsigned short> result;
-			result.reserve(indices.size());
-			std::copy(indices.begin(), indices.end(), std::back_inserter(result));
-			return result;
-		};
-		if(vertices.size() < std::numeric_limits<unsigned short>::max()) {
-			return Mesh(parent, may_convert_vertices(), convert_indices());
-		} else {
-			return Mesh(parent, may_convert_vertices(), indices);
-		}
+		return with_gl_data([&](auto const& gl_vertices, auto const& gl_indices) {
+			return gl_mesh_t(parent, gl_vertices, gl_indices);
+		});
+	}
+	// into the buffers of an existing mesh, for geometry that is rebuilt
+	void load_into(gl_mesh_t& target, GLenum usage = GL_STATIC_DRAW) const {
+		with_gl_data([&](auto const& gl_vertices, auto const& gl_indices) {
+			target.load(gl_vertices, gl_indices, usage);
+		});
 	}
 
 	auto triangles() const
@@ -143,6 +121,41 @@ struct MeshData {
 		}
 		return r;
 	}
+private:
+	// op(vertices, indices) in the types of gl_mesh_t, 16 bit indices where they suffice
+	template<typename OP>
+	decltype(auto) with_gl_data(OP op) const {
+		using target_t = typename vertex_t::template as_type<float>;
+
+		auto convert_vertices = [&]() {
+			std::vector<target_t> target_vertices;
+			target_vertices.reserve(vertices.size());
+			for(auto const& v : vertices) {
+				target_vertices.push_back(v.template as<float>());
+			}
+			return target_vertices;
+		};
+		auto may_convert_vertices = [&]()
+			-> decltype(auto)
+		{
+			if constexpr(std::is_same_v<vertex_t, target_t>) {
+				return static_cast<std::vector<vertex_t> const&>(vertices);
+			} else {
+				return convert_vertices();
+			}
+		};
+		auto convert_indices = [&]() {
+			std::vector<unsigned short> result;
+			result.reserve(indices.size());
+			std::copy(indices.begin(), indices.end(), std::back_inserter(result));
+			return result;
+		};
+		if(vertices.size() < std::numeric_limits<unsigned short>::max()) {
+			return op(may_convert_vertices(), convert_indices());
+		} else {
+			return op(may_convert_vertices(), indices);
+		}
+	}
 };
 
 struct has_normal_tag{};
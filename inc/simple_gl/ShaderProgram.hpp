@@ -0,0 +1,126 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+#include "simple_gl/GL_Window.hpp"
+
+// Pieces of GLSL 1.20 put in front of the shaders' own sources.
+namespace glsl {
+	constexpr char const* version = "#version 120\n";
+
+	// vertex shader: color c as the fixed function pipeline lights it with
+	// GL_LIGHT0 and the light model ambient, N the eye space normal
+	constexpr char const* light0 = R"(
+		vec4 light0(vec3 N, vec4 eye, vec4 c) {
+			vec4  P = gl_LightSource[0].position;
+			vec3  L = normalize(P.xyz - eye.xyz * P.w);
+			float d = max(dot(normalize(N), L), 0.0);
+			vec4  result = (gl_LightModel.ambient + gl_LightSource[0].ambient + gl_LightSource[0].diffuse * d) * c;
+			result.a = c.a;
+			return result;
+		}
+	)";
+} /** namespace glsl */
+
+// Vertex and fragment shader linked into a program. A shader that doesn't
+// compile or link prints its log and leaves the program invalid, callers
+// fall back to the fixed function pipeline then.
+struct ShaderProgram {
+	GL_Window const* parent;
+	unsigned int     program = 0;
+
+	ShaderProgram(ShaderProgram const&) = delete;
+	ShaderProgram& operator=(ShaderProgram const&) = delete;
+
+	ShaderProgram(ShaderProgram&& other)
+		: parent(other.parent)
+		, program(other.program)
+	{
+		other.program = 0;
+	}
+
+	// sources: concatenated to one shader each
+	// attributes: generic attribute locations bound before linking
+	ShaderProgram(
+		  GL_Window const*                                         parent
+		, std::vector<char const*> const&                          vertex_sources
+		, std::vector<char const*> const&                          fragment_sources
+		, std::vector<std::pair<unsigned int, char const*>> const& attributes = {}
+	)
+		: parent(parent)
+	{
+		parent->do_operation([&]() {
+			unsigned int vs = compile(GL_VERTEX_SHADER,   vertex_sources);
+			unsigned int fs = compile(GL_FRAGMENT_SHADER, fragment_sources);
+			if(vs && fs) {
+				program = glCreateProgram();
+				glAttachShader(program, vs);
+				glAttachShader(program, fs);
+				for(auto const& [location, name] : attributes) {
+					glBindAttribLocation(program, location, name);
+				}
+				glLinkProgram(program);
+				GLint ok = GL_FALSE;
+				glGetProgramiv(program, GL_LINK_STATUS, &ok);
+				if(ok != GL_TRUE) {
+					print_log("link", program, glGetProgramiv, glGetProgramInfoLog);
+					glDeleteProgram(program);
+					program = 0;
+				}
+			}
+			if(vs) {
+				glDeleteShader(vs);
+			}
+			if(fs) {
+				glDeleteShader(fs);
+			}
+		});
+	}
+
+	~ShaderProgram() {
+		if(program) {
+			parent->do_operation([&]() {
+				glDeleteProgram(program);
+			});
+		}
+	}
+
+	bool is_valid() const {
+		return program != 0;
+	}
+	int uniform(char const* name) const {
+		return glGetUniformLocation(program, name);
+	}
+	void use() const {
+		glUseProgram(program);
+	}
+	static void use_none() {
+		glUseProgram(0);
+	}
+
+private:
+	template<typename GetIv, typename GetLog>
+	static void print_log(char const* what, unsigned int id, GetIv get_iv, GetLog get_log) {
+		GLint length = 0;
+		get_iv(id, GL_INFO_LOG_LENGTH, &length);
+		std::string log(static_cast<std::size_t>(length > 0 ? length : 1), '\0');
+		get_log(id, length, nullptr, log.data());
+		printf("Shader %s failed: %s\n", what, log.c_str());
+	}
+
+	static unsigned int compile(GLenum type, std::vector<char const*> const& sources) {
+		unsigned int shader = glCreateShader(type);
+		glShaderSource(shader, static_cast<GLsizei>(sources.size()), sources.data(), nullptr);
+		glCompileShader(shader);
+		GLint ok = GL_FALSE;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+		if(ok != GL_TRUE) {
+			print_log("compile", shader, glGetShaderiv, glGetShaderInfoLog);
+			glDeleteShader(shader);
+			return 0;
+		}
+		return shader;
+	}
+};
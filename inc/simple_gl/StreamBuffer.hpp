@@ -0,0 +1,105 @@
+#pragma once
+#include <GL/glew.h>
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "simple_gl/GL_Window.hpp"
+
+// Array buffer of records rewritten every frame, kept for the lifetime of
+// its owner. update() compares the records with the ones uploaded last
+// time and sends only the changed spans. When most of them changed, or the
+// buffer has to grow, the storage is orphaned and filled at once instead,
+// so the driver can hand out fresh memory rather than wait for the draws
+// still reading the old one.
+template<typename Record>
+	requires std::is_trivially_copyable_v<Record>
+struct StreamBuffer {
+	constexpr static std::size_t merge_gap = 16;   // clean records between spans that are sent along
+
+	GL_Window const*    parent;
+	unsigned int        id       = 0;
+	std::size_t         capacity = 0;   // in records
+	std::vector<Record> uploaded;
+
+	StreamBuffer(StreamBuffer const&) = delete;
+	StreamBuffer& operator=(StreamBuffer const&) = delete;
+
+	StreamBuffer(GL_Window const* parent)
+		: parent(parent)
+	{
+		parent->do_operation([&]() {
+			glGenBuffers(1, &id);
+		});
+	}
+	~StreamBuffer() {
+		if(id) {
+			parent->do_operation([&]() {
+				glDeleteBuffers(1, &id);
+			});
+		}
+	}
+
+	std::size_t size() const {
+		return uploaded.size();
+	}
+
+	// The caller has made the context current.
+	void update(std::vector<Record> const& records) {
+		std::size_t n = records.size();
+		glBindBuffer(GL_ARRAY_BUFFER, id);
+		if(n > capacity) {
+			capacity = std::max<std::size_t>(n + n / 2, 64);
+			upload_all(records);
+		} else {
+			dirty.clear();
+			std::size_t dirty_records = 0;
+			for(std::size_t i = 0; i < n; ) {
+				if(i < uploaded.size() && std::memcmp(&records[i], &uploaded[i], sizeof(Record)) == 0) {
+					++i;
+					continue;
+				}
+				std::size_t first = i;
+				std::size_t last  = i + 1;   // one past the last dirty record
+				for(std::size_t clean = 0; i < n && clean < merge_gap; ++i) {
+					if(i >= uploaded.size() || std::memcmp(&records[i], &uploaded[i], sizeof(Record)) != 0) {
+						last  = i + 1;
+						clean = 0;
+					} else {
+						++clean;
+					}
+				}
+				dirty.emplace_back(first, last);
+				dirty_records += last - first;
+				i = last;
+			}
+			if(2 * dirty_records > n) {
+				upload_all(records);
+			} else {
+				uploaded.resize(n);
+				for(auto [first, last] : dirty) {
+					glBufferSubData(
+						  GL_ARRAY_BUFFER
+						, sizeof(Record) * first
+						, sizeof(Record) * (last - first)
+						, records.data() + first
+					);
+					std::copy(records.begin() + first, records.begin() + last, uploaded.begin() + first);
+				}
+			}
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+private:
+	std::vector<std::pair<std::size_t, std::size_t>> dirty;   // [first, last) records to send
+
+	void upload_all(std::vector<Record> const& records) {
+		glBufferData(GL_ARRAY_BUFFER, sizeof(Record) * capacity, nullptr, GL_STREAM_DRAW);
+		if(!records.empty()) {
+			glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Record) * records.size(), records.data());
+		}
+		uploaded = records;
+	}
+};
@@ -2,6 +2,7 @@
 #include "EnvironmentView.hpp"
 #include "config/Hotkeys.hpp"
 #include "util/name_this_thread.hpp"
+#include "util/Tracer.hpp"
 #include <atomic>
 #include <thread>
 #include "imgui/imgui.h"
@@ -147,6 +148,7 @@ inline void event_loop(robo::Environment& environment, double delta_t_gui, std::
 	std::optional<Vertex<int,2>> mouse_on_begin_mod_shift;
 	view.camera.state = robo::Camera::State::USER;
 	while( is_running ) {
+		TraceScope frame{TraceName<"gui::frame">::id};
 		using clock_t = std::chrono::steady_clock;
 		auto loop_enter = clock_t::now();
 		auto find_view = [&](uint32_t window_id) {
@@ -279,6 +281,7 @@ inline void event_loop(robo::Environment& environment, double delta_t_gui, std::
 		}
 		view.render(is_mod_alt || is_mod_ctrl || is_mod_shift);
 		auto deadline  = loop_enter + std::chrono::duration<double>(delta_t_gui);
+		TraceScope idle{TraceName<"gui::idle">::id};
 		std::this_thread::sleep_until(deadline);
 	}
 }
@@ -0,0 +1,159 @@
+#pragma once
+#include "socket/Endpoint.hpp"
+#include "socket/SHM_Socket.hpp"
+#include "socket/TCP_Socket.hpp"
+#include "socket/UNIX_Socket.hpp"
+#include <optional>
+#include <type_traits>
+#include <variant>
+
+// Stream socket of any transport selected at runtime by an Endpoint.
+// Forwards the common TCP_Socket interface, so it can be used wherever
+// the client_server templates expect a Socket.
+class AnySocket {
+private:
+	std::variant<TCP_Socket, UNIX_Socket, SHM_Socket> _socket;
+
+	template<typename F>
+	decltype(auto) visit(F&& f) const {
+		return std::visit(std::forward<F>(f), _socket);
+	}
+	template<typename F>
+	decltype(auto) visit(F&& f) {
+		return std::visit(std::forward<F>(f), _socket);
+	}
+
+public:
+	AnySocket() = default;
+
+	template<typename Socket, typename... Args>
+	Socket& emplace(Args&&... args) {
+		return _socket.emplace<Socket>(std::forward<Args>(args)...);
+	}
+
+	uint64_t send(const void* buffer, uint64_t size) const {
+		return visit([&](auto const& s) { return s.send(buffer, size); });
+	}
+	uint64_t recv(void* buffer, uint64_t size) const {
+		return visit([&](auto const& s) { return s.recv(buffer, size); });
+	}
+	uint64_t recv_exact(void* buffer, uint64_t size) const {
+		return visit([&](auto const& s) { return s.recv_exact(buffer, size); });
+	}
+	uint64_t peek(void* buffer, uint64_t size) const {
+		return visit([&](auto const& s) { return s.peek(buffer, size); });
+	}
+	uint64_t recv_nonblocking(void* buffer, uint64_t size) const {
+		return visit([&](auto const& s) { return s.recv_nonblocking(buffer, size); });
+	}
+	uint64_t peek_nonblocking(void* buffer, uint64_t size) const {
+		return visit([&](auto const& s) { return s.peek_nonblocking(buffer, size); });
+	}
+	bool can_read(long timeout_secs, int timeout_usecs) const {
+		return visit([&](auto const& s) { return s.can_read(timeout_secs, timeout_usecs); });
+	}
+	bool can_write(long timeout_secs, int timeout_usecs) const {
+		return visit([&](auto const& s) { return s.can_write(timeout_secs, timeout_usecs); });
+	}
+	bool is_valid() const {
+		return visit([&](auto const& s) { return s.is_valid(); });
+	}
+	void close() {
+		visit([&](auto& s) { s.close(); });
+	}
+	void shutdown_recv() {
+		visit([&](auto& s) { s.shutdown_recv(); });
+	}
+	void shutdown_send() {
+		visit([&](auto& s) { s.shutdown_send(); });
+	}
+	void shutdown() {
+		visit([&](auto& s) { s.shutdown(); });
+	}
+	// only known for unix domain sockets
+	std::optional<ucred> peer_credentials() const {
+		if(auto s = std::get_if<UNIX_Socket>(&_socket)) {
+			return s->peer_credentials();
+		}
+		return {};
+	}
+};
+
+class AnyServerSocket {
+private:
+	std::variant<TCP_ServerSocket, UNIX_ServerSocket, SHM_ServerSocket> _socket;
+
+	static decltype(_socket) make(Endpoint const& endpoint) {
+		switch(endpoint.transport) {
+			case Endpoint::Transport::SHM:
+				return decltype(_socket){std::in_place_type<SHM_ServerSocket>, endpoint.name};
+			case Endpoint::Transport::UNIX:
+				return decltype(_socket){std::in_place_type<UNIX_ServerSocket>, endpoint.name};
+			case Endpoint::Transport::TCP:
+			default:
+				return decltype(_socket){std::in_place_type<TCP_ServerSocket>, endpoint.port, true};
+		}
+	}
+
+public:
+	AnyServerSocket(Endpoint const& endpoint)
+		: _socket{make(endpoint)}
+	{}
+
+	bool can_read(long timeout_secs, int timeout_usecs) const {
+		return std::visit(
+			  [&](auto const& s) { return s.can_read(timeout_secs, timeout_usecs); }
+			, _socket
+		);
+	}
+	// listening file descriptor, shared memory has none
+	std::optional<int> native_handle() const {
+		return std::visit(
+			[&](auto const& s) -> std::optional<int> {
+				using server_t = std::decay_t<decltype(s)>;
+				if constexpr(std::is_same_v<server_t, SHM_ServerSocket>) {
+					return {};
+				} else {
+					return s.native_handle();
+				}
+			}
+			, _socket
+		);
+	}
+	void accept(AnySocket& new_socket) const {
+		std::visit(
+			[&](auto const& s) {
+				using server_t = std::decay_t<decltype(s)>;
+				if constexpr(std::is_same_v<server_t, SHM_ServerSocket>) {
+					s.accept(new_socket.emplace<SHM_Socket>());
+				} else if constexpr(std::is_same_v<server_t, UNIX_ServerSocket>) {
+					s.accept(new_socket.emplace<UNIX_Socket>());
+				} else {
+					s.accept(new_socket.emplace<TCP_Socket>());
+				}
+			}
+			, _socket
+		);
+	}
+};
+
+class AnyClientSocket : public AnySocket {
+public:
+	AnyClientSocket(Endpoint const& endpoint) {
+		switch(endpoint.transport) {
+			case Endpoint::Transport::SHM:
+				emplace<SHM_Socket>(SHM_ClientSocket(endpoint.name));
+				break;
+			case Endpoint::Transport::UNIX:
+				emplace<UNIX_Socket>(UNIX_ClientSocket(endpoint.name));
+				break;
+			case Endpoint::Transport::TCP:
+			default:
+				emplace<TCP_Socket>(TCP_ClientSocket(endpoint.host, endpoint.port));
+				break;
+		}
+	}
+	AnyClientSocket(std::string const& url, int default_port)
+		: AnyClientSocket(Endpoint::parse(url, default_port))
+	{}
+};
@@ -0,0 +1,70 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <charconv>
+
+// Where a server listens or a client connects to.
+//   "shm://name"       shared memory segment /name (same host only)
+//   "unix://path"      unix domain socket, "unix://@name" is abstract
+//   "/path", "@name"   same as unix://
+//   "tcp://host:port"  tcp
+//   "tcp://:port"      tcp, listening on port
+//   "host"             tcp on default_port, as before
+struct Endpoint {
+	enum class Transport {
+		  TCP
+		, SHM
+		, UNIX
+	};
+	Transport   transport = Transport::TCP;
+	std::string host;
+	int         port      = 0;
+	std::string name;
+
+	static Endpoint parse(std::string_view url, int default_port) {
+		constexpr std::string_view shm_scheme  = "shm://";
+		constexpr std::string_view tcp_scheme  = "tcp://";
+		constexpr std::string_view unix_scheme = "unix://";
+		Endpoint e;
+		e.port = default_port;
+		if(url.substr(0, shm_scheme.size()) == shm_scheme) {
+			e.transport = Transport::SHM;
+			e.name      = url.substr(shm_scheme.size());
+			return e;
+		}
+		if(url.substr(0, unix_scheme.size()) == unix_scheme) {
+			e.transport = Transport::UNIX;
+			e.name      = url.substr(unix_scheme.size());
+			return e;
+		}
+		if(!url.empty() && (url[0] == '/' || url[0] == '@')) {
+			e.transport = Transport::UNIX;
+			e.name      = url;
+			return e;
+		}
+		if(url.substr(0, tcp_scheme.size()) == tcp_scheme) {
+			url = url.substr(tcp_scheme.size());
+			auto colon = url.rfind(':');
+			if(colon != std::string_view::npos) {
+				std::string_view port = url.substr(colon + 1);
+				std::from_chars(port.data(), port.data() + port.size(), e.port);
+				url = url.substr(0, colon);
+			}
+		}
+		e.host = url;
+		return e;
+	}
+
+	std::string to_string() const {
+		switch(transport) {
+			case Transport::SHM:
+				return "shm://" + name;
+			case Transport::UNIX:
+				return "unix://" + name;
+			case Transport::TCP:
+			default:
+				break;
+		}
+		return "tcp://" + host + ':' + std::to_string(port);
+	}
+};
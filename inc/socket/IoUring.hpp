@@ -0,0 +1,84 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <linux/io_uring.h>
+
+// Minimal io_uring wrapper on top of the raw syscalls (no liburing).
+// Single threaded use only: one thread prepares sqes, submits and reaps.
+class IoUring {
+private:
+	int                 _fd = -1;
+	io_uring_params     _params{};
+
+	void*               _sq_ring      = nullptr;
+	std::size_t         _sq_ring_size = 0;
+	void*               _cq_ring      = nullptr;
+	std::size_t         _cq_ring_size = 0;
+	io_uring_sqe*       _sqes         = nullptr;
+	std::size_t         _sqes_size    = 0;
+
+	unsigned*           _sq_head;
+	unsigned*           _sq_tail;
+	unsigned*           _sq_array;
+	unsigned            _sq_mask;
+	unsigned            _sqe_tail     = 0;   // prepared, not yet published
+	unsigned*           _cq_head;
+	unsigned*           _cq_tail;
+	unsigned            _cq_mask;
+	io_uring_cqe*       _cqes;
+
+	io_uring_buf_ring*  _buf_ring         = nullptr;
+	std::size_t         _buf_ring_size    = 0;
+	std::byte*          _buffers          = nullptr;
+	unsigned            _buffer_count     = 0;
+	unsigned            _buffer_size      = 0;
+	uint16_t            _buffer_group     = 0;
+	unsigned            _buf_tail_pending = 0;
+
+	uint64_t            _enter_calls = 0;
+
+	void destroy();
+
+public:
+	// throws PosixError if the kernel lacks io_uring or one of the ops in use
+	IoUring(unsigned entries);
+	IoUring(IoUring const&) = delete;
+	IoUring& operator=(IoUring const&) = delete;
+	~IoUring();
+
+	// true, if every opcode is available
+	bool supports(std::initializer_list<uint8_t> opcodes) const;
+
+	// nullptr, if the submission queue is full, submit() first
+	io_uring_sqe* get_sqe();
+
+	// publishes prepared sqes and waits for at least wait_nr completions
+	void submit(unsigned wait_nr = 0);
+
+	// calls f(io_uring_cqe const&) for every available completion,
+	// returns the number of completions consumed
+	template<typename F>
+	unsigned for_each_cqe(F&& f) {
+		unsigned head  = *_cq_head;
+		unsigned tail  = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+		unsigned count = 0;
+		for(; head != tail; ++head, ++count) {
+			f(_cqes[head & _cq_mask]);
+		}
+		__atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+		return count;
+	}
+
+	// Provided buffer ring, used by recv with IOSQE_BUFFER_SELECT.
+	// count must be a power of two.
+	void register_buffer_ring(uint16_t group, unsigned count, unsigned buffer_size);
+	std::byte* buffer(uint16_t id) const;
+	unsigned buffer_size() const;
+	uint16_t buffer_group() const;
+	// hand a consumed buffer back to the kernel, visible after commit_buffers()
+	void recycle_buffer(uint16_t id);
+	void commit_buffers();
+
+	uint64_t enter_calls() const;
+};
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+
+struct SHM_Mapping;
+struct SHM_Slot;
+struct SHM_Ring;
+
+// Stream socket on top of a shared memory segment.
+// Every connection owns one slot of the segment with a request and a
+// response ring. Both sides spin shortly and then sleep on a futex, so a
+// round trip on the same host does not enter the network stack at all.
+class SHM_Socket {
+	friend class SHM_ServerSocket;
+	friend class SHM_ClientSocket;
+
+private:
+	std::shared_ptr<SHM_Mapping> _mapping;
+	SHM_Slot*                    _slot      = nullptr;
+	bool                         _is_server = false;
+
+	SHM_Ring& in_ring() const;
+	SHM_Ring& out_ring() const;
+	bool is_peer_closed(bool check_process) const;
+	bool wait_readable(uint64_t size, long timeout_secs, int timeout_usecs, bool has_timeout) const;
+
+public:
+	SHM_Socket();
+	SHM_Socket(SHM_Socket const&) = delete;
+	SHM_Socket& operator=(SHM_Socket const&) = delete;
+	SHM_Socket(SHM_Socket&& o);
+	~SHM_Socket();
+
+	uint64_t send(const void* buffer, uint64_t size) const;
+	uint64_t recv(void* buffer, uint64_t size) const;
+	uint64_t recv_exact(void* buffer, uint64_t size) const;
+	uint64_t peek(void* buffer, uint64_t size) const;
+	uint64_t recv_nonblocking(void* buffer, uint64_t size) const;
+	uint64_t peek_nonblocking(void* buffer, uint64_t size) const;
+
+	bool can_read(long timeout_secs, int timeout_usecs) const;
+	bool can_write(long timeout_secs, int timeout_usecs) const;
+
+	bool is_valid() const;
+	void close();
+	void shutdown_recv();
+	void shutdown_send();
+	void shutdown();
+};
+
+class SHM_ServerSocket {
+private:
+	std::shared_ptr<SHM_Mapping> _mapping;
+
+public:
+	// name: segment name as passed to shm_open, leading '/' is optional
+	SHM_ServerSocket(std::string const& name);
+
+	// true, if a client waits to be accepted
+	bool can_read(long timeout_secs, int timeout_usecs) const;
+	void accept(SHM_Socket& new_socket) const;
+};
+
+class SHM_ClientSocket : public SHM_Socket {
+public:
+	SHM_ClientSocket(std::string const& name);
+};
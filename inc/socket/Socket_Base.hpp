@@ -14,8 +14,8 @@ protected:
 		return _socket;
 	}
 public:
-	Socket_Base(int socket_type) {
-		_socket.create(socket_type);
+	Socket_Base(int socket_type, int domain = AF_INET) {
+		_socket.create(socket_type, domain);
 	}
 	bool can_read(long timeout_secs, int timeout_usecs) const {
 		return _socket.can_read(timeout_secs, timeout_usecs);
@@ -29,6 +29,9 @@ public:
 	bool is_valid() const {
 		return _socket.is_valid();
 	}
+	int native_handle() const {
+		return _socket.native_handle();
+	}
 	void shutdown_recv() {
 		_socket.shutdown_recv();
 	}
@@ -4,6 +4,7 @@
 #include <string>
 #include <cstdint>
 #include <mutex>
+#include <sys/socket.h>
 
 class Socket_impl {
 public:
@@ -12,23 +13,33 @@ public:
 	Socket_impl(Socket_impl&& o);
 	~Socket_impl();
 
-	void create(int socket_type);
+	void create(int socket_type, int domain = AF_INET);
 	void enable_broadcast(bool enable) const;
 	void enable_reuse_address(bool enable) const;
 	void join_multicast_group(std::string const& group) const;
+	void set_multicast_ttl(int ttl) const;
+	void enable_multicast_loop(bool enable) const;
 
 	void close();
 	void shutdown_recv();
 	void shutdown_send();
 	void shutdown();
-	void bind(int port);
+	// loopback_only: reachable from this host only
+	void bind(int port, bool loopback_only = false);
+	// AF_UNIX, a leading '@' selects the abstract namespace
+	void bind(std::string const& unix_path);
 	void listen(int max_connections) const;
 	void accept(Socket_impl& new_socket) const;
 	
 	bool is_valid() const ;
+	int native_handle() const;
 
 	void connect(const std::string host, const int port) const;
 	void connect(const std::string host, const int port, int max_tries) const;
+	void connect(std::string const& unix_path) const;
+
+	// AF_UNIX only: pid, uid and gid of the connected peer
+	ucred peer_credentials() const;
 
 	uint64_t send(const void* buffer, uint64_t size) const;
 	uint64_t peek(void* buffer, uint64_t size) const;
@@ -31,11 +31,11 @@ public:
 
 class TCP_ServerSocket : public TCP_Socket {
 public:
-	TCP_ServerSocket(int port, bool enable_reuse_address = false, int max_connections = 128) {
+	TCP_ServerSocket(int port, bool enable_reuse_address = false, int max_connections = 128, bool loopback_only = false) {
 		if(enable_reuse_address) {
 			socket().enable_reuse_address(true);
 		}
-		socket().bind(port);
+		socket().bind(port, loopback_only);
 		socket().listen(max_connections);
 	}
 	void accept(TCP_Socket& new_socket) const {
@@ -19,6 +19,12 @@ public:
 	void join_multicast_group(std::string const& group) {
 		socket().join_multicast_group(group);
 	}
+	void set_multicast_ttl(int ttl) {
+		socket().set_multicast_ttl(ttl);
+	}
+	void enable_multicast_loop(bool enable) {
+		socket().enable_multicast_loop(enable);
+	}
 	uint64_t sendto(const Address& dst, const void* buffer, uint64_t size ) const {
 		return socket().sendto(dst, buffer, size);
 	}
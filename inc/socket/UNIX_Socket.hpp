@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unistd.h>
+#include "socket/Socket_Base.hpp"
+
+// Stream socket in the AF_UNIX domain.
+// Paths starting with '@' live in the abstract namespace and vanish with
+// the last socket, all others are socket files in the filesystem.
+class UNIX_Socket : public Socket_Base {
+	friend class UNIX_ServerSocket;
+
+public:
+	UNIX_Socket()
+		: Socket_Base(SOCK_STREAM, AF_UNIX)
+	{}
+	uint64_t send(const void* buffer, uint64_t size) const {
+		return socket().send(buffer, size);
+	}
+	uint64_t recv(void* buffer, uint64_t size) const {
+		return socket().recv(buffer, size);
+	}
+	uint64_t recv_exact(void* buffer, uint64_t size) const {
+		return socket().recv_exact(buffer, size);
+	}
+	uint64_t peek(void* buffer, uint64_t size) const {
+		return socket().peek(buffer, size);
+	}
+	uint64_t recv_nonblocking(void* buffer, uint64_t size) const {
+		return socket().recv_nonblocking(buffer, size);
+	}
+	uint64_t peek_nonblocking(void* buffer, uint64_t size) const {
+		return socket().peek_nonblocking(buffer, size);
+	}
+	ucred peer_credentials() const {
+		return socket().peer_credentials();
+	}
+};
+
+class UNIX_ServerSocket : public UNIX_Socket {
+private:
+	std::string _path;
+
+public:
+	UNIX_ServerSocket(std::string const& path, int max_connections = 128)
+		: _path(path)
+	{
+		socket().bind(path);
+		socket().listen(max_connections);
+	}
+	UNIX_ServerSocket(UNIX_ServerSocket&& o)
+		: UNIX_Socket(std::move(o))
+		, _path(std::move(o._path))
+	{
+		o._path.clear();
+	}
+	~UNIX_ServerSocket() {
+		if(!_path.empty() && _path[0] != '@') {
+			::unlink(_path.c_str());
+		}
+	}
+	void accept(UNIX_Socket& new_socket) const {
+		socket().accept(new_socket.socket());
+	}
+};
+
+class UNIX_ClientSocket : public UNIX_Socket {
+public:
+	UNIX_ClientSocket(std::string const& path) {
+		socket().connect(path);
+	}
+};
@@ -27,6 +27,22 @@ struct CommandLineArguments {
 		return default_value;
 	}
 	
+	// all values of a repeatable argument, e.g. --listen=a --listen=b
+	template<typename T>
+	std::vector<T> get_all(std::string_view prefix) const {
+		std::vector<T> values;
+		for(std::string const& arg : args) {
+			if(std::string_view(arg).substr(0, prefix.size()) == prefix) {
+				std::stringstream ss(arg.substr(prefix.size()));
+				T value;
+				if(ss >> value) {
+					values.push_back(value);
+				}
+			}
+		}
+		return values;
+	}
+	
 	const_iterator find_prefix(std::string_view prefix) const {
 		using std::begin;
 		using std::end;
@@ -41,4 +57,8 @@ struct CommandLineArguments {
 	bool has_prefix(std::string_view prefix) const {
 		return find_prefix(prefix) != end(args);
 	}
+	// a flag exactly, --stats but not --stats_interval=
+	bool has(std::string_view flag) const {
+		return std::find(args.begin(), args.end(), flag) != args.end();
+	}
 };
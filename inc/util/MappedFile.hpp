@@ -0,0 +1,61 @@
+#pragma once
+#include "socket/PosixError.hpp"
+#include <cstddef>
+#include <span>
+#include <string>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read only mapping of a whole file, throws PosixError.
+class MappedFile {
+private:
+	void*       _data = nullptr;
+	std::size_t _size = 0;
+
+public:
+	explicit MappedFile(std::string const& path) {
+		int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if(fd < 0) {
+			throw PosixError("MappedFile::open " + path, errno);
+		}
+		struct stat st;
+		if(::fstat(fd, &st) != 0) {
+			int e = errno;
+			::close(fd);
+			throw PosixError("MappedFile::fstat " + path, e);
+		}
+		_size = static_cast<std::size_t>(st.st_size);
+		if(_size != 0) {
+			_data = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+			if(_data == MAP_FAILED) {
+				int e = errno;
+				::close(fd);
+				throw PosixError("MappedFile::mmap " + path, e);
+			}
+		}
+		::close(fd);
+	}
+	MappedFile(MappedFile&& other) noexcept
+		: _data{std::exchange(other._data, nullptr)}
+		, _size{std::exchange(other._size, 0)}
+	{}
+	MappedFile(MappedFile const&) = delete;
+	MappedFile& operator=(MappedFile const&) = delete;
+	~MappedFile() {
+		if(_data) {
+			::munmap(_data, _size);
+		}
+	}
+
+	auto bytes() const
+		-> std::span<std::byte const>
+	{
+		return {static_cast<std::byte const*>(_data), _size};
+	}
+	std::size_t size() const {
+		return _size;
+	}
+};
@@ -3,6 +3,7 @@
 #include <condition_variable>
 #include <queue>
 #include <optional>
+#include <utility>
 
 template<typename T>
 class SynchronizedQueue {
@@ -50,6 +51,34 @@ public:
 		}
 		return false;
 	}
+	// keeps at most max_size values by dropping the oldest ones,
+	// returns how many were dropped
+	std::size_t push_latest(value_t v, std::size_t max_size) {
+		std::unique_lock<std::mutex> lock(mutex);
+		if(!_is_running) {
+			return 0;
+		}
+		std::size_t dropped = 0;
+		while(!data.empty() && data.size() >= max_size) {
+			data.pop();
+			++dropped;
+		}
+		data.push(std::move(v));
+		lock.unlock();
+		state_changed.notify_all();
+		return dropped;
+	}
+	// pushes only while fewer than max_size values wait
+	bool try_push(value_t v, std::size_t max_size) {
+		std::unique_lock<std::mutex> lock(mutex);
+		if(_is_running && data.size() < max_size) {
+			data.push(std::move(v));
+			lock.unlock();
+			state_changed.notify_all();
+			return true;
+		}
+		return false;
+	}
 	pop_t pop() {
 		std::unique_lock<std::mutex> lock(mutex);
 		while(_is_running && data.empty()) {
@@ -58,7 +87,7 @@ public:
 		if(data.empty()) {
 			return {};
 		} else {
-			auto v = data.front();
+			auto v = std::move(data.front());
 			data.pop();
 			lock.unlock();
 			state_changed.notify_all();
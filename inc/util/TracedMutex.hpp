@@ -0,0 +1,89 @@
+#pragma once
+#include "util/time_this.hpp"
+#include "util/Tracer.hpp"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// std::mutex that counts its locks and how long the contended ones waited,
+// and while tracing is enabled records how long a thread waited for it
+// (name.wait) and held it (name.hold). Usable with std::lock_guard and
+// std::unique_lock. An uncontended lock costs one try_lock more than a
+// plain std::mutex, the clock is only read for contended or traced ones.
+class TracedMutex {
+public:
+	// written while holding the mutex, readable any time
+	struct Counters {
+		std::atomic<uint64_t> locks{0};
+		std::atomic<uint64_t> contended{0};
+		TimeHistogram         waits;   // of the contended locks, ns
+	};
+
+private:
+	std::mutex mutex;
+	uint32_t   wait_name;
+	uint32_t   hold_name;
+	uint64_t   hold_start = 0;   // of the owner, if traced
+	bool       traced     = false;
+	Counters   _counters;
+
+	void count() {
+		_counters.locks.store(_counters.locks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+public:
+	explicit TracedMutex(std::string const& name)
+		: wait_name{Tracer::get().add_name(name + ".wait")}
+		, hold_name{Tracer::get().add_name(name + ".hold")}
+	{}
+	TracedMutex(TracedMutex const&) = delete;
+	TracedMutex& operator=(TracedMutex const&) = delete;
+
+	Counters const& counters() const {
+		return _counters;
+	}
+
+	void lock() {
+		bool     sampled = Tracer::get().sample();
+		uint64_t start   = sampled ? Tracer::now() : 0;
+		if(mutex.try_lock()) {
+			if(sampled) {
+				hold_start = Tracer::now();
+			}
+		} else {
+			if(!sampled) {
+				start = Tracer::now();
+			}
+			mutex.lock();
+			hold_start = Tracer::now();
+			_counters.contended.store(_counters.contended.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			_counters.waits.add(hold_start - start);
+		}
+		count();
+		traced = sampled;
+		if(sampled) {
+			Tracer::get().record(wait_name, start, hold_start);
+		}
+	}
+	bool try_lock() {
+		if(!mutex.try_lock()) {
+			return false;
+		}
+		count();
+		traced = Tracer::get().sample();
+		if(traced) {
+			hold_start = Tracer::now();
+		}
+		return true;
+	}
+	void unlock() {
+		bool     was_traced = traced;
+		uint64_t start      = hold_start;
+		traced = false;
+		mutex.unlock();
+		if(was_traced) {
+			Tracer::get().record(hold_name, start, Tracer::now());
+		}
+	}
+};
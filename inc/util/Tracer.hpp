@@ -0,0 +1,256 @@
+#pragma once
+#include "config/Trace.hpp"
+#include "util/ZoneName.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <pthread.h>
+
+// Opt-in event tracer: every traced scope becomes a complete event (name,
+// start, duration) in a ring of the calling thread, the oldest events are
+// overwritten. Only every sample_every-th scope of a thread is recorded.
+// Nothing is locked on the recording path; dump() copies the rings while
+// they are written and drops what was overwritten meanwhile, then writes
+// Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+class Tracer {
+private:
+	struct Event {
+		std::atomic<uint64_t> start{0};      // ns, steady clock
+		std::atomic<uint64_t> duration{0};   // ns
+		std::atomic<uint32_t> name{0};
+	};
+
+public:
+	struct ThreadBuffer {
+		std::vector<Event>    events{robo::config::Trace::events_per_thread};
+		std::atomic<uint64_t> written{0};
+		uint32_t              tid;
+		std::string           thread_name;
+		uint64_t              scopes = 0;   // for sampling, owner only
+	};
+
+private:
+	// registers the calling thread, retires its ring when it ends
+	struct ThreadSlot {
+		ThreadBuffer* buffer;
+
+		ThreadSlot()
+			: buffer{Tracer::get().attach()}
+		{}
+		~ThreadSlot() {
+			Tracer::get().detach(buffer);
+		}
+	};
+
+	std::mutex                                mutex;   // names, thread registration, dump
+	std::vector<std::string>                  names;
+	std::vector<ThreadBuffer*>                threads;
+	std::deque<std::unique_ptr<ThreadBuffer>> retired;
+	uint32_t                                  next_tid = 1;
+	std::atomic<bool>                         _enabled{false};
+	std::atomic<uint64_t>                     _sample_every{1};
+
+	ThreadBuffer* attach() {
+		auto* b = new ThreadBuffer;
+		char name[32] = {};
+		pthread_getname_np(pthread_self(), name, sizeof(name));
+		b->thread_name = name;
+		std::lock_guard<std::mutex> lock(mutex);
+		b->tid = next_tid++;
+		threads.push_back(b);
+		return b;
+	}
+	void detach(ThreadBuffer* b) {
+		std::lock_guard<std::mutex> lock(mutex);
+		threads.erase(std::find(threads.begin(), threads.end(), b));
+		retired.emplace_back(b);
+		if(retired.size() > robo::config::Trace::retired_threads) {
+			retired.pop_front();
+		}
+	}
+
+	struct Copy {
+		uint64_t start;
+		uint64_t duration;
+		uint32_t name;
+	};
+	// the events of b that were not overwritten while copying
+	static auto copy(ThreadBuffer const& b)
+		-> std::vector<Copy>
+	{
+		std::size_t const capacity = b.events.size();
+		uint64_t end   = b.written.load(std::memory_order_acquire);
+		uint64_t begin = end > capacity ? end - capacity : 0;
+		std::vector<Copy> result;
+		result.reserve(static_cast<std::size_t>(end - begin));
+		for(uint64_t i = begin; i < end; ++i) {
+			Event const& e = b.events[i % capacity];
+			result.push_back({
+				  e.start.load(std::memory_order_relaxed)
+				, e.duration.load(std::memory_order_relaxed)
+				, e.name.load(std::memory_order_relaxed)
+			});
+		}
+		// the slot after the last published one may be half written
+		uint64_t now   = b.written.load(std::memory_order_acquire);
+		uint64_t valid = now + 1 > capacity ? now + 1 - capacity : 0;
+		if(valid > begin) {
+			result.erase(result.begin(), result.begin() + static_cast<std::ptrdiff_t>(std::min(valid - begin, end - begin)));
+		}
+		return result;
+	}
+
+	static void write_string(std::FILE* f, std::string const& s) {
+		std::fputc('"', f);
+		for(char c : s) {
+			if(c == '"' || c == '\\') {
+				std::fputc('\\', f);
+			}
+			if(static_cast<unsigned char>(c) >= 0x20) {
+				std::fputc(c, f);
+			}
+		}
+		std::fputc('"', f);
+	}
+
+public:
+	static Tracer& get() {
+		static Tracer tracer;
+		return tracer;
+	}
+	static ThreadBuffer& this_thread() {
+		thread_local ThreadSlot slot;
+		return *slot.buffer;
+	}
+	static uint64_t now() {
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()
+		).count());
+	}
+
+	bool enabled() const {
+		return _enabled.load(std::memory_order_relaxed);
+	}
+	void set_enabled(bool enabled) {
+		_enabled.store(enabled, std::memory_order_relaxed);
+	}
+	// record one in n scopes per thread
+	void set_sample_every(uint64_t n) {
+		_sample_every.store(std::max<uint64_t>(n, 1), std::memory_order_relaxed);
+	}
+
+	uint32_t add_name(std::string const& name) {
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = std::find(names.begin(), names.end(), name);
+		if(it != names.end()) {
+			return static_cast<uint32_t>(it - names.begin());
+		}
+		names.push_back(name);
+		return static_cast<uint32_t>(names.size() - 1);
+	}
+
+	// whether the scope starting now on this thread is recorded
+	bool sample() {
+		if(!enabled()) {
+			return false;
+		}
+		ThreadBuffer& b = this_thread();
+		return b.scopes++ % _sample_every.load(std::memory_order_relaxed) == 0;
+	}
+	void record(uint32_t name, uint64_t start, uint64_t end) {
+		ThreadBuffer& b = this_thread();
+		uint64_t w = b.written.load(std::memory_order_relaxed);
+		Event&   e = b.events[w % b.events.size()];
+		e.start.store(start, std::memory_order_relaxed);
+		e.duration.store(end - start, std::memory_order_relaxed);
+		e.name.store(name, std::memory_order_relaxed);
+		b.written.store(w + 1, std::memory_order_release);
+	}
+
+	// Writes the events held right now as Chrome trace JSON, returns how
+	// many or -1 if path cannot be written.
+	long dump(std::string const& path) {
+		std::FILE* f = std::fopen(path.c_str(), "w");
+		if(!f) {
+			return -1;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		long n = 0;
+		std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", f);
+		auto thread = [&](ThreadBuffer const& b) {
+			std::fprintf(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", n ? ",\n" : "", b.tid);
+			write_string(f, b.thread_name.empty() ? "thread " + std::to_string(b.tid) : b.thread_name);
+			std::fputs("}}", f);
+			++n;
+			for(Copy const& e : copy(b)) {
+				std::fputs(",\n{\"ph\":\"X\",\"name\":", f);
+				write_string(f, e.name < names.size() ? names[e.name] : "?");
+				std::fprintf(
+					  f
+					, ",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}"
+					, b.tid
+					, e.start * 1e-3
+					, e.duration * 1e-3
+				);
+				++n;
+			}
+		};
+		for(auto const& b : retired) {
+			thread(*b);
+		}
+		for(ThreadBuffer const* b : threads) {
+			thread(*b);
+		}
+		std::fputs("\n]}\n", f);
+		std::fclose(f);
+		return n;
+	}
+};
+
+template<ZoneName name>
+struct TraceName {
+	inline static uint32_t const id = Tracer::get().add_name(name.c_str());
+};
+
+// Qualified name of T as the compiler spells it, e.g.
+// "robo::QueryVisionCommand::Request", without constructing a T.
+template<typename T>
+constexpr std::string_view type_name_of() {
+	std::string_view s     = __PRETTY_FUNCTION__;
+	std::size_t      first = s.find("T = ") + 4;
+	return s.substr(first, s.find_first_of(";]", first) - first);
+}
+
+// Records the lifetime of the scope as event name, if sampled.
+class TraceScope {
+private:
+	uint32_t name;
+	uint64_t start;
+	bool     active;
+
+public:
+	explicit TraceScope(uint32_t name)
+		: name{name}
+		, start{0}
+		, active{Tracer::get().sample()}
+	{
+		if(active) {
+			start = Tracer::now();
+		}
+	}
+	TraceScope(TraceScope const&) = delete;
+	TraceScope& operator=(TraceScope const&) = delete;
+	~TraceScope() {
+		if(active) {
+			Tracer::get().record(name, start, Tracer::now());
+		}
+	}
+};
@@ -0,0 +1,48 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+// Latest value handover from one writer to one reader without locks or
+// waiting: the writer fills back() and publish()es it, the reader take()s
+// the latest published one whenever it likes, values published meanwhile
+// are skipped. The three buffers rotate and are never freed, so values
+// that reuse their storage (vectors assigned in place) stop allocating.
+// Writes must not overlap, neither must reads.
+template<typename T>
+class TripleBuffer {
+private:
+	constexpr static uint8_t fresh = 4;   // middle holds a value not taken yet
+
+	std::array<T, 3>     buffers;
+	std::atomic<uint8_t> middle{1};
+	uint8_t              back_index  = 0;   // writer
+	uint8_t              front_index = 2;   // reader
+
+public:
+	// writer: the buffer to fill, holds whatever was there before
+	T& back() {
+		return buffers[back_index];
+	}
+	void publish() {
+		back_index = middle.exchange(back_index | fresh, std::memory_order_acq_rel) & ~fresh;
+	}
+	// writer: true once the reader took the last published value, so
+	// a writer faster than its reader can skip filling values nobody sees
+	bool is_taken() const {
+		return !(middle.load(std::memory_order_relaxed) & fresh);
+	}
+
+	// reader: swaps the latest published value into value and returns
+	// true, or returns false if there is none since the last call. The
+	// old value goes back to the writer.
+	bool take(T& value) {
+		if(!(middle.load(std::memory_order_relaxed) & fresh)) {
+			return false;
+		}
+		front_index = middle.exchange(front_index, std::memory_order_acq_rel) & ~fresh;
+		std::swap(value, buffers[front_index]);
+		return true;
+	}
+};
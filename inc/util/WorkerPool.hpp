@@ -0,0 +1,118 @@
+#pragma once
+#include "util/name_this_thread.hpp"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Fixed set of threads for data parallel loops. parallel_for hands out the
+// indices one by one, the calling thread works along and returns once all
+// of them are done. Without threads everything runs on the caller.
+// Loops of concurrent callers run one after the other.
+class WorkerPool {
+private:
+	std::vector<std::thread>               threads;
+	std::mutex                             loop_mutex;
+	std::mutex                             mutex;
+	std::condition_variable                work_available;
+	std::condition_variable                work_done;
+	std::function<void(std::size_t)> const* task   = nullptr;
+	std::size_t                            count   = 0;
+	std::size_t                            next    = 0;
+	std::size_t                            pending = 0;
+	uint64_t                               generation = 0;
+	std::exception_ptr                     error;
+	bool                                   stop = false;
+
+	// runs indices of the current loop until there are none left
+	void work(std::unique_lock<std::mutex>& lock) {
+		while(next < count) {
+			std::size_t i = next++;
+			auto const& f = *task;
+			lock.unlock();
+			std::exception_ptr e;
+			try {
+				f(i);
+			} catch(...) {
+				e = std::current_exception();
+			}
+			lock.lock();
+			if(e && !error) {
+				error = e;
+			}
+			if(--pending == 0) {
+				work_done.notify_all();
+			}
+		}
+	}
+
+	void run(std::size_t index) {
+		name_this_thread("worker" + std::to_string(index));
+		std::unique_lock<std::mutex> lock{mutex};
+		uint64_t seen = generation;
+		while(true) {
+			work_available.wait(lock, [&]{ return stop || generation != seen; });
+			if(stop) {
+				return;
+			}
+			seen = generation;
+			work(lock);
+		}
+	}
+
+public:
+	explicit WorkerPool(std::size_t n_threads) {
+		threads.reserve(n_threads);
+		for(std::size_t i = 0; i < n_threads; ++i) {
+			threads.emplace_back([this, i]{ run(i); });
+		}
+	}
+	WorkerPool(WorkerPool const&) = delete;
+	WorkerPool& operator=(WorkerPool const&) = delete;
+	~WorkerPool() {
+		{
+			std::lock_guard<std::mutex> lock{mutex};
+			stop = true;
+		}
+		work_available.notify_all();
+		for(auto& t : threads) {
+			t.join();
+		}
+	}
+
+	std::size_t size() const {
+		return threads.size();
+	}
+
+	// calls f(i) for all i in [0, n), rethrows the first exception
+	void parallel_for(std::size_t n, std::function<void(std::size_t)> const& f) {
+		if(threads.empty() || n < 2) {
+			for(std::size_t i = 0; i < n; ++i) {
+				f(i);
+			}
+			return;
+		}
+		std::lock_guard<std::mutex>  loop_lock{loop_mutex};
+		std::unique_lock<std::mutex> lock{mutex};
+		task    = &f;
+		count   = n;
+		next    = 0;
+		pending = n;
+		error   = nullptr;
+		++generation;
+		work_available.notify_all();
+		work(lock);
+		work_done.wait(lock, [&]{ return pending == 0; });
+		task  = nullptr;
+		count = 0;
+		if(error) {
+			std::rethrow_exception(std::exchange(error, nullptr));
+		}
+	}
+};
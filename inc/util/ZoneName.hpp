@@ -0,0 +1,16 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+
+// string literal as template argument, names of time_this and trace zones
+template<std::size_t N>
+struct ZoneName {
+	char chars[N];
+
+	constexpr ZoneName(char const (&s)[N]) {
+		std::copy_n(s, N, chars);
+	}
+	constexpr char const* c_str() const {
+		return chars;
+	}
+};
@@ -0,0 +1,79 @@
+#pragma once
+#include "socket/PosixError.hpp"
+#include <cerrno>
+#include <chrono>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+// Placement and timing of latency critical threads, throws PosixError.
+
+// the cpus this process may run on but cpu, for everybody else when cpu
+// is reserved; taskset and cpusets narrow the set
+inline std::vector<int> cpus_except(int cpu) {
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if(::sched_getaffinity(0, sizeof(set), &set) != 0) {
+		throw PosixError("cpus_except", errno);
+	}
+	std::vector<int> result;
+	for(int i = 0; i < CPU_SETSIZE; ++i) {
+		if(i != cpu && CPU_ISSET(i, &set)) {
+			result.push_back(i);
+		}
+	}
+	if(result.empty()) {
+		throw PosixError("cpus_except: no cpu left besides " + std::to_string(cpu), EINVAL);
+	}
+	return result;
+}
+
+// Threads started by the calling one afterwards inherit the set.
+inline void pin_this_thread(std::vector<int> const& cpus) {
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for(int cpu : cpus) {
+		if(cpu < 0 || cpu >= CPU_SETSIZE) {
+			throw PosixError("pin_this_thread cpu " + std::to_string(cpu), EINVAL);
+		}
+		CPU_SET(cpu, &set);
+	}
+	if(int e = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set); e != 0) {
+		throw PosixError("pin_this_thread", e);
+	}
+}
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	asm volatile("yield");
+#endif
+}
+
+// Sleeps on CLOCK_MONOTONIC (steady_clock) until spin before deadline,
+// then busy waits for the rest: wakeups from sleep are late by the timer
+// slack and the scheduler, spinning is late by a clock read. spin should
+// cover the wakeup latency of the box, zero sleeps all the way.
+inline void sleep_then_spin_until(
+	  std::chrono::steady_clock::time_point deadline
+	, std::chrono::steady_clock::duration   spin
+) {
+	using std::chrono::steady_clock;
+	steady_clock::time_point wake = deadline - spin;
+	if(steady_clock::now() < wake) {
+		auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(wake.time_since_epoch()).count();
+		timespec t{
+			  static_cast<time_t>(ns / 1000000000)
+			, static_cast<long>(ns % 1000000000)
+		};
+		while(::clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, nullptr) == EINTR) {
+		}
+	}
+	while(steady_clock::now() < deadline) {
+		cpu_relax();
+	}
+}
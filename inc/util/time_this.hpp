@@ -1,112 +1,278 @@
 #pragma once
+#include "util/Tracer.hpp"
+#include "util/ZoneName.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
 #include <mutex>
-#include <map>
-#include <vector>
+#include <stdexcept>
 #include <string>
-#include <iostream>
-#include <algorithm>
+#include <vector>
+
+// Timing zones for time_this<"name">(op). Every name is a zone with an id
+// fixed at static initialization, a call indexes per thread histograms by
+// that id: no lock, no lookup, no read-modify-write shared with another
+// thread. Readers merge the histograms of all threads on demand.
+
+// Log-linear histogram of nanoseconds: exact below sub_buckets, above that
+// every power of two is split into sub_buckets buckets (~3% resolution).
+// Written by one thread only, readable by any.
+struct TimeHistogram {
+	constexpr static unsigned    sub_bits    = 5;
+	constexpr static uint64_t    sub_buckets = uint64_t{1} << sub_bits;
+	constexpr static unsigned    octaves     = 40;   // up to ~18 minutes
+	constexpr static std::size_t size        = (octaves - sub_bits + 1) * sub_buckets;
+
+	std::array<std::atomic<uint64_t>, size> counts{};
+	std::atomic<uint64_t>                   count{0};
+	std::atomic<uint64_t>                   sum{0};
+	std::atomic<uint64_t>                   max{0};
+
+	constexpr static std::size_t index(uint64_t ns) {
+		ns = std::min(ns, (uint64_t{1} << octaves) - 1);
+		if(ns < sub_buckets) {
+			return ns;
+		}
+		unsigned shift = static_cast<unsigned>(std::bit_width(ns)) - 1 - sub_bits;
+		return (shift + 1) * sub_buckets + ((ns >> shift) - sub_buckets);
+	}
+	// smallest value and width of bucket i
+	constexpr static uint64_t lower(std::size_t i) {
+		if(i < sub_buckets) {
+			return i;
+		}
+		unsigned shift = static_cast<unsigned>(i / sub_buckets) - 1;
+		return (sub_buckets + i % sub_buckets) << shift;
+	}
+	constexpr static uint64_t width(std::size_t i) {
+		return i < sub_buckets ? 1 : uint64_t{1} << (i / sub_buckets - 1);
+	}
+
+	// single writer, plain loads and stores suffice
+	void add(uint64_t ns) {
+		auto bump = [](std::atomic<uint64_t>& a, uint64_t v) {
+			a.store(a.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+		};
+		bump(counts[index(ns)], 1);
+		bump(count, 1);
+		bump(sum, ns);
+		if(ns > max.load(std::memory_order_relaxed)) {
+			max.store(ns, std::memory_order_relaxed);
+		}
+	}
+};
+
+// Merged copy of histograms, what readers get.
+struct TimeSummary {
+	std::string           name;
+	std::vector<uint64_t> counts = std::vector<uint64_t>(TimeHistogram::size);
+	uint64_t              count  = 0;
+	uint64_t              sum    = 0;   // ns
+	uint64_t              max    = 0;   // ns
+
+	void merge(TimeHistogram const& h) {
+		for(std::size_t i = 0; i < TimeHistogram::size; ++i) {
+			counts[i] += h.counts[i].load(std::memory_order_relaxed);
+		}
+		count += h.count.load(std::memory_order_relaxed);
+		sum   += h.sum.load(std::memory_order_relaxed);
+		max    = std::max(max, h.max.load(std::memory_order_relaxed));
+	}
+	void merge(TimeSummary const& s) {
+		for(std::size_t i = 0; i < TimeHistogram::size; ++i) {
+			counts[i] += s.counts[i];
+		}
+		count += s.count;
+		sum   += s.sum;
+		max    = std::max(max, s.max);
+	}
+
+	// seconds
+	double total() const {
+		return sum * 1e-9;
+	}
+	double mean() const {
+		return count ? sum * 1e-9 / count : 0.0;
+	}
+	double maximum() const {
+		return max * 1e-9;
+	}
+	// q in [0, 1], middle of the bucket holding it, in seconds
+	double percentile(double q) const {
+		if(count == 0) {
+			return 0.0;
+		}
+		uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * count)));
+		uint64_t seen = 0;
+		for(std::size_t i = 0; i < TimeHistogram::size; ++i) {
+			seen += counts[i];
+			if(seen >= rank) {
+				uint64_t mid = TimeHistogram::lower(i) + TimeHistogram::width(i) / 2;
+				return std::min(mid, max) * 1e-9;
+			}
+		}
+		return maximum();
+	}
+
+	template<typename OS>
+	friend
+	OS& operator<<(OS& os, TimeSummary const& s) {
+		auto us = [](double seconds) {
+			return seconds * 1e6;
+		};
+		return os
+			<< "calls: "  << s.count
+			<< ", total: " << s.total() << 's'
+			<< ", mean: "  << us(s.mean())            << "us"
+			<< ", p50: "   << us(s.percentile(0.5))   << "us"
+			<< ", p90: "   << us(s.percentile(0.9))   << "us"
+			<< ", p99: "   << us(s.percentile(0.99))  << "us"
+			<< ", p99.9: " << us(s.percentile(0.999)) << "us"
+			<< ", max: "   << us(s.maximum())         << "us"
+		;
+	}
+};
 
 struct TimeStats {
-	struct S {
-		double      sum = 0;
-		std::size_t n   = 0;
-		
-		void update(double t) {
-			sum += t;
-			++n;
-		}
-		
-		double average() const {
-			return sum / n;
-		}
-		
-		template<typename OS>
-		friend
-		OS& operator<<(OS& os, S const& s) {
-			return os
-				<< "avg: " << s.average() << "s/call"
-				<< ", total: " << s.sum << 's'
-				<< ", calls: " << s.n
-			;
+	constexpr static std::size_t max_zones = 64;
+
+	// histograms of one thread, allocated on its first call per zone
+	struct ThreadHistograms {
+		std::array<std::atomic<TimeHistogram*>, max_zones> zones{};
+
+		~ThreadHistograms() {
+			for(auto& z : zones) {
+				delete z.load(std::memory_order_relaxed);
+			}
+		}
+		TimeHistogram& zone(std::size_t id) {
+			TimeHistogram* h = zones[id].load(std::memory_order_relaxed);
+			if(!h) {
+				h = new TimeHistogram;
+				zones[id].store(h, std::memory_order_release);
+			}
+			return *h;
 		}
 	};
-	template<typename Str, typename clock_t>
-	struct Lock {
-		typename clock_t::time_point begin;
-		Str const&                   name;
-		TimeStats&                   ts;
-		Lock(Str const& name, TimeStats& ts)
-			: begin{clock_t::now()}
-			, name{name}
-			, ts{ts}
+
+	// registers the calling thread, merges it into retired when it ends
+	struct ThreadSlot {
+		ThreadHistograms* histograms;
+
+		ThreadSlot()
+			: histograms{TimeStats::get().attach()}
 		{}
-		~Lock() {
-			ts.add(
-				  name
-				, std::chrono::duration<double>{
-					clock_t::now() - begin
-				}.count()
-			);
+		~ThreadSlot() {
+			TimeStats::get().detach(histograms);
 		}
 	};
-	
-	std::mutex mutex;
-	std::map<std::string, S> times;
-	bool _enabled = false;
-	
-	bool enabled() {
-		std::lock_guard<std::mutex> lock(mutex);
-		return _enabled;
+
+	std::mutex                     mutex;   // zone and thread registration, readers
+	std::vector<std::string>       names;
+	std::vector<ThreadHistograms*> threads;
+	std::vector<TimeSummary>       retired;   // of threads that ended
+	std::atomic<bool>              _enabled{false};
+	std::atomic<bool>              _print_at_exit{true};
+
+	bool enabled() const {
+		return _enabled.load(std::memory_order_relaxed);
 	}
 	void set_enabled(bool enabled) {
+		_enabled.store(enabled, std::memory_order_relaxed);
+	}
+	// whether an enabled TimeStats prints its zones when destroyed
+	void set_print_at_exit(bool print) {
+		_print_at_exit.store(print, std::memory_order_relaxed);
+	}
+
+	std::size_t add_zone(char const* name) {
 		std::lock_guard<std::mutex> lock(mutex);
-		_enabled = enabled;
+		auto it = std::find(names.begin(), names.end(), name);
+		if(it != names.end()) {
+			return static_cast<std::size_t>(it - names.begin());
+		}
+		if(names.size() == max_zones) {
+			throw std::length_error("TimeStats: too many zones");
+		}
+		names.push_back(name);
+		retired.emplace_back();
+		retired.back().name = name;
+		return names.size() - 1;
 	}
-	
-	void add(std::string const& name, double time) {
+	ThreadHistograms* attach() {
+		auto* h = new ThreadHistograms;
 		std::lock_guard<std::mutex> lock(mutex);
-		times[name].update(time);
+		threads.push_back(h);
+		return h;
 	}
-	
-	~TimeStats() {
-		if(!enabled()) {
-			return;
-		}
-		std::vector<std::pair<std::string, S>> entries;
-		entries.reserve(times.size());
-		std::size_t max_name_length = 0;
-		for(auto& p : times) {
-			entries.push_back(p);
-			max_name_length = std::max(max_name_length, p.first.size());
-		}
-		auto print_name = [&](auto const& p) 
-			-> std::ostream&
-		{
-			std::cout << p.first;
-			for(std::size_t n = max_name_length - p.first.size(); n;) {
-				--n;
-				std::cout << ' ';
-			}
-			return std::cout << ": ";
-		};
-		auto sorted_print = [&](auto const& what, auto pred) {
-			std::sort(entries.begin(), entries.end(), pred);
-			std::cout << "#### Times, sorted by " << what << '\n';
-			for(auto& p : entries) {
-				print_name(p) << p.second << '\n';
-			}
-		};
-		sorted_print("total time",
-			[](auto const& p1, auto const& p2) {
-				return p1.second.sum > p2.second.sum;
+	void detach(ThreadHistograms* h) {
+		std::lock_guard<std::mutex> lock(mutex);
+		for(std::size_t id = 0; id < names.size(); ++id) {
+			if(TimeHistogram* z = h->zones[id].load(std::memory_order_acquire)) {
+				retired[id].merge(*z);
 			}
-		);
-		sorted_print("average time per call"
-			, [](auto const& p1, auto const& p2) {
-				return p1.second.average() > p2.second.average();
+		}
+		threads.erase(std::find(threads.begin(), threads.end(), h));
+		delete h;
+	}
+
+	static ThreadHistograms& this_thread() {
+		thread_local ThreadSlot slot;
+		return *slot.histograms;
+	}
+	void add(std::size_t zone, uint64_t ns) {
+		this_thread().zone(zone).add(ns);
+	}
+
+	// every zone called so far, merged over all threads, live or ended
+	auto summaries()
+		-> std::vector<TimeSummary>
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::vector<TimeSummary> result = retired;
+		for(ThreadHistograms* t : threads) {
+			for(std::size_t id = 0; id < result.size(); ++id) {
+				if(TimeHistogram* z = t->zones[id].load(std::memory_order_acquire)) {
+					result[id].merge(*z);
+				}
 			}
+		}
+		result.erase(
+			  std::remove_if(result.begin(), result.end(), [](TimeSummary const& s) { return s.count == 0; })
+			, result.end()
 		);
+		return result;
+	}
+
+	template<typename OS>
+	void print(OS& os) {
+		auto entries = summaries();
+		std::size_t max_name_length = 0;
+		for(auto const& s : entries) {
+			max_name_length = std::max(max_name_length, s.name.size());
+		}
+		std::sort(entries.begin(), entries.end(), [](auto const& a, auto const& b) {
+			return a.sum > b.sum;
+		});
+		os << "#### Times, sorted by total time\n";
+		for(auto const& s : entries) {
+			os << std::left << std::setw(static_cast<int>(max_name_length)) << s.name << std::right << ": " << s << '\n';
+		}
+	}
+
+	~TimeStats() {
+		if(!enabled() || !_print_at_exit.load(std::memory_order_relaxed)) {
+			return;
+		}
+		print(std::cout);
 	}
 
 	static TimeStats& get() {
@@ -115,15 +281,30 @@ struct TimeStats {
 	}
 };
 
-template<typename Str, typename OP, typename clock_t = std::chrono::steady_clock>
-auto time_this(Str const& name, OP op) 
+template<ZoneName name>
+struct TimeZone {
+	inline static std::size_t const id = TimeStats::get().add_zone(name.c_str());
+};
+
+template<ZoneName name, typename OP, typename clock_t = std::chrono::steady_clock>
+auto time_this(OP op)
 	-> decltype(op())
 {
 	TimeStats& ts = TimeStats::get();
 	if(!ts.enabled()) {
-		return op();
-	} else{ 
-		TimeStats::Lock<Str,clock_t> lock(name, ts);
+		if(!Tracer::get().enabled()) {
+			return op();
+		}
+		TraceScope trace{TraceName<name>::id};
 		return op();
 	}
+	TraceScope trace{TraceName<name>::id};
+	struct Stop {
+		typename clock_t::time_point begin = clock_t::now();
+		~Stop() {
+			auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_t::now() - begin).count();
+			TimeStats::get().add(TimeZone<name>::id, static_cast<uint64_t>(std::max<decltype(ns)>(ns, 0)));
+		}
+	} stop;
+	return op();
 }
@@ -1,24 +1,177 @@
 #pragma once
+#include <optional>
 #include "robo_commands.hpp"
 #include "util/iterator_of.hpp"
 #include "simple_gl/MeshData.hpp"
+#include "simple_gl/ShaderProgram.hpp"
+#include "simple_gl/StreamBuffer.hpp"
+#include "simple_gl/InstanceRenderer.hpp"
 
 namespace robo {
 
+// Shared by the DebugLinesMesh of a window: a unit quad, drawn once per
+// line with GL 3.3 instancing, that the vertex shader stretches from start
+// to end and widens to the thickness, lit like the fixed function path.
+struct DebugLinesProgram {
+	using corner_vertex_t = MeshVertex<float, false, false, false>;
+
+	// one line as the shader reads it
+	struct Record {
+		Vertex<float,4> start;         // w: thickness
+		Vertex<float,4> end;
+		Vertex<float,4> color_start;
+		Vertex<float,4> color_end;
+	};
+
+	constexpr static unsigned int location_start = 10;
+
+	std::optional<ShaderProgram> program;
+	Mesh<corner_vertex_t>        quad;
+	int                          uniform_lighting = -1;
+	bool                         is_enabled = true;
+
+	DebugLinesProgram(GL_Window const* parent)
+		: quad{parent}
+	{
+		if(!InstanceRenderer::is_supported()) {
+			return;
+		}
+		program.emplace(
+			  parent
+			, std::vector<char const*>{glsl::version, glsl::light0, vertex_source}
+			, std::vector<char const*>{glsl::version, fragment_source}
+			, std::vector<std::pair<unsigned int, char const*>>{
+				  {location_start + 0, "line_start"}
+				, {location_start + 1, "line_end"}
+				, {location_start + 2, "line_color_start"}
+				, {location_start + 3, "line_color_end"}
+			}
+		);
+		// x: along the line, y: side; the corners of the expanded quads
+		std::vector<corner_vertex_t> corners(4);
+		corners[0].position = {0.0f, -1.0f, 0.0f};
+		corners[1].position = {0.0f,  1.0f, 0.0f};
+		corners[2].position = {1.0f,  1.0f, 0.0f};
+		corners[3].position = {1.0f, -1.0f, 0.0f};
+		quad.load(corners, std::vector<unsigned short>{0, 1, 2, 0, 2, 3});
+		parent->do_operation([&]() {
+			uniform_lighting = program->uniform("lighting");
+		});
+	}
+
+	bool is_usable() const {
+		return is_enabled && program && program->is_valid();
+	}
+
+	void draw(StreamBuffer<Record> const& lines) const {
+		program->use();
+		glUniform1i(uniform_lighting, glIsEnabled(GL_LIGHTING) ? 1 : 0);
+		{
+			auto lock = quad.lock();
+			glBindBuffer(GL_ARRAY_BUFFER, lines.id);
+			for(unsigned int i = 0; i < 4; ++i) {
+				glEnableVertexAttribArray(location_start + i);
+				glVertexAttribPointer(
+					  location_start + i
+					, 4
+					, GL_FLOAT
+					, GL_FALSE
+					, sizeof(Record)
+					, reinterpret_cast<void*>(i * sizeof(Vertex<float,4>))
+				);
+				glVertexAttribDivisor(location_start + i, 1);
+			}
+			lock.draw_instanced(static_cast<GLsizei>(lines.size()));
+			for(unsigned int i = 0; i < 4; ++i) {
+				glVertexAttribDivisor(location_start + i, 0);
+				glDisableVertexAttribArray(location_start + i);
+			}
+		}
+		ShaderProgram::use_none();
+	}
+
+private:
+	constexpr static char const* vertex_source = R"(
+		attribute vec4 line_start;
+		attribute vec4 line_end;
+		attribute vec4 line_color_start;
+		attribute vec4 line_color_end;
+		uniform bool   lighting;
+		varying vec4   color;
+
+		void main() {
+			vec2  d = line_end.xy - line_start.xy;
+			float l = length(d);
+			vec2  n = l > 0.0
+				? vec2(-d.y, d.x) / l
+				: vec2(1.0, 0.0)
+			;
+			vec3 p = mix(line_start.xyz, line_end.xyz, gl_Vertex.x)
+				+ vec3(n * (gl_Vertex.y * line_start.w / 2.0), 0.0)
+			;
+			vec4 eye    = gl_ModelViewMatrix * vec4(p, 1.0);
+			gl_Position = gl_ProjectionMatrix * eye;
+			vec4 c      = mix(line_color_start, line_color_end, gl_Vertex.x);
+			color = lighting
+				? light0(gl_NormalMatrix * vec3(0.0, 0.0, 1.0), eye, c)
+				: c
+			;
+		}
+	)";
+	constexpr static char const* fragment_source = R"(
+		varying vec4 color;
+
+		void main() {
+			gl_FragColor = color;
+		}
+	)";
+};
+
+// Lines of one kind, streamed to the GPU as one record per line that is
+// only re-uploaded when it changed, or expanded to quads on the CPU and
+// loaded whole each frame where DebugLinesProgram can't be used.
 struct DebugLinesMesh {
 	std::vector<unsigned int>                       index_buffer;
 	std::vector<MeshVertex<float, true,false,true>> vertex_buffer;
 	Mesh<MeshVertex<float, true, false, true>>      mesh;
+	DebugLinesProgram const*                        program;
+	std::vector<DebugLinesProgram::Record>          records;
+	StreamBuffer<DebugLinesProgram::Record>         stream;
 
-	DebugLinesMesh(GL_Window* parent)
+	DebugLinesMesh(GL_Window* parent, DebugLinesProgram const* program)
 		: mesh{parent}
+		, program{program}
+		, stream{parent}
 	{}
+
+	static DebugLinesProgram::Record make_record(DebugLine const& l) {
+		auto f = [](double x) {
+			return static_cast<float>(x);
+		};
+		return {
+			  {f(l.start[0]),       f(l.start[1]),       f(l.start[2]),       f(l.thickness)}
+			, {f(l.end[0]),         f(l.end[1]),         f(l.end[2]),         0.0f}
+			, {f(l.color_start[0]), f(l.color_start[1]), f(l.color_start[2]), 1.0f}
+			, {f(l.color_end[0]),   f(l.color_end[1]),   f(l.color_end[2]),   1.0f}
+		};
+	}
+
 	template<iterator_of<DebugLine> iterator>
 	void show(iterator first, iterator last) {
 		std::size_t N = std::distance(first, last);
 		if(!N) {
 			return;
 		}
+		if(program && program->is_usable()) {
+			records.clear();
+			records.reserve(N);
+			for(; first != last; ++first) {
+				records.push_back(make_record(*first));
+			}
+			stream.update(records);
+			program->draw(stream);
+			return;
+		}
 		index_buffer.clear();
 		vertex_buffer.clear();
 		index_buffer.resize( 6 * N);
@@ -2,8 +2,10 @@
 #include <vector>
 #include <map>
 #include <variant>
+#include <optional>
 #include "simple_gl/GL_Window.hpp"
 #include "simple_gl/Mesh.hpp"
+#include "simple_gl/InstanceRenderer.hpp"
 #include "robo_commands.hpp"
 #include "math/Vertex.hpp"
 #include "config/Simulator.hpp"
@@ -22,6 +24,10 @@ struct EnvironmentViewBase {
 	bool                    is_show_logos  = true;
 	bool                    is_show_remaining_time=false;
 	Environment::GuiData    sim_state;
+	int                     frames_without_snapshot = 0;
+	constexpr static int    stale_frames = 30;
+	std::optional<InstanceRenderer> instance_renderer;
+	bool                    is_instanced_render = false;
 
 	EnvironmentViewBase(Environment& environment, int width, int height)
 		: environment{environment}
@@ -30,12 +36,36 @@ struct EnvironmentViewBase {
 			, width
 			, height
 		}
-	{}
+	{
+		if(InstanceRenderer::is_supported()) {
+			instance_renderer.emplace(&window);
+			is_instanced_render = instance_renderer->is_valid();
+		}
+		environment.is_rendered = true;
+		environment.publish_render_snapshot();
+	}
+	~EnvironmentViewBase() {
+		environment.is_rendered = false;
+	}
 
 	template<typename debug_line_selector>
 		requires std::is_invocable_r_v<bool, debug_line_selector, RobotId>
 	void update(debug_line_selector selector) {
-		sim_state = environment.get_gui_data(selector);
+		if(!environment.take_render_snapshot(sim_state)) {
+			// nothing published while the sim loop doesn't run
+			if(++frames_without_snapshot < stale_frames) {
+				return;
+			}
+			environment.publish_render_snapshot();
+			environment.take_render_snapshot(sim_state);
+		}
+		frames_without_snapshot = 0;
+		sim_state.debug_lines.clear();
+		for(auto const& robot : sim_state.robots) {
+			if(selector(robot.id)) {
+				sim_state.debug_lines.insert(sim_state.debug_lines.end(), robot.debug_lines.begin(), robot.debug_lines.end());
+			}
+		}
 	}
 	
 	void set_color(Vertex<float,4> const& color) {
@@ -57,6 +87,18 @@ struct EnvironmentViewBase {
 		);
 	}
 
+	bool can_render_instanced() const {
+		return instance_renderer && instance_renderer->is_valid();
+	}
+	bool use_instanced_render() const {
+		return is_instanced_render && can_render_instanced();
+	}
+	// the instanced counterpart of set_color and drawing mesh per instance
+	template<typename V>
+	void draw_instances(Mesh<V> const& mesh, std::vector<Instance> const& instances, bool textured) {
+		instance_renderer->draw(mesh, instances, textured, !is_simplified_render);
+	}
+
 	void setup_light() const {
 		window.do_operation([&]() {
 			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
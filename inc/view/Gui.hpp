@@ -314,6 +314,9 @@ struct Gui {
 		if(ImGui::SliderInt("history size", &hist_size, 1, 2048)) {
 			robots.history_size = static_cast<std::size_t>(hist_size);
 		}
+		if(parent.can_render_instanced()) {
+			ImGui::Checkbox("instanced", &parent.is_instanced_render);
+		}
 
 		using Mode = RobotsView::SelectMode;
 		auto button = [&](std::string const& name, Mode& source_sink, Mode match) {
@@ -4,7 +4,7 @@
 #include "config/View.hpp"
 #include "simple_gl/make_checker_board.hpp"
 #include <vector>
-#include <map>
+#include <cstdint>
 #include <iostream>
 #include "view/EnvironmentViewBase.hpp"
 
@@ -14,26 +14,50 @@ struct ObstaclesView {
 	using source_t = ObstacleSet::exchange_t;
 
 	using mesh_data_t = typename ObstacleGeometry::mesh_data_t;
+	using gl_mesh_t   = typename mesh_data_t::gl_mesh_t;
 
-	struct ObstacleSetMeshes {
-		typename mesh_data_t::gl_mesh_t mesh_original;
-		typename mesh_data_t::gl_mesh_t mesh_collision;
-		typename mesh_data_t::gl_mesh_t mesh_collision_bounding_box;
+	// All obstacles of the snapshot pre-transformed into one mesh, rebuilt
+	// when the obstacle set's version changes.
+	struct MergedMesh {
+		gl_mesh_t   mesh;
+		mesh_data_t data;
+		uint64_t    version  = 0;
+		bool        is_built = false;
 
-		ObstacleSetMeshes(
-			  ObstaclesView&    parent
-			, ObstacleSet::ObstacleClass const& geometry
-		)
-			: mesh_original{              geometry.raw.mesh_data.mesh(               &parent.parent.window)}
-			, mesh_collision{             geometry.grown.mesh_data.mesh(             &parent.parent.window)}
-			, mesh_collision_bounding_box{geometry.grown.bounding_box_mesh_data.mesh(&parent.parent.window)}
+		MergedMesh(GL_Window* window)
+			: mesh{window}
 		{}
-	};
 
-	using meshes_map_t = std::map<ObstacleSet::class_id_t, ObstacleSetMeshes>;
+		// geometry(class_id) of each obstacle, scaled about its origin
+		template<typename Geometry>
+		void build(source_t const& obstacles, uint64_t obstacles_version, Geometry geometry, double scale = 1.0) {
+			if(is_built && version == obstacles_version) {
+				return;
+			}
+			data.vertices.clear();
+			data.indices.clear();
+			for(auto const& [class_id, pose] : obstacles) {
+				mesh_data_t const& source = geometry(class_id);
+				auto const ofs = static_cast<unsigned int>(data.vertices.size());
+				for(auto v : source.vertices) {
+					v.position = pose.position(v.position * scale);
+					v.normal   = pose.direction(v.normal);
+					data.vertices.push_back(v);
+				}
+				for(auto i : source.indices) {
+					data.indices.push_back(i + ofs);
+				}
+			}
+			data.load_into(mesh);
+			version  = obstacles_version;
+			is_built = true;
+		}
+	};
 
 	EnvironmentViewBase& parent;
-	meshes_map_t         meshes;
+	MergedMesh           original{          &parent.window};
+	MergedMesh           collision{         &parent.window};
+	MergedMesh           bounding_box{      &parent.window};
 	Texture              texture = make_checker_board(
 		  &parent.window
 		, 7, 9
@@ -54,48 +78,46 @@ struct ObstaclesView {
 		: parent{parent}
 	{}
 
+	// one draw per shown kind, the meshes follow the obstacles lazily
 	void show() {
 		source_t const& obstacles = parent.sim_state.obstacles;
-		for(auto const& p : obstacles) {
-			auto it = meshes.find(p.first);
-			if(it == meshes.end()) {
-				it = meshes.emplace(
-					  std::piecewise_construct
-					, std::forward_as_tuple(p.first)
-					, std::forward_as_tuple(*this, *p.first)
-				).first;
+		uint64_t        version   = parent.sim_state.obstacles_version;
+		if(show_original) {
+			original.build(obstacles, version, [](ObstacleSet::class_id_t c) -> mesh_data_t const& {
+				return c->raw.mesh_data;
+			});
+			auto lock = original.mesh.lock();
+			if(show_texture) {
+				glEnable(GL_TEXTURE_2D);
+				texture.bind();
+				parent.set_color(Vertex<double,4>{1.0,1.0,1.0,alpha_original});
+				lock.draw();
+				glDisable(GL_TEXTURE_2D);
+			} else {
+				parent.set_color(Vertex<double,4>{0.9,0.2,0.3,alpha_original});
+				lock.draw();
 			}
-			ObstacleSetMeshes const& osm = it->second;
-			Transform const& pose = p.second;
-			scoped_draw([&]() {
-				glMultMatrixd(pose.as_gl_matrix().data());
-				if(show_original) {
-					if(show_texture) {
-						glEnable(GL_TEXTURE_2D);
-						texture.bind();
-						auto lock = osm.mesh_original.lock();
-						parent.set_color(Vertex<double,4>{1.0,1.0,1.0,alpha_original});
-						lock.draw();
-						glDisable(GL_TEXTURE_2D);
-					} else {
-						auto lock = osm.mesh_original.lock();
-						parent.set_color(Vertex<double,4>{0.9,0.2,0.3,alpha_original});
-						lock.draw();
-					}
-				}
-				if(show_collision) {
-					auto lock = osm.mesh_collision.lock();
-					parent.set_color(Vertex<double,4>{1.0,1.0,1.0,alpha_collision});
-					lock.draw();
-				}
-				if(show_bounding_box) {
-					auto lock = osm.mesh_collision_bounding_box.lock();
-					double scale = 1.005;
-					glScaled(scale, scale, scale);
-					parent.set_color(Vertex<double,4>{1.0,0.0,0.0,alpha_bounding_box});
-					lock.draw();
-				}
+		}
+		if(show_collision) {
+			collision.build(obstacles, version, [](ObstacleSet::class_id_t c) -> mesh_data_t const& {
+				return c->grown.mesh_data;
 			});
+			auto lock = collision.mesh.lock();
+			parent.set_color(Vertex<double,4>{1.0,1.0,1.0,alpha_collision});
+			lock.draw();
+		}
+		if(show_bounding_box) {
+			bounding_box.build(
+				  obstacles
+				, version
+				, [](ObstacleSet::class_id_t c) -> mesh_data_t const& {
+					return c->grown.bounding_box_mesh_data;
+				}
+				, 1.005
+			);
+			auto lock = bounding_box.mesh.lock();
+			parent.set_color(Vertex<double,4>{1.0,0.0,0.0,alpha_bounding_box});
+			lock.draw();
 		}
 	}
 };
@@ -1,13 +1,98 @@
 #pragma once
 #include <array>
+#include <optional>
 #include <vector>
 #include "math/Vertex.hpp"
 #include "simple_gl/Mesh.hpp"
 #include "simple_gl/GL_Window.hpp"
+#include "simple_gl/ShaderProgram.hpp"
+#include "simple_gl/InstanceRenderer.hpp"
 #include "Robot.hpp"
 #include "config/Robot.hpp"
 
 namespace robo {
+
+// Shader of the RobotHistoryMesh ring buffers: z of a vertex holds its
+// slot in the ring, the age derived from that and the slot written next
+// gives the height and the fade, so nothing but the new samples has to be
+// uploaded per frame.
+struct RobotHistoryProgram {
+	std::optional<ShaderProgram> program;
+	int                          uniform_head       = -1;
+	int                          uniform_size       = -1;
+	int                          uniform_max_height = -1;
+	int                          uniform_alpha      = -1;
+	int                          uniform_lighting   = -1;
+	bool                         is_enabled = true;
+
+	RobotHistoryProgram(GL_Window const* parent) {
+		if(!InstanceRenderer::is_supported()) {
+			return;
+		}
+		program.emplace(
+			  parent
+			, std::vector<char const*>{glsl::version, glsl::light0, vertex_source}
+			, std::vector<char const*>{glsl::version, fragment_source}
+		);
+		parent->do_operation([&]() {
+			uniform_head       = program->uniform("head");
+			uniform_size       = program->uniform("size");
+			uniform_max_height = program->uniform("max_height");
+			uniform_alpha      = program->uniform("alpha");
+			uniform_lighting   = program->uniform("lighting");
+		});
+	}
+
+	bool is_usable() const {
+		return is_enabled && program && program->is_valid();
+	}
+
+	// head: the slot written next, the oldest
+	void use(std::size_t head, std::size_t size, double max_height, double alpha) const {
+		program->use();
+		glUniform1f(uniform_head,       static_cast<float>(head));
+		glUniform1f(uniform_size,       static_cast<float>(size));
+		glUniform1f(uniform_max_height, static_cast<float>(max_height));
+		glUniform1f(uniform_alpha,      static_cast<float>(alpha));
+		glUniform1i(uniform_lighting,   glIsEnabled(GL_LIGHTING) ? 1 : 0);
+	}
+
+private:
+	constexpr static char const* vertex_source = R"(
+		uniform float head;
+		uniform float size;
+		uniform float max_height;
+		uniform float alpha;
+		uniform bool  lighting;
+		varying vec4  color;
+
+		void main() {
+			float age   = mod(gl_Vertex.z - head + size, size);   // 0 oldest, size - 1 newest
+			vec4  eye   = gl_ModelViewMatrix * vec4(gl_Vertex.xy, (age + 1.0) * max_height / size, 1.0);
+			gl_Position = gl_ProjectionMatrix * eye;
+			vec4  c     = vec4(gl_Color.rgb, age * alpha / size);
+			color = lighting
+				? light0(gl_NormalMatrix * gl_Normal, eye, c)
+				: c
+			;
+		}
+	)";
+	constexpr static char const* fragment_source = R"(
+		varying vec4 color;
+
+		void main() {
+			gl_FragColor = color;
+		}
+	)";
+};
+
+// Trail of a robot, a strip of size samples of its left and right side
+// kept as a ring. With a usable RobotHistoryProgram the ring lives in the
+// vertex buffer as well: update() only writes the new pair, show() sends
+// the pairs written since the last frame and draws the ring through a
+// static index buffer, in two ranges around the seam between the newest
+// and the oldest sample. Otherwise indices, heights and fade are rebuilt
+// and the whole mesh is loaded each frame.
 struct RobotHistoryMesh {
 	using mesh_vertex_t = MeshVertex<float, true, false, true>;
 	using mesh_t        = Mesh<mesh_vertex_t>;
@@ -19,6 +104,9 @@ struct RobotHistoryMesh {
 	bool                        do_reset = true;
 	static constexpr double     path_max_height = 0.05;
 	double                      alpha = 1.0;
+	RobotHistoryProgram const*  program;
+	bool                        is_ring_loaded = false;   // mesh holds the ring and its static indices
+	std::size_t                 pending = 0;              // samples written since the ring was uploaded
 
 	static std::size_t num_vertices(std::size_t history_size) {
 		return 2 * history_size;
@@ -30,10 +118,11 @@ struct RobotHistoryMesh {
 		;
 	}
 
-	RobotHistoryMesh(GL_Window* parent)
+	RobotHistoryMesh(GL_Window* parent, RobotHistoryProgram const* program)
 		: mesh{parent}
 		, vertices(num_vertices(size))
 		, indices(num_indices(size))
+		, program{program}
 	{}
 
 	void reset() {
@@ -42,6 +131,7 @@ struct RobotHistoryMesh {
 
 	void resize(std::size_t new_size) {
 		if(size != new_size) {
+			is_ring_loaded = false;
 			if(size) {
 				std::size_t last = (history_idx - 1) % size;
 				mesh_vertex_t A = vertices[2 * last + 0];
@@ -91,6 +181,7 @@ struct RobotHistoryMesh {
 			vl.position[1] = entry[0][1];
 			vr.position[0] = entry[1][0];
 			vr.position[1] = entry[1][1];
+			vl.position[2] = vr.position[2] = static_cast<float>(history_idx);
 
 			vl.normal = vr.normal = Vertex<float,3>{0.0f, 0.0f, 1.0f};
 			vl.color  = vr.color  = color;//Vertex<float,4>{1.0f, 1.0f, 1.0f, 1.0f};
@@ -102,8 +193,10 @@ struct RobotHistoryMesh {
 			}
 			history_idx = 0;
 			do_reset = false;
+			is_ring_loaded = false;
 		} else {
 			dofoo();
+			++pending;
 		}
 		++history_idx;
 		history_idx %= size;
@@ -155,7 +248,70 @@ struct RobotHistoryMesh {
 		}
 	}
 
+	// segment k joins slot k to the next one, the last one wraps around
+	void load_ring() {
+		std::vector<unsigned short> ring_indices(6 * size);
+		for(std::size_t k = 0; k < size; ++k) {
+			std::size_t k1 = (k + 1) % size;
+			ring_indices[6 * k + 0] = 2*k1;
+			ring_indices[6 * k + 1] = 2*k1 + 1;
+			ring_indices[6 * k + 2] = 2*k  + 1;
+			ring_indices[6 * k + 3] = 2*k1;
+			ring_indices[6 * k + 4] = 2*k  + 1;
+			ring_indices[6 * k + 5] = 2*k;
+		}
+		for(std::size_t i = 0; i < vertices.size(); ++i) {
+			vertices[i].position[2] = static_cast<float>(i / 2);
+		}
+		mesh.load(vertices, ring_indices, GL_DYNAMIC_DRAW);
+		is_ring_loaded = true;
+		pending        = 0;
+	}
+	// the pending slots before history_idx, wrapping at most once
+	void upload_pending() {
+		if(pending >= size) {
+			mesh.load_vertices(0, vertices.data(), vertices.size());
+		} else if(pending) {
+			std::size_t first = (history_idx + size - pending) % size;
+			if(first + pending <= size) {
+				mesh.load_vertices(2 * first, &vertices[2 * first], 2 * pending);
+			} else {
+				mesh.load_vertices(2 * first, &vertices[2 * first], 2 * (size - first));
+				mesh.load_vertices(0,         vertices.data(),      2 * history_idx);
+			}
+		}
+		pending = 0;
+	}
+	void show_ring() {
+		if(!is_ring_loaded) {
+			load_ring();
+		} else {
+			upload_pending();
+		}
+		std::size_t seam = (history_idx + size - 1) % size;   // newest to oldest
+		scoped_draw([&]() {
+			glColorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE);
+			glEnable(GL_COLOR_MATERIAL);
+			program->use(history_idx, size, path_max_height, alpha);
+			{
+				auto lock = mesh.lock();
+				lock.draw_range(0,                6 * seam);
+				lock.draw_range(6 * (seam + 1),   6 * (size - seam - 1));
+			}
+			ShaderProgram::use_none();
+			glDisable(GL_COLOR_MATERIAL);
+		});
+	}
+
 	void show() {
+		if(!size) {
+			return;
+		}
+		if(program && program->is_usable()) {
+			show_ring();
+			return;
+		}
+		is_ring_loaded = false;
 		update_indices();
 		update_slope();
 		update_alpha();
@@ -60,16 +60,20 @@ struct RobotsView {
 	SelectMode                          request_mode_debug_lines          = SelectMode::SELECTIVE;
 	SelectMode                          request_mode_rays                 = SelectMode::SELECTIVE;
 	SelectMode                          request_mode_coordinate_systems   = SelectMode::SELECTIVE;
-	DebugLinesMesh                      debug_lines_mesh{&parent.window};
+	DebugLinesProgram                   debug_lines_program{&parent.window};
+	DebugLinesMesh                      debug_lines_mesh{&parent.window, &debug_lines_program};
 	std::vector<DebugLine>              velocities;
-	DebugLinesMesh                      velocities_mesh{&parent.window};
+	DebugLinesMesh                      velocities_mesh{&parent.window, &debug_lines_program};
 	std::vector<DebugLine>              reference_velocities;
-	DebugLinesMesh                      reference_velocities_mesh{&parent.window};
+	DebugLinesMesh                      reference_velocities_mesh{&parent.window, &debug_lines_program};
 	std::vector<DebugLine>              rays;
-	DebugLinesMesh                      rays_mesh{&parent.window};
+	DebugLinesMesh                      rays_mesh{&parent.window, &debug_lines_program};
 	std::size_t                         history_size = 512;
+	RobotHistoryProgram                 history_program{&parent.window};
 	std::map<RobotId, RobotHistoryMesh> histories;
 	std::map<RobotId, Features>         features;
+	std::vector<Transform>              wheel_mounts;   // robot to wheel, turned by 0
+	std::vector<Instance>               instances;
 
 	RobotsView(EnvironmentViewBase& parent)
 		: parent{parent}
@@ -90,7 +94,16 @@ struct RobotsView {
 		}
 		, mesh_data_robot_outer_body{make_simple_cylinder<false,false>(config::Robot::radius,            config::Body::h0,      config::Body::h1,         24, false, true)}
 		, font(&parent.window, config::View::label_font, config::View::label_font_size, config::View::label_height)
-	{}
+	{
+		for(std::size_t i = 0; i < config::Wheel::axis_angles.size(); ++i) {
+			wheel_mounts.push_back(
+				  Transform::rotate_z(config::Wheel::axis_angles[i])
+				* Transform::translate(config::Wheel::distance/2 - config::Wheel::thickness/2, 0.0, config::Wheel::radius)
+				* Transform::rotate_x(M_PI_2)
+				* Transform::rotate_y(M_PI_2)
+			);
+		}
+	}
 
 	static void toggle_select_mode(SelectMode& mode) {
 		mode = mode == SelectMode::ALL
@@ -102,6 +115,27 @@ struct RobotsView {
 	void show_robot_wheels() {
 		glEnable(GL_TEXTURE_2D);
 		texture_wheel.bind();
+		if(parent.use_instanced_render()) {
+			instances.clear();
+			for(auto& robot : parent.sim_state.robots) {
+				auto const& kinematics = robot.kinematics;
+				Transform pose
+					= Transform::translate(kinematics.position[0], kinematics.position[1], 0.0)
+					* Transform::rotate_z(kinematics.orientation)
+				;
+				for(std::size_t i = 0; i < wheel_mounts.size(); ++i) {
+					instances.push_back(
+						Instance::make(
+							  pose * wheel_mounts[i] * Transform::rotate_z(-kinematics.wheel_turn_angle[i])
+							, Vertex<float,4>{1.0f, 1.0f, 1.0f, 1.0f}
+						)
+					);
+				}
+			}
+			parent.draw_instances(mesh_wheel, instances, true);
+			glDisable(GL_TEXTURE_2D);
+			return;
+		}
 		auto lock = mesh_wheel.lock();
 		parent.set_color(Vertex<double,4>{1.0, 1.0, 1.0, 1.0});
 		for(auto& robot : parent.sim_state.robots) {
@@ -142,9 +176,32 @@ struct RobotsView {
 		};
 	}
 	
+	// one instance per robot at its pose
+	void make_body_instances(double v_scale, double alpha, bool is_oriented) {
+		instances.clear();
+		for(auto& robot : parent.sim_state.robots) {
+			auto const& kinematics = robot.kinematics;
+			instances.push_back(
+				Instance::make(
+					  kinematics.position[0]
+					, kinematics.position[1]
+					, 0.0
+					, is_oriented ? kinematics.orientation : 0.0
+					, robot_color(robot, v_scale, alpha)
+				)
+			);
+		}
+	}
+
 	void show_robot_inner_bodies() {
 		glEnable(GL_TEXTURE_2D);
 		texture_body.bind();
+		if(parent.use_instanced_render()) {
+			make_body_instances(0.7, 1.0, true);
+			parent.draw_instances(mesh_robot_inner_body, instances, true);
+			glDisable(GL_TEXTURE_2D);
+			return;
+		}
 		auto lock = mesh_robot_inner_body.lock();
 		for(auto& robot : parent.sim_state.robots) {
 			auto const& kinematics = robot.kinematics;
@@ -160,6 +217,12 @@ struct RobotsView {
 	void show_robot_tops() {
 		glEnable(GL_TEXTURE_2D);
 		texture_top.bind();
+		if(parent.use_instanced_render()) {
+			make_body_instances(0.7, 1.0, true);
+			parent.draw_instances(mesh_robot_top, instances, true);
+			glDisable(GL_TEXTURE_2D);
+			return;
+		}
 		auto lock = mesh_robot_top.lock();
 		for(auto& robot : parent.sim_state.robots) {
 			auto const& kinematics = robot.kinematics;
@@ -173,6 +236,15 @@ struct RobotsView {
 		glDisable(GL_TEXTURE_2D);
 	}
 	void show_robot_outer_bodies() {
+		if(parent.use_instanced_render()) {
+			if(!parent.is_simplified_render) {
+				make_body_instances(0.7, 0.4, false);
+			} else {
+				make_body_instances(0.9, 1.0, false);
+			}
+			parent.draw_instances(mesh_robot_outer_body, instances, false);
+			return;
+		}
 		auto lock = mesh_robot_outer_body.lock();
 		for(auto& robot : parent.sim_state.robots) {
 			auto const& kinematics = robot.kinematics;
@@ -407,7 +479,7 @@ struct RobotsView {
 				it = histories.emplace(
 					  std::piecewise_construct
 					, std::forward_as_tuple(robot.id)
-					, std::forward_as_tuple(&parent.window)
+					, std::forward_as_tuple(&parent.window, &history_program)
 				).first;
 			}
 			it->second.resize(history_size);
@@ -446,6 +518,8 @@ struct RobotsView {
 	}
 
 	void show() {
+		debug_lines_program.is_enabled = parent.is_instanced_render;
+		history_program.is_enabled     = parent.is_instanced_render;
 		clean_map(histories);
 		clean_map(features);
 		show_coordinate_systems();
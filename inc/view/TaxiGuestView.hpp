@@ -35,6 +35,7 @@ struct TaxiGuestView {
 	gl_mesh_t   const    mesh_body{mesh_data_body.mesh(&parent.window)};
 	gl_mesh_t   const    mesh_legs{mesh_data_legs.mesh(&parent.window)};
 	gl_mesh_t   const    mesh_ears{mesh_data_ears.mesh(&parent.window)};
+	std::vector<Instance> instances;
 
 	static auto make_mesh_data_body(double radius)
 		-> mesh_data_t
@@ -133,6 +134,46 @@ struct TaxiGuestView {
 		, mesh_data_ears{make_mesh_data_ears(0.05)}
 	{}
 
+	Vertex<float,4> guest_color(TaxiGuests::GuestState const& g) const {
+		Robot const* robot = parent.sim_state.robots.find(*g.bound_to_robot);
+		return robot
+			? robots_view.robot_color(*robot, 0.7)
+			: Vertex<float,4>{1.0f, 1.0f, 1.0f, 1.0f}
+		;
+	}
+
+	// one instanced draw per texture
+	void show_components_instanced(
+		  gl_mesh_t const& mesh
+		, Texture const&   texture_inactive
+		, Texture const&   texture_active
+		, Texture const&   texture_target
+	) {
+		auto draw = [&](Texture const& texture, bool is_bound, bool is_target) {
+			instances.clear();
+			for(auto const& g: parent.sim_state.taxi_guests.guests) {
+				if(g.done || g.bound_to_robot.has_value() != is_bound) {
+					continue;
+				}
+				auto const& position = is_target ? g.target_position : g.position;
+				instances.push_back(
+					Instance::make(
+						  position[0]
+						, position[1]
+						, g.height
+						, g.rotation
+						, is_bound ? guest_color(g) : Vertex<float,4>{1.0f, 1.0f, 1.0f, 1.0f}
+					)
+				);
+			}
+			texture.bind();
+			parent.draw_instances(mesh, instances, true);
+		};
+		draw(texture_inactive, false, false);
+		draw(texture_active,   true,  false);
+		draw(texture_target,   true,  true);
+	}
+
 	void show() {
 		auto show_component = [](
 			  Vertex<double,2> const& position
@@ -152,7 +193,10 @@ struct TaxiGuestView {
 			, Texture const&   texture_active
 			, Texture const&   texture_target
 		) {
-
+			if(parent.use_instanced_render()) {
+				show_components_instanced(mesh, texture_inactive, texture_active, texture_target);
+				return;
+			}
 			{
 				texture_inactive.bind();
 				auto lock = mesh.lock();
@@ -168,7 +212,7 @@ struct TaxiGuestView {
 				auto lock = mesh.lock();
 				for(auto const& g: parent.sim_state.taxi_guests.guests) {
 					if(g.bound_to_robot && !g.done) {
-						Robot const* robot = parent.environment.robots.find(*g.bound_to_robot);
+						Robot const* robot = parent.sim_state.robots.find(*g.bound_to_robot);
 						if(robot) {
 							parent.set_color(robots_view.robot_color(*robot, 0.7));
 						} else {
@@ -183,7 +227,7 @@ struct TaxiGuestView {
 				auto lock = mesh.lock();
 				for(auto const& g: parent.sim_state.taxi_guests.guests) {
 					if(g.bound_to_robot && !g.done) {
-						Robot const* robot = parent.environment.robots.find(*g.bound_to_robot);
+						Robot const* robot = parent.sim_state.robots.find(*g.bound_to_robot);
 						if(robot) {
 							parent.set_color(robots_view.robot_color(*robot, 0.7));
 						} else {
@@ -7,9 +7,9 @@ struct Environment::Hidden
 {
 	Robot robot;
 
-	Hidden(std::string const& name, Environment& environment)
+	Hidden(std::string const& name, std::string const& server, Environment& environment)
 		: robo::RobotProxy{
-			  "localhost"
+			  server
 			, robo::config::Simulator::default_port
 			, name
 		}
@@ -45,6 +45,19 @@ static auto robot_state(robo::RobotView const& x)
 	};
 }
 
+static auto trajectory_progress(robo::TrajectoryProgress const& x)
+	-> TrajectoryProgress
+{
+	return {
+		  x.trajectory_id
+		, x.waypoint
+		, x.waypoint_count
+		, x.remaining_distance
+		, x.elapsed_time
+		, x.done
+	};
+}
+
 static auto drop_result_result(robo::DropResult const& x)
 	-> DropResult
 {
@@ -130,8 +143,12 @@ auto DebugLine::make(
 }
 
 Environment::Environment(std::string const& robot_name)
+	: Environment(robot_name, "localhost")
+{}
+
+Environment::Environment(std::string const& robot_name, std::string const& server)
 	: implementation{
-		  new Hidden{robot_name, *this}
+		  new Hidden{robot_name, server, *this}
 		, delete_hidden
 	}
 {}
@@ -176,6 +193,7 @@ auto Environment::vision() const
 		, guests()
 		, v.distance_sensor_values
 		, v.guest ? guest_state(*v.guest) : std::optional<GuestState>{}
+		, v.trajectory ? trajectory_progress(*v.trajectory) : std::optional<TrajectoryProgress>{}
 	};
 }
 
@@ -197,6 +215,21 @@ void Robot::set_local_velocity_fixed_frame(
 	environment.implementation->set_local_velocity_fixed_frame(velocity, angular_velocity);
 }
 
+auto Robot::follow_trajectory(
+	  std::vector<TrajectoryWaypoint> const& waypoints
+	, double const                           velocity_max
+	, double const                           angular_velocity_max
+)
+	-> std::size_t
+{
+	std::vector<robo::TrajectoryWaypoint> x;
+	x.reserve(waypoints.size());
+	for(auto const& y : waypoints) {
+		x.push_back({y.position, y.orientation});
+	}
+	return environment.implementation->follow_trajectory(x, velocity_max, angular_velocity_max);
+}
+
 void Environment::set_debug_lines(std::vector<DebugLine> const& debug_lines) {
 	std::vector<robo::DebugLine> x;
 	x.reserve(debug_lines.size());
@@ -51,11 +51,26 @@ struct GuestState {
 	int               const score_on_arrival;
 };
 
+struct TrajectoryWaypoint {
+	Vertex<double,2> position;
+	double           orientation;
+};
+
+struct TrajectoryProgress {
+	std::size_t const trajectory_id;
+	std::size_t const waypoint;
+	std::size_t const waypoint_count;
+	double const      remaining_distance;
+	double const      elapsed_time;
+	bool const        done;
+};
+
 struct Vision {
-	std::vector<RobotState> const   robots;
-	std::vector<GuestState> const   available_guests;
-	std::vector<double> const       distance_sensor_values;
-	std::optional<GuestState> const guest;
+	std::vector<RobotState> const           robots;
+	std::vector<GuestState> const           available_guests;
+	std::vector<double> const               distance_sensor_values;
+	std::optional<GuestState> const         guest;
+	std::optional<TrajectoryProgress> const trajectory;
 };
 
 enum struct SegmentState {
@@ -109,6 +124,16 @@ public:
 		, double const            angular_velocity
 	);
 
+	// The simulator follows the waypoints on its own, until the next
+	// velocity command. Returns the id reported in Vision::trajectory.
+	auto follow_trajectory(
+		  std::vector<TrajectoryWaypoint> const& waypoints
+		, double const                           velocity_max
+		, double const                           angular_velocity_max
+	)
+		-> std::size_t
+	;
+
 	auto drop_guest()
 		-> DropResult
 	;
@@ -134,6 +159,8 @@ class Environment {
 	friend class Robot;
 public:
 	Environment(std::string const& robot_name);
+	// server: hostname, or url like "unix:///tmp/robo.sock", "unix://@robo_sim", "shm://robo_sim"
+	Environment(std::string const& robot_name, std::string const& server);
 
 	auto robot() const
 		-> Robot&
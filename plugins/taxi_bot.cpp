@@ -0,0 +1,94 @@
+#include "plugin/ControllerPlugin.hpp"
+#include "math/angle_util.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <random>
+
+// Built-in greedy taxi controller: drives to the closest visible guest,
+// picks it, drives to its target and drops it. Wanders to random points
+// while no guest is in sight.
+//     simulator --plugin=bin/plugins/taxi_bot.so:100[:seed]
+
+using namespace robo;
+
+class TaxiBot : public plugin::Controller {
+private:
+	RobotDescriptor  descriptor;
+	std::mt19937     gen;
+	Vertex<double,2> wander_target{0.0, 0.0};
+	double           wander_until = -1.0;
+
+	auto self(Vision const& vision, RobotId id) const
+		-> RobotView const*
+	{
+		for(auto const& r : vision.robots) {
+			if(r.id == id) {
+				return &r;
+			}
+		}
+		return nullptr;
+	}
+
+	// braking distance limited velocity towards target, in the robot frame
+	auto drive_to(RobotView const& me, Vertex<double,2> const& target) const
+		-> plugin::Decision
+	{
+		auto const& k     = descriptor.kinematics;
+		Vertex<double,2> error = rotate(target - me.position, -me.orientation);
+		double d = error.length();
+		double v = std::min(
+			  std::min(k.velocity_max_x, k.velocity_max_y)
+			, std::sqrt(2.0 * std::min(k.acceleration_max_x, k.acceleration_max_y) * d)
+		);
+		plugin::Decision decision;
+		decision.velocity = d > 1e-6
+			? error * (0.9 * v / d)
+			: Vertex<double,2>{0.0, 0.0}
+		;
+		return decision;
+	}
+
+public:
+	TaxiBot(RobotDescriptor const& descriptor, char const* args)
+		: descriptor{descriptor}
+		, gen{static_cast<std::mt19937::result_type>(std::strtoul(args, nullptr, 10))}
+	{}
+
+	auto control(Vision const& vision, plugin::Context const& context)
+		-> plugin::Decision override
+	{
+		RobotView const* me = self(vision, context.id);
+		if(!me) {
+			return {};
+		}
+		auto const& g = descriptor.guest;
+		if(vision.guest) {
+			plugin::Decision decision = drive_to(*me, vision.guest->target_position);
+			decision.drop = (vision.guest->target_position - me->position).length() < g.max_drop_distance;
+			return decision;
+		}
+		Vision::Guest const* closest = nullptr;
+		double               best    = 0.0;
+		for(auto const& guest : vision.available_guests) {
+			double d = (guest.position - me->position).length();
+			if(!closest || d < best) {
+				closest = &guest;
+				best    = d;
+			}
+		}
+		if(closest) {
+			plugin::Decision decision = drive_to(*me, closest->position);
+			decision.pick = best < g.max_pick_distance;
+			return decision;
+		}
+		if(context.time > wander_until || (wander_target - me->position).length() < 0.1) {
+			double r = descriptor.visibility.max_guest_distance;
+			std::uniform_real_distribution<double> offset(-r, r);
+			wander_target = me->position + Vertex<double,2>{offset(gen), offset(gen)};
+			wander_until  = context.time + 5.0;
+		}
+		return drive_to(*me, wander_target);
+	}
+};
+
+ROBO_CONTROLLER_PLUGIN("taxi_bot", TaxiBot)
@@ -0,0 +1,73 @@
+#include "util/CommandLineArguments.hpp"
+#include "BatchEnvironment.hpp"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Throughput of BatchEnvironment::step with random actions, no server.
+//     batch_bench [--robots=100] [--ticks=4] [--steps=200]
+//                 [--obstacles=32] [--guests=100]
+
+int main(int argc, char** argv) {
+	CommandLineArguments cla(argc, argv);
+	std::size_t n_robots    = cla.get<std::size_t>("--robots=",    100);
+	std::size_t ticks       = cla.get<std::size_t>("--ticks=",     4);
+	std::size_t steps       = cla.get<std::size_t>("--steps=",     200);
+	std::size_t n_obstacles = cla.get<std::size_t>("--obstacles=", 32);
+	std::size_t n_guests    = cla.get<std::size_t>("--guests=",    100);
+
+	double dt = robo::config::Simulation::delta_t_sim;
+	robo::Environment environment{dt * ticks, dt, 0};
+	environment.populate_obstacles(n_obstacles);
+	environment.populate_guests(n_guests);
+
+	using batch_t = robo::BatchEnvironment;
+	batch_t batch(environment, n_robots);
+	std::size_t n = batch.size();
+	std::vector<float> actions(n * batch_t::action_size);
+	std::vector<float> sensors(n * batch_t::sensor_size);
+	std::vector<float> poses(n * batch_t::pose_size);
+	std::vector<float> guests(n * batch_t::guest_size);
+	std::vector<float> rewards(n);
+	batch_t::Observations out{sensors.data(), poses.data(), guests.data(), rewards.data(), nullptr};
+
+	std::mt19937 gen{42};
+	std::uniform_real_distribution<float> v(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> flag(0.0f, 1.0f);
+	std::vector<std::vector<float>> action_sets(16, actions);
+	for(auto& set : action_sets) {
+		for(std::size_t i = 0; i < n; ++i) {
+			float* a = set.data() + i * batch_t::action_size;
+			a[0] = v(gen) * robo::config::Robot::velocity_max_x;
+			a[1] = v(gen) * robo::config::Robot::velocity_max_y;
+			a[2] = v(gen) * robo::config::Robot::angular_velocity_max;
+			a[3] = flag(gen);
+			a[4] = flag(gen);
+		}
+	}
+
+	double reward = 0.0;
+	using clock_t = std::chrono::steady_clock;
+	auto start = clock_t::now();
+	for(std::size_t s = 0; s < steps; ++s) {
+		batch.step(action_sets[s % action_sets.size()].data(), ticks, out);
+		for(float r : rewards) {
+			reward += r;
+		}
+	}
+	double seconds = std::chrono::duration<double>(clock_t::now() - start).count();
+
+	std::cout
+		<< "robots "              << n
+		<< ", ticks per step "    << ticks
+		<< ", steps "             << steps
+		<< ", seconds "           << seconds
+		<< "\nsteps/s "           << steps / seconds
+		<< ", robot steps/s "     << steps * n / seconds
+		<< ", physics ticks/s "   << steps * ticks / seconds
+		<< ", reward "            << reward
+		<< std::endl
+	;
+	return 0;
+}
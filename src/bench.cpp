@@ -0,0 +1,497 @@
+#include "serializer/DefaultPodBackend.hpp"
+#include "serializer/SerializationBuffers.hpp"
+#include "serializer/PrefixSerializer.hpp"
+#include "client_server/ServerStats.hpp"
+#include "util/CommandLineArguments.hpp"
+#include "config/Build.hpp"
+#include "math/QuadTree.hpp"
+#include "Environment.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+// Microbenchmarks of the hot paths: triangle and obstacle geometry,
+// obstacle set queries, serialization of every command, the physics step
+// and the quad tree. Every fixture is built from --seed, so runs on the
+// same build are comparable. Results go to --out as JSON, a summary to
+// stderr.
+//     bench [--filter=substring] [--min_time=0.5] [--repetitions=5]
+//           [--seed=42] [--out=bench.json]
+
+using Serializer = PrefixSerializer<DefaultPodBackend>;
+
+// keeps the compiler from dropping the computation of value
+template<typename T>
+void keep(T const& value) {
+	asm volatile("" : : "g"(&value) : "memory");
+}
+
+class Bench {
+public:
+	struct Result {
+		std::string name;
+		std::string unit;          // what items_per_op counts
+		double      items_per_op;
+		uint64_t    iterations;    // per repetition
+		double      ns_min;        // per op, over the repetitions
+		double      ns_median;
+		double      ns_max;
+	};
+
+private:
+	std::string         filter;
+	double              min_time;
+	std::size_t         repetitions;
+	std::vector<Result> results;
+
+public:
+	Bench(std::string filter, double min_time, std::size_t repetitions)
+		: filter{std::move(filter)}
+		, min_time{min_time}
+		, repetitions{std::max<std::size_t>(repetitions, 1)}
+	{}
+
+	// whether a benchmark of that name runs, to skip building a fixture
+	// that draws nothing from the group's generator after it
+	bool selected(std::string const& name) const {
+		return filter.empty() || name.find(filter) != std::string::npos;
+	}
+
+	// Times op(), one operation of items units each: the iterations per
+	// repetition are grown until a repetition takes its share of min_time.
+	template<typename OP>
+	void run(std::string const& name, std::string const& unit, double items_per_op, OP op) {
+		if(!selected(name)) {
+			return;
+		}
+		using clock_t = std::chrono::steady_clock;
+		auto batch = [&](uint64_t n) {
+			auto start = clock_t::now();
+			for(uint64_t i = 0; i < n; ++i) {
+				op();
+			}
+			return std::chrono::duration<double>(clock_t::now() - start).count();
+		};
+		double   share = min_time / static_cast<double>(repetitions);
+		uint64_t n     = 1;
+		for(double t = batch(n); t < share; t = batch(n)) {
+			double grow = t > 0.0 ? 1.2 * share / t : 100.0;
+			n = std::max(n + 1, static_cast<uint64_t>(static_cast<double>(n) * std::min(grow, 100.0)));
+		}
+		std::vector<double> ns;
+		for(std::size_t r = 0; r < repetitions; ++r) {
+			ns.push_back(batch(n) * 1e9 / static_cast<double>(n));
+		}
+		std::sort(ns.begin(), ns.end());
+		Result result{name, unit, items_per_op, n, ns.front(), ns[ns.size() / 2], ns.back()};
+		std::cerr
+			<< std::left  << std::setw(56) << result.name
+			<< std::right << std::setw(14) << std::fixed << std::setprecision(1) << result.ns_median << " ns/op"
+			<< std::setw(16) << std::setprecision(0) << result.items_per_op * 1e9 / result.ns_median << ' ' << result.unit << "/s"
+			<< std::defaultfloat << '\n'
+		;
+		results.push_back(std::move(result));
+	}
+
+	// names are ASCII literals of this file and need no escaping
+	void write_json(std::ostream& os, uint64_t seed) const {
+		os << std::setprecision(9);
+		os
+			<< "{\n"
+			<< "\t\"git\": \"" << robo::config::Build::git << "\",\n"
+			<< "\t\"build\": \"" << robo::config::Build::date << ' ' << robo::config::Build::time << "\",\n"
+			<< "\t\"seed\": " << seed << ",\n"
+			<< "\t\"min_time\": " << min_time << ",\n"
+			<< "\t\"repetitions\": " << repetitions << ",\n"
+			<< "\t\"results\": ["
+		;
+		for(std::size_t i = 0; i < results.size(); ++i) {
+			Result const& r = results[i];
+			os
+				<< (i ? "," : "") << "\n\t\t{"
+				<< "\"name\": \"" << r.name << "\""
+				<< ", \"unit\": \"" << r.unit << "\""
+				<< ", \"items_per_op\": " << r.items_per_op
+				<< ", \"iterations\": " << r.iterations
+				<< ", \"ns_per_op\": {\"min\": " << r.ns_min << ", \"median\": " << r.ns_median << ", \"max\": " << r.ns_max << "}"
+				<< ", \"items_per_second\": " << r.items_per_op * 1e9 / r.ns_median
+				<< "}"
+			;
+		}
+		os << "\n\t]\n}\n";
+	}
+};
+
+// Cycles through a fixed set of inputs, so every op sees different data
+// but every run the same.
+template<typename T>
+struct Inputs {
+	std::vector<T> values;
+	std::size_t    next = 0;
+
+	T const& operator()() {
+		T const& v = values[next];
+		next = next + 1 == values.size() ? 0 : next + 1;
+		return v;
+	}
+};
+
+constexpr std::size_t input_count = 1024;
+
+template<typename Gen, typename F>
+auto make_inputs(Gen& gen, F make)
+	-> Inputs<decltype(make(gen))>
+{
+	Inputs<decltype(make(gen))> inputs;
+	inputs.values.reserve(input_count);
+	for(std::size_t i = 0; i < input_count; ++i) {
+		inputs.values.push_back(make(gen));
+	}
+	return inputs;
+}
+
+using V3 = Vertex<double, 3>;
+using V2 = Vertex<double, 2>;
+
+void bench_triangle(Bench& bench, std::mt19937& gen) {
+	std::uniform_real_distribution<double> d{-1.0, 1.0};
+	auto point = [&](std::mt19937& g) {
+		return V3{d(g), d(g), d(g)};
+	};
+	std::vector<TriangleIntersector> triangles;
+	for(std::size_t i = 0; i < input_count; ++i) {
+		triangles.emplace_back(Triangle{point(gen), point(gen), point(gen)});
+	}
+	auto rays = make_inputs(gen, [&](std::mt19937& g) {
+		return Ray3{point(g), point(g)};
+	});
+	auto segments = make_inputs(gen, [&](std::mt19937& g) {
+		return Segment3{point(g), point(g)};
+	});
+	std::size_t t = 0;
+	bench.run("triangle/intersected_by/ray", "tests", 1.0, [&]() {
+		keep(triangles[t++ % input_count].intersected_by(rays()));
+	});
+	bench.run("triangle/intersected_by/segment", "tests", 1.0, [&]() {
+		keep(triangles[t++ % input_count].intersected_by(segments()));
+	});
+}
+
+void bench_obstacle_geometry(Bench& bench, std::mt19937& gen) {
+	ObstacleSet set{robo::config::Robot::radius};
+	struct Shape {
+		char const*             name;
+		ObstacleSet::class_id_t class_id;
+	};
+	std::array const shapes{
+		  Shape{"box",      set.add_box_class(0.3, 0.5, 1.0)}
+		, Shape{"cylinder", set.add_cylinder_class(0.3, 0.8)}
+	};
+	// around the obstacle, about half of the queries hit
+	std::uniform_real_distribution<double> d{-0.6, 0.6};
+	auto point = [&](std::mt19937& g) {
+		return V3{d(g), d(g), 0.5 + d(g)};
+	};
+	auto rays = make_inputs(gen, [&](std::mt19937& g) {
+		V3 p = 3.0 * point(g);
+		return Ray3{p, point(g) - p};
+	});
+	auto segments = make_inputs(gen, [&](std::mt19937& g) {
+		V3 p = point(g);
+		return Segment3{p, 0.5 * (point(g) - p)};
+	});
+	auto points = make_inputs(gen, point);
+	Transform Ti = Transform::translate(0.0, 0.0, 0.5).invert();
+	for(Shape const& shape : shapes) {
+		for(auto [geometry_name, geometry] : {
+			  std::pair<char const*, ObstacleGeometry const*>{"raw",   &shape.class_id->raw}
+			, std::pair<char const*, ObstacleGeometry const*>{"grown", &shape.class_id->grown}
+		}) {
+			std::string prefix = std::string("obstacle_geometry/") + shape.name + '/' + geometry_name + '/';
+			bench.run(prefix + "intersect", "rays", 1.0, [&]() {
+				keep(geometry->intersect(rays(), Ti, {}));
+			});
+			bench.run(prefix + "intersects", "segments", 1.0, [&]() {
+				keep(geometry->intersects(segments(), Ti));
+			});
+			bench.run(prefix + "inside", "points", 1.0, [&]() {
+				keep(geometry->inside(points(), Ti));
+			});
+		}
+	}
+}
+
+// the classes and mix of robo::Obstacles, without its placement checks,
+// so the set has exactly n obstacles
+ObstacleSet make_obstacle_set(std::mt19937& gen, std::size_t n) {
+	ObstacleSet set{robo::config::Robot::radius};
+	std::array const class_ids{
+		  set.add_box_class(0.2, 0.2, 0.5)
+		, set.add_box_class(0.3, 0.5, 1.0)
+		, set.add_cylinder_class(0.2, 0.2)
+		, set.add_cylinder_class(0.3, 0.8)
+	};
+	std::discrete_distribution<std::size_t>  pick{10.0, 2.0, 8.0, 1.0};
+	std::uniform_real_distribution<double>   x{-robo::config::Pitch::width  / 2.0, robo::config::Pitch::width  / 2.0};
+	std::uniform_real_distribution<double>   y{-robo::config::Pitch::height / 2.0, robo::config::Pitch::height / 2.0};
+	std::uniform_real_distribution<double>   phi{0.0, 2.0 * M_PI};
+	for(std::size_t i = 0; i < n; ++i) {
+		ObstacleSet::class_id_t class_id = class_ids[pick(gen)];
+		set.add_obstacle(
+			  class_id
+			, Transform::translate(x(gen), y(gen), class_id->raw.bounding_box_size[2] / 2.0)
+				* Transform::rotate_z(phi(gen))
+		);
+	}
+	return set;
+}
+
+void bench_obstacle_set(Bench& bench, std::mt19937& gen) {
+	std::uniform_real_distribution<double> x{-robo::config::Pitch::width  / 2.0, robo::config::Pitch::width  / 2.0};
+	std::uniform_real_distribution<double> y{-robo::config::Pitch::height / 2.0, robo::config::Pitch::height / 2.0};
+	std::uniform_real_distribution<double> phi{0.0, 2.0 * M_PI};
+	// horizontal at the height of the robots' sensors, as vision and
+	// traversability queries are
+	auto point = [&](std::mt19937& g) {
+		return V3{x(g), y(g), 0.1};
+	};
+	auto direction = [&](std::mt19937& g, double length) {
+		double a = phi(g);
+		return V3{length * std::cos(a), length * std::sin(a), 0.0};
+	};
+	auto rays = make_inputs(gen, [&](std::mt19937& g) {
+		return Ray3{point(g), direction(g, 1.0)};
+	});
+	auto segments = make_inputs(gen, [&](std::mt19937& g) {
+		return Segment3{point(g), direction(g, 1.0)};
+	});
+	auto points = make_inputs(gen, point);
+	for(std::size_t n : {16, 64, 256, 1024}) {
+		std::string prefix = "obstacle_set/" + std::to_string(n) + '/';
+		ObstacleSet set = make_obstacle_set(gen, n);
+		bench.run(prefix + "raw/intersect", "rays", 1.0, [&]() {
+			keep(set.raw_view().intersect(rays()));
+		});
+		bench.run(prefix + "grown/intersects", "segments", 1.0, [&]() {
+			keep(set.grown_view().intersects(segments()));
+		});
+		bench.run(prefix + "grown/inside", "points", 1.0, [&]() {
+			keep(set.grown_view().inside(points()));
+		});
+	}
+}
+
+template<typename T>
+void bench_round_trip(Bench& bench, std::string const& name, T const& message) {
+	DynamicSerializationBuffer<> out;
+	Serializer::serialize(out, message);
+	double bytes = static_cast<double>(out.count());
+	bench.run("serialize/" + name, "bytes", bytes, [&]() {
+		out.reset();
+		Serializer::serialize(out, message);
+		std::span<std::byte const> payload{out.buffer.data(), out.count()};
+		detail::FixedDeserializationBufferBase<0, std::span<std::byte const>, std::size_t> in{payload};
+		in.reset(payload.size());
+		T result;
+		Serializer::deserialize(in, result);
+		keep(result);
+	});
+}
+
+// every command as sent: default valued requests and responses wrapped in
+// the CommandSet, and the two large messages filled from a running world
+void bench_serialization(Bench& bench, robo::Environment& environment) {
+	using command_set_t = robo::Environment::CommandSet;
+	[&]<std::size_t... Is>(std::index_sequence<Is...>) {
+		([&]() {
+			using command_t = typename command_set_t::template command<Is>;
+			using request_t = typename command_t::Request;
+			std::string const& name = ServerStats::command_name_of<request_t>();
+			bench_round_trip(bench, name + "/request",  typename command_set_t::Request{request_t{}});
+			bench_round_trip(bench, name + "/response", typename command_set_t::Response{typename command_t::Response{}});
+		}(), ...);
+	}(std::make_index_sequence<command_set_t::size>{});
+
+	if(bench.selected("serialize/QueryVisionCommand/response/vision")) {
+		robo::RobotId id = environment.robots.front().id;
+		bench_round_trip(
+			  bench
+			, "QueryVisionCommand/response/vision"
+			, command_set_t::Response{environment.handle(robo::QueryVisionCommand::Request{id})}
+		);
+	}
+	uint64_t last_tick = ~uint64_t{0};
+	if(auto world = environment.world_state(last_tick)) {
+		bench_round_trip(bench, "WorldState/" + std::to_string(world->robots.size()) + "_robots", *world);
+	}
+}
+
+auto make_environment(std::mt19937& gen, std::size_t n_robots)
+	-> std::unique_ptr<robo::Environment>
+{
+	double dt = robo::config::Simulation::delta_t_sim;
+	auto environment = std::make_unique<robo::Environment>(dt, dt, 0);
+	environment->populate_obstacles(32);
+	environment->populate_guests(100);
+	std::uniform_real_distribution<double> v(-1.0, 1.0);
+	for(std::size_t i = 0; i < n_robots; ++i) {
+		auto r = environment->handle(robo::RegisterRobotCommand::Request{"bench" + std::to_string(i)});
+		if(r.result) {
+			environment->handle(robo::LocalVelocityCommand::Request{
+				  r.result->registration
+				, V2{v(gen) * robo::config::Robot::velocity_max_x, v(gen) * robo::config::Robot::velocity_max_y}
+				, v(gen) * robo::config::Robot::angular_velocity_max
+			});
+		}
+	}
+	return environment;
+}
+
+void bench_environment(Bench& bench, std::mt19937& gen) {
+	for(std::size_t n : {1, 10, 100, 1000}) {
+		std::string name = "environment/update/" + std::to_string(n);
+		auto environment = make_environment(gen, n);
+		bench.run(name, "robots", static_cast<double>(n), [&]() {
+			environment->update(false);
+		});
+	}
+	if(bench.selected("serialize/")) {
+		auto environment = make_environment(gen, 100);
+		for(std::size_t i = 0; i < 10; ++i) {
+			environment->update(false);
+		}
+		bench_serialization(bench, *environment);
+	}
+}
+
+// Refines the cells crossed by the rim of an obstacle footprint down to
+// min_width, the shape of tree a planner builds over the pitch.
+struct FootprintRefinement {
+	struct CellValue {};
+	struct Circle {
+		V2     center;
+		double radius;
+	};
+	std::vector<Circle> circles;
+	double              min_width;
+
+	bool operator()(CellValue&, sm::Rectangle const& bounds) const {
+		if(bounds.width() <= min_width) {
+			return false;
+		}
+		for(Circle const& c : circles) {
+			V2 nearest{
+				  std::clamp(c.center[0], bounds.min[0], bounds.max[0])
+				, std::clamp(c.center[1], bounds.min[1], bounds.max[1])
+			};
+			V2 farthest{
+				  std::max(std::abs(c.center[0] - bounds.min[0]), std::abs(c.center[0] - bounds.max[0]))
+				, std::max(std::abs(c.center[1] - bounds.min[1]), std::abs(c.center[1] - bounds.max[1]))
+			};
+			V2     d  = nearest - c.center;
+			double r2 = c.radius * c.radius;
+			if(d * d <= r2 && farthest * farthest >= r2) {
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+void bench_quad_tree(Bench& bench, std::mt19937& gen) {
+	if(!bench.selected("quad_tree/")) {
+		return;
+	}
+	using tree_t = sm::QuadTree<FootprintRefinement>;
+	double w = robo::config::Pitch::width  / 2.0;
+	double h = robo::config::Pitch::height / 2.0;
+	sm::Rectangle pitch{V2{-w, -h}, V2{w, h}};
+	FootprintRefinement refinement{{}, robo::config::Pitch::width / 256.0};
+	ObstacleSet set = make_obstacle_set(gen, 64);
+	for(std::size_t i = 0; i < set.obstacles.size(); ++i) {
+		V3 center = set.obstacles[i].second.position(V3{0.0, 0.0, 0.0});
+		V3 size   = set.grown_size(i);
+		refinement.circles.push_back({V2{center[0], center[1]}, std::max(size[0], size[1]) / 2.0});
+	}
+	std::uniform_real_distribution<double> x{-w, w};
+	std::uniform_real_distribution<double> y{-h, h};
+	auto points = make_inputs(gen, [&](std::mt19937& g) {
+		return V2{x(g), y(g)};
+	});
+
+	typename tree_t::Context  context;
+	std::vector<std::size_t> leaves;
+	{
+		tree_t tree{context, refinement, pitch};
+		tree.collect_leave_ids(leaves);
+	}
+	double n_leaves = static_cast<double>(leaves.size());
+	bench.run("quad_tree/build", "leaves", n_leaves, [&]() {
+		tree_t tree{context, refinement, pitch};
+		tree.collect_leave_ids(leaves);
+		keep(leaves.size());
+	});
+	// build included, subtract quad_tree/build for the queries alone
+	bench.run("quad_tree/neighbours8/cold", "leaves", n_leaves, [&]() {
+		tree_t tree{context, refinement, pitch};
+		tree.collect_leave_ids(leaves);
+		for(std::size_t id : leaves) {
+			keep(tree.find_neighbour8_ids(id).size());
+		}
+	});
+
+	tree_t tree{context, refinement, pitch};
+	tree.collect_leave_ids(leaves);
+	for(std::size_t id : leaves) {
+		tree.find_neighbour8_ids(id);
+	}
+	bench.run("quad_tree/find_id", "points", 1.0, [&]() {
+		keep(tree.find_id(points()));
+	});
+	bench.run("quad_tree/find_id/neighbours4", "points", 1.0, [&]() {
+		keep(tree.find_neighbour4_ids(tree.find_id(points())).size());
+	});
+	bench.run("quad_tree/find_id/neighbours8", "points", 1.0, [&]() {
+		keep(tree.find_neighbour8_ids(tree.find_id(points())).size());
+	});
+}
+
+int main(int argc, char** argv) {
+	CommandLineArguments cla(argc, argv);
+	std::string filter      = cla.get<std::string>("--filter=",      "");
+	double      min_time    = cla.get<double>(     "--min_time=",    0.5);
+	std::size_t repetitions = cla.get<std::size_t>("--repetitions=", 5);
+	uint64_t    seed        = cla.get<uint64_t>(   "--seed=",        42);
+	std::string out         = cla.get<std::string>("--out=",         "bench.json");
+
+	Bench bench{filter, min_time, repetitions};
+	// each group draws from its own generator, so --filter doesn't change
+	// the fixtures of the others, and within a group every fixture is built,
+	// filtered out or not, so the later ones get the same draws
+	auto group = [&](auto f, uint64_t n) {
+		std::mt19937 gen{static_cast<std::mt19937::result_type>(seed + n)};
+		f(bench, gen);
+	};
+	group(bench_triangle,          0);
+	group(bench_obstacle_geometry, 1);
+	group(bench_obstacle_set,      2);
+	group(bench_environment,       3);
+	group(bench_quad_tree,         4);
+
+	std::ofstream file(out);
+	if(!file) {
+		std::cerr << "can't write " << out << '\n';
+		return 1;
+	}
+	bench.write_json(file, seed);
+	std::cerr << "results written to " << out << '\n';
+	return 0;
+}
@@ -0,0 +1,543 @@
+#include "RobotProxy.hpp"
+#include "util/CommandLineArguments.hpp"
+#include "util/name_this_thread.hpp"
+#include "util/time_this.hpp"
+#include "config/Pitch.hpp"
+#include "config/Simulator.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <random>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+
+// Swarm of synthetic bots against a running simulator, to find how many
+// bots it serves at which latency. Every bot has its own connection and
+// runs the command mix at the given rates (per bot and second, 0 disables
+// a command). By default every bot has its own thread too; with fewer
+// --threads the bots of a thread wait for each other's calls, which shows
+// as send delay.
+//     loadgen [--host=localhost] [--port=31114] [--bots=100] [--threads=bots]
+//             [--seconds=30] [--report=1] [--open_loop] [--seed=1]
+//             [--vision_rate=30] [--velocity_rate=30] [--traversable_rate=10]
+//             [--debug_lines_rate=2] [--debug_lines=16] [--out=loadgen.json]
+// Closed loop, a command is issued one period after the previous one of
+// its kind returned and its latency is taken from sending it. Open loop,
+// the commands of a kind are due on a fixed grid and the latency is taken
+// from when a command was due, so a stalled simulator shows up as latency
+// instead of as fewer samples (coordinated omission). The send delay, from
+// when a command was due to when it was sent, is recorded apart, so load
+// on the client side can be told from latency of the simulator.
+
+using client_t = robo::RobotProxy::client_t;
+using std::chrono::steady_clock;
+
+enum Kind : std::size_t {
+	  VISION
+	, VELOCITY
+	, TRAVERSABLE
+	, DEBUG_LINES
+	, KINDS
+};
+constexpr std::array<char const*, KINDS> kind_names{
+	"vision", "velocity", "traversable", "debug_lines"
+};
+
+struct Options {
+	std::string                 host;
+	int                         port;
+	double                      seconds;
+	bool                        open_loop;
+	std::array<double, KINDS>   rates;   // per bot and second
+	std::size_t                 debug_lines;
+};
+
+// Counters of one worker thread, written by it only.
+struct WorkerStats {
+	std::array<TimeHistogram, KINDS>         latency;
+	std::array<TimeHistogram, KINDS>         send_delay;   // sent after it was due
+	std::array<std::atomic<uint64_t>, KINDS> errors{};     // no response, the bot is dropped
+	std::array<std::atomic<uint64_t>, KINDS> rejected{};   // answered, but not with success
+	std::atomic<uint64_t>                    connect_errors{0};
+	std::atomic<uint64_t>                    disconnect_errors{0};   // deregistration not confirmed
+	std::atomic<uint64_t>                    bots{0};      // registered and not dropped
+};
+
+struct Bot {
+	std::string               name;
+	std::unique_ptr<client_t> client;
+	robo::RobotId             id;
+	bool                      alive = false;
+};
+
+class Worker {
+private:
+	struct Due {
+		steady_clock::time_point at;
+		std::size_t         bot;
+		Kind                kind;
+
+		friend bool operator>(Due const& a, Due const& b) {
+			return a.at > b.at;
+		}
+	};
+	enum class Outcome {
+		  SUCCESS
+		, REJECTED
+		, FAILED
+	};
+
+	Options const&           options;
+	std::atomic<bool> const& running;
+	WorkerStats&             stats;
+	std::vector<Bot>         bots;
+	std::mt19937             gen;
+
+	template<typename Command, typename Accept>
+	Outcome call(Bot& bot, typename Command::Request const& request, Accept accept) {
+		auto response = bot.client->template call<Command>(request);
+		if(!response) {
+			return Outcome::FAILED;
+		}
+		return accept(*response) ? Outcome::SUCCESS : Outcome::REJECTED;
+	}
+
+	Outcome issue(Bot& bot, Kind kind) {
+		std::uniform_real_distribution<double> u{-1.0, 1.0};
+		auto point = [&]() {
+			return Vertex<double, 2>{
+				  u(gen) * robo::config::Pitch::width  / 2.0
+				, u(gen) * robo::config::Pitch::height / 2.0
+			};
+		};
+		switch(kind) {
+			case VISION:
+				return call<robo::QueryVisionCommand>(bot, {bot.id}, [](auto const& r) {
+					return r.result == robo::QueryVisionCommand::Response::Result::SUCCESS;
+				});
+			case VELOCITY:
+				return call<robo::LocalVelocityCommand>(
+					  bot
+					, {
+						  bot.id
+						, Vertex<double, 2>{
+							  0.5 * u(gen) * robo::config::Robot::velocity_max_x
+							, 0.5 * u(gen) * robo::config::Robot::velocity_max_y
+						}
+						, 0.5 * u(gen) * robo::config::Robot::angular_velocity_max
+					}
+					, [](auto const& r) {
+						return r.result == robo::LocalVelocityCommand::Response::Result::SUCCESS;
+					}
+				);
+			case TRAVERSABLE:
+				return call<robo::QuerySegmentTraversableCommand>(bot, {bot.id, point(), point()}, [](auto const& r) {
+					return r.result != robo::QuerySegmentTraversableCommand::Response::Result::UNKNOWN_ROBOT;
+				});
+			case DEBUG_LINES: {
+				std::vector<robo::DebugLine> lines;
+				lines.reserve(options.debug_lines);
+				for(std::size_t i = 0; i < options.debug_lines; ++i) {
+					lines.push_back(robo::DebugLine::make(point(), point(), {1.0, 0.5, 0.0}, 0.01, 0.05));
+				}
+				return call<robo::SetDebugLinesCommand>(bot, {bot.id, std::move(lines)}, [](auto const& r) {
+					return r.result == robo::SetDebugLinesCommand::Response::Result::SUCCESS;
+				});
+			}
+			default:
+				return Outcome::FAILED;
+		}
+	}
+
+	void connect() {
+		for(Bot& bot : bots) {
+			try {
+				bot.client = std::make_unique<client_t>(options.host, options.port);
+				auto r = bot.client->call<robo::RegisterRobotCommand>({bot.name});
+				if(r && r->result) {
+					bot.id    = r->result->registration;
+					bot.alive = true;
+					stats.bots.fetch_add(1, std::memory_order_relaxed);
+					continue;
+				}
+			} catch(PosixError const& e) {
+				std::cerr << bot.name << ": " << e.what() << '\n';
+			}
+			bot.client.reset();
+			stats.connect_errors.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+	void disconnect() {
+		for(Bot& bot : bots) {
+			if(!bot.alive) {
+				continue;
+			}
+			auto r = bot.client->call<robo::DeregisterRobotCommand>({bot.id});
+			if(!r || r->result != robo::DeregisterRobotCommand::Response::Result::SUCCESS) {
+				stats.disconnect_errors.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+	}
+
+public:
+	Worker(Options const& options, std::atomic<bool> const& running, WorkerStats& stats, uint64_t seed)
+		: options{options}
+		, running{running}
+		, stats{stats}
+		, gen{static_cast<std::mt19937::result_type>(seed)}
+	{}
+
+	void add_bot(std::string name) {
+		bots.push_back(Bot{std::move(name), {}, {}, false});
+	}
+
+	void run() {
+		name_this_thread("loadgen");
+		connect();
+		std::priority_queue<Due, std::vector<Due>, std::greater<Due>> queue;
+		std::array<steady_clock::duration, KINDS> periods{};
+		// staggered over the first period, so the bots don't fire in sync
+		std::uniform_real_distribution<double> phase{0.0, 1.0};
+		auto start = steady_clock::now();
+		for(std::size_t k = 0; k < KINDS; ++k) {
+			if(options.rates[k] <= 0.0) {
+				continue;
+			}
+			periods[k] = std::chrono::duration_cast<steady_clock::duration>(std::chrono::duration<double>(1.0 / options.rates[k]));
+			for(std::size_t b = 0; b < bots.size(); ++b) {
+				if(bots[b].alive) {
+					auto offset = std::chrono::duration_cast<steady_clock::duration>(phase(gen) * periods[k]);
+					queue.push({start + offset, b, static_cast<Kind>(k)});
+				}
+			}
+		}
+		while(running && !queue.empty()) {
+			Due due = queue.top();
+			queue.pop();
+			if(due.at > steady_clock::now()) {
+				// wake up at least every 100ms to notice the end
+				std::this_thread::sleep_until(std::min(due.at, steady_clock::now() + std::chrono::milliseconds(100)));
+				queue.push(due);
+				continue;
+			}
+			Bot& bot = bots[due.bot];
+			if(!bot.alive) {
+				continue;
+			}
+			auto    sent    = steady_clock::now();
+			Outcome outcome = issue(bot, due.kind);
+			auto    done    = steady_clock::now();
+			auto    ns      = std::chrono::duration_cast<std::chrono::nanoseconds>(done - (options.open_loop ? due.at : sent)).count();
+			auto    delay   = std::chrono::duration_cast<std::chrono::nanoseconds>(sent - due.at).count();
+			stats.latency[due.kind].add(static_cast<uint64_t>(std::max<decltype(ns)>(ns, 0)));
+			stats.send_delay[due.kind].add(static_cast<uint64_t>(std::max<decltype(delay)>(delay, 0)));
+			if(outcome == Outcome::REJECTED) {
+				stats.rejected[due.kind].fetch_add(1, std::memory_order_relaxed);
+			} else if(outcome == Outcome::FAILED) {
+				// the client can't recover its stream, give up on the bot
+				stats.errors[due.kind].fetch_add(1, std::memory_order_relaxed);
+				stats.bots.fetch_sub(1, std::memory_order_relaxed);
+				bot.alive = false;
+				continue;
+			}
+			due.at = (options.open_loop ? due.at : done) + periods[due.kind];
+			queue.push(due);
+		}
+		disconnect();
+	}
+};
+
+// everything so far of one kind, merged over the workers
+struct KindTotals {
+	TimeSummary latency;
+	TimeSummary send_delay;
+	uint64_t    errors   = 0;
+	uint64_t    rejected = 0;
+};
+
+auto collect(std::vector<std::unique_ptr<WorkerStats>> const& stats)
+	-> std::array<KindTotals, KINDS>
+{
+	std::array<KindTotals, KINDS> totals;
+	for(std::size_t k = 0; k < KINDS; ++k) {
+		totals[k].latency.name = kind_names[k];
+		for(auto const& s : stats) {
+			totals[k].latency.merge(s->latency[k]);
+			totals[k].send_delay.merge(s->send_delay[k]);
+			totals[k].errors   += s->errors[k].load(std::memory_order_relaxed);
+			totals[k].rejected += s->rejected[k].load(std::memory_order_relaxed);
+		}
+	}
+	return totals;
+}
+
+// the part of now that came after last, max stays the overall one
+auto since(KindTotals const& now, KindTotals const& last)
+	-> KindTotals
+{
+	KindTotals d = now;
+	for(std::size_t i = 0; i < TimeHistogram::size; ++i) {
+		d.latency.counts[i]    -= last.latency.counts[i];
+		d.send_delay.counts[i] -= last.send_delay.counts[i];
+	}
+	d.latency.count    -= last.latency.count;
+	d.latency.sum      -= last.latency.sum;
+	d.send_delay.count -= last.send_delay.count;
+	d.send_delay.sum   -= last.send_delay.sum;
+	d.errors           -= last.errors;
+	d.rejected         -= last.rejected;
+	return d;
+}
+
+struct Interval {
+	double                        time;   // since start, at the end of the interval
+	double                        duration;
+	uint64_t                      bots;
+	std::array<KindTotals, KINDS> kinds;
+};
+
+void write_json(
+	  std::ostream&                        os
+	, Options const&                       options
+	, std::size_t                          n_bots
+	, std::size_t                          n_threads
+	, uint64_t                             connect_errors
+	, uint64_t                             disconnect_errors
+	, std::vector<Interval> const&         intervals
+	, std::array<KindTotals, KINDS> const& totals
+	, double                               duration
+) {
+	auto ms = [](double seconds) {
+		return seconds * 1e3;
+	};
+	auto latency = [&](TimeSummary const& s) {
+		os
+			<< "\"count\": " << s.count
+			<< ", \"mean_ms\": " << ms(s.mean())
+			<< ", \"p50_ms\": "  << ms(s.percentile(0.5))
+			<< ", \"p90_ms\": "  << ms(s.percentile(0.9))
+			<< ", \"p99_ms\": "  << ms(s.percentile(0.99))
+			<< ", \"p999_ms\": " << ms(s.percentile(0.999))
+		;
+	};
+	os << std::setprecision(9);
+	os
+		<< "{\n"
+		<< "\t\"bots\": " << n_bots << ",\n"
+		<< "\t\"threads\": " << n_threads << ",\n"
+		<< "\t\"open_loop\": " << (options.open_loop ? "true" : "false") << ",\n"
+		<< "\t\"seconds\": " << duration << ",\n"
+		<< "\t\"connect_errors\": " << connect_errors << ",\n"
+		<< "\t\"disconnect_errors\": " << disconnect_errors << ",\n"
+		<< "\t\"rates\": {"
+	;
+	for(std::size_t k = 0; k < KINDS; ++k) {
+		os << (k ? ", " : "") << '"' << kind_names[k] << "\": " << options.rates[k];
+	}
+	os << "},\n\t\"intervals\": [";
+	for(std::size_t i = 0; i < intervals.size(); ++i) {
+		Interval const& interval = intervals[i];
+		os
+			<< (i ? "," : "") << "\n\t\t{\"time\": " << interval.time
+			<< ", \"duration\": " << interval.duration
+			<< ", \"bots\": " << interval.bots
+		;
+		for(std::size_t k = 0; k < KINDS; ++k) {
+			KindTotals const& t = interval.kinds[k];
+			os << ", \"" << kind_names[k] << "\": {";
+			latency(t.latency);
+			os
+				<< ", \"send_delay_p99_ms\": " << ms(t.send_delay.percentile(0.99))
+				<< ", \"per_second\": " << t.latency.count / interval.duration
+				<< ", \"errors\": " << t.errors
+				<< ", \"rejected\": " << t.rejected
+				<< '}'
+			;
+		}
+		os << '}';
+	}
+	os << "\n\t],\n\t\"commands\": {";
+	for(std::size_t k = 0; k < KINDS; ++k) {
+		KindTotals const& t = totals[k];
+		os << (k ? "," : "") << "\n\t\t\"" << kind_names[k] << "\": {";
+		latency(t.latency);
+		os
+			<< ", \"max_ms\": " << ms(t.latency.maximum())
+			<< ", \"send_delay_p50_ms\": " << ms(t.send_delay.percentile(0.5))
+			<< ", \"send_delay_p99_ms\": " << ms(t.send_delay.percentile(0.99))
+			<< ", \"send_delay_max_ms\": " << ms(t.send_delay.maximum())
+			<< ", \"per_second\": " << t.latency.count / duration
+			<< ", \"errors\": " << t.errors
+			<< ", \"rejected\": " << t.rejected
+			<< ", \"histogram_ns\": ["
+		;
+		// non empty buckets as [lower bound, width, count]
+		bool first = true;
+		for(std::size_t i = 0; i < TimeHistogram::size; ++i) {
+			if(t.latency.counts[i]) {
+				os
+					<< (first ? "" : ", ")
+					<< '[' << TimeHistogram::lower(i) << ", " << TimeHistogram::width(i) << ", " << t.latency.counts[i] << ']'
+				;
+				first = false;
+			}
+		}
+		os << "]}";
+	}
+	os << "\n\t}\n}\n";
+}
+
+int main(int argc, char** argv) {
+	CommandLineArguments cla(argc, argv);
+	Options options{
+		  cla.get<std::string>("--host=",     "localhost")
+		, cla.get<int>(        "--port=",     robo::config::Simulator::default_port)
+		, cla.get<double>(     "--seconds=",  30.0)
+		, cla.has_prefix("--open_loop")
+		, {
+			  cla.get<double>("--vision_rate=",      30.0)
+			, cla.get<double>("--velocity_rate=",    30.0)
+			, cla.get<double>("--traversable_rate=", 10.0)
+			, cla.get<double>("--debug_lines_rate=", 2.0)
+		}
+		, cla.get<std::size_t>("--debug_lines=", 16)
+	};
+	std::size_t n_bots    = cla.get<std::size_t>("--bots=",    100);
+	std::size_t n_threads = std::clamp<std::size_t>(cla.get<std::size_t>("--threads=", n_bots), 1, std::max<std::size_t>(n_bots, 1));
+	double      report    = cla.get<double>(     "--report=",  1.0);
+	uint64_t    seed      = cla.get<uint64_t>(   "--seed=",    1);
+	std::string out       = cla.get<std::string>("--out=",     "");
+
+	// one descriptor per bot
+	rlimit limit;
+	if(::getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+		limit.rlim_cur = limit.rlim_max;
+		::setrlimit(RLIMIT_NOFILE, &limit);
+	}
+
+	std::atomic<bool>                         running{true};
+	std::vector<std::unique_ptr<WorkerStats>> stats;
+	std::vector<std::unique_ptr<Worker>>      workers;
+	for(std::size_t t = 0; t < n_threads; ++t) {
+		stats.push_back(std::make_unique<WorkerStats>());
+		workers.push_back(std::make_unique<Worker>(options, running, *stats.back(), seed + t));
+	}
+	for(std::size_t b = 0; b < n_bots; ++b) {
+		workers[b % n_threads]->add_bot("loadgen" + std::to_string(b));
+	}
+	std::vector<std::thread> threads;
+	for(auto& w : workers) {
+		threads.emplace_back(&Worker::run, w.get());
+	}
+
+	auto bots = [&]() {
+		uint64_t n = 0;
+		for(auto const& s : stats) {
+			n += s->bots.load(std::memory_order_relaxed);
+		}
+		return n;
+	};
+	auto start = steady_clock::now();
+	auto end   = start + std::chrono::duration_cast<steady_clock::duration>(std::chrono::duration<double>(options.seconds));
+	auto last_time = start;
+	auto last      = collect(stats);
+	std::vector<Interval> intervals;
+	std::cout << std::fixed;
+	while(steady_clock::now() < end) {
+		auto next = std::min(end, last_time + std::chrono::duration_cast<steady_clock::duration>(std::chrono::duration<double>(report)));
+		std::this_thread::sleep_until(next);
+		auto   now      = steady_clock::now();
+		auto   totals   = collect(stats);
+		double duration = std::chrono::duration<double>(now - last_time).count();
+		Interval interval{std::chrono::duration<double>(now - start).count(), duration, bots(), {}};
+		for(std::size_t k = 0; k < KINDS; ++k) {
+			interval.kinds[k] = since(totals[k], last[k]);
+		}
+		std::cout << std::setprecision(1) << std::setw(7) << interval.time << "s bots " << interval.bots;
+		for(std::size_t k = 0; k < KINDS; ++k) {
+			if(options.rates[k] <= 0.0) {
+				continue;
+			}
+			KindTotals const& t = interval.kinds[k];
+			std::cout
+				<< " | " << kind_names[k]
+				<< ' ' << std::setprecision(0) << t.latency.count / duration << "/s"
+				<< " p50 " << std::setprecision(2) << t.latency.percentile(0.5) * 1e3
+				<< " p99 " << t.latency.percentile(0.99) * 1e3 << "ms"
+				<< " delay p99 " << t.send_delay.percentile(0.99) * 1e3 << "ms"
+			;
+			if(t.errors || t.rejected) {
+				std::cout << " err " << t.errors << " rej " << t.rejected;
+			}
+		}
+		std::cout << std::endl;
+		intervals.push_back(std::move(interval));
+		last      = totals;
+		last_time = now;
+	}
+	running = false;
+	for(auto& t : threads) {
+		t.join();
+	}
+	// as of the last report, what came after is not part of its duration
+	double   duration       = std::chrono::duration<double>(last_time - start).count();
+	auto     totals            = last;
+	uint64_t connect_errors    = 0;
+	uint64_t disconnect_errors = 0;
+	for(auto const& s : stats) {
+		connect_errors    += s->connect_errors.load(std::memory_order_relaxed);
+		disconnect_errors += s->disconnect_errors.load(std::memory_order_relaxed);
+	}
+	std::cout
+		<< "\n" << n_bots << " bots on " << n_threads << " threads, "
+		<< (options.open_loop ? "open" : "closed") << " loop, "
+		<< connect_errors << " failed to connect, "
+		<< disconnect_errors << " to deregister\n"
+		<< std::left << std::setw(12) << "command" << std::right
+		<< std::setw(10) << "cmd/s"
+		<< std::setw(10) << "mean ms"
+		<< std::setw(10) << "p50 ms"
+		<< std::setw(10) << "p90 ms"
+		<< std::setw(10) << "p99 ms"
+		<< std::setw(10) << "p99.9 ms"
+		<< std::setw(10) << "max ms"
+		<< std::setw(12) << "delay p99"
+		<< std::setw(8)  << "errors"
+		<< std::setw(10) << "rejected"
+		<< '\n'
+	;
+	for(KindTotals const& t : totals) {
+		TimeSummary const& s = t.latency;
+		std::cout
+			<< std::left << std::setw(12) << s.name << std::right
+			<< std::setprecision(0) << std::setw(10) << (duration > 0.0 ? s.count / duration : 0.0)
+			<< std::setprecision(3)
+			<< std::setw(10) << s.mean() * 1e3
+			<< std::setw(10) << s.percentile(0.5) * 1e3
+			<< std::setw(10) << s.percentile(0.9) * 1e3
+			<< std::setw(10) << s.percentile(0.99) * 1e3
+			<< std::setw(10) << s.percentile(0.999) * 1e3
+			<< std::setw(10) << s.maximum() * 1e3
+			<< std::setw(12) << t.send_delay.percentile(0.99) * 1e3
+			<< std::setw(8)  << t.errors
+			<< std::setw(10) << t.rejected
+			<< '\n'
+		;
+	}
+	if(!out.empty()) {
+		std::ofstream file(out);
+		if(!file) {
+			std::cerr << "can't write " << out << '\n';
+			return 1;
+		}
+		write_json(file, options, n_bots, n_threads, connect_errors, disconnect_errors, intervals, totals, duration);
+	}
+	return 0;
+}
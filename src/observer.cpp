@@ -0,0 +1,53 @@
+#include "serializer/DefaultPodBackend.hpp"
+#include "serializer/SerializationBuffers.hpp"
+#include "serializer/PrefixSerializer.hpp"
+#include "client_server/WorldStateBroadcast.hpp"
+#include "util/CommandLineArguments.hpp"
+#include "config/Simulator.hpp"
+#include "robo_commands.hpp"
+#include <csignal>
+#include <atomic>
+#include <iostream>
+
+// Passive spectator: prints the world state the simulator broadcasts with
+// --multicast, without connecting to the command server.
+//     observer [--multicast_group=239.255.31.114] [--multicast_port=31115] [--verbose]
+
+using Serializer            = PrefixSerializer<DefaultPodBackend>;
+using DeserializationBuffer = DynamicDeserializationBuffer<>;
+
+std::atomic<bool> is_running{true};
+void signal_handler(int /*signal*/) {
+	is_running = false;
+}
+
+int main(int argc, char** argv) {
+	std::signal(SIGINT,  signal_handler);
+	std::signal(SIGTERM, signal_handler);
+	CommandLineArguments cla(argc, argv);
+	bool verbose = cla.has_prefix("--verbose");
+	WorldStateReceiver<Serializer, DeserializationBuffer> receiver(
+		  cla.get<std::string>("--multicast_group=", robo::config::Simulator::multicast_group)
+		, cla.get<int>("--multicast_port=", robo::config::Simulator::multicast_port)
+	);
+	while(is_running) {
+		auto state = receiver.receive<robo::WorldState>(0.5);
+		if(!state) {
+			continue;
+		}
+		if(verbose) {
+			std::cout << *state << '\n';
+		} else {
+			std::cout
+				<< "tick "        << state->tick
+				<< ", time "      << state->time
+				<< ", robots "    << state->robots.size()
+				<< ", guests "    << state->guests.size()
+				<< ", obstacles " << state->obstacles.size()
+				<< '\n'
+			;
+		}
+	}
+	std::cout << receiver.stats() << std::endl;
+	return 0;
+}
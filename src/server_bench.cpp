@@ -0,0 +1,165 @@
+#include "serializer/DefaultPodBackend.hpp"
+#include "client_server/client_server.hpp"
+#include "serializer/SerializationBuffers.hpp"
+#include "serializer/PrefixSerializer.hpp"
+#include "util/CommandLineArguments.hpp"
+#include "Environment.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+
+// Threads vs io_uring server engine with many concurrent clients.
+// Runs the server in process, every client is a thread issuing
+// LocalVelocity and QuerySegmentTraversable commands back to back.
+//     server_bench [--clients=10,100,500] [--seconds=2] [--port=31200]
+
+using Serializer            = PrefixSerializer<DefaultPodBackend>;
+using SerializationBuffer   = DynamicSerializationBuffer<>;
+using DeserializationBuffer = DynamicDeserializationBuffer<>;
+using server_t = Server<robo::Environment, Serializer, SerializationBuffer, DeserializationBuffer>;
+using client_t = Client<
+	  make_command_set_from_variant<robo::CommandSet>
+	, Serializer
+	, SerializationBuffer
+	, DeserializationBuffer
+>;
+
+struct Result {
+	char const*         engine;
+	int                 clients;
+	double              duration;
+	int                 errors;
+	std::vector<double> latencies;
+
+	double percentile(double p) {
+		if(latencies.empty()) {
+			return 0.0;
+		}
+		std::size_t n = std::min(latencies.size() - 1, static_cast<std::size_t>(p * latencies.size()));
+		std::nth_element(latencies.begin(), latencies.begin() + n, latencies.end());
+		return latencies[n];
+	}
+};
+
+Result run(ServerEngine engine, int n_clients, double seconds, int port) {
+	using clock_t = std::chrono::steady_clock;
+	robo::Environment environment{1.0/60.0, 5e-3, 0};
+	server_t server(
+		  environment
+		, std::vector<Endpoint>{Endpoint::parse("tcp://:" + std::to_string(port), port)}
+		, false
+		, engine
+	);
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+	std::vector<std::unique_ptr<client_t>> clients;
+	std::vector<robo::RobotId>             ids;
+	for(int i = 0; i < n_clients; ++i) {
+		clients.push_back(std::make_unique<client_t>("localhost", port));
+		auto r = clients.back()->call<robo::RegisterRobotCommand>({"server_bench"});
+		if(!r || !r->result) {
+			std::cerr << "registration failed\n";
+			std::exit(1);
+		}
+		ids.push_back(r->result->registration);
+	}
+
+	std::atomic<bool>                go{false};   // spawning 500 threads takes a while, start them together
+	std::atomic<bool>                running{true};
+	std::atomic<int>                 errors{0};
+	std::vector<std::vector<double>> latencies(n_clients);
+	std::vector<std::thread>         threads;
+	for(int i = 0; i < n_clients; ++i) {
+		threads.emplace_back([&, i]() {
+			client_t& client = *clients[i];
+			latencies[i].reserve(1 << 16);
+			while(!go) {
+				std::this_thread::yield();
+			}
+			for(uint64_t k = 0; running; ++k) {
+				auto start = clock_t::now();
+				bool ok = k % 2
+					? client.call<robo::LocalVelocityCommand>({ids[i], {0.0, 0.0}, 0.0}).has_value()
+					: client.call<robo::QuerySegmentTraversableCommand>({ids[i], {0.0, 0.0}, {1.0, 1.0}}).has_value()
+				;
+				if(!ok) {
+					++errors;
+					break;
+				}
+				latencies[i].push_back(std::chrono::duration<double>(clock_t::now() - start).count());
+			}
+		});
+	}
+	auto start = clock_t::now();
+	go = true;
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+	running = false;
+	for(auto& t : threads) {
+		t.join();
+	}
+	Result result{
+		  engine == ServerEngine::URING ? "uring" : "threads"
+		, n_clients
+		, std::chrono::duration<double>(clock_t::now() - start).count()
+		, errors
+		, {}
+	};
+	for(auto& l : latencies) {
+		result.latencies.insert(result.latencies.end(), l.begin(), l.end());
+	}
+	clients.clear();
+	environment.kill();
+	return result;
+}
+
+int main(int argc, char** argv) {
+	CommandLineArguments cla(argc, argv);
+	double seconds = cla.get<double>("--seconds=", 2.0);
+	int    port    = cla.get<int>("--port=", 31200);
+	std::vector<int> client_counts;
+	{
+		std::stringstream ss(cla.get<std::string>("--clients=", "10,100,500"));
+		for(std::string n; std::getline(ss, n, ',');) {
+			client_counts.push_back(std::stoi(n));
+		}
+	}
+	// two descriptors per client
+	rlimit limit;
+	if(::getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+		limit.rlim_cur = limit.rlim_max;
+		::setrlimit(RLIMIT_NOFILE, &limit);
+	}
+
+	std::cout
+		<< std::setw(8)  << "engine"
+		<< std::setw(9)  << "clients"
+		<< std::setw(14) << "cmd/s"
+		<< std::setw(12) << "p50 us"
+		<< std::setw(12) << "p99 us"
+		<< std::setw(8)  << "errors"
+		<< '\n'
+	;
+	for(int n : client_counts) {
+		for(ServerEngine engine : {ServerEngine::THREADS, ServerEngine::URING}) {
+			Result r = run(engine, n, seconds, port++);
+			std::cout
+				<< std::setw(8)  << r.engine
+				<< std::setw(9)  << r.clients
+				<< std::fixed    << std::setprecision(0)
+				<< std::setw(14) << r.latencies.size() / r.duration
+				<< std::setprecision(1)
+				<< std::setw(12) << r.percentile(0.50) * 1e6
+				<< std::setw(12) << r.percentile(0.99) * 1e6
+				<< std::setw(8)  << r.errors
+				<< std::endl
+			;
+		}
+	}
+	return 0;
+}
@@ -1,23 +1,118 @@
 #include "serializer/DefaultPodBackend.hpp"
 #include "client_server/client_server.hpp"
+#include "client_server/MetricsListener.hpp"
+#include "client_server/WorldStateBroadcast.hpp"
 #include "serializer/SerializationBuffers.hpp"
 #include "serializer/PrefixSerializer.hpp"
 #include "util/CommandLineArguments.hpp"
+#include "util/realtime.hpp"
+#include "dp_lib/util/priority.hpp"
+#include "plugin/PluginHost.hpp"
+#include "CommandJournal.hpp"
 #include "Environment.hpp"
+#include "EnvironmentCheckpoint.hpp"
 #include "EnvironmentView.hpp"
+#include "ServerMetrics.hpp"
+#include "TrajectoryRecorder.hpp"
 #include "simulator_gui.hpp"
 #include <csignal>
+#include <system_error>
 #include <atomic>
+#include <memory>
 #include <thread>
 
-void simloop(robo::Environment& environment, std::atomic<bool> & is_running) {
+using Serializer = PrefixSerializer<DefaultPodBackend>;
+using SerializationBuffer = PooledSerializationBuffer<>;
+using DeserializationBuffer = PooledDeserializationBuffer<>;
+using Broadcaster = WorldStatePublisher<Serializer, SerializationBuffer, robo::WorldState>;
+
+// --sim_cpu=n runs the sim loop alone on cpu n and every other thread on
+// the rest, --sim_priority=1..99 under SCHED_FIFO, --sim_spin=us busy
+// waits the last us of every tick instead of sleeping
+struct SimThread {
+	int                                 cpu      = -1;
+	int                                 priority = 0;
+	std::chrono::steady_clock::duration spin{0};
+
+	// by the sim loop; it runs on as before when this fails
+	void apply() const {
+		if(cpu >= 0) {
+			try {
+				pin_this_thread({cpu});
+			} catch(PosixError const& e) {
+				std::cerr << "sim loop not pinned: " << e.what() << std::endl;
+			}
+		}
+		if(priority > 0) {
+			try {
+				dp::set_real_time_scheduler(
+					  dp::priority::RealTimePriority{priority}
+					, dp::priority::Inheritance::Reset
+				);
+			} catch(std::system_error const& e) {
+				std::cerr << "sim loop not real time, needs CAP_SYS_NICE: " << e.what() << std::endl;
+			}
+		}
+	}
+};
+
+void simloop(
+	  robo::Environment&                          environment
+	, std::atomic<bool>&                          is_running
+	, std::unique_ptr<Broadcaster>                broadcaster
+	, std::unique_ptr<robo::plugin::PluginHost>   plugins
+	, std::string const&                          checkpoint_path
+	, double                                      checkpoint_interval
+	, robo::CommandJournal*                       journal
+	, robo::TrajectoryRecorder*                   recorder
+	, SimThread const&                            placement
+) {
 	name_this_thread("simloop");
+	uint64_t last_broadcast_tick = 0;
+	std::unique_ptr<robo::CheckpointWriter> checkpoints;
+	double next_checkpoint = environment.get_time() + checkpoint_interval;
+	if(!checkpoint_path.empty()) {
+		checkpoints = std::make_unique<robo::CheckpointWriter>();
+	}
+	// after starting the writer, it must not share the cpu
+	placement.apply();
+	robo::TickMonitor& monitor = environment.tick_monitor;
 	while(is_running) {
-		using clock_t = std::chrono::steady_clock;
-		auto loop_enter = clock_t::now();
-		time_this("simulation", [&]() {environment.update(false);});
-		auto deadline  = loop_enter + std::chrono::duration<double>(1.0/environment.get_fps_simulation());
-		std::this_thread::sleep_until(deadline);
+		using clock_t = robo::TickMonitor::clock_t;
+		monitor.begin();
+		auto update_enter = clock_t::now();
+		time_this<"simulation">([&]() {environment.update(false);});
+		monitor.updated(clock_t::now() - update_enter);
+		if(journal) {
+			journal->checkpoint_if_due();
+		}
+		if(recorder) {
+			time_this<"record">([&]() {recorder->record(environment);});
+		}
+		if(plugins) {
+			time_this<"plugins">([&]() {plugins->step_if_due(environment.get_time());});
+		}
+		if(broadcaster) {
+			if(auto state = environment.world_state(last_broadcast_tick)) {
+				if(!broadcaster->publish(std::make_unique<robo::WorldState const>(std::move(*state)))) {
+					broadcaster.reset();
+				}
+			}
+		}
+		if(checkpoints && environment.get_time() >= next_checkpoint) {
+			time_this<"checkpoint">([&]() {checkpoints->write(checkpoint_path, environment);});
+			next_checkpoint += checkpoint_interval;
+		}
+		auto period = std::chrono::duration_cast<clock_t::duration>(
+			std::chrono::duration<double>(1.0/environment.get_fps_simulation())
+		);
+		sleep_then_spin_until(monitor.end(period), placement.spin);
+	}
+	if(checkpoints) {
+		checkpoints->write(checkpoint_path, environment);
+		if(uint64_t replaced = checkpoints->replaced()) {
+			std::cerr << "checkpoint: " << replaced << " snapshots replaced by newer ones before written\n";
+		}
 	}
 }
 
@@ -25,10 +120,48 @@ std::atomic<bool> is_running{true};
 void signal_handler(int /*signal*/) {
   is_running = false;
 }
+std::atomic<bool> dump_trace{false};
+void dump_trace_handler(int /*signal*/) {
+  dump_trace = true;
+}
 
-using Serializer = PrefixSerializer<DefaultPodBackend>;
-using SerializationBuffer = DynamicSerializationBuffer<>;
-using DeserializationBuffer = DynamicDeserializationBuffer<>;
+// --replay=journal [--replay_to=tick] [--replay_verify]: rebuilds the
+// recorded world at full speed, then shows it in the GUI unless --no_gui.
+int replay(robo::Environment& environment, CommandLineArguments const& cla, double fps_gui, bool has_imgui) {
+	std::string path = cla.get<std::string>("--replay=", "");
+	try {
+		robo::JournalReplay replay(path);
+		uint64_t to     = cla.get<uint64_t>("--replay_to=", replay.journal().last_tick());
+		bool     verify = cla.has_prefix("--replay_verify");
+		if(replay.journal().is_truncated()) {
+			std::cerr << path << ": last record incomplete, ignored\n";
+		}
+		auto start = std::chrono::steady_clock::now();
+		auto stats = verify ? replay.run(environment, to, true) : replay.seek(environment, to);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cerr
+			<< "replayed " << path << " to tick " << environment.get_physics_tick()
+			<< ": "        << stats.commands << " requests, " << stats.ticks << " ticks in "
+			<< seconds * 1e3 << " ms"
+		;
+		if(verify) {
+			std::cerr << ", " << stats.verified << " checkpoints verified, " << stats.mismatches << " differ";
+		}
+		std::cerr << '\n';
+		if(stats.mismatches != 0) {
+			return 2;
+		}
+	} catch(std::exception const& e) {
+		std::cerr << "replay failed: " << e.what() << std::endl;
+		return 1;
+	}
+	if(!cla.has_prefix("--no_gui")) {
+		environment.set_pause(true);
+		event_loop(environment, 1.0/fps_gui, is_running, has_imgui);
+	}
+	environment.kill();
+	return 0;
+}
 
 int main(int argc, char** argv) {
 	std::signal(SIGINT,  signal_handler);
@@ -43,24 +176,216 @@ int main(int argc, char** argv) {
 	if(cla.has_prefix("--sync")) {
 		fps_gui = fps_sim;
 	}
+	SimThread sim_placement{
+		  cla.get<int>("--sim_cpu=", -1)
+		, cla.get<int>("--sim_priority=", 0)
+		, std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::duration<double, std::micro>(cla.get<double>("--sim_spin=", 0.0))
+		)
+	};
+	// before any thread starts, they all inherit it
+	if(sim_placement.cpu >= 0) {
+		try {
+			pin_this_thread(cpus_except(sim_placement.cpu));
+		} catch(PosixError const& e) {
+			std::cerr << "threads not kept off cpu " << sim_placement.cpu << ": " << e.what() << std::endl;
+		}
+	}
 	robo::Environment environment{1.0/fps_vision, 1.0/fps_sim, speed_scale};
+	if(auto path = cla.get<std::string>("--restore=", ""); !path.empty()) {
+		try {
+			auto start = std::chrono::steady_clock::now();
+			robo::restore(environment, robo::read_checkpoint(path));
+			std::cerr
+				<< "restored " << path << " at time " << environment.get_time() << " in "
+				<< std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e3 << " ms\n"
+			;
+		} catch(std::exception const& e) {
+			std::cerr << "restore failed: " << e.what() << std::endl;
+			return 1;
+		}
+	}
+	if(cla.has_prefix("--replay=")) {
+		return replay(environment, cla, fps_gui, has_imgui);
+	}
+	// --shed=gui,rays,debug_lines|all|none: what the sim loop leaves out
+	// while it can't keep --fps_sim, see TickMonitor; nothing unless asked
+	environment.tick_monitor.set_policy(
+		robo::TickMonitor::Policy::parse(cla.get<std::string>("--shed=", "none"))
+	);
+	// written every --checkpoint_interval simulated seconds and at exit
+	std::string checkpoint_path     = cla.get<std::string>("--checkpoint=", "");
+	double      checkpoint_interval = cla.get<double>("--checkpoint_interval=", 60.0);
+
+	{
+		BufferPool::Limits limits;
+		limits.max_frame_size    = cla.get<std::size_t>("--max_frame_size=",    limits.max_frame_size);
+		limits.connection_budget = cla.get<std::size_t>("--connection_budget=", limits.connection_budget);
+		limits.global_budget     = cla.get<std::size_t>("--buffer_budget=",     limits.global_budget);
+		BufferPool::global().set_limits(limits);
+	}
+
+	std::vector<Endpoint> endpoints;
+	for(std::string const& url : cla.get_all<std::string>("--listen=")) {
+		endpoints.push_back(Endpoint::parse(url, robo::config::Simulator::default_port));
+	}
+	if(endpoints.empty()) {
+		endpoints.push_back(Endpoint::parse("tcp://:" + std::to_string(robo::config::Simulator::default_port), 0));
+	}
+	if(cla.has_prefix("--unix")) {
+		endpoints.push_back(Endpoint::parse(std::string("unix://") + robo::config::Simulator::default_unix_path, 0));
+	}
+	if(cla.has_prefix("--shm")) {
+		endpoints.push_back(Endpoint::parse(std::string("shm://") + robo::config::Simulator::default_shm_name, 0));
+	}
+
+	// every served request with checkpoints every --journal_checkpoint_interval
+	// simulated seconds, see --replay. Outlives the server.
+	std::unique_ptr<robo::CommandJournal> journal;
+	if(auto path = cla.get<std::string>("--journal=", ""); !path.empty()) {
+		try {
+			journal = std::make_unique<robo::CommandJournal>(
+				  path
+				, environment
+				, cla.get<double>("--journal_checkpoint_interval=", 10.0)
+			);
+		} catch(std::exception const& e) {
+			std::cerr << "journal failed: " << e.what() << std::endl;
+			return 1;
+		}
+	}
+
+	// --record=path [--record_float] [--record_every=1], see trajectory_csv
+	std::unique_ptr<robo::TrajectoryRecorder> recorder;
+	if(auto path = cla.get<std::string>("--record=", ""); !path.empty()) {
+		try {
+			recorder = std::make_unique<robo::TrajectoryRecorder>(
+				  path
+				, cla.has_prefix("--record_float") ? sizeof(float) : sizeof(double)
+				, cla.get<uint64_t>("--record_every=", 1)
+			);
+		} catch(std::exception const& e) {
+			std::cerr << "recording failed: " << e.what() << std::endl;
+			return 1;
+		}
+	}
 
 	Server<
 		  robo::Environment
 		, Serializer
 		, SerializationBuffer
 		, DeserializationBuffer
-	> server(environment, robo::config::Simulator::default_port, false);
+	> server(
+		  environment
+		, endpoints
+		, false
+		, cla.has_prefix("--uring") ? ServerEngine::URING : ServerEngine::THREADS
+	);
 	
-	if(cla.has_prefix("--stats")) {
-		TimeStats::get().set_enabled(true);
-	} else {
-		TimeStats::get().set_enabled(false);
+	// --stats prints the timing zones at exit, --stats_interval=seconds
+	// while running; either one collects them
+	bool   with_stats     = cla.has("--stats");
+	double stats_interval = cla.get<double>("--stats_interval=", 0.0);
+	TimeStats::get().set_enabled(with_stats || stats_interval > 0.0);
+	TimeStats::get().set_print_at_exit(with_stats);
+	std::thread stats_thread;
+	if(stats_interval > 0.0) {
+		stats_thread = std::thread([interval = stats_interval]() {
+			name_this_thread("stats");
+			using clock_t = std::chrono::steady_clock;
+			auto next = clock_t::now() + std::chrono::duration<double>(interval);
+			while(is_running) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+				if(clock_t::now() >= next) {
+					TimeStats::get().print(std::cerr);
+					next += std::chrono::duration_cast<clock_t::duration>(std::chrono::duration<double>(interval));
+				}
+			}
+		});
+	}
+	// --metrics=port serves the server statistics to Prometheus on localhost
+	std::unique_ptr<MetricsListener> metrics;
+	if(int port = cla.get<int>("--metrics=", 0); port > 0) {
+		try {
+			metrics = std::make_unique<MetricsListener>(port, [&environment]() {
+				return robo::prometheus_metrics(environment.handle(robo::QueryServerStatsCommand::Request{true}));
+			});
+		} catch(PosixError const& e) {
+			std::cerr << "metrics: port " << port << ": " << e.what() << '\n';
+		}
 	}
 	
+	// --trace=file.json records events of all threads, kill -USR1 writes
+	// what is held so far, exit writes the rest; --trace_sample=n keeps
+	// only every n-th event per thread
+	std::string trace_path = cla.get<std::string>("--trace=", "");
+	std::thread trace_thread;
+	if(!trace_path.empty()) {
+		Tracer::get().set_sample_every(cla.get<uint64_t>("--trace_sample=", 1));
+		Tracer::get().set_enabled(true);
+		std::signal(SIGUSR1, dump_trace_handler);
+		trace_thread = std::thread([&trace_path]() {
+			name_this_thread("trace");
+			while(is_running) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+				if(dump_trace.exchange(false)) {
+					std::cerr << "trace: " << Tracer::get().dump(trace_path) << " events to " << trace_path << '\n';
+				}
+			}
+		});
+	}
+	
+	std::unique_ptr<Broadcaster> broadcaster;
+	if(cla.has("--multicast")) {
+		broadcaster = std::make_unique<Broadcaster>(
+			  cla.get<std::string>("--multicast_group=", robo::config::Simulator::multicast_group)
+			, cla.get<int>("--multicast_port=", robo::config::Simulator::multicast_port)
+			, robo::config::Simulator::multicast_ttl
+		);
+	}
+
+	// --plugin=path.so[:count[:args]], repeatable
+	std::unique_ptr<robo::plugin::PluginHost> plugins;
+	if(auto specs = cla.get_all<std::string>("--plugin="); !specs.empty()) {
+		plugins = std::make_unique<robo::plugin::PluginHost>(
+			  environment
+			, cla.get<double>("--plugin_rate=", fps_vision)
+			, cla.get<std::size_t>("--plugin_threads=", 0)
+		);
+		for(std::string const& spec : specs) {
+			try {
+				std::size_t colon = spec.find(':');
+				std::size_t count = 1;
+				std::string args;
+				if(colon != std::string::npos) {
+					std::size_t second = spec.find(':', colon + 1);
+					count = std::stoul(spec.substr(colon + 1, second - colon - 1));
+					if(second != std::string::npos) {
+						args = spec.substr(second + 1);
+					}
+				}
+				plugins->add(spec.substr(0, colon), count, args);
+			} catch(std::exception const& e) {
+				std::cerr << "plugin " << spec << " not loaded: " << e.what() << std::endl;
+				return 1;
+			}
+		}
+		std::cerr << "plugin robots: " << plugins->size() << '\n';
+	}
+
 	auto do_sim = [&]() {
 		if(!cla.has_prefix("--no_simloop")) {
-		    simloop(environment,is_running);
+		    simloop(
+				  environment
+				, is_running
+				, std::move(broadcaster)
+				, std::move(plugins)
+				, checkpoint_path
+				, checkpoint_interval
+				, journal.get()
+				, recorder.get()
+				, sim_placement
+			);
 		}
 	};
 	
@@ -73,5 +398,20 @@ int main(int argc, char** argv) {
 		environment.kill();
 		sim_thread.join();
 	}
+	is_running = false;
+	if(stats_thread.joinable()) {
+		stats_thread.join();
+	}
+	if(trace_thread.joinable()) {
+		trace_thread.join();
+		Tracer::get().set_enabled(false);
+		std::cerr << "trace: " << Tracer::get().dump(trace_path) << " events to " << trace_path << '\n';
+	}
+	if(with_stats) {
+		std::cerr << "Buffer pool: " << BufferPool::global().stats() << '\n';
+	}
+	if(recorder) {
+		std::cerr << "recorded " << recorder->frames() << " frames, " << recorder->dropped() << " dropped\n";
+	}
 	return 0;
 }
@@ -0,0 +1,226 @@
+#include "socket/IoUring.hpp"
+#include "socket/PosixError.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int io_uring_setup(unsigned entries, io_uring_params* params) {
+	return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+	return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+static int io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+	return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+template<typename T>
+static T* offset_ptr(void* base, uint32_t offset) {
+	return reinterpret_cast<T*>(static_cast<std::byte*>(base) + offset);
+}
+
+IoUring::IoUring(unsigned entries) {
+	_params.flags = IORING_SETUP_CLAMP;
+	errno = 0;
+	_fd = io_uring_setup(entries, &_params);
+	if(_fd == -1) {
+		throw PosixError("Can't io_uring_setup", errno);
+	}
+	if(!(_params.features & IORING_FEAT_NODROP)) {
+		destroy();
+		throw PosixError("io_uring without IORING_FEAT_NODROP", ENOTSUP);
+	}
+	_sq_ring_size = _params.sq_off.array + _params.sq_entries * sizeof(unsigned);
+	_cq_ring_size = _params.cq_off.cqes  + _params.cq_entries * sizeof(io_uring_cqe);
+	bool single_mmap = _params.features & IORING_FEAT_SINGLE_MMAP;
+	if(single_mmap) {
+		_sq_ring_size = _cq_ring_size = std::max(_sq_ring_size, _cq_ring_size);
+	}
+	_sq_ring = ::mmap(nullptr, _sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+	if(_sq_ring == MAP_FAILED) {
+		int e = errno;
+		_sq_ring = nullptr;
+		destroy();
+		throw PosixError("Can't map io_uring sq ring", e);
+	}
+	if(single_mmap) {
+		_cq_ring = _sq_ring;
+	} else {
+		_cq_ring = ::mmap(nullptr, _cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+		if(_cq_ring == MAP_FAILED) {
+			int e = errno;
+			_cq_ring = nullptr;
+			destroy();
+			throw PosixError("Can't map io_uring cq ring", e);
+		}
+	}
+	_sqes_size = _params.sq_entries * sizeof(io_uring_sqe);
+	void* sqes = ::mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+	if(sqes == MAP_FAILED) {
+		int e = errno;
+		destroy();
+		throw PosixError("Can't map io_uring sqes", e);
+	}
+	_sqes = static_cast<io_uring_sqe*>(sqes);
+
+	_sq_head  = offset_ptr<unsigned>(_sq_ring, _params.sq_off.head);
+	_sq_tail  = offset_ptr<unsigned>(_sq_ring, _params.sq_off.tail);
+	_sq_array = offset_ptr<unsigned>(_sq_ring, _params.sq_off.array);
+	_sq_mask  = *offset_ptr<unsigned>(_sq_ring, _params.sq_off.ring_mask);
+	_cq_head  = offset_ptr<unsigned>(_cq_ring, _params.cq_off.head);
+	_cq_tail  = offset_ptr<unsigned>(_cq_ring, _params.cq_off.tail);
+	_cq_mask  = *offset_ptr<unsigned>(_cq_ring, _params.cq_off.ring_mask);
+	_cqes     = offset_ptr<io_uring_cqe>(_cq_ring, _params.cq_off.cqes);
+	_sqe_tail = *_sq_tail;
+}
+
+void IoUring::destroy() {
+	if(_buf_ring) {
+		::munmap(_buf_ring, _buf_ring_size);
+		_buf_ring = nullptr;
+	}
+	delete[] _buffers;
+	_buffers = nullptr;
+	if(_sqes) {
+		::munmap(_sqes, _sqes_size);
+		_sqes = nullptr;
+	}
+	if(_cq_ring && _cq_ring != _sq_ring) {
+		::munmap(_cq_ring, _cq_ring_size);
+	}
+	_cq_ring = nullptr;
+	if(_sq_ring) {
+		::munmap(_sq_ring, _sq_ring_size);
+		_sq_ring = nullptr;
+	}
+	if(_fd != -1) {
+		::close(_fd);
+		_fd = -1;
+	}
+}
+
+IoUring::~IoUring() {
+	destroy();
+}
+
+bool IoUring::supports(std::initializer_list<uint8_t> opcodes) const {
+	constexpr unsigned n_ops = 256;
+	std::vector<std::byte> storage(sizeof(io_uring_probe) + n_ops * sizeof(io_uring_probe_op));
+	auto probe = reinterpret_cast<io_uring_probe*>(storage.data());
+	if(io_uring_register(_fd, IORING_REGISTER_PROBE, probe, n_ops) == -1) {
+		return false;
+	}
+	for(uint8_t op : opcodes) {
+		if(op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+io_uring_sqe* IoUring::get_sqe() {
+	unsigned head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+	if(_sqe_tail - head >= _params.sq_entries) {
+		return nullptr;
+	}
+	unsigned index = _sqe_tail & _sq_mask;
+	io_uring_sqe* sqe = &_sqes[index];
+	std::memset(sqe, 0, sizeof(*sqe));
+	_sq_array[index] = index;
+	++_sqe_tail;
+	return sqe;
+}
+
+void IoUring::submit(unsigned wait_nr) {
+	unsigned to_submit = _sqe_tail - *_sq_tail;
+	__atomic_store_n(_sq_tail, _sqe_tail, __ATOMIC_RELEASE);
+	while(true) {
+		++_enter_calls;
+		errno = 0;
+		int r = io_uring_enter(_fd, to_submit, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0);
+		if(r == -1) {
+			if(errno == EINTR) {
+				continue;
+			}
+			// completion queue full: the caller has to reap first
+			if(errno == EBUSY || errno == EAGAIN) {
+				return;
+			}
+			throw PosixError("Error: io_uring_enter", errno);
+		}
+		return;
+	}
+}
+
+void IoUring::register_buffer_ring(uint16_t group, unsigned count, unsigned buffer_size) {
+	_buf_ring_size = count * sizeof(io_uring_buf);
+	void* ring = ::mmap(nullptr, _buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(ring == MAP_FAILED) {
+		throw PosixError("Can't allocate io_uring buffer ring", errno);
+	}
+	std::memset(ring, 0, _buf_ring_size);
+	_buf_ring = static_cast<io_uring_buf_ring*>(ring);
+	io_uring_buf_reg reg{};
+	reg.ring_addr    = reinterpret_cast<uint64_t>(ring);
+	reg.ring_entries = count;
+	reg.bgid         = group;
+	errno = 0;
+	if(io_uring_register(_fd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1) {
+		int e = errno;
+		::munmap(_buf_ring, _buf_ring_size);
+		_buf_ring = nullptr;
+		throw PosixError("Can't register io_uring buffer ring", e);
+	}
+	_buffers          = new std::byte[std::size_t{count} * buffer_size];
+	_buffer_count     = count;
+	_buffer_size      = buffer_size;
+	_buffer_group     = group;
+	_buf_tail_pending = 0;
+	for(unsigned id = 0; id < count; ++id) {
+		recycle_buffer(static_cast<uint16_t>(id));
+	}
+	commit_buffers();
+}
+
+std::byte* IoUring::buffer(uint16_t id) const {
+	return _buffers + std::size_t{id} * _buffer_size;
+}
+
+unsigned IoUring::buffer_size() const {
+	return _buffer_size;
+}
+
+uint16_t IoUring::buffer_group() const {
+	return _buffer_group;
+}
+
+void IoUring::recycle_buffer(uint16_t id) {
+	// not _buf_ring->bufs: in C++ the flexible array of the uapi header
+	// lands behind an empty struct, at offset 8 instead of 0
+	auto          bufs = reinterpret_cast<io_uring_buf*>(_buf_ring);
+	unsigned      tail = _buf_ring->tail + _buf_tail_pending;
+	io_uring_buf& buf  = bufs[tail & (_buffer_count - 1)];
+	buf.addr = reinterpret_cast<uint64_t>(buffer(id));
+	buf.len  = _buffer_size;
+	buf.bid  = id;
+	++_buf_tail_pending;
+}
+
+void IoUring::commit_buffers() {
+	if(_buf_tail_pending == 0) {
+		return;
+	}
+	uint16_t tail = static_cast<uint16_t>(_buf_ring->tail + _buf_tail_pending);
+	__atomic_store_n(&_buf_ring->tail, tail, __ATOMIC_RELEASE);
+	_buf_tail_pending = 0;
+}
+
+uint64_t IoUring::enter_calls() const {
+	return _enter_calls;
+}
@@ -0,0 +1,591 @@
+#include "socket/SHM_Socket.hpp"
+#include "socket/PosixError.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock    = std::chrono::steady_clock;
+using atomic_u32 = std::atomic<uint32_t>;
+using atomic_u64 = std::atomic<uint64_t>;
+
+static_assert(atomic_u32::is_always_lock_free);
+static_assert(atomic_u64::is_always_lock_free);
+
+constexpr uint32_t    segment_magic   = 0x524f424f;
+constexpr uint32_t    segment_version = 1;
+constexpr uint64_t    ring_capacity   = uint64_t{1} << 17;
+constexpr std::size_t slot_count      = 64;
+// how often sleeping waiters check whether the peer process still exists
+constexpr std::chrono::milliseconds liveness_period{100};
+
+// A client owns a slot once it swapped its pid into client_pid, the state
+// only follows. Freeing sets the state first and clears the pid last.
+enum SlotState : uint32_t {
+	  FREE
+	, CLAIMED
+	, PENDING
+	, CONNECTED
+};
+
+bool is_process_alive(uint32_t pid) {
+	return pid != 0 && (::kill(static_cast<pid_t>(pid), 0) == 0 || errno != ESRCH);
+}
+
+} // namespace
+
+struct SHM_Ring {
+	alignas(64) atomic_u64 head;          // bytes written, owned by producer
+	alignas(64) atomic_u64 tail;          // bytes read, owned by consumer
+	alignas(64) atomic_u32 data_seq;      // bumped whenever head moves
+	atomic_u32             data_waiters;
+	alignas(64) atomic_u32 space_seq;     // bumped whenever tail moves
+	atomic_u32             space_waiters;
+	alignas(64) std::byte  data[ring_capacity];
+};
+
+struct SHM_Slot {
+	alignas(64) atomic_u32 state;
+	atomic_u32             refs;
+	atomic_u32             client_pid;
+	atomic_u32             client_closed;
+	atomic_u32             server_closed;
+	SHM_Ring               request;       // client -> server
+	SHM_Ring               response;      // server -> client
+};
+
+struct SHM_Segment {
+	uint32_t   magic;
+	uint32_t   version;
+	atomic_u32 server_pid;
+	atomic_u32 pending_seq;
+	SHM_Slot   slots[slot_count];
+};
+
+struct SHM_Mapping {
+	std::string  name;
+	SHM_Segment* segment  = nullptr;
+	bool         is_owner = false;
+
+	// whether the segment of that name belongs to a running server, one
+	// that isn't a complete segment of this version belongs to nobody
+	static bool is_in_use(std::string const& name) {
+		int fd = ::shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+		if(fd == -1) {
+			return false;
+		}
+		struct stat st;
+		void* p = ::fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) == sizeof(SHM_Segment)
+			? ::mmap(nullptr, sizeof(SHM_Segment), PROT_READ, MAP_SHARED, fd, 0)
+			: MAP_FAILED
+		;
+		::close(fd);
+		if(p == MAP_FAILED) {
+			return false;
+		}
+		auto const* segment = static_cast<SHM_Segment const*>(p);
+		bool in_use = segment->magic == segment_magic
+			&& segment->version == segment_version
+			&& is_process_alive(segment->server_pid.load())
+		;
+		::munmap(p, sizeof(SHM_Segment));
+		return in_use;
+	}
+
+	SHM_Mapping(std::string const& name, bool create)
+		: name{name.empty() || name[0] != '/' ? "/" + name : name}
+		, is_owner{create}
+	{
+		errno = 0;
+		int fd = -1;
+		if(create) {
+			// a stale segment left by a crashed server is replaced, a live one isn't
+			fd = ::shm_open(this->name.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600);
+			if(fd == -1 && errno == EEXIST) {
+				if(is_in_use(this->name)) {
+					throw PosixError("Can't create shm segment " + this->name + ", already in use", EADDRINUSE);
+				}
+				::shm_unlink(this->name.c_str());
+				fd = ::shm_open(this->name.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600);
+			}
+			if(fd == -1) {
+				throw PosixError("Can't create shm segment " + this->name, errno);
+			}
+			if(::ftruncate(fd, sizeof(SHM_Segment)) == -1) {
+				int e = errno;
+				::close(fd);
+				::shm_unlink(this->name.c_str());
+				throw PosixError("Can't resize shm segment " + this->name, e);
+			}
+		} else {
+			fd = ::shm_open(this->name.c_str(), O_RDWR | O_CLOEXEC, 0);
+			if(fd == -1) {
+				throw PosixError("Can't connect to shm segment " + this->name, errno);
+			}
+			struct stat st;
+			if(::fstat(fd, &st) == -1 || static_cast<std::size_t>(st.st_size) != sizeof(SHM_Segment)) {
+				::close(fd);
+				throw PosixError("Can't connect to shm segment (size mismatch) " + this->name, EPROTO);
+			}
+		}
+		void* p = ::mmap(nullptr, sizeof(SHM_Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		int e = errno;
+		::close(fd);
+		if(p == MAP_FAILED) {
+			if(create) {
+				::shm_unlink(this->name.c_str());
+			}
+			throw PosixError("Can't map shm segment " + this->name, e);
+		}
+		segment = static_cast<SHM_Segment*>(p);
+		if(create) {
+			// fresh pages are zero, which is FREE for every slot
+			segment->server_pid.store(static_cast<uint32_t>(::getpid()));
+			segment->version = segment_version;
+			std::atomic_thread_fence(std::memory_order_release);
+			segment->magic   = segment_magic;
+		} else if(segment->magic != segment_magic || segment->version != segment_version) {
+			::munmap(segment, sizeof(SHM_Segment));
+			throw PosixError("Can't connect to shm segment (version mismatch) " + this->name, EPROTO);
+		}
+	}
+	SHM_Mapping(SHM_Mapping const&) = delete;
+	SHM_Mapping& operator=(SHM_Mapping const&) = delete;
+	~SHM_Mapping() {
+		::munmap(segment, sizeof(SHM_Segment));
+		if(is_owner) {
+			::shm_unlink(name.c_str());
+		}
+	}
+};
+
+namespace {
+
+void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#endif
+}
+
+// returns false on timeout
+bool futex_wait(atomic_u32& word, uint32_t expected, Clock::duration timeout) {
+	auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count();
+	timespec ts;
+	ts.tv_sec  = ns / 1000000000;
+	ts.tv_nsec = ns % 1000000000;
+	long r = ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, &ts, nullptr, 0);
+	return !(r == -1 && errno == ETIMEDOUT);
+}
+
+void futex_wake(atomic_u32& word) {
+	::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+void notify(atomic_u32& seq, atomic_u32& waiters) {
+	seq.fetch_add(1);
+	if(waiters.load()) {
+		futex_wake(seq);
+	}
+}
+
+// busy waiting before going to sleep, pointless with a single cpu
+int spin_count() {
+	static int const count = std::thread::hardware_concurrency() > 1 ? 4000 : 0;
+	return count;
+}
+
+void free_slot(SHM_Slot& slot) {
+	slot.state.store(FREE);
+	slot.client_pid.store(0);
+}
+
+// Spins for a short while, then sleeps on seq until ready() or is_done(bool check_process) holds.
+// Returns ready(). No deadline means: wait forever.
+template<typename Ready, typename Done>
+bool wait_on(
+	  atomic_u32&                        seq
+	, atomic_u32&                        waiters
+	, int                                spins
+	, Ready                              ready
+	, Done                               is_done
+	, std::optional<Clock::time_point> deadline
+) {
+	for(int i = 0; i < spins; ++i) {
+		if(ready()) {
+			return true;
+		}
+		cpu_relax();
+	}
+	bool check_process = false;
+	while(true) {
+		uint32_t s = seq.load();
+		if(ready()) {
+			return true;
+		}
+		if(is_done(check_process)) {
+			return ready();
+		}
+		Clock::duration timeout = liveness_period;
+		if(deadline) {
+			auto now = Clock::now();
+			if(now >= *deadline) {
+				return ready();
+			}
+			timeout = std::min<Clock::duration>(timeout, *deadline - now);
+		}
+		waiters.fetch_add(1);
+		check_process = !ready() && !futex_wait(seq, s, timeout);
+		waiters.fetch_sub(1);
+	}
+}
+
+std::optional<Clock::time_point> make_deadline(long timeout_secs, int timeout_usecs) {
+	return Clock::now()
+		+ std::chrono::seconds{timeout_secs}
+		+ std::chrono::microseconds{timeout_usecs}
+	;
+}
+
+uint64_t ring_available(SHM_Ring const& ring) {
+	return ring.head.load(std::memory_order_acquire) - ring.tail.load(std::memory_order_relaxed);
+}
+
+uint64_t ring_space(SHM_Ring const& ring) {
+	return ring_capacity - (ring.head.load(std::memory_order_relaxed) - ring.tail.load(std::memory_order_acquire));
+}
+
+void ring_copy_out(SHM_Ring const& ring, uint64_t position, void* buffer, uint64_t size) {
+	uint64_t offset = position % ring_capacity;
+	uint64_t first  = std::min(size, ring_capacity - offset);
+	std::memcpy(buffer, ring.data + offset, first);
+	std::memcpy(static_cast<std::byte*>(buffer) + first, ring.data, size - first);
+}
+
+void ring_copy_in(SHM_Ring& ring, uint64_t position, void const* buffer, uint64_t size) {
+	uint64_t offset = position % ring_capacity;
+	uint64_t first  = std::min(size, ring_capacity - offset);
+	std::memcpy(ring.data + offset, buffer, first);
+	std::memcpy(ring.data, static_cast<std::byte const*>(buffer) + first, size - first);
+}
+
+void reset_ring(SHM_Ring& ring) {
+	ring.head.store(0);
+	ring.tail.store(0);
+	ring.data_waiters.store(0);
+	ring.space_waiters.store(0);
+}
+
+} // namespace
+
+SHM_Socket::SHM_Socket() = default;
+
+SHM_Socket::SHM_Socket(SHM_Socket&& o)
+	: _mapping{std::move(o._mapping)}
+	, _slot{o._slot}
+	, _is_server{o._is_server}
+{
+	o._slot = nullptr;
+}
+
+SHM_Socket::~SHM_Socket() {
+	close();
+}
+
+SHM_Ring& SHM_Socket::in_ring() const {
+	return _is_server ? _slot->request : _slot->response;
+}
+
+SHM_Ring& SHM_Socket::out_ring() const {
+	return _is_server ? _slot->response : _slot->request;
+}
+
+bool SHM_Socket::is_peer_closed(bool check_process) const {
+	atomic_u32 const& closed = _is_server ? _slot->client_closed : _slot->server_closed;
+	if(closed.load()) {
+		return true;
+	}
+	if(check_process) {
+		uint32_t pid = _is_server
+			? _slot->client_pid.load()
+			: _mapping->segment->server_pid.load()
+		;
+		return !is_process_alive(pid);
+	}
+	return false;
+}
+
+bool SHM_Socket::is_valid() const {
+	return _slot != nullptr;
+}
+
+bool SHM_Socket::wait_readable(uint64_t size, long timeout_secs, int timeout_usecs, bool has_timeout) const {
+	SHM_Ring& ring = in_ring();
+	size = std::min(size, ring_capacity);
+	return wait_on(
+		  ring.data_seq
+		, ring.data_waiters
+		, spin_count()
+		, [&]() { return ring_available(ring) >= size; }
+		, [&](bool check_process) { return is_peer_closed(check_process); }
+		, has_timeout ? make_deadline(timeout_secs, timeout_usecs) : std::nullopt
+	);
+}
+
+uint64_t SHM_Socket::send(const void* buffer, uint64_t size) const {
+	if( !is_valid() ) {
+		throw std::runtime_error("Can't send on invalid socket");
+	}
+	SHM_Ring& ring = out_ring();
+	uint64_t s = 0;
+	while(s != size) {
+		bool has_space = wait_on(
+			  ring.space_seq
+			, ring.space_waiters
+			, spin_count()
+			, [&]() { return ring_space(ring) > 0; }
+			, [&](bool check_process) { return is_peer_closed(check_process); }
+			, std::nullopt
+		);
+		if(!has_space || is_peer_closed(false)) {
+			throw PosixError("Error: send", EPIPE);
+		}
+		uint64_t head  = ring.head.load(std::memory_order_relaxed);
+		uint64_t chunk = std::min(size - s, ring_space(ring));
+		ring_copy_in(ring, head, static_cast<std::byte const*>(buffer) + s, chunk);
+		ring.head.store(head + chunk);
+		notify(ring.data_seq, ring.data_waiters);
+		s += chunk;
+	}
+	return s;
+}
+
+uint64_t SHM_Socket::recv(void* buffer, uint64_t size) const {
+	if( !is_valid() ) {
+		throw std::runtime_error("Can't recv on invalid socket");
+	}
+	if(size == 0 || !wait_readable(1, 0, 0, false)) {
+		return 0;
+	}
+	return recv_nonblocking(buffer, size);
+}
+
+uint64_t SHM_Socket::recv_exact(void* buffer, uint64_t size) const {
+	uint64_t r = 0;
+	while(r != size) {
+		uint64_t status = recv(static_cast<std::byte*>(buffer) + r, size - r);
+		r += status;
+		if(status == 0) {
+			break;
+		}
+	}
+	return r;
+}
+
+uint64_t SHM_Socket::peek(void* buffer, uint64_t size) const {
+	if( !is_valid() ) {
+		throw std::runtime_error("Can't peek on invalid socket");
+	}
+	wait_readable(size, 0, 0, false);
+	SHM_Ring& ring = in_ring();
+	uint64_t n = std::min(size, ring_available(ring));
+	ring_copy_out(ring, ring.tail.load(std::memory_order_relaxed), buffer, n);
+	return n;
+}
+
+uint64_t SHM_Socket::recv_nonblocking(void* buffer, uint64_t size) const {
+	if( !is_valid() ) {
+		throw std::runtime_error("Can't recv_nonblocking on invalid socket");
+	}
+	SHM_Ring& ring = in_ring();
+	uint64_t available = ring_available(ring);
+	if(available == 0) {
+		return is_peer_closed(false) ? 0 : -1;
+	}
+	uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+	uint64_t n    = std::min(size, available);
+	ring_copy_out(ring, tail, buffer, n);
+	ring.tail.store(tail + n);
+	notify(ring.space_seq, ring.space_waiters);
+	return n;
+}
+
+uint64_t SHM_Socket::peek_nonblocking(void* buffer, uint64_t size) const {
+	if( !is_valid() ) {
+		throw std::runtime_error("Can't peek_nonblocking on invalid socket");
+	}
+	SHM_Ring& ring = in_ring();
+	uint64_t available = ring_available(ring);
+	if(available == 0) {
+		return is_peer_closed(false) ? 0 : -1;
+	}
+	uint64_t n = std::min(size, available);
+	ring_copy_out(ring, ring.tail.load(std::memory_order_relaxed), buffer, n);
+	return n;
+}
+
+// like select(): a closed peer counts as readable, recv() then returns 0
+bool SHM_Socket::can_read(long timeout_secs, int timeout_usecs) const {
+	if( !is_valid() ) {
+		throw std::runtime_error("Can't can_read on invalid socket");
+	}
+	return wait_readable(1, timeout_secs, timeout_usecs, true) || is_peer_closed(true);
+}
+
+bool SHM_Socket::can_write(long timeout_secs, int timeout_usecs) const {
+	if( !is_valid() ) {
+		throw std::runtime_error("Can't can_write on invalid socket");
+	}
+	SHM_Ring& ring = out_ring();
+	return wait_on(
+		  ring.space_seq
+		, ring.space_waiters
+		, spin_count()
+		, [&]() { return ring_space(ring) > 0; }
+		, [&](bool check_process) { return is_peer_closed(check_process); }
+		, make_deadline(timeout_secs, timeout_usecs)
+	);
+}
+
+void SHM_Socket::shutdown_recv() {
+}
+
+void SHM_Socket::shutdown_send() {
+	shutdown();
+}
+
+void SHM_Socket::shutdown() {
+	if(!is_valid()) {
+		return;
+	}
+	(_is_server ? _slot->server_closed : _slot->client_closed).store(1);
+	for(SHM_Ring* ring : {&_slot->request, &_slot->response}) {
+		notify(ring->data_seq,  ring->data_waiters);
+		notify(ring->space_seq, ring->space_waiters);
+	}
+}
+
+void SHM_Socket::close() {
+	if(!is_valid()) {
+		return;
+	}
+	shutdown();
+	bool is_last = _slot->refs.fetch_sub(1) == 1;
+	// a crashed client never drops its reference
+	if(is_last || (_is_server && !is_process_alive(_slot->client_pid.load()))) {
+		free_slot(*_slot);
+	}
+	_slot = nullptr;
+	_mapping.reset();
+}
+
+SHM_ServerSocket::SHM_ServerSocket(std::string const& name)
+	: _mapping{std::make_shared<SHM_Mapping>(name, true)}
+{}
+
+bool SHM_ServerSocket::can_read(long timeout_secs, int timeout_usecs) const {
+	SHM_Segment& segment = *_mapping->segment;
+	auto has_pending = [&]() {
+		for(SHM_Slot& slot : segment.slots) {
+			uint32_t state = slot.state.load();
+			if(state == PENDING) {
+				return true;
+			}
+			// a client that died while connecting, or between taking the
+			// pid and the state
+			uint32_t pid = slot.client_pid.load();
+			if(pid == 0 || is_process_alive(pid)) {
+				continue;
+			}
+			if(state == CLAIMED && slot.state.compare_exchange_strong(state, FREE)) {
+				slot.client_pid.store(0);
+			} else if(state == FREE) {
+				slot.client_pid.compare_exchange_strong(pid, 0);
+			}
+		}
+		return false;
+	};
+	atomic_u32 waiters{1}; // the client always wakes
+	return wait_on(
+		  segment.pending_seq
+		, waiters
+		, 0
+		, has_pending
+		, [](bool) { return false; }
+		, make_deadline(timeout_secs, timeout_usecs)
+	);
+}
+
+void SHM_ServerSocket::accept(SHM_Socket& new_socket) const {
+	for(SHM_Slot& slot : _mapping->segment->slots) {
+		uint32_t expected = PENDING;
+		if(slot.state.compare_exchange_strong(expected, CONNECTED)) {
+			futex_wake(slot.state);
+			new_socket.close();
+			new_socket._mapping   = _mapping;
+			new_socket._slot      = &slot;
+			new_socket._is_server = true;
+			return;
+		}
+	}
+	throw PosixError("Can't accept", EAGAIN);
+}
+
+SHM_ClientSocket::SHM_ClientSocket(std::string const& name) {
+	auto mapping = std::make_shared<SHM_Mapping>(name, false);
+	SHM_Segment& segment = *mapping->segment;
+	SHM_Slot* slot = nullptr;
+	uint32_t  pid  = static_cast<uint32_t>(::getpid());
+	for(SHM_Slot& s : segment.slots) {
+		uint32_t none = 0;
+		if(s.state.load() != FREE || !s.client_pid.compare_exchange_strong(none, pid)) {
+			continue;
+		}
+		uint32_t expected = FREE;
+		if(s.state.compare_exchange_strong(expected, CLAIMED)) {
+			slot = &s;
+			break;
+		}
+		s.client_pid.store(0);
+	}
+	if(!slot) {
+		throw PosixError("Can't connect (no free shm slot)", ECONNREFUSED);
+	}
+	reset_ring(slot->request);
+	reset_ring(slot->response);
+	slot->client_closed.store(0);
+	slot->server_closed.store(0);
+	slot->refs.store(2);
+	slot->state.store(PENDING);
+	segment.pending_seq.fetch_add(1);
+	futex_wake(segment.pending_seq);
+
+	auto deadline = Clock::now() + std::chrono::seconds{10};
+	while(slot->state.load() == PENDING) {
+		auto now = Clock::now();
+		if(now >= deadline || !is_process_alive(segment.server_pid.load())) {
+			uint32_t expected = PENDING;
+			if(slot->state.compare_exchange_strong(expected, FREE)) {
+				slot->client_pid.store(0);
+				throw PosixError("Can't connect", ETIMEDOUT);
+			}
+			break;
+		}
+		futex_wait(slot->state, PENDING, std::min<Clock::duration>(liveness_period, deadline - now));
+	}
+	_mapping = std::move(mapping);
+	_slot    = slot;
+}
@@ -2,7 +2,11 @@
 #include "socket/PosixError.hpp"
 #include <stdexcept>
 #include <cerrno>
+#include <cstddef>
+#include <cstring>
 #include <unistd.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 
 Socket_impl::Socket_impl()
 	: m_sock( -1 )
@@ -27,6 +31,10 @@ bool Socket_impl::is_valid() const {
 	return m_sock.is_valid();
 }
 
+int Socket_impl::native_handle() const {
+	return m_sock.fd();
+}
+
 void Socket_impl::close() {
 	m_sock.close();
 }
@@ -64,6 +72,36 @@ void Socket_impl::join_multicast_group(std::string const& group) const {
 	}
 }
 
+void Socket_impl::set_multicast_ttl(int ttl) const {
+	unsigned char value = static_cast<unsigned char>(ttl);
+	errno = 0;
+	int setsockopt_return = setsockopt(
+		  m_sock.fd()
+		, IPPROTO_IP
+		, IP_MULTICAST_TTL
+		, (const char*)(&value)
+		, sizeof(value)
+	);
+	if( setsockopt_return == -1 ) {
+		throw PosixError("Can't setsockopt (IP_MULTICAST_TTL)", errno);
+	}
+}
+
+void Socket_impl::enable_multicast_loop(bool enable) const {
+	unsigned char value = enable ? 1 : 0;
+	errno = 0;
+	int setsockopt_return = setsockopt(
+		  m_sock.fd()
+		, IPPROTO_IP
+		, IP_MULTICAST_LOOP
+		, (const char*)(&value)
+		, sizeof(value)
+	);
+	if( setsockopt_return == -1 ) {
+		throw PosixError("Can't setsockopt (IP_MULTICAST_LOOP)", errno);
+	}
+}
+
 void Socket_impl::enable_reuse_address(bool enable) const {
 	int on = enable ? 1 : 0;
 	errno = 0;
@@ -79,9 +117,9 @@ void Socket_impl::enable_reuse_address(bool enable) const {
 	}
 }
 
-void Socket_impl::create(int socket_type) {
+void Socket_impl::create(int socket_type, int domain) {
 	errno = 0;
-	int new_fd = ::socket(AF_INET, socket_type | SOCK_CLOEXEC, 0);
+	int new_fd = ::socket(domain, socket_type | SOCK_CLOEXEC, 0);
 	if(new_fd == -1) {
 		throw PosixError("Can't create socket", errno);
 	}
@@ -106,13 +144,13 @@ void Socket_impl::enable_broadcast(bool enable) const {
 	}
 }
 
-void Socket_impl::bind(const int port) {
+void Socket_impl::bind(const int port, bool loopback_only) {
 	if( !is_valid() ) {
 		throw std::runtime_error("Can't bind invalid socket");
 	}
 	m_addr._addr.sin_family = AF_INET;
 	m_addr._addr.sin_port = htons ( port );
-	m_addr._addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	m_addr._addr.sin_addr.s_addr = htonl(loopback_only ? INADDR_LOOPBACK : INADDR_ANY);
 	errno = 0;
 	int bind_return = ::bind(m_sock.fd(), m_addr.sockaddr_ptr(), m_addr.size());
 	if( bind_return == -1 ) {
@@ -120,6 +158,49 @@ void Socket_impl::bind(const int port) {
 	}
 }
 
+static socklen_t make_unix_address(std::string const& unix_path, sockaddr_un& addr) {
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if(unix_path.empty() || unix_path.size() >= sizeof(addr.sun_path)) {
+		throw PosixError("Invalid unix socket path " + unix_path, ENAMETOOLONG);
+	}
+	std::memcpy(addr.sun_path, unix_path.data(), unix_path.size());
+	if(unix_path[0] == '@') {
+		addr.sun_path[0] = '\0';
+		return offsetof(sockaddr_un, sun_path) + unix_path.size();
+	}
+	return sizeof(addr);
+}
+
+void Socket_impl::bind(std::string const& unix_path) {
+	if( !is_valid() ) {
+		throw std::runtime_error("Can't bind invalid socket");
+	}
+	sockaddr_un addr;
+	socklen_t size = make_unix_address(unix_path, addr);
+	// A socket file left behind by a previous run blocks bind(). It is
+	// stale if nobody accepts on it; one of a running server is kept and
+	// bind() fails with EADDRINUSE.
+	struct stat st;
+	if(unix_path[0] != '@' && ::stat(unix_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+		int       type      = SOCK_STREAM;
+		socklen_t type_size = sizeof(type);
+		::getsockopt(m_sock.fd(), SOL_SOCKET, SO_TYPE, &type, &type_size);
+		FileDescriptor probe(::socket(AF_UNIX, type | SOCK_CLOEXEC, 0));
+		if(    probe.is_valid()
+			&& ::connect(probe.fd(), reinterpret_cast<sockaddr*>(&addr), size) == -1
+			&& errno == ECONNREFUSED
+		) {
+			::unlink(unix_path.c_str());
+		}
+	}
+	errno = 0;
+	int bind_return = ::bind(m_sock.fd(), reinterpret_cast<sockaddr*>(&addr), size);
+	if( bind_return == -1 ) {
+		throw PosixError("Can't bind " + unix_path, errno);
+	}
+}
+
 void Socket_impl::listen(int max_connections) const {
 	if( !is_valid() ) {
 		throw std::runtime_error("Can't listen on invalid socket");
@@ -173,6 +254,33 @@ void Socket_impl::connect(const std::string host, const int port, int max_tries)
 	throw ee;
 }
 
+void Socket_impl::connect(std::string const& unix_path) const {
+	if( !is_valid() ) {
+		throw std::runtime_error("Can't connect invalid socket");
+	}
+	sockaddr_un addr;
+	socklen_t size = make_unix_address(unix_path, addr);
+	errno = 0;
+	int status = ::connect(m_sock.fd(), reinterpret_cast<sockaddr*>(&addr), size);
+	if( status == -1 ) {
+		throw PosixError("Can't connect " + unix_path, errno);
+	}
+}
+
+ucred Socket_impl::peer_credentials() const {
+	if( !is_valid() ) {
+		throw std::runtime_error("Can't get peer_credentials of invalid socket");
+	}
+	ucred credentials;
+	socklen_t size = sizeof(credentials);
+	errno = 0;
+	int status = ::getsockopt(m_sock.fd(), SOL_SOCKET, SO_PEERCRED, &credentials, &size);
+	if( status == -1 ) {
+		throw PosixError("Can't getsockopt (SO_PEERCRED)", errno);
+	}
+	return credentials;
+}
+
 uint64_t Socket_impl::send(const void* buffer, uint64_t size) const {
 	if( !is_valid() ) {
 		throw std::runtime_error("Can't send on invalid socket");
@@ -200,7 +308,7 @@ uint64_t Socket_impl::sendto(const Address& dst, const void* buffer, uint64_t si
 		errno = 0;
 		ssize_t r = ::sendto(m_sock.fd(), buffer, size, 0, dst.sockaddr_ptr(), dst.size());
 		if(r == -1) {
-			if(errno != EINTR) {
+			if(errno == EINTR) {
 				continue;
 			}
 			throw PosixError("Error: sendto", errno);
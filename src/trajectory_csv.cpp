@@ -0,0 +1,69 @@
+#include "util/CommandLineArguments.hpp"
+#include "TrajectoryRecorder.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+// Flattens a recording of simulator --record into one CSV row per robot
+// and frame: tick, time and all columns.
+//     trajectory_csv --in=recording [--out=file.csv] [--robot=id]
+//                    [--from=tick] [--to=tick] [--every=1]
+
+int main(int argc, char** argv) {
+	CommandLineArguments cla(argc, argv);
+	std::string in    = cla.get<std::string>("--in=",  "");
+	std::string out   = cla.get<std::string>("--out=", "");
+	long long   robot = cla.get<long long>("--robot=", -1);
+	uint64_t    from  = cla.get<uint64_t>("--from=", 0);
+	uint64_t    to    = cla.get<uint64_t>("--to=",   UINT64_MAX);
+	std::size_t every = std::max<std::size_t>(cla.get<std::size_t>("--every=", 1), 1);
+	if(in.empty()) {
+		std::cerr << "usage: trajectory_csv --in=recording [--out=file.csv] [--robot=id] [--from=tick] [--to=tick] [--every=1]\n";
+		return 1;
+	}
+	try {
+		robo::TrajectoryReader reader(in);
+		std::FILE* f = out.empty() ? stdout : std::fopen(out.c_str(), "w");
+		if(!f) {
+			std::cerr << out << ": cannot open\n";
+			return 1;
+		}
+		std::fputs("tick,time", f);
+		for(std::size_t c = 0; c < reader.num_columns(); ++c) {
+			std::fprintf(f, ",%s", robo::recording::column_name(c).c_str());
+		}
+		std::fputc('\n', f);
+		std::size_t rows = 0;
+		for(std::size_t i = reader.lower_bound(from); i < reader.size(); i += every) {
+			auto frame = reader[i];
+			if(frame.tick() > to) {
+				break;
+			}
+			for(std::size_t r = 0; r < frame.size(); ++r) {
+				if(robot >= 0 && frame.id(r).value != static_cast<uint32_t>(robot)) {
+					continue;
+				}
+				std::fprintf(f, "%llu,%.9g", static_cast<unsigned long long>(frame.tick()), frame.time());
+				for(std::size_t c = 0; c < reader.num_columns(); ++c) {
+					if(robo::recording::is_integer(c)) {
+						std::fprintf(f, ",%d", static_cast<int>(frame.value(c, r)));
+					} else {
+						std::fprintf(f, ",%.9g", frame.value(c, r));
+					}
+				}
+				std::fputc('\n', f);
+				++rows;
+			}
+		}
+		if(f != stdout) {
+			std::fclose(f);
+		}
+		std::cerr << reader.size() << " frames, " << rows << " rows\n";
+	} catch(std::exception const& e) {
+		std::cerr << in << ": " << e.what() << '\n';
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,108 @@
+#include "RobotProxy.hpp"
+#include "config/Simulator.hpp"
+#include "util/CommandLineArguments.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Round trip latency and commands/s of the different transports.
+// Start the simulator with all of them, e.g.
+//     simulator --no_gui --listen=tcp://:31114 --unix --shm
+// and run
+//     transport_bench [--calls=N] [--url=localhost --url=unix://@robo_sim ...]
+
+using namespace robo;
+
+struct Result {
+	std::string         url;
+	std::string         command;
+	std::vector<double> latencies; // seconds
+	double              duration;  // seconds
+	double              syscalls;  // client side, per command
+
+	double percentile(double p) const {
+		std::vector<double> l = latencies;
+		std::size_t n = std::min(l.size() - 1, static_cast<std::size_t>(p * l.size()));
+		std::nth_element(l.begin(), l.begin() + n, l.end());
+		return l[n];
+	}
+
+	friend std::ostream& operator<<(std::ostream& os, Result const& r) {
+		return os
+			<< std::left  << std::setw(24) << r.url
+			<< std::setw(20) << r.command
+			<< std::right << std::fixed << std::setprecision(1)
+			<< std::setw(10) << r.percentile(0.50) * 1e6 << " us"
+			<< std::setw(10) << r.percentile(0.99) * 1e6 << " us"
+			<< std::setw(12) << std::setprecision(0) << r.latencies.size() / r.duration << " cmd/s"
+			<< std::setw(10) << std::setprecision(2) << r.syscalls
+		;
+	}
+};
+
+template<typename F>
+Result measure(RobotProxy const& robo, std::string const& url, std::string const& command, int calls, F&& f) {
+	using clock_t = std::chrono::steady_clock;
+	Result result{url, command, {}, 0.0, 0.0};
+	result.latencies.reserve(calls);
+	// warm up caches, page in buffers
+	for(int i = 0; i < std::min(calls, 100); ++i) {
+		f();
+	}
+	uint64_t syscalls_start = robo.client.stats().syscalls();
+	auto start = clock_t::now();
+	for(int i = 0; i < calls; ++i) {
+		auto call_start = clock_t::now();
+		f();
+		result.latencies.push_back(std::chrono::duration<double>(clock_t::now() - call_start).count());
+	}
+	result.duration = std::chrono::duration<double>(clock_t::now() - start).count();
+	result.syscalls = static_cast<double>(robo.client.stats().syscalls() - syscalls_start) / calls;
+	return result;
+}
+
+int main(int argc, char** argv) {
+	CommandLineArguments cla(argc, argv);
+	int calls = cla.get<int>("--calls=", 10000);
+	std::vector<std::string> urls = cla.get_all<std::string>("--url=");
+	if(urls.empty()) {
+		urls = {
+			  "localhost"
+			, std::string("unix://") + config::Simulator::default_unix_path
+			, std::string("shm://")  + config::Simulator::default_shm_name
+		};
+	}
+
+	std::vector<Result> results;
+	for(std::string const& url : urls) {
+		RobotProxy robo{url, config::Simulator::default_port, "transport_bench"};
+		results.push_back(measure(robo, url, "LocalVelocity", calls, [&]() {
+			robo.set_local_velocity({0.0, 0.0}, 0.0);
+		}));
+		// blocks until the next vision tick, so this one measures pacing, not transport
+		results.push_back(measure(robo, url, "QueryVision", std::max(1, calls / 100), [&]() {
+			robo.vision();
+		}));
+		results.push_back(measure(robo, url, "SegmentTraversable", calls, [&]() {
+			robo.is_traversable({0.0, 0.0}, {1.0, 1.0});
+		}));
+	}
+
+	std::cout
+		<< std::left  << std::setw(24) << "url"
+		<< std::setw(20) << "command"
+		<< std::right
+		<< std::setw(13) << "p50"
+		<< std::setw(13) << "p99"
+		<< std::setw(18) << "throughput"
+		<< std::setw(10) << "syscalls"
+		<< '\n'
+	;
+	for(auto const& r : results) {
+		std::cout << r << '\n';
+	}
+	return 0;
+}
@@ -104,6 +104,7 @@ auto velocity_by_distance(double thresh, double acceleration_max, double distanc
 
 bool always_fixed = false;
 bool never_fixed = false;
+bool use_trajectory = false;
 
 auto position_control(
 	  Vertex<double, 2> const& reference_position
@@ -200,6 +201,10 @@ int main(int argc, char** argv) {
 			never_fixed = true;
 			name = "never_fixed";
 		}
+		if(std::string_view{"--trajectory"} == std::string_view{argv[1]}) {
+			use_trajectory = true;
+			name = "trajectory";
+		}
 	}
 	RobotProxy robo{"localhost", config::Simulator::default_port, name};
 	std::vector<DebugLine> debug_sink;
@@ -221,6 +226,30 @@ int main(int argc, char** argv) {
 	}
 	std::size_t i_wp = 0;
 
+	if(use_trajectory) {
+		// the simulator tracks the whole lap, one command per lap
+		std::vector<TrajectoryWaypoint> lap;
+		for(std::size_t i = 0; i <= std::size(wps); ++i) {
+			Vertex<double,2> const& p    = wps[i % std::size(wps)];
+			Vertex<double,2> const& next = wps[(i + 1) % std::size(wps)];
+			lap.push_back({p, orientation(next - p)});
+		}
+		auto const& limits = robo.descriptor().kinematics;
+		uint32_t    id     = robo.follow_trajectory(lap, limits.velocity_max_x, limits.angular_velocity_max);
+		for(std::size_t i = 0; i < std::size(wps); ++i) {
+			debug_sink.push_back(
+				DebugLine::make(wps[i], wps[(i + 1) % std::size(wps)], {0.4, 0.4, 0.4}, 0.01, 0.01)
+			);
+		}
+		robo.set_debug_lines(debug_sink);
+		while(true) {
+			Vision v = robo.vision();
+			if(v.trajectory && v.trajectory->trajectory_id == id && v.trajectory->done) {
+				id = robo.follow_trajectory(lap, limits.velocity_max_x, limits.angular_velocity_max);
+			}
+		}
+	}
+
 	while(true) {
 		struct DBG_Lock{
 			RobotProxy&             robo;